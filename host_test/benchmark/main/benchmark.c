@@ -0,0 +1,220 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_trace.h"
+#include "espfsp_latency_hist.h"
+#include "loopback_rig.h"
+
+// Whole pipeline over loopback: CLIENT_PUSH fragments and sends frames, server reassembles and relays them,
+// CLIENT_PLAY reassembles them and benchmark takes them as application would. Stage latencies come from
+// trace ring, allocations from espfsp_mem counters of whole process. Every result is one JSON line on stdout.
+
+#define BENCH_FPS 60
+#define BENCH_BUFFERED_FBS 2
+#define BENCH_BASE_PORT 47000
+#define BENCH_WARMUP_MS 1000
+#define BENCH_WINDOW_MS 5000
+#define BENCH_GET_FB_TIMEOUT_MS 100
+#define BENCH_STOP_SETTLE_MS 200
+#define BENCH_CONTROL_REQUESTS 50
+#define BENCH_CONTROL_TIMEOUT_MS 1000
+#define BENCH_CONTROL_RETRY_MS 50
+
+static const uint32_t FRAME_LENS[] = {8 * 1024, 32 * 1024, 96 * 1024};
+static const espfsp_transport_t TRANSPORTS[] = {ESPFSP_TRANSPORT_UDP, ESPFSP_TRANSPORT_TCP};
+
+typedef struct
+{
+    const loopback_rig_config_t *config;
+    loopback_rig_t rig;
+} bench_run_t;
+
+static const char *TAG = "BENCHMARK";
+
+static const char *get_transport_name(espfsp_transport_t transport)
+{
+    return transport == ESPFSP_TRANSPORT_TCP ? "tcp" : "udp";
+}
+
+static void print_header(const bench_run_t *run, const char *benchmark)
+{
+    printf("{\"benchmark\":\"%s\",\"transport\":\"%s\",\"frame_len\":%lu,\"fps\":%u,\"buffered_fbs\":%u",
+           benchmark,
+           get_transport_name(run->config->transport),
+           (unsigned long) run->config->frame_len,
+           run->config->fps,
+           run->config->buffered_fbs);
+}
+
+static void print_latency(const bench_run_t *run, const char *benchmark, const espfsp_latency_stats_t *stats)
+{
+    print_header(run, benchmark);
+    printf(",\"count\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu}\n",
+           (unsigned long) stats->count,
+           (unsigned long) stats->p50_us,
+           (unsigned long) stats->p99_us,
+           (unsigned long) stats->max_us);
+}
+
+static void print_stage_latency(
+    const bench_run_t *run, const char *benchmark, espfsp_trace_stage_t from, espfsp_trace_stage_t to)
+{
+    espfsp_latency_stats_t stats;
+
+    if (espfsp_trace_get_stage_latency(from, to, &stats) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Trace is not compiled in, enable CONFIG_ESPFSP_TRACE");
+        return;
+    }
+
+    print_latency(run, benchmark, &stats);
+}
+
+static void consume_frames(espfsp_client_play_handler_t play, uint32_t duration_ms)
+{
+    int64_t end_us = esp_timer_get_time() + (int64_t) duration_ms * 1000;
+
+    while (esp_timer_get_time() < end_us)
+    {
+        espfsp_fb_t *fb = espfsp_client_play_get_fb(play, BENCH_GET_FB_TIMEOUT_MS);
+        if (fb != NULL)
+        {
+            espfsp_client_play_return_fb(play, fb);
+        }
+    }
+}
+
+// Frames completed by CLIENT_PLAY, with every allocation made meanwhile in server and both clients
+static void bench_throughput(bench_run_t *run)
+{
+    espfsp_client_stats_t before;
+    espfsp_client_stats_t after;
+
+    espfsp_client_play_get_stats(run->rig.play, &before);
+    int64_t start_us = esp_timer_get_time();
+
+    consume_frames(run->rig.play, BENCH_WINDOW_MS);
+
+    espfsp_client_play_get_stats(run->rig.play, &after);
+    double window_s = (esp_timer_get_time() - start_us) / 1e6;
+
+    uint32_t frames = after.stream.frames_completed - before.stream.frames_completed;
+    uint32_t bytes = after.stream.bytes_in - before.stream.bytes_in;
+    uint32_t allocations = after.memory.total.allocations - before.memory.total.allocations;
+
+    print_header(run, "throughput");
+    printf(",\"frames\":%lu,\"frames_per_s\":%.1f,\"bytes_per_s\":%.0f,\"allocations_per_frame\":%.2f}\n",
+           (unsigned long) frames,
+           frames / window_s,
+           bytes / window_s,
+           frames > 0 ? (double) allocations / frames : 0.0);
+}
+
+// Request answered by server over control connection, while stream runs
+static void bench_control_rtt(bench_run_t *run)
+{
+    espfsp_latency_hist_t hist;
+    espfsp_latency_stats_t stats;
+    espfsp_clock_sync_info_t clock_sync;
+    uint32_t failed = 0;
+
+    espfsp_latency_hist_reset(&hist);
+
+    for (int i = 0; i < BENCH_CONTROL_REQUESTS; i++)
+    {
+        espfsp_frame_config_t frame_config = {0};
+        int64_t start_us = esp_timer_get_time();
+        esp_err_t ret = espfsp_client_play_get_frame(run->rig.play, &frame_config, BENCH_CONTROL_TIMEOUT_MS);
+        int64_t rtt_us = esp_timer_get_time() - start_us;
+
+        // Request is not sent when action queue of control connection is full, not all params come on timeout
+        if (ret != ESP_OK || frame_config.frame_max_len != run->config->frame_len)
+        {
+            failed++;
+            vTaskDelay(pdMS_TO_TICKS(BENCH_CONTROL_RETRY_MS));
+            continue;
+        }
+
+        espfsp_latency_hist_add(&hist, rtt_us);
+    }
+
+    espfsp_latency_hist_get_stats(&hist, &stats);
+    espfsp_client_play_get_clock_sync(run->rig.play, &clock_sync);
+
+    print_header(run, "control_rtt");
+    printf(",\"count\":%lu,\"failed\":%lu,\"p50_us\":%lu,\"p99_us\":%lu,\"max_us\":%lu,\"ping_rtt_us\":%lld}\n",
+           (unsigned long) stats.count,
+           (unsigned long) failed,
+           (unsigned long) stats.p50_us,
+           (unsigned long) stats.p99_us,
+           (unsigned long) stats.max_us,
+           clock_sync.valid ? (long long) clock_sync.rtt_us : -1LL);
+}
+
+static void run_benchmarks(bench_run_t *run)
+{
+    if (loopback_rig_start(&run->rig, run->config) != ESP_OK)
+    {
+        print_header(run, "error");
+        printf("}\n");
+        return;
+    }
+
+    consume_frames(run->rig.play, BENCH_WARMUP_MS);
+    espfsp_trace_clear();
+
+    bench_throughput(run);
+    bench_control_rtt(run);
+
+    // Trace is read once no frame is on the way. Fragments are sent by CLIENT_PUSH and by server, both
+    // spread over frame interval.
+    espfsp_client_play_stop_stream(run->rig.play);
+    vTaskDelay(pdMS_TO_TICKS(BENCH_STOP_SETTLE_MS));
+
+    print_stage_latency(run, "fragment_send", ESPFSP_TRACE_STAGE_SEND_START, ESPFSP_TRACE_STAGE_SEND_END);
+    print_stage_latency(run, "reassembly", ESPFSP_TRACE_STAGE_SEND_START, ESPFSP_TRACE_STAGE_SERVER_REASSEMBLED);
+    print_stage_latency(run, "relay", ESPFSP_TRACE_STAGE_SERVER_REASSEMBLED, ESPFSP_TRACE_STAGE_PLAY_REASSEMBLED);
+
+    loopback_rig_stop(&run->rig);
+}
+
+void app_main(void)
+{
+    uint32_t run_id = 0;
+
+    for (int t = 0; t < sizeof(TRANSPORTS) / sizeof(TRANSPORTS[0]); t++)
+    {
+        for (int f = 0; f < sizeof(FRAME_LENS) / sizeof(FRAME_LENS[0]); f++)
+        {
+            // Every run takes own ports, so sockets of previous one do not linger on them
+            loopback_rig_config_t config = {
+                .frame_len = FRAME_LENS[f],
+                .fps = BENCH_FPS,
+                .buffered_fbs = BENCH_BUFFERED_FBS,
+                .transport = TRANSPORTS[t],
+                .base_port = BENCH_BASE_PORT + run_id * LOOPBACK_RIG_PORTS,
+            };
+            bench_run_t run = {
+                .config = &config,
+            };
+
+            run_id++;
+
+            run_benchmarks(&run);
+            fflush(stdout);
+        }
+    }
+
+    exit(0);
+}
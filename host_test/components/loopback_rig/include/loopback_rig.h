@@ -0,0 +1,47 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "espfsp_server.h"
+#include "espfsp_client_push.h"
+#include "espfsp_client_play.h"
+
+// Server, CLIENT_PUSH and CLIENT_PLAY of one process, connected over loopback. CLIENT_PUSH takes frames
+// from synthetic camera, which stamps every frame with its generation time. Only one rig runs at a time.
+
+// Ports taken from base_port on
+#define LOOPBACK_RIG_PORTS 8
+
+typedef struct
+{
+    uint32_t frame_len;             // Bytes of every generated frame, also frame_max_len of all ends
+    uint16_t fps;
+    uint16_t buffered_fbs;          // Of server and CLIENT_PLAY
+    espfsp_transport_t transport;
+    int base_port;
+} loopback_rig_config_t;
+
+typedef struct
+{
+    espfsp_server_handler_t server;
+    espfsp_client_push_handler_t push;
+    espfsp_client_play_handler_t play;
+} loopback_rig_t;
+
+// Returns once CLIENT_PLAY started stream of CLIENT_PUSH. Frames are taken with espfsp_client_play_get_fb().
+esp_err_t loopback_rig_start(loopback_rig_t *rig, const loopback_rig_config_t *config);
+
+void loopback_rig_stop(loopback_rig_t *rig);
+
+// Generation time of frame, the same clock as esp_timer_get_time() in whole process
+int64_t loopback_rig_frame_time_us(const espfsp_fb_t *fb);
+
+// Since start of rig
+uint32_t loopback_rig_frames_generated(void);
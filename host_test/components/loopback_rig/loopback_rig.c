@@ -0,0 +1,293 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "loopback_rig.h"
+
+#define RIG_TASK_STACK_SIZE 8192
+#define RIG_TASK_PRIO 5
+#define RIG_START_TIMEOUT_MS 5000
+#define RIG_REQUEST_TIMEOUT_MS 200
+#define RIG_FRAME_WIDTH 640
+#define RIG_FRAME_HEIGHT 480
+
+static const char *TAG = "LOOPBACK_RIG";
+
+// Camera callbacks have no context, so synthetic camera is single
+typedef struct
+{
+    uint32_t frame_len;
+    _Atomic int64_t frame_interval_us;      // 0 while camera is stopped
+    _Atomic int64_t next_frame_us;
+    _Atomic uint32_t frames_generated;
+} synthetic_cam_t;
+
+static synthetic_cam_t cam_;
+
+static esp_err_t start_cam(const espfsp_cam_config_t *cam_config, const espfsp_frame_config_t *frame_config)
+{
+    int64_t interval_us = frame_config->fps > 0 ? 1000000 / frame_config->fps : 0;
+
+    atomic_store(&cam_.next_frame_us, esp_timer_get_time());
+    atomic_store(&cam_.frame_interval_us, interval_us);
+    return ESP_OK;
+}
+
+static esp_err_t stop_cam()
+{
+    atomic_store(&cam_.frame_interval_us, 0);
+    return ESP_OK;
+}
+
+static esp_err_t reconf_cam(const espfsp_cam_config_t *cam_config)
+{
+    return ESP_OK;
+}
+
+// Called by data task of CLIENT_PUSH over and over, frame is given once its time has come
+static esp_err_t send_frame(espfsp_fb_t *fb, espfsp_send_frame_cb_state_t *state, uint32_t max_allowed_size)
+{
+    int64_t interval_us = atomic_load(&cam_.frame_interval_us);
+    int64_t next_frame_us = atomic_load(&cam_.next_frame_us);
+    int64_t now_us = esp_timer_get_time();
+
+    *state = ESPFSP_SEND_FRAME_CB_FRAME_NOT_OBTAINED;
+
+    if (interval_us == 0 || now_us < next_frame_us)
+    {
+        return ESP_OK;
+    }
+
+    if (cam_.frame_len > max_allowed_size)
+    {
+        ESP_LOGE(TAG, "Frame of %lu bytes over allowed %lu", (unsigned long) cam_.frame_len, (unsigned long) max_allowed_size);
+        return ESP_FAIL;
+    }
+
+    // Frames that sender was too slow for are skipped, as camera would overwrite them
+    next_frame_us += interval_us;
+    atomic_store(&cam_.next_frame_us, next_frame_us > now_us ? next_frame_us : now_us + interval_us);
+
+    uint32_t seq = atomic_fetch_add(&cam_.frames_generated, 1);
+
+    // Whole frame is written, as by camera driver
+    memset(fb->buf, (uint8_t) seq, cam_.frame_len);
+    memcpy(fb->buf, &seq, sizeof(seq) < cam_.frame_len ? sizeof(seq) : cam_.frame_len);
+
+    fb->len = cam_.frame_len;
+    fb->width = RIG_FRAME_WIDTH;
+    fb->height = RIG_FRAME_HEIGHT;
+    fb->format = ESPFSP_PIXFORMAT_JPEG;
+    fb->timestamp.tv_sec = now_us / 1000000;
+    fb->timestamp.tv_usec = now_us % 1000000;
+
+    *state = ESPFSP_SEND_FRAME_CB_FRAME_OBTAINED;
+    return ESP_OK;
+}
+
+static void fill_task_info(espfsp_task_info_t *task_info)
+{
+    task_info->stack_size = RIG_TASK_STACK_SIZE;
+    task_info->task_prio = RIG_TASK_PRIO;
+}
+
+static void fill_frame_config(espfsp_frame_config_t *frame_config, const loopback_rig_config_t *config)
+{
+    frame_config->frame_max_len = config->frame_len;
+    frame_config->buffered_fbs = config->buffered_fbs;
+    frame_config->fb_in_buffer_before_get = 0;
+    frame_config->fps = config->fps;
+}
+
+static espfsp_server_handler_t init_server(const loopback_rig_config_t *config)
+{
+    espfsp_server_config_t server_config = {0};
+
+    fill_task_info(&server_config.client_push_data_task_info);
+    fill_task_info(&server_config.client_play_data_task_info);
+    fill_task_info(&server_config.client_push_session_and_control_task_info);
+    fill_task_info(&server_config.client_play_session_and_control_task_info);
+
+    server_config.client_push_local.control_port = config->base_port;
+    server_config.client_push_local.data_port = config->base_port + 1;
+    server_config.client_play_local.control_port = config->base_port + 2;
+    server_config.client_play_local.data_port = config->base_port + 3;
+    server_config.client_push_data_transport = config->transport;
+    server_config.client_play_data_transport = config->transport;
+    server_config.client_push_max_connections = 1;
+    server_config.client_play_max_connections = 1;
+
+    fill_frame_config(&server_config.frame_config, config);
+    server_config.cam_config.cam_pixel_format = ESPFSP_PIXFORMAT_JPEG;
+    server_config.cam_config.cam_frame_size = ESPFSP_FRAMESIZE_VGA;
+
+    return espfsp_server_init(&server_config);
+}
+
+static espfsp_client_push_handler_t init_push(const loopback_rig_config_t *config)
+{
+    espfsp_client_push_config_t push_config = {0};
+
+    fill_task_info(&push_config.data_task_info);
+    fill_task_info(&push_config.session_and_control_task_info);
+    fill_task_info(&push_config.capture_task_info);
+
+    push_config.local.control_port = config->base_port + 4;
+    push_config.local.data_port = config->base_port + 5;
+    push_config.remote.control_port = config->base_port;
+    push_config.remote.data_port = config->base_port + 1;
+    push_config.data_transport = config->transport;
+    push_config.remote_addr.addr = htonl(INADDR_LOOPBACK);
+
+    push_config.cb.start_cam = start_cam;
+    push_config.cb.stop_cam = stop_cam;
+    push_config.cb.send_frame = send_frame;
+    push_config.cb.reconf_cam = reconf_cam;
+
+    fill_frame_config(&push_config.frame_config, config);
+    push_config.cam_config.cam_pixel_format = ESPFSP_PIXFORMAT_JPEG;
+    push_config.cam_config.cam_frame_size = ESPFSP_FRAMESIZE_VGA;
+
+    return espfsp_client_push_init(&push_config);
+}
+
+static espfsp_client_play_handler_t init_play(const loopback_rig_config_t *config)
+{
+    espfsp_client_play_config_t play_config = {0};
+
+    fill_task_info(&play_config.data_task_info);
+    fill_task_info(&play_config.session_and_control_task_info);
+
+    play_config.local.control_port = config->base_port + 6;
+    play_config.local.data_port = config->base_port + 7;
+    play_config.remote.control_port = config->base_port + 2;
+    play_config.remote.data_port = config->base_port + 3;
+    play_config.data_transport = config->transport;
+    play_config.remote_addr.addr = htonl(INADDR_LOOPBACK);
+
+    fill_frame_config(&play_config.frame_config, config);
+
+    return espfsp_client_play_init(&play_config);
+}
+
+// Sessions connect in background, so source shows up after a while
+static esp_err_t select_source(espfsp_client_play_handler_t play)
+{
+    char sources[SOURCE_NAMES_MAX][SOURCE_NAME_LEN_MAX];
+    int sources_len = 0;
+    espfsp_client_stats_t stats;
+
+    for (int waited_ms = 0; waited_ms < RIG_START_TIMEOUT_MS; waited_ms += RIG_REQUEST_TIMEOUT_MS)
+    {
+        // Requests are refused until session of CLIENT_PLAY is active
+        if (espfsp_client_play_get_stats(play, &stats) == ESP_OK && stats.session_active)
+        {
+            sources_len = SOURCE_NAMES_MAX;
+            if (espfsp_client_play_get_sources_timeout(play, sources, &sources_len, RIG_REQUEST_TIMEOUT_MS) == ESP_OK &&
+                sources_len > 0)
+            {
+                return espfsp_client_play_set_source(play, sources[0]);
+            }
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(RIG_REQUEST_TIMEOUT_MS));
+    }
+
+    ESP_LOGE(TAG, "CLIENT_PUSH not connected in %d ms", RIG_START_TIMEOUT_MS);
+    return ESP_ERR_TIMEOUT;
+}
+
+esp_err_t loopback_rig_start(loopback_rig_t *rig, const loopback_rig_config_t *config)
+{
+    esp_err_t ret = ESP_OK;
+
+    // Sockets are host ones, write to connection closed by peer must not end process
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(rig, 0, sizeof(loopback_rig_t));
+    cam_.frame_len = config->frame_len;
+    atomic_store(&cam_.frame_interval_us, 0);
+    atomic_store(&cam_.frames_generated, 0);
+
+    rig->server = init_server(config);
+    if (rig->server == NULL)
+    {
+        ESP_LOGE(TAG, "Server init failed");
+        ret = ESP_FAIL;
+    }
+    if (ret == ESP_OK)
+    {
+        rig->push = init_push(config);
+        if (rig->push == NULL)
+        {
+            ESP_LOGE(TAG, "CLIENT_PUSH init failed");
+            ret = ESP_FAIL;
+        }
+    }
+    if (ret == ESP_OK)
+    {
+        rig->play = init_play(config);
+        if (rig->play == NULL)
+        {
+            ESP_LOGE(TAG, "CLIENT_PLAY init failed");
+            ret = ESP_FAIL;
+        }
+    }
+    if (ret == ESP_OK)
+    {
+        ret = select_source(rig->play);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_client_play_start_stream(rig->play);
+    }
+
+    if (ret != ESP_OK)
+    {
+        loopback_rig_stop(rig);
+    }
+
+    return ret;
+}
+
+void loopback_rig_stop(loopback_rig_t *rig)
+{
+    if (rig->play != NULL)
+    {
+        espfsp_client_play_stop_stream(rig->play);
+        espfsp_client_play_deinit(rig->play);
+        rig->play = NULL;
+    }
+    if (rig->push != NULL)
+    {
+        espfsp_client_push_deinit(rig->push);
+        rig->push = NULL;
+    }
+    if (rig->server != NULL)
+    {
+        espfsp_server_deinit(rig->server);
+        rig->server = NULL;
+    }
+}
+
+int64_t loopback_rig_frame_time_us(const espfsp_fb_t *fb)
+{
+    return (int64_t) fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+uint32_t loopback_rig_frames_generated(void)
+{
+    return atomic_load(&cam_.frames_generated);
+}
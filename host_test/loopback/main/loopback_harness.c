@@ -0,0 +1,155 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_timer.h"
+
+#include "espfsp_latency_hist.h"
+#include "loopback_rig.h"
+
+// Streams synthetic frames from CLIENT_PUSH through server to CLIENT_PLAY of one process, for every
+// combination of frame size, frame rate and buffered frames. Latency is from generation of frame to
+// espfsp_client_play_get_fb() returning it, on one clock. Configuration is sustained when CLIENT_PUSH keeps
+// up with camera rate and application gets almost every generated frame. Every result is one JSON line on stdout.
+
+#define HARNESS_BASE_PORT 48000
+#define HARNESS_WARMUP_MS 500
+#define HARNESS_WINDOW_MS 3000
+#define HARNESS_GET_FB_TIMEOUT_MS 100
+#define HARNESS_DELIVERED_PERMILLE 950     // Of generated frames
+#define HARNESS_GENERATED_PERMILLE 900     // Of camera rate, sender paces frames by whole milliseconds of 1024 us
+
+static const uint32_t FRAME_LENS[] = {16 * 1024, 64 * 1024, 160 * 1024};
+static const uint16_t FPS[] = {15, 30, 60, 120};
+static const uint16_t BUFFERED_FBS[] = {1, 2, 4};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef struct
+{
+    espfsp_latency_stats_t latency;
+    double generated_fps;
+    double delivered_fps;
+    bool sustained;
+    bool started;
+} harness_result_t;
+
+static void take_frames(espfsp_client_play_handler_t play, uint32_t duration_ms, espfsp_latency_hist_t *hist)
+{
+    int64_t end_us = esp_timer_get_time() + (int64_t) duration_ms * 1000;
+
+    while (esp_timer_get_time() < end_us)
+    {
+        espfsp_fb_t *fb = espfsp_client_play_get_fb(play, HARNESS_GET_FB_TIMEOUT_MS);
+        if (fb == NULL)
+        {
+            continue;
+        }
+
+        if (hist != NULL)
+        {
+            espfsp_latency_hist_add(hist, esp_timer_get_time() - loopback_rig_frame_time_us(fb));
+        }
+
+        espfsp_client_play_return_fb(play, fb);
+    }
+}
+
+static void run_config(const loopback_rig_config_t *config, harness_result_t *result)
+{
+    loopback_rig_t rig;
+    espfsp_latency_hist_t hist;
+
+    result->started = loopback_rig_start(&rig, config) == ESP_OK;
+    if (!result->started)
+    {
+        return;
+    }
+
+    take_frames(rig.play, HARNESS_WARMUP_MS, NULL);
+
+    espfsp_latency_hist_reset(&hist);
+    uint32_t generated = loopback_rig_frames_generated();
+    take_frames(rig.play, HARNESS_WINDOW_MS, &hist);
+    generated = loopback_rig_frames_generated() - generated;
+    espfsp_latency_hist_get_stats(&hist, &result->latency);
+
+    loopback_rig_stop(&rig);
+
+    result->generated_fps = generated * 1e6 / result->latency.window_us;
+    result->delivered_fps = result->latency.count * 1e6 / result->latency.window_us;
+    result->sustained = result->generated_fps * 1000 >= (double) config->fps * HARNESS_GENERATED_PERMILLE &&
+                        result->delivered_fps * 1000 >= result->generated_fps * HARNESS_DELIVERED_PERMILLE;
+}
+
+static void print_result(const loopback_rig_config_t *config, const harness_result_t *result)
+{
+    printf("{\"result\":\"config\",\"frame_len\":%lu,\"fps\":%u,\"buffered_fbs\":%u",
+           (unsigned long) config->frame_len, config->fps, config->buffered_fbs);
+
+    if (!result->started)
+    {
+        printf(",\"error\":\"start failed\"}\n");
+        return;
+    }
+
+    printf(",\"generated_fps\":%.1f,\"delivered_fps\":%.1f,\"sustained\":%s,\"count\":%lu,\"min_us\":%lu,\"p50_us\":%lu,\"p90_us\":%lu,"
+           "\"p99_us\":%lu,\"max_us\":%lu}\n",
+           result->generated_fps,
+           result->delivered_fps,
+           result->sustained ? "true" : "false",
+           (unsigned long) result->latency.count,
+           (unsigned long) result->latency.min_us,
+           (unsigned long) result->latency.p50_us,
+           (unsigned long) result->latency.p90_us,
+           (unsigned long) result->latency.p99_us,
+           (unsigned long) result->latency.max_us);
+}
+
+void app_main(void)
+{
+    uint32_t run_id = 0;
+
+    for (int f = 0; f < COUNT_OF(FRAME_LENS); f++)
+    {
+        for (int b = 0; b < COUNT_OF(BUFFERED_FBS); b++)
+        {
+            uint16_t max_sustained_fps = 0;
+
+            for (int r = 0; r < COUNT_OF(FPS); r++)
+            {
+                // Every run takes own ports, so sockets of previous one do not linger on them
+                loopback_rig_config_t config = {
+                    .frame_len = FRAME_LENS[f],
+                    .fps = FPS[r],
+                    .buffered_fbs = BUFFERED_FBS[b],
+                    .transport = ESPFSP_TRANSPORT_UDP,
+                    .base_port = HARNESS_BASE_PORT + run_id * LOOPBACK_RIG_PORTS,
+                };
+                harness_result_t result = {0};
+
+                run_id++;
+                run_config(&config, &result);
+                print_result(&config, &result);
+                fflush(stdout);
+
+                if (result.sustained)
+                {
+                    max_sustained_fps = FPS[r];
+                }
+            }
+
+            // Highest rate of sweep application kept up with, 0 when none
+            printf("{\"result\":\"max_sustainable_fps\",\"frame_len\":%lu,\"buffered_fbs\":%u,\"fps\":%u}\n",
+                   (unsigned long) FRAME_LENS[f], BUFFERED_FBS[b], max_sustained_fps);
+            fflush(stdout);
+        }
+    }
+
+    exit(0);
+}
@@ -0,0 +1,379 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "unity.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "espfsp_message_buffer.h"
+#include "espfsp_message_defs.h"
+
+// Producer and consumer run as separate tasks and hand over frames through receiver buffer as fast as they can.
+// Every frame carries its sequence number in width and pattern derived from it in every byte, so frame assembled
+// from parts of two frames, or overwritten while held by consumer, is seen as torn.
+
+#define FRAME_MAX_LEN (6 * MESSAGE_BUFFER_SIZE)
+#define FRAMES_COUNT 20000
+#define TASK_STACK_SIZE 8192
+#define TASK_PRIO 5
+#define TASK_DONE_TIMEOUT_MS 120000
+#define RECONFIGURE_INTERVAL_MS 3
+
+typedef struct
+{
+    espfsp_receiver_buffer_t buffer;
+    uint16_t buffered_fbs;
+    bool take_newest;
+    atomic_bool producer_done;
+    SemaphoreHandle_t done;
+
+    // Written by consumer, checked after both tasks are done
+    uint32_t consumed;
+    uint32_t cached_consumed;
+    uint32_t torn;
+    uint32_t out_of_order;
+    uint32_t reconfigured;
+} stress_ctx_t;
+
+static uint32_t next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+static uint32_t get_frame_len(uint32_t seq)
+{
+    return 1 + (seq * 2654435761u) % FRAME_MAX_LEN;
+}
+
+static uint8_t get_pattern_byte(uint32_t seq, uint32_t offset)
+{
+    return (uint8_t) (seq * 131 + offset * 7 + (offset >> 8));
+}
+
+// Zero timestamp is never sent, buffer uses it as "no frame"
+static void get_frame_timestamp(uint32_t seq, struct timeval *timestamp)
+{
+    timestamp->tv_sec = 1 + seq / 1000;
+    timestamp->tv_usec = (seq % 1000) * 1000;
+}
+
+static void produce_frame(stress_ctx_t *ctx, uint32_t seq, espfsp_message_t *message, uint32_t *seed)
+{
+    uint32_t len = get_frame_len(seq);
+    int msg_total = (len + MESSAGE_BUFFER_SIZE - 1) / MESSAGE_BUFFER_SIZE;
+
+    message->len = len;
+    message->width = seq;
+    message->height = 0;
+    message->msg_total = msg_total;
+    get_frame_timestamp(seq, &message->timestamp);
+
+    for (int i = 0; i < msg_total; i++)
+    {
+        uint32_t offset = i * MESSAGE_BUFFER_SIZE;
+        uint32_t msg_len = len - offset < MESSAGE_BUFFER_SIZE ? len - offset : MESSAGE_BUFFER_SIZE;
+
+        for (uint32_t j = 0; j < msg_len; j++)
+        {
+            message->buf[j] = get_pattern_byte(seq, offset + j);
+        }
+
+        message->msg_number = i;
+        message->msg_len = msg_len;
+        espfsp_message_buffer_process_message(message, &ctx->buffer);
+
+        if (next_random(seed) % 4 == 0)
+        {
+            taskYIELD();
+        }
+    }
+}
+
+static void producer_task(void *pvParameters)
+{
+    stress_ctx_t *ctx = (stress_ctx_t *) pvParameters;
+    espfsp_message_t *message = (espfsp_message_t *) malloc(sizeof(espfsp_message_t));
+    uint32_t seed = 1234 + ctx->buffered_fbs;
+
+    for (uint32_t seq = 0; seq < FRAMES_COUNT && message != NULL; seq++)
+    {
+        produce_frame(ctx, seq, message, &seed);
+
+        // Consumer catches up now and then, otherwise it would only see late drops
+        if (next_random(&seed) % 16 == 0)
+        {
+            vTaskDelay(1);
+        }
+    }
+
+    free(message);
+    atomic_store(&ctx->producer_done, true);
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static bool is_frame_torn(const espfsp_fb_t *fb)
+{
+    uint32_t seq = fb->width;
+    struct timeval timestamp;
+
+    get_frame_timestamp(seq, &timestamp);
+    if (fb->len != get_frame_len(seq) ||
+        fb->timestamp.tv_sec != timestamp.tv_sec ||
+        fb->timestamp.tv_usec != timestamp.tv_usec)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < fb->len; i++)
+    {
+        if ((uint8_t) fb->buf[i] != get_pattern_byte(seq, i))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void consumer_task(void *pvParameters)
+{
+    stress_ctx_t *ctx = (stress_ctx_t *) pvParameters;
+    int64_t last_seq = -1;
+    uint32_t seed = 4321 + ctx->buffered_fbs;
+
+    while (!atomic_load(&ctx->producer_done) || espfsp_message_buffer_has_frame(&ctx->buffer))
+    {
+        espfsp_fb_t *fb = ctx->take_newest ?
+            espfsp_message_buffer_get_newest_fb(&ctx->buffer, 10) :
+            espfsp_message_buffer_get_fb(&ctx->buffer, 10);
+        if (fb == NULL)
+        {
+            continue;
+        }
+
+        if (is_frame_torn(fb))
+        {
+            ctx->torn++;
+        }
+        if ((int64_t) fb->width <= last_seq)
+        {
+            ctx->out_of_order++;
+        }
+        last_seq = fb->width;
+        ctx->consumed++;
+
+        // Holding frame for a while lets producer run out of free assemblies
+        if (next_random(&seed) % 8 == 0)
+        {
+            vTaskDelay(1);
+        }
+
+        // Frame is checked again, producer must not have written into it meanwhile
+        if (is_frame_torn(fb))
+        {
+            ctx->torn++;
+        }
+
+        espfsp_message_buffer_return_fb(&ctx->buffer);
+
+        // Returned frame is cached, unless producer took its assembly back meanwhile
+        if (next_random(&seed) % 4 == 0)
+        {
+            fb = espfsp_message_buffer_get_cached_fb(&ctx->buffer);
+            if (fb != NULL)
+            {
+                if (is_frame_torn(fb) || (int64_t) fb->width != last_seq)
+                {
+                    ctx->torn++;
+                }
+                ctx->cached_consumed++;
+                espfsp_message_buffer_return_fb(&ctx->buffer);
+            }
+        }
+    }
+
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+// Buffer is relaid out only when it grows, so frame length grows with every call, like start of new stream
+// with larger frames does. Buffered FBs count alternates, so assemblies above count are left in ring too.
+static void reconfigure_task(void *pvParameters)
+{
+    stress_ctx_t *ctx = (stress_ctx_t *) pvParameters;
+
+    for (uint32_t i = 1; !atomic_load(&ctx->producer_done); i++)
+    {
+        espfsp_receiver_buffer_config_t config = {
+            .frame_max_len = FRAME_MAX_LEN + i * MESSAGE_BUFFER_ARENA_ALIGN,
+            .buffered_fbs = ctx->buffered_fbs + i % 2,
+            .fb_in_buffer_before_get = 0,
+            .fps = 1000,
+        };
+
+        if (espfsp_message_buffer_reconfigure(&ctx->buffer, &config) == ESP_OK)
+        {
+            ctx->reconfigured++;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(RECONFIGURE_INTERVAL_MS));
+    }
+
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static void run_stress(stress_ctx_t *ctx, uint16_t buffered_fbs, bool take_newest, bool reconfigure)
+{
+    espfsp_receiver_buffer_config_t config = {
+        .frame_max_len = FRAME_MAX_LEN,
+        .buffered_fbs = buffered_fbs,
+        .fb_in_buffer_before_get = 0,
+        .fps = 1000,
+    };
+    int tasks = reconfigure ? 3 : 2;
+
+    memset(ctx, 0, sizeof(stress_ctx_t));
+    ctx->buffered_fbs = buffered_fbs;
+    ctx->take_newest = take_newest;
+    atomic_init(&ctx->producer_done, false);
+
+    TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_init(&ctx->buffer, &config));
+
+    ctx->done = xSemaphoreCreateCounting(tasks, 0);
+    TEST_ASSERT_NOT_NULL(ctx->done);
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(consumer_task, "consumer", TASK_STACK_SIZE, ctx, TASK_PRIO, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(producer_task, "producer", TASK_STACK_SIZE, ctx, TASK_PRIO, NULL));
+    if (reconfigure)
+    {
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(reconfigure_task, "reconfigure", TASK_STACK_SIZE, ctx, TASK_PRIO, NULL));
+    }
+
+    for (int i = 0; i < tasks; i++)
+    {
+        TEST_ASSERT_EQUAL(pdTRUE, xSemaphoreTake(ctx->done, pdMS_TO_TICKS(TASK_DONE_TIMEOUT_MS)));
+    }
+
+    vSemaphoreDelete(ctx->done);
+}
+
+static void check_stress(uint16_t buffered_fbs, bool take_newest)
+{
+    static stress_ctx_t ctx;
+    espfsp_receiver_buffer_stats_t stats;
+
+    run_stress(&ctx, buffered_fbs, take_newest, false);
+    espfsp_message_buffer_get_stats(&ctx.buffer, &stats);
+
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.torn);
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.out_of_order);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, ctx.consumed);
+    // Every frame is completed or dropped once, every completed frame is consumed or dropped for newer one,
+    // by producer or by consumer taking the newest frame
+    TEST_ASSERT_EQUAL_UINT32(FRAMES_COUNT, stats.frames_received + stats.frames_lost);
+    TEST_ASSERT_EQUAL_UINT32(stats.frames_received, ctx.consumed + stats.frames_late);
+    TEST_ASSERT_EQUAL_UINT16(0, stats.buffer_depth);
+    // Producer fills frames one by one, so with frame held by consumer it still has cached or completed one to take.
+    // Only frame started while consumer moves assemblies between states may be lost.
+    if (buffered_fbs > 1)
+    {
+        TEST_ASSERT_LESS_THAN_UINT32(FRAMES_COUNT / 1000, stats.frames_lost);
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_deinit(&ctx.buffer));
+}
+
+static void test_single_buffered_fb(void)
+{
+    check_stress(1, false);
+}
+
+static void test_two_buffered_fbs(void)
+{
+    check_stress(2, false);
+}
+
+static void test_five_buffered_fbs(void)
+{
+    check_stress(5, false);
+}
+
+static void test_newest_fb_taken(void)
+{
+    check_stress(5, true);
+}
+
+// Frames in buffer at relayout are discarded, so only content and order are checked
+static void test_reconfigure_while_streaming(void)
+{
+    static stress_ctx_t ctx;
+
+    run_stress(&ctx, 2, false, true);
+
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.torn);
+    TEST_ASSERT_EQUAL_UINT32(0, ctx.out_of_order);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, ctx.consumed);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, ctx.reconfigured);
+
+    TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_deinit(&ctx.buffer));
+}
+
+// Buffers of lower simulcast layers are created without FPS
+static void test_unpaced_buffer(void)
+{
+    static stress_ctx_t ctx;
+    static espfsp_message_t message;
+    uint32_t seed = 1;
+    espfsp_receiver_buffer_config_t config = {
+        .frame_max_len = FRAME_MAX_LEN,
+        .buffered_fbs = 2,
+        .fb_in_buffer_before_get = 0,
+        .fps = 0,
+    };
+
+    memset(&ctx, 0, sizeof(stress_ctx_t));
+    TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_init(&ctx.buffer, &config));
+
+    for (uint32_t seq = 0; seq < 2; seq++)
+    {
+        produce_frame(&ctx, seq, &message, &seed);
+
+        espfsp_fb_t *fb = espfsp_message_buffer_get_fb(&ctx.buffer, 0);
+        TEST_ASSERT_NOT_NULL(fb);
+        TEST_ASSERT_FALSE(is_frame_torn(fb));
+        TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_return_fb(&ctx.buffer));
+    }
+
+    TEST_ASSERT_EQUAL(ESP_OK, espfsp_message_buffer_deinit(&ctx.buffer));
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_single_buffered_fb);
+    RUN_TEST(test_two_buffered_fbs);
+    RUN_TEST(test_five_buffered_fbs);
+    RUN_TEST(test_newest_fb_taken);
+    RUN_TEST(test_reconfigure_while_streaming);
+    RUN_TEST(test_unpaced_buffer);
+    exit(UNITY_END());
+}
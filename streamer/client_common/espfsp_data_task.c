@@ -11,10 +11,14 @@
 
 #include "lwip/sockets.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_sock_op.h"
+#include "espfsp_task_group.h"
 #include "client_common/espfsp_data_task.h"
 #include "data_proto/espfsp_data_proto.h"
 
+#define CLIENT_DATA_RETRY_TIME_MS 200
+
 static const char *TAG = "ESPFSP_CLIENT_DATA_TASK";
 
 static void handle_new_connection(espfsp_client_data_task_data_t *data, int sock)
@@ -27,11 +31,12 @@ static void handle_new_connection(espfsp_client_data_task_data_t *data, int sock
 void espfsp_client_data_task(void *pvParameters)
 {
     espfsp_client_data_task_data_t *data = (espfsp_client_data_task_data_t *) pvParameters;
+    espfsp_task_group_t *task_group = data->task_group;
 
     struct sockaddr_in dest_addr;
     espfsp_set_addr(&dest_addr, &data->remote_addr, data->remote_port);
 
-    while (1)
+    while (!espfsp_task_group_should_stop(task_group))
     {
         esp_err_t ret = ESP_OK;
         int sock = 0;
@@ -40,12 +45,15 @@ void espfsp_client_data_task(void *pvParameters)
         if (ret != ESP_OK)
         {
             ESP_LOGE(TAG, "Create UDP client failed");
+            espfsp_task_group_wait_stop(task_group, CLIENT_DATA_RETRY_TIME_MS);
             continue;
         }
 
         ESP_LOGI(TAG, "Start process connection");
 
+        espfsp_task_group_set_sock(task_group, sock);
         handle_new_connection(data, sock);
+        espfsp_task_group_set_sock(task_group, -1);
 
         ESP_LOGI(TAG, "Shut down socket and restart...");
 
@@ -57,6 +65,6 @@ void espfsp_client_data_task(void *pvParameters)
         }
     }
 
-    free(data);
-    vTaskDelete(NULL);
+    espfsp_mem_free(data);
+    espfsp_task_group_exit(task_group);
 }
@@ -9,22 +9,60 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+
 #include "lwip/sockets.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_sock_op.h"
+#include "espfsp_task_group.h"
 #include "client_common/espfsp_session_and_control_task.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
+// Reconnect delay doubles with every failed attempt and is reset once session is acked
+#define RECONNECT_MIN_DELAY_MS 20
+#define RECONNECT_MAX_DELAY_MS 5000
+
 static const char *TAG = "ESPFSP_CLIENT_SESSION_AND_CONTROL_TASK";
 
+static void expire_session_if_needed(espfsp_client_session_and_control_task_data_t *data)
+{
+    espfsp_client_session_resume_t *resume = data->resume;
+
+    if (resume->token != 0 && resume->lost_us != 0 &&
+        esp_timer_get_time() - resume->lost_us >= (int64_t) resume->grace_ms * 1000)
+    {
+        ESP_LOGI(TAG, "Session was not resumed in time");
+
+        if (data->session_expired_cb(data->comm_proto, data->session_expired_ctx) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Stop expired session failed");
+        }
+        resume->token = 0;
+    }
+}
+
+static uint32_t next_reconnect_delay(uint32_t delay_ms)
+{
+    delay_ms *= 2;
+    return delay_ms > RECONNECT_MAX_DELAY_MS ? RECONNECT_MAX_DELAY_MS : delay_ms;
+}
+
 static void handle_new_connection(espfsp_client_session_and_control_task_data_t *data, int sock)
 {
     espfsp_comm_proto_t *comm_proto = data->comm_proto;
 
     espfsp_comm_proto_req_session_init_message_t msg = {
         .client_type = data->client_type,
+        .session_id = data->resume->session_id,
+        .resume_token = data->resume->token,
+        .version = ESPFSP_COMM_PROTO_VERSION,
+        .capabilities = ESPFSP_COMM_PROTO_CAPS_SUPPORTED,
+        .simulcast_layers = data->simulcast_layers,
     };
 
+    data->resume->acked = false;
+
     esp_err_t err = espfsp_comm_proto_session_init(comm_proto, &msg);
     if (err == ESP_OK)
     {
@@ -35,26 +73,34 @@ static void handle_new_connection(espfsp_client_session_and_control_task_data_t
 void espfsp_client_session_and_control_task(void *pvParameters)
 {
     espfsp_client_session_and_control_task_data_t *data = (espfsp_client_session_and_control_task_data_t *) pvParameters;
+    espfsp_task_group_t *task_group = data->task_group;
 
     struct sockaddr_in dest_addr;
     espfsp_set_addr(&dest_addr, &data->remote_addr, data->remote_port);
 
-    while (1) // In later phase, synchronization should be added
+    uint32_t reconnect_delay_ms = RECONNECT_MIN_DELAY_MS;
+
+    while (!espfsp_task_group_should_stop(task_group))
     {
         esp_err_t ret = ESP_OK;
         int sock = 0;
 
+        expire_session_if_needed(data);
+
         ret = espfsp_create_tcp_client(&sock, data->local_port, &dest_addr);
         if (ret != ESP_OK)
         {
-            ESP_LOGE(TAG, "Create TCP client failed. Waiting 5 sec before retrying...");
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
+            ESP_LOGE(TAG, "Create TCP client failed. Waiting %lu ms before retrying...", (unsigned long) reconnect_delay_ms);
+            espfsp_task_group_wait_stop(task_group, reconnect_delay_ms);
+            reconnect_delay_ms = next_reconnect_delay(reconnect_delay_ms);
             continue;
         }
 
         ESP_LOGI(TAG, "Start processing messages");
 
+        espfsp_task_group_set_sock(task_group, sock);
         handle_new_connection(data, sock);
+        espfsp_task_group_set_sock(task_group, -1);
 
         ESP_LOGI(TAG, "Shut down socket and restart...");
 
@@ -65,9 +111,16 @@ void espfsp_client_session_and_control_task(void *pvParameters)
             break;
         }
 
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
+        // Session was up, so it was dropped by network. Reconnect fast to resume it in grace window
+        if (data->resume->acked)
+        {
+            reconnect_delay_ms = RECONNECT_MIN_DELAY_MS;
+        }
+
+        espfsp_task_group_wait_stop(task_group, reconnect_delay_ms);
+        reconnect_delay_ms = next_reconnect_delay(reconnect_delay_ms);
     }
 
-    free(data);
-    vTaskDelete(NULL);
+    espfsp_mem_free(data);
+    espfsp_task_group_exit(task_group);
 }
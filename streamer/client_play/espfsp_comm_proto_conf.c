@@ -8,12 +8,15 @@
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "espfsp_clock_sync.h"
 #include "client_play/espfsp_state_def.h"
 #include "client_play/espfsp_comm_proto_handlers.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
 #include "client_play/espfsp_comm_proto_conf.h"
 
+#define COMM_PROTO_BUFFERED_ACTIONS 5
+
 // static const char *TAG = "ESPFSP_CLIENT_PLAY_COMM_PROTO_CONF";
 
 esp_err_t espfsp_client_play_comm_protos_init(espfsp_client_play_instance_t *instance)
@@ -22,22 +25,24 @@ esp_err_t espfsp_client_play_comm_protos_init(espfsp_client_play_instance_t *ins
     espfsp_comm_proto_config_t config;
 
     config.callback_ctx = (void *) instance,
-    config.buffered_actions = 5,
+    config.buffered_actions = COMM_PROTO_BUFFERED_ACTIONS,
 
     memset(config.req_callbacks, 0, sizeof(config.req_callbacks));
     memset(config.resp_callbacks, 0, sizeof(config.resp_callbacks));
 
     config.req_callbacks[ESPFSP_COMM_REQ_SESSION_TERMINATE] = espfsp_client_play_req_session_terminate_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_STOP_STREAM] = espfsp_client_play_req_stop_stream_handler;
+    config.req_callbacks[ESPFSP_COMM_REQ_SCENE_STATE] = espfsp_client_play_req_scene_state_handler;
     config.resp_callbacks[ESPFSP_COMM_RESP_SESSION_ACK] = espfsp_client_play_resp_session_ack_handler;
+    config.resp_callbacks[ESPFSP_COMM_RESP_SESSION_PONG] = espfsp_client_play_resp_session_pong_handler;
     config.resp_callbacks[ESPFSP_COMM_RESP_SOURCES_RESP] = espfsp_client_play_resp_sources_handler;
     config.resp_callbacks[ESPFSP_COMM_RESP_FRAME_PARAMS_RESP] = espfsp_client_play_resp_frame_config_handler;
     config.resp_callbacks[ESPFSP_COMM_RESP_CAM_PARAMS_RESP] = espfsp_client_play_resp_cam_config_handler;
-    config.repetive_callback = NULL;
-    config.repetive_callback_freq_us = 100000000;
-    config.conn_closed_callback = espfsp_client_play_connection_stop;
-    config.conn_reset_callback = espfsp_client_play_connection_stop;
-    config.conn_term_callback = espfsp_client_play_connection_stop;
+    config.repetive_callback = espfsp_client_play_session_repetive;
+    config.repetive_callback_freq_us = ESPFSP_CLOCK_SYNC_PING_INTERVAL_US;
+    config.conn_closed_callback = espfsp_client_play_connection_lost;
+    config.conn_reset_callback = espfsp_client_play_connection_lost;
+    config.conn_term_callback = espfsp_client_play_connection_lost;
 
     ret = espfsp_comm_proto_init(&instance->comm_proto, &config);
     if (ret != ESP_OK)
@@ -52,3 +57,8 @@ esp_err_t espfsp_client_play_comm_protos_deinit(espfsp_client_play_instance_t *i
 {
     return espfsp_comm_proto_deinit(&instance->comm_proto);
 }
+
+void espfsp_client_play_comm_protos_estimate_memory(espfsp_mem_estimate_t *estimate)
+{
+    espfsp_comm_proto_estimate_memory(COMM_PROTO_BUFFERED_ACTIONS, estimate);
+}
@@ -11,6 +11,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
 #include "client_play/espfsp_state_def.h"
@@ -76,11 +78,38 @@ esp_err_t espfsp_client_play_req_stop_stream_handler(
     return ret;
 }
 
+esp_err_t espfsp_client_play_req_scene_state_handler(
+    espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    espfsp_comm_req_scene_state_message_t *msg = (espfsp_comm_req_scene_state_message_t *) msg_content;
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) ctx;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+    // Fewer frames are expected then, not lost ones
+    if (instance->session_data.active && instance->session_data.session_id == msg->session_id)
+    {
+        instance->session_data.scene_static = msg->scene_static != 0;
+    }
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t espfsp_client_play_resp_session_ack_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
 {
+    esp_err_t ret = ESP_OK;
     espfsp_comm_proto_resp_session_ack_message_t *msg = (espfsp_comm_proto_resp_session_ack_message_t *) msg_content;
     espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) ctx;
+    espfsp_client_session_resume_t *resume = &instance->session_data.resume;
 
     if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
     {
@@ -89,8 +118,57 @@ esp_err_t espfsp_client_play_resp_session_ack_handler(
     }
     if (!instance->session_data.active)
     {
+        // Server has not kept previous session, so its stream is not running anymore
+        if (resume->token != 0 && !msg->resumed && instance->session_data.stream_started)
+        {
+            ret = espfsp_data_proto_stop(&instance->data_proto);
+            instance->session_data.stream_started = false;
+        }
+
         instance->session_data.active = true;
         instance->session_data.session_id = msg->session_id;
+        instance->session_data.capabilities = msg->capabilities;
+
+        // Server clock could change with new session, e.g. after server restart
+        if (!msg->resumed)
+        {
+            espfsp_clock_sync_init(&instance->session_data.clock_sync);
+            instance->session_data.source_clock_sync.valid = false;
+        }
+
+        resume->session_id = msg->session_id;
+        resume->token = msg->resume_token;
+        resume->grace_ms = msg->resume_grace_ms;
+        resume->lost_us = 0;
+        resume->acked = true;
+    }
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_client_play_resp_session_pong_handler(
+    espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    int64_t t4 = esp_timer_get_time();
+    espfsp_comm_proto_resp_session_pong_message_t *msg = (espfsp_comm_proto_resp_session_pong_message_t *) msg_content;
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) ctx;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+    if (instance->session_data.active && instance->session_data.session_id == msg->session_id)
+    {
+        espfsp_clock_sync_update(&instance->session_data.clock_sync, msg->t1_us, msg->t2_us, msg->t3_us, t4);
+
+        instance->session_data.source_clock_sync.offset_us = msg->source_offset_us;
+        instance->session_data.source_clock_sync.valid = msg->source_offset_valid != 0;
     }
     if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
     {
@@ -251,6 +329,86 @@ esp_err_t espfsp_client_play_resp_cam_config_handler(
     return ret;
 }
 
+static uint16_t get_latency_ms(
+    const espfsp_receiver_buffer_stats_t *stats,
+    const espfsp_clock_sync_info_t *clock_sync,
+    const espfsp_clock_sync_info_t *source_clock_sync)
+{
+    if (!clock_sync->valid || !source_clock_sync->valid || stats->frames_received == 0)
+    {
+        return ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN;
+    }
+
+    // Transit is measured between clocks of CLIENT_PUSH and CLIENT_PLAY, both offsets are to server clock
+    int64_t latency_us = stats->last_transit_us - source_clock_sync->offset_us + clock_sync->offset_us;
+    if (latency_us < 0)
+    {
+        return 0;
+    }
+    if (latency_us / 1000 >= ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN)
+    {
+        return ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN - 1;
+    }
+    return (uint16_t) (latency_us / 1000);
+}
+
+esp_err_t espfsp_client_play_session_repetive(espfsp_comm_proto_t *comm_proto, void *ctx)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) ctx;
+    espfsp_comm_proto_req_session_ping_message_t msg;
+    espfsp_comm_req_stream_status_message_t status_msg;
+    espfsp_receiver_buffer_stats_t stats;
+    bool active = false;
+    bool stream_started = false;
+    uint32_t capabilities = 0;
+
+    espfsp_message_buffer_get_stats(&instance->receiver_buffer, &stats);
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    active = instance->session_data.active;
+    stream_started = instance->session_data.stream_started;
+    capabilities = instance->session_data.capabilities;
+    msg.session_id = instance->session_data.session_id;
+    msg.t1_us = 0;
+    msg.rtt_us = instance->session_data.clock_sync.info.rtt_us;
+    msg.offset_us = instance->session_data.clock_sync.info.offset_us;
+    msg.estimate_valid = instance->session_data.clock_sync.info.valid ? 1 : 0;
+
+    status_msg.session_id = instance->session_data.session_id;
+    status_msg.frames_received = stats.frames_received;
+    status_msg.frames_lost = stats.frames_lost;
+    status_msg.frames_late = stats.frames_late;
+    status_msg.jitter_us = stats.jitter_us;
+    status_msg.buffer_depth = stats.buffer_depth;
+    status_msg.latency_ms = get_latency_ms(
+        &stats, &instance->session_data.clock_sync.info, &instance->session_data.source_clock_sync);
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    // Lost ping or report only delays next one, it is not a reason to drop connection
+    if (active && (capabilities & ESPFSP_COMM_PROTO_CAP_CLOCK_SYNC) &&
+        espfsp_comm_proto_session_ping(comm_proto, &msg) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Ping not sent");
+    }
+    if (active && stream_started && (capabilities & ESPFSP_COMM_PROTO_CAP_STREAM_STATUS) &&
+        espfsp_comm_proto_stream_status(comm_proto, &status_msg) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Stream status not sent");
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t espfsp_client_play_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx)
 {
     esp_err_t ret = ESP_OK;
@@ -270,6 +428,7 @@ esp_err_t espfsp_client_play_connection_stop(espfsp_comm_proto_t *comm_proto, vo
         instance->session_data.active = false;
         instance->session_data.session_id = -1;
         instance->session_data.stream_started = false;
+        instance->session_data.resume.token = 0;
     }
     if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
     {
@@ -279,3 +438,29 @@ esp_err_t espfsp_client_play_connection_stop(espfsp_comm_proto_t *comm_proto, vo
 
     return ret;
 }
+
+esp_err_t espfsp_client_play_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) ctx;
+    bool detached = false;
+
+    // Stream is kept running, server holds session for grace window
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+    if (instance->session_data.active && instance->session_data.resume.token != 0)
+    {
+        instance->session_data.active = false;
+        instance->session_data.resume.lost_us = esp_timer_get_time();
+        detached = true;
+    }
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return detached ? ESP_OK : espfsp_client_play_connection_stop(comm_proto, ctx);
+}
@@ -21,6 +21,12 @@ esp_err_t espfsp_client_play_data_protos_init(espfsp_client_play_instance_t *ins
     config.mode = ESPFSP_DATA_PROTO_MODE_NAT;
     config.recv_buffer = &instance->receiver_buffer;
     config.send_frame_callback = NULL;
+    config.release_frame_callback = NULL;
+    config.newer_frame_callback = NULL;
+    config.preempt_after_percent = 0;
+    config.layer_frame_callback = NULL;
+    config.layer_recv_buffers = NULL;
+    config.layer_recv_buffers_count = 0;
     config.send_frame_ctx = NULL;
     config.frame_config = &instance->config->frame_config;
 
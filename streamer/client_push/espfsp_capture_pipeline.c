@@ -0,0 +1,334 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "espfsp_mem_alloc.h"
+#include "espfsp_trace_ring.h"
+#include "client_push/espfsp_capture_pipeline.h"
+
+#define NO_SLOT -1
+
+// Capture waits that long for sender to give a buffer back, then checks stop request again
+#define FREE_SLOT_WAIT_MS 50
+#define IDLE_WAIT_MS 50
+#define CAPTURE_FAIL_WAIT_MS 10
+#define STOP_POLL_MS 1
+
+static const char *TAG = "ESPFSP_CAPTURE_PIPELINE";
+
+// Rings have one producer and one consumer. Slots count is never over ring length, so push cannot overflow.
+static void ring_push(uint8_t *ring, _Atomic uint32_t *head, uint8_t slot)
+{
+    uint32_t cur = atomic_load_explicit(head, memory_order_relaxed);
+
+    ring[cur % ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS] = slot;
+    // Release makes slot content visible to consumer
+    atomic_store_explicit(head, cur + 1, memory_order_release);
+}
+
+static int ring_pop(uint8_t *ring, _Atomic uint32_t *head, _Atomic uint32_t *tail)
+{
+    uint32_t cur = atomic_load_explicit(tail, memory_order_relaxed);
+
+    if (cur == atomic_load_explicit(head, memory_order_acquire))
+    {
+        return NO_SLOT;
+    }
+
+    int slot = ring[cur % ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];
+    atomic_store_explicit(tail, cur + 1, memory_order_release);
+
+    return slot;
+}
+
+static void give_back_slot(espfsp_capture_pipeline_t *pipeline, int slot)
+{
+    ring_push(pipeline->free_ring, &pipeline->free_head, slot);
+    xSemaphoreGive(pipeline->free_signal);
+}
+
+// Sender that runs late sends only the newest captured frame, older ones go back to capture at once
+static int pop_newest_slot(espfsp_capture_pipeline_t *pipeline)
+{
+    int newest = NO_SLOT;
+    int slot = NO_SLOT;
+
+    while ((slot = ring_pop(pipeline->captured_ring, &pipeline->captured_head, &pipeline->captured_tail)) != NO_SLOT)
+    {
+        if (newest != NO_SLOT)
+        {
+            give_back_slot(pipeline, newest);
+        }
+        newest = slot;
+    }
+
+    return newest;
+}
+
+bool espfsp_capture_pipeline_is_enabled(const espfsp_capture_pipeline_t *pipeline)
+{
+    return pipeline->slots_count > 0;
+}
+
+esp_err_t espfsp_capture_pipeline_init(
+    espfsp_capture_pipeline_t *pipeline, uint8_t buffers, uint32_t frame_max_len, __espfsp_send_frame capture_cb)
+{
+    memset(pipeline, 0, sizeof(espfsp_capture_pipeline_t));
+    pipeline->capture_slot = NO_SLOT;
+    pipeline->send_slot = NO_SLOT;
+
+    if (buffers < 2)
+    {
+        return ESP_OK;
+    }
+
+    if (buffers > ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS)
+    {
+        ESP_LOGE(TAG, "At most %d send buffers are supported", ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS);
+        return ESP_FAIL;
+    }
+
+    pipeline->captured_signal = xSemaphoreCreateBinary();
+    pipeline->free_signal = xSemaphoreCreateBinary();
+    if (pipeline->captured_signal == NULL || pipeline->free_signal == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < buffers; i++)
+    {
+        pipeline->slots[i].buf = (char *) espfsp_mem_malloc(ESPFSP_MEM_TAG_DATA_PROTO, 0, frame_max_len);
+        if (pipeline->slots[i].buf == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot initialize memory for send buffer");
+            return ESP_FAIL;
+        }
+
+        pipeline->slot_len[i] = frame_max_len;
+        pipeline->slots_count++;
+        ring_push(pipeline->free_ring, &pipeline->free_head, i);
+    }
+
+    pipeline->capture_cb = capture_cb;
+    atomic_init(&pipeline->frame_max_len, frame_max_len);
+    atomic_init(&pipeline->generation, 0);
+    atomic_init(&pipeline->running, false);
+    atomic_init(&pipeline->capturing, false);
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_capture_pipeline_deinit(espfsp_capture_pipeline_t *pipeline)
+{
+    for (int i = 0; i < pipeline->slots_count; i++)
+    {
+        espfsp_mem_free(pipeline->slots[i].buf);
+    }
+
+    if (pipeline->captured_signal != NULL)
+    {
+        vSemaphoreDelete(pipeline->captured_signal);
+    }
+    if (pipeline->free_signal != NULL)
+    {
+        vSemaphoreDelete(pipeline->free_signal);
+    }
+
+    pipeline->slots_count = 0;
+
+    return ESP_OK;
+}
+
+void espfsp_capture_pipeline_estimate_memory(uint8_t buffers, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate)
+{
+    if (buffers < 2)
+    {
+        return;
+    }
+
+    for (int i = 0; i < buffers; i++)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_DATA_PROTO, 0, frame_max_len);
+    }
+}
+
+void espfsp_capture_pipeline_start(espfsp_capture_pipeline_t *pipeline)
+{
+    if (!espfsp_capture_pipeline_is_enabled(pipeline))
+    {
+        return;
+    }
+
+    // Frames left from previous streaming are dropped by sender
+    atomic_fetch_add(&pipeline->generation, 1);
+    atomic_store(&pipeline->running, true);
+}
+
+void espfsp_capture_pipeline_stop(espfsp_capture_pipeline_t *pipeline)
+{
+    if (!espfsp_capture_pipeline_is_enabled(pipeline))
+    {
+        return;
+    }
+
+    atomic_store(&pipeline->running, false);
+
+    // Capture task sets capturing before it checks running again, so after this loop callback is not entered
+    while (atomic_load(&pipeline->capturing))
+    {
+        vTaskDelay(pdMS_TO_TICKS(STOP_POLL_MS));
+    }
+}
+
+void espfsp_capture_pipeline_set_frame_max_len(espfsp_capture_pipeline_t *pipeline, uint32_t frame_max_len)
+{
+    atomic_store_explicit(&pipeline->frame_max_len, frame_max_len, memory_order_relaxed);
+}
+
+// Only owner of slot calls it, so buffer can be replaced without lock
+static esp_err_t fit_slot(espfsp_capture_pipeline_t *pipeline, int slot, uint32_t frame_max_len)
+{
+    if (pipeline->slot_len[slot] >= frame_max_len)
+    {
+        return ESP_OK;
+    }
+
+    espfsp_mem_free(pipeline->slots[slot].buf);
+    pipeline->slot_len[slot] = 0;
+
+    pipeline->slots[slot].buf = (char *) espfsp_mem_malloc(ESPFSP_MEM_TAG_DATA_PROTO, 0, frame_max_len);
+    if (pipeline->slots[slot].buf == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot reinitialize memory for send buffer");
+        return ESP_FAIL;
+    }
+
+    pipeline->slot_len[slot] = frame_max_len;
+    return ESP_OK;
+}
+
+void espfsp_capture_pipeline_run(espfsp_capture_pipeline_t *pipeline, espfsp_task_group_t *group)
+{
+    while (!espfsp_task_group_should_stop(group))
+    {
+        if (!atomic_load(&pipeline->running))
+        {
+            espfsp_task_group_wait_stop(group, IDLE_WAIT_MS);
+            continue;
+        }
+
+        if (pipeline->capture_slot == NO_SLOT)
+        {
+            pipeline->capture_slot = ring_pop(pipeline->free_ring, &pipeline->free_head, &pipeline->free_tail);
+            if (pipeline->capture_slot == NO_SLOT)
+            {
+                // Sender is slower than camera
+                xSemaphoreTake(pipeline->free_signal, pdMS_TO_TICKS(FREE_SLOT_WAIT_MS));
+                continue;
+            }
+        }
+
+        int slot = pipeline->capture_slot;
+        uint32_t frame_max_len = atomic_load_explicit(&pipeline->frame_max_len, memory_order_relaxed);
+
+        if (fit_slot(pipeline, slot, frame_max_len) != ESP_OK)
+        {
+            espfsp_task_group_wait_stop(group, CAPTURE_FAIL_WAIT_MS);
+            continue;
+        }
+
+        atomic_store(&pipeline->capturing, true);
+        if (!atomic_load(&pipeline->running))
+        {
+            atomic_store(&pipeline->capturing, false);
+            continue;
+        }
+
+        espfsp_send_frame_cb_state_t state = ESPFSP_SEND_FRAME_CB_FRAME_NOT_OBTAINED;
+        esp_err_t ret = pipeline->capture_cb(&pipeline->slots[slot], &state, frame_max_len);
+        uint32_t generation = atomic_load(&pipeline->generation);
+
+        atomic_store(&pipeline->capturing, false);
+
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Frame capture failed");
+            espfsp_task_group_wait_stop(group, CAPTURE_FAIL_WAIT_MS);
+            continue;
+        }
+        if (state != ESPFSP_SEND_FRAME_CB_FRAME_OBTAINED)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+
+        ESPFSP_TRACE(ESPFSP_TRACE_STAGE_CAPTURE, &pipeline->slots[slot].timestamp);
+
+        pipeline->slot_generation[slot] = generation;
+        pipeline->capture_slot = NO_SLOT;
+        ring_push(pipeline->captured_ring, &pipeline->captured_head, slot);
+        xSemaphoreGive(pipeline->captured_signal);
+    }
+}
+
+espfsp_fb_t *espfsp_capture_pipeline_take(espfsp_capture_pipeline_t *pipeline, uint32_t timeout_ms)
+{
+    while (true)
+    {
+        int slot = pop_newest_slot(pipeline);
+        if (slot == NO_SLOT)
+        {
+            // Signal can be left from frame already taken, then ring is still empty
+            if (xSemaphoreTake(pipeline->captured_signal, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)
+            {
+                return NULL;
+            }
+
+            slot = pop_newest_slot(pipeline);
+            if (slot == NO_SLOT)
+            {
+                return NULL;
+            }
+        }
+
+        // Generation only grows, so frames given back as older than this one were stale too
+        if (pipeline->slot_generation[slot] != atomic_load(&pipeline->generation))
+        {
+            give_back_slot(pipeline, slot);
+            continue;
+        }
+
+        pipeline->send_slot = slot;
+        return &pipeline->slots[slot];
+    }
+}
+
+bool espfsp_capture_pipeline_has_frame(espfsp_capture_pipeline_t *pipeline)
+{
+    return atomic_load_explicit(&pipeline->captured_head, memory_order_acquire) !=
+           atomic_load_explicit(&pipeline->captured_tail, memory_order_relaxed);
+}
+
+void espfsp_capture_pipeline_release(espfsp_capture_pipeline_t *pipeline)
+{
+    if (pipeline->send_slot == NO_SLOT)
+    {
+        return;
+    }
+
+    give_back_slot(pipeline, pipeline->send_slot);
+    pipeline->send_slot = NO_SLOT;
+}
@@ -8,12 +8,15 @@
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "espfsp_clock_sync.h"
 #include "client_push/espfsp_state_def.h"
 #include "client_push/espfsp_comm_proto_handlers.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
 #include "client_push/espfsp_comm_proto_conf.h"
 
+#define COMM_PROTO_BUFFERED_ACTIONS 3
+
 // static const char *TAG = "ESPFSP_CLIENT_PUSH_COMM_PROTO_CONF";
 
 esp_err_t espfsp_client_push_comm_protos_init(espfsp_client_push_instance_t *instance)
@@ -22,7 +25,7 @@ esp_err_t espfsp_client_push_comm_protos_init(espfsp_client_push_instance_t *ins
     espfsp_comm_proto_config_t config;
 
     config.callback_ctx = (void *) instance,
-    config.buffered_actions = 3,
+    config.buffered_actions = COMM_PROTO_BUFFERED_ACTIONS,
 
     memset(config.req_callbacks, 0, sizeof(config.req_callbacks));
     memset(config.resp_callbacks, 0, sizeof(config.resp_callbacks));
@@ -33,11 +36,12 @@ esp_err_t espfsp_client_push_comm_protos_init(espfsp_client_push_instance_t *ins
     config.req_callbacks[ESPFSP_COMM_REQ_CAM_SET_PARAMS] = espfsp_client_push_req_cam_set_params_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_FRAME_SET_PARAMS] = espfsp_client_push_req_frame_set_params_handler;
     config.resp_callbacks[ESPFSP_COMM_RESP_SESSION_ACK] = espfsp_client_push_resp_session_ack_handler;
-    config.repetive_callback = NULL;
-    config.repetive_callback_freq_us = 100000000;
-    config.conn_closed_callback = espfsp_client_push_connection_stop;
-    config.conn_reset_callback = espfsp_client_push_connection_stop;
-    config.conn_term_callback = espfsp_client_push_connection_stop;
+    config.resp_callbacks[ESPFSP_COMM_RESP_SESSION_PONG] = espfsp_client_push_resp_session_pong_handler;
+    config.repetive_callback = espfsp_client_push_session_repetive;
+    config.repetive_callback_freq_us = ESPFSP_CLOCK_SYNC_PING_INTERVAL_US;
+    config.conn_closed_callback = espfsp_client_push_connection_lost;
+    config.conn_reset_callback = espfsp_client_push_connection_lost;
+    config.conn_term_callback = espfsp_client_push_connection_lost;
 
     ret = espfsp_comm_proto_init(&instance->comm_proto, &config);
     if (ret != ESP_OK)
@@ -52,3 +56,8 @@ esp_err_t espfsp_client_push_comm_protos_deinit(espfsp_client_push_instance_t *i
 {
     return espfsp_comm_proto_deinit(&instance->comm_proto);
 }
+
+void espfsp_client_push_comm_protos_estimate_memory(espfsp_mem_estimate_t *estimate)
+{
+    espfsp_comm_proto_estimate_memory(COMM_PROTO_BUFFERED_ACTIONS, estimate);
+}
@@ -9,10 +9,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+
 #include "espfsp_params_map.h"
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
 #include "client_push/espfsp_state_def.h"
+#include "client_push/espfsp_data_proto_conf.h"
 #include "client_push/espfsp_comm_proto_handlers.h"
 
 static const char *TAG = "CLIENT_PUSH_COMMUNICATION_PROTOCOL_HANDLERS";
@@ -37,26 +40,103 @@ esp_err_t espfsp_client_push_req_session_terminate_handler(espfsp_comm_proto_t *
     return ret;
 }
 
+static esp_err_t stop_camera(espfsp_client_push_instance_t *instance)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (instance->session_data.camera_started)
+    {
+        ret = espfsp_data_proto_stop(&instance->data_proto);
+        if (ret == ESP_OK)
+        {
+            // Camera is not used by capture or data task anymore
+            espfsp_capture_pipeline_stop(&instance->capture_pipeline);
+            espfsp_client_push_data_protos_stop_lending(instance);
+            ret = instance->config->cb.stop_cam();
+        }
+        if (ret != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Stop camera callback failed");
+            ret = ESP_FAIL;
+        }
+
+        instance->session_data.camera_started = false;
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_client_push_resp_session_ack_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
 {
     esp_err_t ret = ESP_OK;
     espfsp_comm_proto_resp_session_ack_message_t *msg = (espfsp_comm_proto_resp_session_ack_message_t *) msg_content;
     espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+    espfsp_client_session_resume_t *resume = &instance->session_data.resume;
 
     if (instance->session_data.active)
     {
         ESP_LOGE(TAG, "Bad request for session ack");
         ret = ESP_FAIL;
     }
+    if (ret == ESP_OK && resume->token != 0 && !msg->resumed)
+    {
+        // Server has not kept previous session, it starts stream again when needed
+        ret = stop_camera(instance);
+    }
     if (ret == ESP_OK)
     {
         instance->session_data.active = true;
         instance->session_data.session_id = msg->session_id;
+        instance->session_data.capabilities = msg->capabilities;
+        espfsp_data_proto_set_peer_frame_abort(
+            &instance->data_proto, msg->capabilities & ESPFSP_COMM_PROTO_CAP_FRAME_ABORT);
+        espfsp_simulcast_layers_set_enabled(&instance->simulcast, msg->capabilities & ESPFSP_COMM_PROTO_CAP_SIMULCAST);
+
+        // Server clock could change with new session, e.g. after server restart
+        if (!msg->resumed && xSemaphoreTake(instance->clock_sync_mutex, portMAX_DELAY) == pdTRUE)
+        {
+            espfsp_clock_sync_init(&instance->clock_sync);
+            xSemaphoreGive(instance->clock_sync_mutex);
+        }
+
+        resume->session_id = msg->session_id;
+        resume->token = msg->resume_token;
+        resume->grace_ms = msg->resume_grace_ms;
+        resume->lost_us = 0;
+        resume->acked = true;
     }
 
     return ret;
 }
 
+esp_err_t espfsp_client_push_resp_session_pong_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    int64_t t4 = esp_timer_get_time();
+    espfsp_comm_proto_resp_session_pong_message_t *msg = (espfsp_comm_proto_resp_session_pong_message_t *) msg_content;
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    if (!instance->session_data.active || instance->session_data.session_id != msg->session_id)
+    {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(instance->clock_sync_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    espfsp_clock_sync_update(&instance->clock_sync, msg->t1_us, msg->t2_us, msg->t3_us, t4);
+
+    if (xSemaphoreGive(instance->clock_sync_mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t espfsp_client_push_req_start_stream_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
 {
     esp_err_t ret = ESP_OK;
@@ -86,7 +166,12 @@ esp_err_t espfsp_client_push_req_start_stream_handler(espfsp_comm_proto_t *comm_
         }
         if (ret == ESP_OK)
         {
+            espfsp_capture_pipeline_set_frame_max_len(
+                &instance->capture_pipeline, instance->config->frame_config.frame_max_len);
+            espfsp_capture_pipeline_start(&instance->capture_pipeline);
+            espfsp_client_push_data_protos_allow_lending(instance);
             instance->session_data.camera_started = true;
+            instance->session_data.scene_static_reported = false;
         }
     }
 
@@ -109,6 +194,9 @@ esp_err_t espfsp_client_push_req_stop_stream_handler(espfsp_comm_proto_t *comm_p
         ret = espfsp_data_proto_stop(&instance->data_proto);
         if (ret == ESP_OK)
         {
+            // Camera is not used by capture or data task anymore
+            espfsp_capture_pipeline_stop(&instance->capture_pipeline);
+            espfsp_client_push_data_protos_stop_lending(instance);
             ret = instance->config->cb.stop_cam();
         }
         if (ret != ESP_OK)
@@ -173,6 +261,8 @@ esp_err_t espfsp_client_push_req_frame_set_params_handler(
             &instance->config->frame_config, received_msg->param_id, received_msg->value);
         if (ret == ESP_OK)
         {
+            espfsp_capture_pipeline_set_frame_max_len(
+                &instance->capture_pipeline, instance->config->frame_config.frame_max_len);
             ret = espfsp_data_proto_set_frame_params(&instance->data_proto, &instance->config->frame_config);
         }
     }
@@ -180,31 +270,106 @@ esp_err_t espfsp_client_push_req_frame_set_params_handler(
     return ret;
 }
 
+// Static scene is reported on every call, so also play session started later learns it
+static void report_scene_state(espfsp_client_push_instance_t *instance, espfsp_comm_proto_t *comm_proto)
+{
+    espfsp_comm_req_scene_state_message_t msg;
+    bool scene_static = espfsp_scene_detector_is_static(&instance->scene_detector);
+
+    if (!instance->session_data.camera_started || !(instance->session_data.capabilities & ESPFSP_COMM_PROTO_CAP_SCENE_STATE))
+    {
+        return;
+    }
+    if (!scene_static && !instance->session_data.scene_static_reported)
+    {
+        return;
+    }
+
+    msg.session_id = instance->session_data.session_id;
+    msg.scene_static = scene_static ? 1 : 0;
+    msg.keepalive_interval_ms = instance->config->static_scene.keepalive_interval_ms;
+
+    if (espfsp_comm_proto_scene_state(comm_proto, &msg) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Scene state not sent");
+        return;
+    }
+
+    instance->session_data.scene_static_reported = scene_static;
+}
+
+esp_err_t espfsp_client_push_session_repetive(espfsp_comm_proto_t *comm_proto, void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+    espfsp_comm_proto_req_session_ping_message_t msg;
+
+    if (!instance->session_data.active)
+    {
+        return ESP_OK;
+    }
+
+    report_scene_state(instance, comm_proto);
+
+    if (!(instance->session_data.capabilities & ESPFSP_COMM_PROTO_CAP_CLOCK_SYNC))
+    {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(instance->clock_sync_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    msg.session_id = instance->session_data.session_id;
+    msg.t1_us = 0;
+    msg.rtt_us = instance->clock_sync.info.rtt_us;
+    msg.offset_us = instance->clock_sync.info.offset_us;
+    msg.estimate_valid = instance->clock_sync.info.valid ? 1 : 0;
+
+    if (xSemaphoreGive(instance->clock_sync_mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    // Lost ping only delays next estimate, it is not a reason to drop connection
+    if (espfsp_comm_proto_session_ping(comm_proto, &msg) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Ping not sent");
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t espfsp_client_push_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx)
 {
     esp_err_t ret = ESP_OK;
     espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
 
-    if (instance->session_data.active)
+    if (instance->session_data.active || instance->session_data.resume.token != 0)
     {
-        if (instance->session_data.camera_started)
-        {
-            ret = espfsp_data_proto_stop(&instance->data_proto);
-            if (ret == ESP_OK)
-            {
-                ret = instance->config->cb.stop_cam();
-            }
-            if (ret != ESP_OK)
-            {
-                ESP_LOGW(TAG, "Stop camera callback failed");
-                ret = ESP_FAIL;
-            }
-        }
+        ret = stop_camera(instance);
 
         instance->session_data.active = false;
         instance->session_data.session_id = -123;
-        instance->session_data.camera_started = false;
+        instance->session_data.resume.token = 0;
     }
 
     return ret;
 }
+
+esp_err_t espfsp_client_push_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    // Camera is kept running, server holds session for grace window
+    if (instance->session_data.active && instance->session_data.resume.token != 0)
+    {
+        instance->session_data.active = false;
+        instance->session_data.resume.lost_us = esp_timer_get_time();
+        return ESP_OK;
+    }
+
+    return espfsp_client_push_connection_stop(comm_proto, ctx);
+}
@@ -3,14 +3,24 @@
  * Author: Maksymilian Komarnicki
  */
 
+#include <string.h>
+
 #include "esp_err.h"
 #include "esp_log.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_trace_ring.h"
 #include "client_push/espfsp_state_def.h"
 #include "data_proto/espfsp_data_proto.h"
 
 #include "client_push/espfsp_data_proto_conf.h"
 
+// Data task checks start and stop requests between waits
+#define PIPELINE_TAKE_TIMEOUT_MS 20
+#define LEND_STOP_POLL_MS 1
+
 static const char *TAG = "ESPFSP_CLIENT_PUSH_DATA_PROTO_CONF";
 
 static esp_err_t send_frame(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_frame_state_t *state, uint32_t max_allowed_size)
@@ -25,7 +35,15 @@ static esp_err_t send_frame(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_f
         switch (send_frame_cb_state)
         {
         case ESPFSP_SEND_FRAME_CB_FRAME_OBTAINED:
-            *state = ESPFSP_DATA_PROTO_FRAME_OBTAINED;
+            ESPFSP_TRACE(ESPFSP_TRACE_STAGE_CAPTURE, &fb->timestamp);
+            if (espfsp_scene_detector_should_send(&instance->scene_detector, fb))
+            {
+                *state = ESPFSP_DATA_PROTO_FRAME_OBTAINED;
+            }
+            else
+            {
+                *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
+            }
             break;
 
         case ESPFSP_SEND_FRAME_CB_FRAME_NOT_OBTAINED:
@@ -41,6 +59,126 @@ static esp_err_t send_frame(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_f
     return ret;
 }
 
+// Frame captured by capture task is lent to data protocol, no copy is made
+static esp_err_t send_captured_frame(
+    espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_frame_state_t *state, uint32_t max_allowed_size)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+    espfsp_fb_t *captured_fb = espfsp_capture_pipeline_take(&instance->capture_pipeline, PIPELINE_TAKE_TIMEOUT_MS);
+
+    *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
+
+    if (captured_fb == NULL)
+    {
+        return ESP_OK;
+    }
+
+    // Frame size could be lowered while frame was captured
+    if (captured_fb->len > max_allowed_size)
+    {
+        ESP_LOGW(TAG, "Captured frame exceeds max size, dropped");
+        espfsp_capture_pipeline_release(&instance->capture_pipeline);
+        return ESP_OK;
+    }
+
+    // Static scene, buffer goes back to capture task at once
+    if (!espfsp_scene_detector_should_send(&instance->scene_detector, captured_fb))
+    {
+        espfsp_capture_pipeline_release(&instance->capture_pipeline);
+        return ESP_OK;
+    }
+
+    memcpy(fb, captured_fb, sizeof(espfsp_fb_t));
+    *state = ESPFSP_DATA_PROTO_FRAME_OBTAINED;
+
+    return ESP_OK;
+}
+
+static void release_captured_frame(espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    espfsp_capture_pipeline_release(&instance->capture_pipeline);
+}
+
+static bool newer_frame_captured(void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    return espfsp_capture_pipeline_has_frame(&instance->capture_pipeline);
+}
+
+// Frame of camera driver is sent without copy. Lent is set before allowed is checked, so after
+// stop_lending() clears allowed and sees lent cleared, no frame is acquired anymore.
+static esp_err_t send_lent_frame(
+    espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_frame_state_t *state, uint32_t max_allowed_size)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+    espfsp_client_push_lend_t *lend = &instance->lend;
+    espfsp_send_frame_cb_state_t send_frame_cb_state = ESPFSP_SEND_FRAME_CB_FRAME_NOT_OBTAINED;
+
+    *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
+
+    atomic_store(&lend->lent, true);
+    if (!atomic_load(&lend->allowed))
+    {
+        atomic_store(&lend->lent, false);
+        return ESP_OK;
+    }
+
+    ret = instance->config->cb.acquire_frame(fb, &lend->frame_ctx, &send_frame_cb_state, max_allowed_size);
+    if (ret == ESP_OK && send_frame_cb_state == ESPFSP_SEND_FRAME_CB_FRAME_OBTAINED)
+    {
+        if (fb->len > max_allowed_size)
+        {
+            ESP_LOGW(TAG, "Lent frame exceeds max size, dropped");
+        }
+        else if (espfsp_scene_detector_should_send(&instance->scene_detector, fb))
+        {
+            *state = ESPFSP_DATA_PROTO_FRAME_OBTAINED;
+            ESPFSP_TRACE(ESPFSP_TRACE_STAGE_CAPTURE, &fb->timestamp);
+            return ESP_OK;
+        }
+
+        instance->config->cb.release_frame(fb, lend->frame_ctx);
+    }
+
+    atomic_store(&lend->lent, false);
+    return ret;
+}
+
+static void release_lent_frame(espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    instance->config->cb.release_frame(fb, instance->lend.frame_ctx);
+    atomic_store(&instance->lend.lent, false);
+}
+
+static bool next_layer_frame(const espfsp_fb_t *source, espfsp_fb_t **fb, uint8_t *layer, void *ctx)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) ctx;
+
+    return espfsp_simulcast_layers_next(&instance->simulcast, source, fb, layer);
+}
+
+void espfsp_client_push_data_protos_allow_lending(espfsp_client_push_instance_t *instance)
+{
+    atomic_store(&instance->lend.allowed, true);
+}
+
+void espfsp_client_push_data_protos_stop_lending(espfsp_client_push_instance_t *instance)
+{
+    atomic_store(&instance->lend.allowed, false);
+
+    // At most one frame is sent within frame interval
+    while (atomic_load(&instance->lend.lent))
+    {
+        vTaskDelay(pdMS_TO_TICKS(LEND_STOP_POLL_MS));
+    }
+}
+
 esp_err_t espfsp_client_push_data_protos_init(espfsp_client_push_instance_t *instance)
 {
     espfsp_data_proto_config_t config;
@@ -49,7 +187,36 @@ esp_err_t espfsp_client_push_data_protos_init(espfsp_client_push_instance_t *ins
     config.mode = ESPFSP_DATA_PROTO_MODE_LOCAL;
     config.recv_buffer = NULL;
     config.send_frame_callback = send_frame;
+    config.release_frame_callback = NULL;
+    config.newer_frame_callback = NULL;
+    config.preempt_after_percent = 0;
+    config.layer_frame_callback = NULL;
+    config.layer_recv_buffers = NULL;
+    config.layer_recv_buffers_count = 0;
     config.send_frame_ctx = instance;
+
+    atomic_init(&instance->lend.allowed, false);
+    atomic_init(&instance->lend.lent, false);
+    instance->lend.frame_ctx = NULL;
+
+    if (instance->config->cb.acquire_frame != NULL)
+    {
+        config.send_frame_callback = send_lent_frame;
+        config.release_frame_callback = release_lent_frame;
+    }
+    else if (espfsp_capture_pipeline_is_enabled(&instance->capture_pipeline))
+    {
+        config.send_frame_callback = send_captured_frame;
+        config.release_frame_callback = release_captured_frame;
+
+        // Only with own capture task newer frame can be ready while previous one is sent
+        config.newer_frame_callback = newer_frame_captured;
+        config.preempt_after_percent = instance->config->preempt_after_percent;
+    }
+    if (instance->simulcast.count > 0)
+    {
+        config.layer_frame_callback = next_layer_frame;
+    }
     config.frame_config = &instance->config->frame_config;
 
     return espfsp_data_proto_init(&instance->data_proto, &config);
@@ -0,0 +1,194 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "esp_timer.h"
+
+#include "client_push/espfsp_scene_detector.h"
+
+#define GRID ESPFSP_SCENE_DETECTOR_GRID
+#define SAMPLES_PER_CELL_SIDE 2
+
+// Luma from RGB, BT.601 weights scaled by 256
+static uint8_t rgb_to_luma(uint8_t r, uint8_t g, uint8_t b)
+{
+    return (uint8_t) ((r * 77 + g * 150 + b * 29) >> 8);
+}
+
+static uint8_t read_luma(const uint8_t *buf, espfsp_pixformat_t format, size_t pos)
+{
+    switch (format)
+    {
+    case ESPFSP_PIXFORMAT_YUV422:
+        // YUYV, luma in every even byte
+        return buf[pos * 2];
+
+    case ESPFSP_PIXFORMAT_RGB565:
+    {
+        // Big endian, as camera driver gives it
+        uint16_t pixel = (buf[pos * 2] << 8) | buf[pos * 2 + 1];
+        return rgb_to_luma((pixel >> 11) << 3, ((pixel >> 5) & 0x3F) << 2, (pixel & 0x1F) << 3);
+    }
+
+    case ESPFSP_PIXFORMAT_RGB888:
+        return rgb_to_luma(buf[pos * 3], buf[pos * 3 + 1], buf[pos * 3 + 2]);
+
+    default:
+        // Grayscale and luma plane of YUV420
+        return buf[pos];
+    }
+}
+
+// Returns false for formats without known luma layout
+static bool get_signature(const espfsp_fb_t *fb, uint8_t *signature)
+{
+    size_t pixels = (size_t) fb->width * fb->height;
+    size_t needed_len = 0;
+
+    switch (fb->format)
+    {
+    case ESPFSP_PIXFORMAT_GRAYSCALE:
+    case ESPFSP_PIXFORMAT_YUV420:
+        needed_len = pixels;
+        break;
+
+    case ESPFSP_PIXFORMAT_YUV422:
+    case ESPFSP_PIXFORMAT_RGB565:
+        needed_len = pixels * 2;
+        break;
+
+    case ESPFSP_PIXFORMAT_RGB888:
+        needed_len = pixels * 3;
+        break;
+
+    default:
+        return false;
+    }
+
+    if (fb->width < GRID * SAMPLES_PER_CELL_SIDE || fb->height < GRID * SAMPLES_PER_CELL_SIDE ||
+        (size_t) fb->len < needed_len)
+    {
+        return false;
+    }
+
+    const int samples = GRID * SAMPLES_PER_CELL_SIDE;
+    const uint8_t *buf = (const uint8_t *) fb->buf;
+
+    for (int cy = 0; cy < GRID; cy++)
+    {
+        for (int cx = 0; cx < GRID; cx++)
+        {
+            uint32_t sum = 0;
+
+            for (int sy = 0; sy < SAMPLES_PER_CELL_SIDE; sy++)
+            {
+                for (int sx = 0; sx < SAMPLES_PER_CELL_SIDE; sx++)
+                {
+                    // Centers of sample areas, so frame borders are not sampled
+                    size_t x = ((cx * SAMPLES_PER_CELL_SIDE + sx) * 2 + 1) * fb->width / (samples * 2);
+                    size_t y = ((cy * SAMPLES_PER_CELL_SIDE + sy) * 2 + 1) * fb->height / (samples * 2);
+
+                    sum += read_luma(buf, fb->format, y * fb->width + x);
+                }
+            }
+
+            signature[cy * GRID + cx] = sum / (SAMPLES_PER_CELL_SIDE * SAMPLES_PER_CELL_SIDE);
+        }
+    }
+
+    return true;
+}
+
+static bool is_changed(espfsp_scene_detector_t *detector, const espfsp_fb_t *fb, const uint8_t *signature, bool has_signature)
+{
+    if (!detector->has_reference)
+    {
+        return true;
+    }
+
+    if (fb->format == ESPFSP_PIXFORMAT_JPEG)
+    {
+        uint32_t delta = abs((int32_t) fb->len - (int32_t) detector->reference_len);
+        return (uint64_t) delta * 1000 > (uint64_t) detector->config.jpeg_size_delta_permille * detector->reference_len;
+    }
+
+    // Unknown layout, every frame is sent
+    if (!has_signature)
+    {
+        return true;
+    }
+
+    // Any cell, so also small moving object is caught
+    for (int i = 0; i < GRID * GRID; i++)
+    {
+        if (abs((int) signature[i] - (int) detector->signature[i]) > detector->config.luma_delta)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void espfsp_scene_detector_init(espfsp_scene_detector_t *detector, const espfsp_static_scene_config_t *config)
+{
+    memcpy(&detector->config, config, sizeof(espfsp_static_scene_config_t));
+    memset(detector->signature, 0, sizeof(detector->signature));
+    detector->reference_len = 0;
+    detector->has_reference = false;
+    detector->unchanged_frames = 0;
+    detector->last_sent_us = 0;
+    atomic_init(&detector->scene_static, false);
+}
+
+bool espfsp_scene_detector_should_send(espfsp_scene_detector_t *detector, const espfsp_fb_t *fb)
+{
+    if (!detector->config.enabled)
+    {
+        return true;
+    }
+
+    uint8_t signature[GRID * GRID];
+    bool has_signature = fb->format != ESPFSP_PIXFORMAT_JPEG && get_signature(fb, signature);
+    int64_t now_us = esp_timer_get_time();
+
+    if (is_changed(detector, fb, signature, has_signature))
+    {
+        // Full rate is back with this frame
+        if (has_signature)
+        {
+            memcpy(detector->signature, signature, sizeof(detector->signature));
+        }
+        detector->reference_len = fb->len;
+        detector->has_reference = true;
+        detector->unchanged_frames = 0;
+        atomic_store_explicit(&detector->scene_static, false, memory_order_relaxed);
+    }
+    else if (detector->unchanged_frames < detector->config.static_after_frames)
+    {
+        detector->unchanged_frames++;
+    }
+    else
+    {
+        atomic_store_explicit(&detector->scene_static, true, memory_order_relaxed);
+
+        if (now_us - detector->last_sent_us < (int64_t) detector->config.keepalive_interval_ms * 1000)
+        {
+            return false;
+        }
+    }
+
+    detector->last_sent_us = now_us;
+    return true;
+}
+
+bool espfsp_scene_detector_is_static(espfsp_scene_detector_t *detector)
+{
+    return atomic_load_explicit(&detector->scene_static, memory_order_relaxed);
+}
@@ -0,0 +1,127 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "espfsp_mem_alloc.h"
+#include "client_push/espfsp_simulcast_layers.h"
+
+static const char *TAG = "ESPFSP_SIMULCAST_LAYERS";
+
+esp_err_t espfsp_simulcast_layers_init(
+    espfsp_simulcast_layers_t *layers,
+    uint8_t count,
+    const espfsp_simulcast_layer_config_t *configs,
+    __espfsp_derive_layer derive_cb)
+{
+    memset(layers, 0, sizeof(espfsp_simulcast_layers_t));
+    atomic_init(&layers->enabled, false);
+
+    if (count == 0)
+    {
+        return ESP_OK;
+    }
+
+    if (count > ESPFSP_SIMULCAST_MAX_LOWER_LAYERS)
+    {
+        ESP_LOGE(TAG, "At most %d lower layers are supported", ESPFSP_SIMULCAST_MAX_LOWER_LAYERS);
+        return ESP_FAIL;
+    }
+    if (derive_cb == NULL)
+    {
+        ESP_LOGE(TAG, "Derive layer callback is required for lower layers");
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        layers->bufs[i] = (char *) espfsp_mem_malloc(ESPFSP_MEM_TAG_DATA_PROTO, 0, configs[i].frame_max_len);
+        if (layers->bufs[i] == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot initialize memory for layer buffer");
+            return ESP_FAIL;
+        }
+
+        memcpy(&layers->configs[i], &configs[i], sizeof(espfsp_simulcast_layer_config_t));
+        espfsp_frame_decimator_init(&layers->decimators[i], configs[i].fps);
+        layers->count++;
+    }
+
+    layers->derive_cb = derive_cb;
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_simulcast_layers_deinit(espfsp_simulcast_layers_t *layers)
+{
+    for (int i = 0; i < layers->count; i++)
+    {
+        espfsp_mem_free(layers->bufs[i]);
+    }
+
+    layers->count = 0;
+
+    return ESP_OK;
+}
+
+void espfsp_simulcast_layers_estimate_memory(
+    uint8_t count, const espfsp_simulcast_layer_config_t *configs, espfsp_mem_estimate_t *estimate)
+{
+    for (int i = 0; i < count && i < ESPFSP_SIMULCAST_MAX_LOWER_LAYERS; i++)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_DATA_PROTO, 0, configs[i].frame_max_len);
+    }
+}
+
+void espfsp_simulcast_layers_set_enabled(espfsp_simulcast_layers_t *layers, bool enabled)
+{
+    atomic_store_explicit(&layers->enabled, enabled && layers->count > 0, memory_order_relaxed);
+}
+
+bool espfsp_simulcast_layers_next(
+    espfsp_simulcast_layers_t *layers, const espfsp_fb_t *source, espfsp_fb_t **fb, uint8_t *layer)
+{
+    if (!atomic_load_explicit(&layers->enabled, memory_order_relaxed))
+    {
+        return false;
+    }
+
+    while (layers->next < layers->count)
+    {
+        uint8_t i = layers->next++;
+        espfsp_fb_t *layer_fb = &layers->fbs[i];
+
+        if (!espfsp_frame_decimator_pass(&layers->decimators[i], &source->timestamp))
+        {
+            continue;
+        }
+
+        layer_fb->buf = layers->bufs[i];
+        if (layers->derive_cb(source, layer_fb, &layers->configs[i], layers->configs[i].frame_max_len) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Layer %d not derived", i + 1);
+            continue;
+        }
+        if (layer_fb->len > layers->configs[i].frame_max_len)
+        {
+            ESP_LOGW(TAG, "Layer %d frame exceeds max size, dropped", i + 1);
+            continue;
+        }
+
+        // Server aligns layers by capture time, so it is the one of camera frame
+        layer_fb->timestamp = source->timestamp;
+        *fb = layer_fb;
+        *layer = i + 1;
+        return true;
+    }
+
+    layers->next = 0;
+    return false;
+}
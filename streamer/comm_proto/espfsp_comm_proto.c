@@ -8,12 +8,14 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "esp_timer.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_sock_op.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
@@ -25,7 +27,8 @@ esp_err_t espfsp_comm_proto_init(espfsp_comm_proto_t *comm_proto, espfsp_comm_pr
 {
     esp_err_t ret = ESP_OK;
 
-    comm_proto->config = (espfsp_comm_proto_config_t *) malloc(sizeof(espfsp_comm_proto_config_t));
+    comm_proto->config = (espfsp_comm_proto_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_COMM_PROTO, 0, sizeof(espfsp_comm_proto_config_t));
     if (!comm_proto->config)
     {
         ESP_LOGE(TAG, "Cannot initialize memory for config");
@@ -34,12 +37,18 @@ esp_err_t espfsp_comm_proto_init(espfsp_comm_proto_t *comm_proto, espfsp_comm_pr
 
     memcpy(comm_proto->config, config, sizeof(espfsp_comm_proto_config_t));
 
+    // Cleared only by espfsp_comm_proto_stop(), so stop is not lost when run is entered after it
+    comm_proto->en = 1;
+    comm_proto->sock = -1;
+    comm_proto->conn_state = ESPFSP_CONN_STATE_GOOD;
+
     comm_proto->reqActionQueue = NULL;
-    comm_proto->reqActionQueue = xQueueCreate(comm_proto->config->buffered_actions, sizeof(espfsp_comm_proto_action_t));
+    comm_proto->reqActionQueue = espfsp_mem_queue_create(
+        ESPFSP_MEM_TAG_COMM_PROTO, comm_proto->config->buffered_actions, sizeof(espfsp_comm_proto_action_t));
     if (comm_proto->reqActionQueue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize actions queue");
-        free(comm_proto->config);
+        espfsp_mem_free(comm_proto->config);
         return ESP_FAIL;
     }
 
@@ -48,18 +57,30 @@ esp_err_t espfsp_comm_proto_init(espfsp_comm_proto_t *comm_proto, espfsp_comm_pr
 
 esp_err_t espfsp_comm_proto_deinit(espfsp_comm_proto_t *comm_proto)
 {
-    free(comm_proto->config);
+    espfsp_mem_free(comm_proto->config);
 
     espfsp_comm_proto_action_t action;
     while (xQueueReceive(comm_proto->reqActionQueue, &action, 0) == pdPASS)
     {
-        free(action.data);
+        espfsp_mem_free(action.data);
     }
-    vQueueDelete(comm_proto->reqActionQueue);
+    espfsp_mem_queue_delete(comm_proto->reqActionQueue);
 
     return ESP_OK;
 }
 
+void espfsp_comm_proto_estimate_memory(int buffered_actions, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_COMM_PROTO, 0, sizeof(espfsp_comm_proto_config_t));
+    espfsp_mem_estimate_add_queue(
+        estimate, ESPFSP_MEM_TAG_COMM_PROTO, buffered_actions, sizeof(espfsp_comm_proto_action_t));
+
+    for (int i = 0; i < buffered_actions + 1; i++)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_COMM_PROTO, 0, MAX_COMM_PROTO_BUFFER_LEN);
+    }
+}
+
 static esp_err_t receive_action_from_sock(
     espfsp_comm_proto_t *comm_proto,
     int sock,
@@ -95,7 +116,15 @@ static esp_err_t receive_action_from_sock(
     action->subtype = tlv_buffer->subtype;
     action->length = tlv_buffer->length;
 
-    action->data = (uint8_t *) malloc(tlv_buffer->length);
+    if (tlv_buffer->length > sizeof(tlv_buffer->value))
+    {
+        *received = 0;
+        ESP_LOGE(TAG, "Received TLV length exceeds buffer");
+        return ESP_FAIL;
+    }
+
+    // Whole message structure is available to handler, fields not sent by older peer are zero
+    action->data = (uint8_t *) espfsp_mem_calloc(ESPFSP_MEM_TAG_COMM_PROTO, 0, 1, sizeof(tlv_buffer->value));
     if (!action->data)
     {
         // Memory allocation did not happen, so we inform that 0 bytes are received
@@ -108,6 +137,28 @@ static esp_err_t receive_action_from_sock(
     return ret;
 }
 
+// Send timestamps of PING/PONG are taken right before sending, so time spent in actions queue is
+// not counted to RTT
+static void stamp_send_time(espfsp_comm_proto_tlv_t *tlv_buffer)
+{
+    if (tlv_buffer->type == ESPFSP_COMM_PROTO_MSG_REQUEST &&
+        tlv_buffer->subtype == ESPFSP_COMM_REQ_SESSION_PING)
+    {
+        espfsp_comm_proto_req_session_ping_message_t msg;
+        memcpy(&msg, tlv_buffer->value, sizeof(msg));
+        msg.t1_us = esp_timer_get_time();
+        memcpy(tlv_buffer->value, &msg, sizeof(msg));
+    }
+    else if (tlv_buffer->type == ESPFSP_COMM_PROTO_MSG_RESPONSE &&
+             tlv_buffer->subtype == ESPFSP_COMM_RESP_SESSION_PONG)
+    {
+        espfsp_comm_proto_resp_session_pong_message_t msg;
+        memcpy(&msg, tlv_buffer->value, sizeof(msg));
+        msg.t3_us = esp_timer_get_time();
+        memcpy(tlv_buffer->value, &msg, sizeof(msg));
+    }
+}
+
 static esp_err_t execute_local_action(
     espfsp_comm_proto_t *comm_proto,
     int sock,
@@ -126,6 +177,7 @@ static esp_err_t execute_local_action(
     }
 
     memcpy(tlv_buffer->value, action->data, action->length);
+    stamp_send_time(tlv_buffer);
 
     ESP_LOGI(TAG,
              "TLV to send type=%d, subtype=%d, len=%d",
@@ -231,11 +283,13 @@ esp_err_t espfsp_comm_proto_run(espfsp_comm_proto_t *comm_proto, int sock)
     ESP_LOGI(TAG, "Start communication handling");
 
     espfsp_comm_proto_state_t state = ESPFSP_COMM_PROTO_STATE_LISTEN;
-    comm_proto->en = 1;
 
     int64_t reptv_last_called = esp_timer_get_time();
     int64_t reptv_now_called = reptv_last_called;
 
+    comm_proto->sock = sock;
+    comm_proto->conn_state = ESPFSP_CONN_STATE_GOOD;
+
     while (comm_proto->en)
     {
         switch (state)
@@ -252,7 +306,7 @@ esp_err_t espfsp_comm_proto_run(espfsp_comm_proto_t *comm_proto, int sock)
             if (remote_action_received > 0)
             {
                 ret = execute_remote_action(comm_proto, &action);
-                free(action.data);
+                espfsp_mem_free(action.data);
             }
 
             if (ret == ESP_OK && conn_state != ESPFSP_CONN_STATE_GOOD)
@@ -271,7 +325,7 @@ esp_err_t espfsp_comm_proto_run(espfsp_comm_proto_t *comm_proto, int sock)
             if (xQueueReceive(comm_proto->reqActionQueue, &action, 0) == pdPASS)
             {
                 ret = execute_local_action(comm_proto, sock, &action, &conn_state, &tlv_buffer);
-                free(action.data);
+                espfsp_mem_free(action.data);
 
                 if (ret == ESP_OK && conn_state != ESPFSP_CONN_STATE_GOOD)
                 {
@@ -298,6 +352,13 @@ esp_err_t espfsp_comm_proto_run(espfsp_comm_proto_t *comm_proto, int sock)
                 }
             }
 
+            // Callback may send without queue, connection lost meanwhile is handled as on any other send
+            if (ret == ESP_OK && comm_proto->conn_state != ESPFSP_CONN_STATE_GOOD)
+            {
+                change_state_base_conn_state(&state, comm_proto->conn_state);
+                break;
+            }
+
             change_state_base_ret(&state, ESPFSP_COMM_PROTO_STATE_LISTEN, ret);
             break;
 
@@ -375,19 +436,19 @@ static esp_err_t insert_action(
     uint8_t *data,
     uint16_t data_len)
 {
-    espfsp_comm_proto_action_t action = {
-        .type = msg_type,
-        .subtype = msg_subtype,
-        .length = data_len,
-        .data = (uint8_t *) malloc(data_len),
-    };
-
     if (data_len > MAX_COMM_PROTO_BUFFER_LEN)
     {
         ESP_LOGE(TAG, "Message too big");
         return ESP_FAIL;
     }
 
+    espfsp_comm_proto_action_t action = {
+        .type = msg_type,
+        .subtype = msg_subtype,
+        .length = data_len,
+        .data = (uint8_t *) espfsp_mem_malloc(ESPFSP_MEM_TAG_COMM_PROTO, 0, data_len),
+    };
+
     if (!action.data)
     {
         ESP_LOGE(TAG, "Create action failed");
@@ -399,13 +460,38 @@ static esp_err_t insert_action(
     if (xQueueSend(comm_proto->reqActionQueue, &action, 0) != pdPASS)
     {
         ESP_LOGE(TAG, "Cannot send action to queue");
-        free(action.data);
+        espfsp_mem_free(action.data);
         return ESP_FAIL;
     }
 
     return ESP_OK;
 }
 
+// Caller runs on task of espfsp_comm_proto_run(), so socket is not used by anyone else meanwhile
+static esp_err_t send_action_now(
+    espfsp_comm_proto_t *comm_proto,
+    espfsp_comm_proto_msg_type_t msg_type,
+    uint8_t msg_subtype,
+    uint8_t *data,
+    uint16_t data_len)
+{
+    espfsp_comm_proto_tlv_t tlv_buffer;
+    espfsp_comm_proto_action_t action = {
+        .type = msg_type,
+        .subtype = msg_subtype,
+        .length = data_len,
+        .data = data,
+    };
+
+    if (comm_proto->sock < 0 || comm_proto->conn_state != ESPFSP_CONN_STATE_GOOD)
+    {
+        ESP_LOGE(TAG, "Communication is not running");
+        return ESP_FAIL;
+    }
+
+    return execute_local_action(comm_proto, comm_proto->sock, &action, &comm_proto->conn_state, &tlv_buffer);
+}
+
 esp_err_t espfsp_comm_proto_session_init(
     espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_session_init_message_t *msg)
 {
@@ -429,7 +515,7 @@ esp_err_t espfsp_comm_proto_session_terminate(espfsp_comm_proto_t *comm_proto, e
 
 esp_err_t espfsp_comm_proto_session_ping(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_session_ping_message_t *msg)
 {
-    return insert_action(
+    return send_action_now(
         comm_proto,
         ESPFSP_COMM_PROTO_MSG_REQUEST,
         (uint8_t) ESPFSP_COMM_REQ_SESSION_PING,
@@ -547,6 +633,26 @@ esp_err_t espfsp_comm_proto_source_get(espfsp_comm_proto_t *comm_proto, espfsp_c
         sizeof(espfsp_comm_req_source_get_message_t));
 }
 
+esp_err_t espfsp_comm_proto_stream_status(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_stream_status_message_t *msg)
+{
+    return send_action_now(
+        comm_proto,
+        ESPFSP_COMM_PROTO_MSG_REQUEST,
+        (uint8_t) ESPFSP_COMM_REQ_STREAM_STATUS,
+        (uint8_t *) msg,
+        sizeof(espfsp_comm_req_stream_status_message_t));
+}
+
+esp_err_t espfsp_comm_proto_scene_state(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_scene_state_message_t *msg)
+{
+    return insert_action(
+        comm_proto,
+        ESPFSP_COMM_PROTO_MSG_REQUEST,
+        (uint8_t) ESPFSP_COMM_REQ_SCENE_STATE,
+        (uint8_t *) msg,
+        sizeof(espfsp_comm_req_scene_state_message_t));
+}
+
 esp_err_t espfsp_comm_proto_cam_params(espfsp_comm_proto_t *comm_proto, espfsp_comm_resp_cam_params_resp_message_t *msg)
 {
     return insert_action(
@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_frame_config.h"
 #include "data_proto/espfsp_data_recv_proto.h"
 #include "data_proto/espfsp_data_send_proto.h"
@@ -34,12 +35,13 @@ static const char *TAG = "ESPFSP_DATA_PROTOCOL";
 static esp_err_t update_frame_config(espfsp_data_proto_t *data_proto, espfsp_frame_config_t *frame_config)
 {
     if (data_proto->config->type == ESPFSP_DATA_PROTO_TYPE_SEND
+        && data_proto->config->release_frame_callback == NULL
         && data_proto->frame_config.frame_max_len != frame_config->frame_max_len)
     {
-        free(data_proto->send_fb.buf);
+        espfsp_mem_free(data_proto->send_buf);
 
-        data_proto->send_fb.buf = (char *) malloc(frame_config->frame_max_len);
-        if (data_proto->send_fb.buf == NULL)
+        data_proto->send_buf = (char *) espfsp_mem_malloc(ESPFSP_MEM_TAG_DATA_PROTO, 0, frame_config->frame_max_len);
+        if (data_proto->send_buf == NULL)
         {
             ESP_LOGE(TAG, "Cannot reinitialize memory for send frame buffer");
             return ESP_FAIL;
@@ -57,14 +59,15 @@ static esp_err_t update_frame_config(espfsp_data_proto_t *data_proto, espfsp_fra
     data_proto->frame_interval_us = (uint64_t) ((1000 / frame_config->fps) << 10);
 
     ESP_LOGI(TAG, "FPS updated to: %d", frame_config->fps);
-    ESP_LOGI(TAG, "Interval set to: %lld", data_proto->frame_interval_us);
+    ESP_LOGI(TAG, "Interval set to: %llu", (unsigned long long) data_proto->frame_interval_us);
 
     return ESP_OK;
 }
 
 esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_proto_config_t *config)
 {
-    data_proto->config = (espfsp_data_proto_config_t *) malloc(sizeof(espfsp_data_proto_config_t));
+    data_proto->config = (espfsp_data_proto_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_DATA_PROTO, 0, sizeof(espfsp_data_proto_config_t));
     if (!data_proto->config)
     {
         ESP_LOGE(TAG, "Cannot initialize memory for config");
@@ -72,11 +75,19 @@ esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_pr
     }
 
     memcpy(data_proto->config, config, sizeof(espfsp_data_proto_config_t));
+    espfsp_stream_counters_init(&data_proto->counters);
+    atomic_init(&data_proto->peer_frame_abort, false);
 
-    if (config->type == ESPFSP_DATA_PROTO_TYPE_SEND)
+    // Cleared only by espfsp_data_proto_terminate(), so it is not lost when run is entered after it
+    data_proto->en = 1;
+
+    data_proto->send_buf = NULL;
+
+    if (config->type == ESPFSP_DATA_PROTO_TYPE_SEND && config->release_frame_callback == NULL)
     {
-        data_proto->send_fb.buf = (char *) malloc(config->frame_config->frame_max_len);
-        if (data_proto->send_fb.buf == NULL)
+        data_proto->send_buf = (char *) espfsp_mem_malloc(
+            ESPFSP_MEM_TAG_DATA_PROTO, 0, config->frame_config->frame_max_len);
+        if (data_proto->send_buf == NULL)
         {
             ESP_LOGE(TAG, "Cannot initialize memory for send frame buffer");
             return ESP_FAIL;
@@ -86,7 +97,7 @@ esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_pr
     }
 
     data_proto->startStopQueue = NULL;
-    data_proto->startStopQueue = xQueueCreate(QUEUE_MAX_SIZE, sizeof(uint8_t));
+    data_proto->startStopQueue = espfsp_mem_queue_create(ESPFSP_MEM_TAG_DATA_PROTO, QUEUE_MAX_SIZE, sizeof(uint8_t));
     if (data_proto->startStopQueue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize start-stop queue");
@@ -94,7 +105,8 @@ esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_pr
     }
 
     data_proto->settingsQueue = NULL;
-    data_proto->settingsQueue = xQueueCreate(QUEUE_MAX_SIZE, sizeof(espfsp_frame_config_t));
+    data_proto->settingsQueue = espfsp_mem_queue_create(
+        ESPFSP_MEM_TAG_DATA_PROTO, QUEUE_MAX_SIZE, sizeof(espfsp_frame_config_t));
     if (data_proto->settingsQueue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize settings queue");
@@ -106,19 +118,29 @@ esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_pr
 
 esp_err_t espfsp_data_proto_deinit(espfsp_data_proto_t *data_proto)
 {
-    vQueueDelete(data_proto->startStopQueue);
-    vQueueDelete(data_proto->settingsQueue);
+    espfsp_mem_queue_delete(data_proto->startStopQueue);
+    espfsp_mem_queue_delete(data_proto->settingsQueue);
 
-    if (data_proto->config->type == ESPFSP_DATA_PROTO_TYPE_SEND)
-    {
-        free(data_proto->send_fb.buf);
-    }
-
-    free(data_proto->config);
+    espfsp_mem_free(data_proto->send_buf);
+    espfsp_mem_free(data_proto->config);
 
     return ESP_OK;
 }
 
+// frame_max_len is 0 for sender with lent frames
+void espfsp_data_proto_estimate_memory(
+    espfsp_data_proto_type_t type, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_DATA_PROTO, 0, sizeof(espfsp_data_proto_config_t));
+    espfsp_mem_estimate_add_queue(estimate, ESPFSP_MEM_TAG_DATA_PROTO, QUEUE_MAX_SIZE, sizeof(uint8_t));
+    espfsp_mem_estimate_add_queue(estimate, ESPFSP_MEM_TAG_DATA_PROTO, QUEUE_MAX_SIZE, sizeof(espfsp_frame_config_t));
+
+    if (type == ESPFSP_DATA_PROTO_TYPE_SEND && frame_max_len > 0)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_DATA_PROTO, 0, frame_max_len);
+    }
+}
+
 static esp_err_t handle_data_proto(espfsp_data_proto_t *data_proto, int sock)
 {
     esp_err_t ret = ESP_OK;
@@ -163,7 +185,6 @@ esp_err_t espfsp_data_proto_run(espfsp_data_proto_t *data_proto, int sock)
 
     data_proto->state = ESPFSP_DATA_PROTO_STATE_START_STOP_CHECK;
     data_proto->last_traffic = TRAFFIC_NO_SIGNAL;
-    data_proto->en = 1;
 
     bool started = false;
 
@@ -276,6 +297,13 @@ esp_err_t espfsp_data_proto_stop(espfsp_data_proto_t *data_proto)
     return ESP_OK;
 }
 
+esp_err_t espfsp_data_proto_terminate(espfsp_data_proto_t *data_proto)
+{
+    // Safe asynchronious write as the other task only reads this variable
+    data_proto->en = 0;
+    return ESP_OK;
+}
+
 esp_err_t espfsp_data_proto_set_frame_params(espfsp_data_proto_t *data_proto, espfsp_frame_config_t *frame_config)
 {
     xQueueReset(data_proto->settingsQueue);
@@ -288,3 +316,19 @@ esp_err_t espfsp_data_proto_set_frame_params(espfsp_data_proto_t *data_proto, es
 
     return ESP_OK;
 }
+
+void espfsp_data_proto_set_peer_frame_abort(espfsp_data_proto_t *data_proto, bool supported)
+{
+    atomic_store_explicit(&data_proto->peer_frame_abort, supported, memory_order_relaxed);
+}
+
+void espfsp_data_proto_get_stats(espfsp_data_proto_t *data_proto, espfsp_stream_stats_t *stats)
+{
+    memset(stats, 0, sizeof(espfsp_stream_stats_t));
+    espfsp_stream_counters_get(&data_proto->counters, stats);
+
+    if (data_proto->config->type == ESPFSP_DATA_PROTO_TYPE_RECV && data_proto->config->recv_buffer != NULL)
+    {
+        espfsp_message_buffer_get_stream_stats(data_proto->config->recv_buffer, stats);
+    }
+}
@@ -34,6 +34,9 @@ static esp_err_t recv_msg(espfsp_data_proto_t *data_proto, int sock)
     ret = espfsp_receive_block(sock, rx_buffer, sizeof(espfsp_message_t), &received, &recv_timeout);
     if (ret == ESP_OK && received > 0)
     {
+        espfsp_stream_counters_add(&data_proto->counters.fragments_in, 1);
+        espfsp_stream_counters_add(&data_proto->counters.bytes_in, received);
+
         // ESP_LOGI(
         //     TAG,
         //     "Received msg part: %d/%d for timestamp: sek: %lld, usek: %ld",
@@ -42,8 +45,25 @@ static esp_err_t recv_msg(espfsp_data_proto_t *data_proto, int sock)
         //     ((espfsp_message_t *)rx_buffer)->timestamp.tv_sec,
         //     ((espfsp_message_t *)rx_buffer)->timestamp.tv_usec);
 
+        // Lower layers are checked against size of their own buffers
+        uint8_t layer = MESSAGE_LAYER(((espfsp_message_t *) rx_buffer)->msg_total);
+        if (layer > 0)
+        {
+            if (layer <= data_proto->config->layer_recv_buffers_count)
+            {
+                espfsp_message_buffer_process_message(
+                    (espfsp_message_t *) rx_buffer, &data_proto->config->layer_recv_buffers[layer - 1]);
+                data_proto->last_traffic = esp_timer_get_time();
+            }
+            return ret;
+        }
+
         if (((espfsp_message_t *) rx_buffer)->len > data_proto->frame_config.frame_max_len)
         {
+            if (((espfsp_message_t *) rx_buffer)->msg_number == 0)
+            {
+                espfsp_stream_counters_add(&data_proto->counters.frames_dropped_oversize, 1);
+            }
             ESP_LOGE(TAG, "Frame to receive size is greater than allocated buffer");
             return ret;
         }
@@ -13,6 +13,7 @@
 
 #include "espfsp_config.h"
 #include "espfsp_sock_op.h"
+#include "espfsp_trace_ring.h"
 #include "data_proto/espfsp_data_signal.h"
 #include "data_proto/espfsp_data_send_proto.h"
 
@@ -22,10 +23,27 @@ static esp_err_t send_fb(espfsp_data_proto_t *data_proto, int sock, espfsp_fb_t
 {
     esp_err_t ret = ESP_OK;
     uint64_t current_time = esp_timer_get_time();
+    espfsp_send_preempt_t preempt = {
+        .after_us = data_proto->frame_interval_us * data_proto->config->preempt_after_percent / 100,
+        .newer_frame = data_proto->config->newer_frame_callback,
+        .ctx = data_proto->config->send_frame_ctx,
+        .send_abort = atomic_load_explicit(&data_proto->peer_frame_abort, memory_order_relaxed),
+        .abandoned = false,
+    };
+    bool preemptible = preempt.newer_frame != NULL && data_proto->config->preempt_after_percent > 0;
 
-    ret = espfsp_send_whole_fb_within(sock, send_fb, data_proto->frame_interval_us);
-    if (ret == ESP_OK)
+    ESPFSP_TRACE(ESPFSP_TRACE_STAGE_SEND_START, &send_fb->timestamp);
+    ret = espfsp_send_whole_fb_within(
+        sock, send_fb, 0, data_proto->frame_interval_us, &data_proto->counters, preemptible ? &preempt : NULL);
+    if (ret == ESP_OK && preempt.abandoned)
     {
+        // Newer frame is taken right away, latency does not pile up behind late one
+        espfsp_stream_counters_add(&data_proto->counters.frames_preempted, 1);
+    }
+    else if (ret == ESP_OK)
+    {
+        ESPFSP_TRACE(ESPFSP_TRACE_STAGE_SEND_END, &send_fb->timestamp);
+        espfsp_stream_counters_add(&data_proto->counters.frames_sent, 1);
         // ESP_LOGI(TAG, "Interval time: %lldms", data_proto->frame_interval_us >> 10);
         // ESP_LOGI(TAG, "Send time: %lldms", (current_time - data_proto->last_traffic) >> 10);
 
@@ -35,6 +53,26 @@ static esp_err_t send_fb(espfsp_data_proto_t *data_proto, int sock, espfsp_fb_t
     return ret;
 }
 
+// Lower layers are small, so they are sent right after frame they come from, without pacing
+static esp_err_t send_layer_fbs(espfsp_data_proto_t *data_proto, int sock, espfsp_fb_t *source_fb)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_fb_t *layer_fb = NULL;
+    uint8_t layer = 0;
+
+    while (ret == ESP_OK &&
+           data_proto->config->layer_frame_callback(source_fb, &layer_fb, &layer, data_proto->config->send_frame_ctx))
+    {
+        ret = espfsp_send_whole_fb_within(sock, layer_fb, layer, 0, &data_proto->counters, NULL);
+        if (ret == ESP_OK)
+        {
+            espfsp_stream_counters_add(&data_proto->counters.frames_sent, 1);
+        }
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_data_proto_handle_send(espfsp_data_proto_t *data_proto, int sock)
 {
     esp_err_t ret = ESP_OK;
@@ -48,6 +86,7 @@ esp_err_t espfsp_data_proto_handle_send(espfsp_data_proto_t *data_proto, int soc
     // In order to not block, it shall return after some short time in order to not trigger WD.
     // It is best not to block at all in this callback.
 
+    data_proto->send_fb.buf = data_proto->send_buf;
     ret = data_proto->config->send_frame_callback(
         &data_proto->send_fb, data_proto->config->send_frame_ctx, &frame_state, data_proto->frame_config.frame_max_len);
 
@@ -62,6 +101,17 @@ esp_err_t espfsp_data_proto_handle_send(espfsp_data_proto_t *data_proto, int soc
     {
         ret = send_fb(data_proto, sock, &data_proto->send_fb);
     }
+    if (ret == ESP_OK && frame_state == ESPFSP_DATA_PROTO_FRAME_OBTAINED && host_connected &&
+        data_proto->config->layer_frame_callback != NULL)
+    {
+        ret = send_layer_fbs(data_proto, sock, &data_proto->send_fb);
+    }
+
+    // Also frames not sent are given back, last fragment has left already
+    if (frame_state == ESPFSP_DATA_PROTO_FRAME_OBTAINED && data_proto->config->release_frame_callback != NULL)
+    {
+        data_proto->config->release_frame_callback(&data_proto->send_fb, data_proto->config->send_frame_ctx);
+    }
 
     return ret;
 }
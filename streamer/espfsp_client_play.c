@@ -8,16 +8,20 @@
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_params_map.h"
 #include "espfsp_client_play.h"
 #include "espfsp_message_buffer.h"
+#include "espfsp_trace_ring.h"
 #include "client_play/espfsp_state_def.h"
 #include "client_play/espfsp_comm_proto_conf.h"
 #include "client_play/espfsp_data_proto_conf.h"
+#include "client_play/espfsp_comm_proto_handlers.h"
 #include "client_common/espfsp_session_and_control_task.h"
 #include "client_common/espfsp_data_task.h"
 
@@ -25,14 +29,14 @@
 
 static const char *TAG = "ESPFSP_CLIENT_PLAY";
 
-static espfsp_client_play_state_t *state_ = NULL;
+static espfsp_client_play_state_t state_;
 
 static esp_err_t start_session_and_control_task(espfsp_client_play_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_client_session_and_control_task_data_t *data = (espfsp_client_session_and_control_task_data_t *) malloc(
-        sizeof(espfsp_client_session_and_control_task_data_t));
+    espfsp_client_session_and_control_task_data_t *data = (espfsp_client_session_and_control_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_session_and_control_task_data_t));
 
     if (data == NULL)
     {
@@ -42,22 +46,27 @@ static esp_err_t start_session_and_control_task(espfsp_client_play_instance_t *
 
     data->comm_proto = &instance->comm_proto;
     data->client_type = ESPFSP_COMM_REQ_CLIENT_PLAY;
+    data->simulcast_layers = 0;
     data->local_port = instance->config->local.control_port;
     data->remote_port = instance->config->remote.control_port;
     data->remote_addr.addr = instance->config->remote_addr.addr;
+    data->task_group = &instance->task_group;
+    data->resume = &instance->session_data.resume;
+    data->session_expired_cb = espfsp_client_play_connection_stop;
+    data->session_expired_ctx = (void *) instance;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_client_session_and_control_task,
         "session_and_control_task",
-        instance->config->session_and_control_task_info.stack_size,
-        (void *) data,
-        instance->config->session_and_control_task_info.task_prio,
-        &instance->session_and_control_task_handle);
+        &instance->config->session_and_control_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start session and control task");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -65,10 +74,10 @@ static esp_err_t start_session_and_control_task(espfsp_client_play_instance_t *
 
 static esp_err_t start_data_task(espfsp_client_play_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_client_data_task_data_t *data = (espfsp_client_data_task_data_t *) malloc(
-        sizeof(espfsp_client_data_task_data_t));
+    espfsp_client_data_task_data_t *data = (espfsp_client_data_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_data_task_data_t));
 
     if (data == NULL)
     {
@@ -80,19 +89,20 @@ static esp_err_t start_data_task(espfsp_client_play_instance_t * instance)
     data->local_port = instance->config->local.data_port;
     data->remote_port = instance->config->remote.data_port;
     data->remote_addr.addr = instance->config->remote_addr.addr;
+    data->task_group = &instance->task_group;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_client_data_task,
         "data_task",
-        instance->config->data_task_info.stack_size,
-        (void *) data,
-        instance->config->data_task_info.task_prio,
-        &instance->data_task_handle);
+        &instance->config->data_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -100,17 +110,8 @@ static esp_err_t start_data_task(espfsp_client_play_instance_t * instance)
 
 static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client_play_config_t *config)
 {
-    espfsp_client_play_instance_t *instance = NULL;
-
-    for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PLAY_MAX_INSTANCES; i++)
-    {
-        if (state_->instances[i].used == false)
-        {
-            state_->instances[i].used = true;
-            instance = &state_->instances[i];
-            break;
-        }
-    }
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) espfsp_instance_pool_alloc(
+        &state_.instances);
 
     if (instance == NULL)
     {
@@ -118,7 +119,8 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
         return NULL;
     }
 
-    instance->config = (espfsp_client_play_config_t *) malloc(sizeof(espfsp_client_play_config_t));
+    instance->config = (espfsp_client_play_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_play_config_t));
     if (instance->config == NULL)
     {
         ESP_LOGE(TAG, "Config is not initialized");
@@ -129,7 +131,13 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
 
     instance->session_data.session_id = -1;
     instance->session_data.active = false;
+    memset(&instance->session_data.resume, 0, sizeof(espfsp_client_session_resume_t));
     instance->session_data.stream_started = false;
+    instance->session_data.scene_static = false;
+    instance->session_data.capabilities = 0;
+    espfsp_clock_sync_init(&instance->session_data.clock_sync);
+    instance->session_data.source_clock_sync.valid = false;
+    espfsp_latency_hist_reset(&instance->session_data.latency_hist);
 
     instance->session_data.mutex = NULL;
     instance->session_data.mutex = xSemaphoreCreateBinary();
@@ -148,7 +156,8 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
     esp_err_t err = ESP_OK;
 
     instance->get_sources_data_queue = NULL;
-    instance->get_sources_data_queue = xQueueCreate(1, sizeof(espfsp_get_sources_data_t));
+    instance->get_sources_data_queue = espfsp_mem_queue_create(
+        ESPFSP_MEM_TAG_INSTANCE, 1, sizeof(espfsp_get_sources_data_t));
     if (instance->get_sources_data_queue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize queue for get sources request");
@@ -156,7 +165,8 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
     }
 
     instance->get_frame_config_data_queue = NULL;
-    instance->get_frame_config_data_queue = xQueueCreate(frame_param_map_size, sizeof(espfsp_get_param_data_t));
+    instance->get_frame_config_data_queue = espfsp_mem_queue_create(
+        ESPFSP_MEM_TAG_INSTANCE, frame_param_map_size, sizeof(espfsp_get_param_data_t));
     if (instance->get_frame_config_data_queue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize queue for get frame config");
@@ -164,7 +174,8 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
     }
 
     instance->get_cam_config_data_queue = NULL;
-    instance->get_cam_config_data_queue = xQueueCreate(cam_param_map_size, sizeof(espfsp_get_param_data_t));
+    instance->get_cam_config_data_queue = espfsp_mem_queue_create(
+        ESPFSP_MEM_TAG_INSTANCE, cam_param_map_size, sizeof(espfsp_get_param_data_t));
     if (instance->get_cam_config_data_queue == NULL)
     {
         ESP_LOGE(TAG, "Cannot initialize queue for get camera config");
@@ -196,6 +207,12 @@ static espfsp_client_play_instance_t *create_new_client_play(const espfsp_client
         return NULL;
     }
 
+    err = espfsp_task_group_init(&instance->task_group);
+    if (err != ESP_OK)
+    {
+        return NULL;
+    }
+
     err = start_session_and_control_task(instance);
     if (err != ESP_OK)
     {
@@ -216,31 +233,24 @@ static esp_err_t stop_tasks(espfsp_client_play_instance_t *instance)
     esp_err_t ret = ESP_OK;
 
     espfsp_data_proto_stop(&instance->data_proto);
+    espfsp_data_proto_terminate(&instance->data_proto);
     espfsp_comm_proto_stop(&instance->comm_proto);
 
-    // Wait for task to stop
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-    vTaskDelete(instance->data_task_handle);
-    vTaskDelete(instance->session_and_control_task_handle);
+    // Tasks exit on their own, so none of them is killed while holding mutex or memory
+    ret = espfsp_task_group_stop_and_join(&instance->task_group, ESPFSP_TASK_GROUP_JOIN_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
 
-    return ret;
+    return espfsp_task_group_deinit(&instance->task_group);
 }
 
 static esp_err_t remove_client_play(espfsp_client_play_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
 
-    bool is_given_instance_correct = false;
-    for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PLAY_MAX_INSTANCES; i++)
-    {
-        if (&state_->instances[i] == instance)
-        {
-            is_given_instance_correct = true;
-        }
-    }
-
-    if (is_given_instance_correct == false)
+    if (!espfsp_instance_pool_is_allocated(&state_.instances, instance))
     {
         ESP_LOGE(TAG, "Given instance pointer is incorrect");
         return ESP_FAIL;
@@ -270,32 +280,58 @@ static esp_err_t remove_client_play(espfsp_client_play_instance_t *instance)
         return ret;
     }
 
-    vQueueDelete(instance->get_sources_data_queue);
-    vQueueDelete(instance->get_frame_config_data_queue);
-    vQueueDelete(instance->get_cam_config_data_queue);
+    espfsp_mem_queue_delete(instance->get_sources_data_queue);
+    espfsp_mem_queue_delete(instance->get_frame_config_data_queue);
+    espfsp_mem_queue_delete(instance->get_cam_config_data_queue);
     vSemaphoreDelete(instance->session_data.mutex);
 
-    free(instance->config);
-    instance->used = false;
+    espfsp_mem_free(instance->config);
 
-    return ret;
+    return espfsp_instance_pool_free(&state_.instances, instance);
+}
+
+esp_err_t espfsp_client_play_pool_init(const espfsp_pool_config_t *pool_config)
+{
+    if (espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Client play pool already initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_init(&state_.instances, sizeof(espfsp_client_play_instance_t), pool_config);
+}
+
+esp_err_t espfsp_client_play_pool_deinit()
+{
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Client play pool is not initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_deinit(&state_.instances);
+}
+
+size_t espfsp_client_play_pool_storage_size(uint8_t max_instances)
+{
+    return espfsp_instance_pool_storage_size(sizeof(espfsp_client_play_instance_t), max_instances);
 }
 
 espfsp_client_play_handler_t espfsp_client_play_init(const espfsp_client_play_config_t *config)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
-        state_ = (espfsp_client_play_state_t *) malloc(sizeof(espfsp_client_play_state_t));
-        if (state_ == NULL)
+        espfsp_pool_config_t pool_config = {
+            .max_instances = ESPFSP_CLIENT_PLAY_DEFAULT_MAX_INSTANCES,
+            .storage = NULL,
+            .storage_len = 0,
+        };
+
+        if (espfsp_client_play_pool_init(&pool_config) != ESP_OK)
         {
             ESP_LOGE(TAG, "State initialization failed");
             return NULL;
         }
-
-        for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PLAY_MAX_INSTANCES; i++)
-        {
-            state_->instances[i].used = false;
-        }
     }
 
     espfsp_client_play_handler_t handler = (espfsp_client_play_handler_t) create_new_client_play(config);
@@ -309,7 +345,7 @@ espfsp_client_play_handler_t espfsp_client_play_init(const espfsp_client_play_co
 
 void espfsp_client_play_deinit(espfsp_client_play_handler_t handler)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
         ESP_LOGE(TAG, "Client play state is not initialized");
         return;
@@ -322,6 +358,32 @@ void espfsp_client_play_deinit(espfsp_client_play_handler_t handler)
     }
 }
 
+// Frames received before clocks are synchronized are not counted
+static void record_latency(espfsp_client_play_instance_t *instance, const espfsp_fb_t *fb)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t capture_us = (int64_t) fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return;
+    }
+
+    if (instance->session_data.clock_sync.info.valid && instance->session_data.source_clock_sync.valid)
+    {
+        int64_t local_capture_us = capture_us +
+            instance->session_data.source_clock_sync.offset_us -
+            instance->session_data.clock_sync.info.offset_us;
+        espfsp_latency_hist_add(&instance->session_data.latency_hist, now_us - local_capture_us);
+    }
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+    }
+}
+
 espfsp_fb_t *espfsp_client_play_get_fb(espfsp_client_play_handler_t handler, uint32_t timeout_ms)
 {
     espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
@@ -349,7 +411,14 @@ espfsp_fb_t *espfsp_client_play_get_fb(espfsp_client_play_handler_t handler, uin
         return NULL;
     }
 
-    return espfsp_message_buffer_get_fb(&instance->receiver_buffer, timeout_ms);
+    espfsp_fb_t *fb = espfsp_message_buffer_get_fb(&instance->receiver_buffer, timeout_ms);
+    if (fb != NULL)
+    {
+        ESPFSP_TRACE(ESPFSP_TRACE_STAGE_GET_FB, &fb->timestamp);
+        record_latency(instance, fb);
+    }
+
+    return fb;
 }
 
 esp_err_t espfsp_client_play_return_fb(espfsp_client_play_handler_t handler, espfsp_fb_t *fb)
@@ -358,6 +427,7 @@ esp_err_t espfsp_client_play_return_fb(espfsp_client_play_handler_t handler, esp
 
     esp_err_t ret = ESP_OK;
 
+    ESPFSP_TRACE(ESPFSP_TRACE_STAGE_RETURN_FB, &fb->timestamp);
     ret = espfsp_message_buffer_return_fb(&instance->receiver_buffer);
     if (ret != ESP_OK)
     {
@@ -392,29 +462,22 @@ esp_err_t espfsp_client_play_start_stream(espfsp_client_play_handler_t handler)
     }
 
     instance->session_data.stream_started = true;
+    instance->session_data.scene_static = false;
     msg.session_id = instance->session_data.session_id;
 
-    if (instance->config->frame_config.buffered_fbs != instance->receiver_buffer.config->buffered_fbs ||
-        instance->config->frame_config.fb_in_buffer_before_get != instance->receiver_buffer.config->fb_in_buffer_before_get ||
-        instance->config->frame_config.frame_max_len != instance->receiver_buffer.config->frame_max_len ||
-        instance->config->frame_config.fps != instance->receiver_buffer.config->fps)
+    espfsp_receiver_buffer_config_t new_config = {
+        .buffered_fbs = instance->config->frame_config.buffered_fbs,
+        .fb_in_buffer_before_get = instance->config->frame_config.fb_in_buffer_before_get,
+        .frame_max_len = instance->config->frame_config.frame_max_len,
+        .fps = instance->config->frame_config.fps,
+    };
+
+    ret = espfsp_message_buffer_reconfigure(&instance->receiver_buffer, &new_config);
+    if (ret != ESP_OK)
     {
-        ret = espfsp_message_buffer_deinit(&instance->receiver_buffer);
-        if (ret == ESP_OK)
-        {
-            espfsp_receiver_buffer_config_t new_config = {
-                .buffered_fbs = instance->config->frame_config.buffered_fbs,
-                .fb_in_buffer_before_get = instance->config->frame_config.fb_in_buffer_before_get,
-                .frame_max_len = instance->config->frame_config.frame_max_len,
-                .fps = instance->config->frame_config.fps,
-            };
-
-            ret = espfsp_message_buffer_init(&instance->receiver_buffer, &new_config);
-        }
-        if (ret != ESP_OK)
-        {
-            ESP_LOGE(TAG, "Receiver buffer reconfiguration failed");
-        }
+        // Stream is not started, so start can be requested again
+        ESP_LOGE(TAG, "Receiver buffer reconfiguration failed");
+        instance->session_data.stream_started = false;
     }
 
     if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
@@ -830,3 +893,152 @@ esp_err_t espfsp_client_play_set_source(
 
     return espfsp_comm_proto_source_set(&instance->comm_proto, &msg);
 }
+
+esp_err_t espfsp_client_play_get_clock_sync(espfsp_client_play_handler_t handler, espfsp_clock_sync_info_t *info)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    memcpy(info, &instance->session_data.clock_sync.info, sizeof(espfsp_clock_sync_info_t));
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_client_play_capture_time_to_local(
+    espfsp_client_play_handler_t handler, const espfsp_fb_t *fb, int64_t *local_time_us)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
+    int64_t capture_us = (int64_t) fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    // Source clock -> server clock -> local clock
+    if (instance->session_data.clock_sync.info.valid && instance->session_data.source_clock_sync.valid)
+    {
+        *local_time_us = capture_us +
+            instance->session_data.source_clock_sync.offset_us -
+            instance->session_data.clock_sync.info.offset_us;
+    }
+    else
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_client_play_get_latency_stats(espfsp_client_play_handler_t handler, espfsp_latency_stats_t *stats)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    espfsp_latency_hist_get_stats(&instance->session_data.latency_hist, stats);
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_client_play_reset_latency_stats(espfsp_client_play_handler_t handler)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    espfsp_latency_hist_reset(&instance->session_data.latency_hist);
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_client_play_get_stats(espfsp_client_play_handler_t handler, espfsp_client_stats_t *stats)
+{
+    espfsp_client_play_instance_t *instance = (espfsp_client_play_instance_t *) handler;
+
+    espfsp_data_proto_get_stats(&instance->data_proto, &stats->stream);
+
+    if (xSemaphoreTake(instance->session_data.mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    stats->session_id = instance->session_data.session_id;
+    stats->session_active = instance->session_data.active;
+    stats->stream_started = instance->session_data.stream_started;
+    stats->scene_static = instance->session_data.scene_static;
+    memcpy(&stats->clock_sync, &instance->session_data.clock_sync.info, sizeof(espfsp_clock_sync_info_t));
+
+    if (xSemaphoreGive(instance->session_data.mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    espfsp_mem_get_stats(&stats->memory);
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_client_play_estimate_memory(const espfsp_client_play_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_receiver_buffer_config_t receiver_buffer_config = {
+        .buffered_fbs = config->frame_config.buffered_fbs,
+        .frame_max_len = config->frame_config.frame_max_len,
+    };
+
+    memset(estimate, 0, sizeof(espfsp_mem_estimate_t));
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_play_config_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_session_and_control_task_data_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_data_task_data_t));
+    espfsp_mem_estimate_add_queue(estimate, ESPFSP_MEM_TAG_INSTANCE, 1, sizeof(espfsp_get_sources_data_t));
+    espfsp_mem_estimate_add_queue(estimate, ESPFSP_MEM_TAG_INSTANCE, frame_param_map_size, sizeof(espfsp_get_param_data_t));
+    espfsp_mem_estimate_add_queue(estimate, ESPFSP_MEM_TAG_INSTANCE, cam_param_map_size, sizeof(espfsp_get_param_data_t));
+
+    espfsp_message_buffer_estimate_memory(&receiver_buffer_config, estimate);
+    espfsp_client_play_comm_protos_estimate_memory(estimate);
+    espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_RECV, config->frame_config.frame_max_len, estimate);
+
+    return ESP_OK;
+}
@@ -12,23 +12,25 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_client_push.h"
 #include "client_push/espfsp_state_def.h"
 #include "client_push/espfsp_comm_proto_conf.h"
 #include "client_push/espfsp_data_proto_conf.h"
+#include "client_push/espfsp_comm_proto_handlers.h"
 #include "client_common/espfsp_data_task.h"
 #include "client_common/espfsp_session_and_control_task.h"
 
 static const char *TAG = "ESPFSP_CLIENT_PUSH";
 
-static espfsp_client_push_state_t *state_ = NULL;
+static espfsp_client_push_state_t state_;
 
 static esp_err_t start_session_and_control_task(espfsp_client_push_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_client_session_and_control_task_data_t *data = (espfsp_client_session_and_control_task_data_t *) malloc(
-        sizeof(espfsp_client_session_and_control_task_data_t));
+    espfsp_client_session_and_control_task_data_t *data = (espfsp_client_session_and_control_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_session_and_control_task_data_t));
 
     if (data == NULL)
     {
@@ -38,22 +40,27 @@ static esp_err_t start_session_and_control_task(espfsp_client_push_instance_t *
 
     data->comm_proto = &instance->comm_proto;
     data->client_type = ESPFSP_COMM_REQ_CLIENT_PUSH;
+    data->simulcast_layers = instance->simulcast.count;
     data->local_port = instance->config->local.control_port;
     data->remote_port = instance->config->remote.control_port;
     data->remote_addr.addr = instance->config->remote_addr.addr;
+    data->task_group = &instance->task_group;
+    data->resume = &instance->session_data.resume;
+    data->session_expired_cb = espfsp_client_push_connection_stop;
+    data->session_expired_ctx = (void *) instance;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_client_session_and_control_task,
         "session_and_control_task",
-        instance->config->session_and_control_task_info.stack_size,
-        (void *) data,
-        instance->config->session_and_control_task_info.task_prio,
-        &instance->session_and_control_task_handle);
+        &instance->config->session_and_control_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start session and control task");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -61,10 +68,10 @@ static esp_err_t start_session_and_control_task(espfsp_client_push_instance_t *
 
 static esp_err_t start_data_task(espfsp_client_push_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_client_data_task_data_t *data = (espfsp_client_data_task_data_t *) malloc(
-        sizeof(espfsp_client_data_task_data_t));
+    espfsp_client_data_task_data_t *data = (espfsp_client_data_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_data_task_data_t));
 
     if (data == NULL)
     {
@@ -76,45 +83,77 @@ static esp_err_t start_data_task(espfsp_client_push_instance_t * instance)
     data->local_port = instance->config->local.data_port;
     data->remote_port = instance->config->remote.data_port;
     data->remote_addr.addr = instance->config->remote_addr.addr;
+    data->task_group = &instance->task_group;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_client_data_task,
         "data_task",
-        instance->config->data_task_info.stack_size,
-        (void *) data,
-        instance->config->data_task_info.task_prio,
-        &instance->data_task_handle);
+        &instance->config->data_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
 }
 
-static espfsp_client_push_instance_t *create_new_client_push(const espfsp_client_push_config_t *config)
+static void capture_task(void *pvParameters)
 {
-    espfsp_client_push_instance_t *instance = NULL;
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) pvParameters;
 
-    for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PUSH_MAX_INSTANCES; i++)
+    espfsp_capture_pipeline_run(&instance->capture_pipeline, &instance->task_group);
+    espfsp_task_group_exit(&instance->task_group);
+}
+
+static esp_err_t start_capture_task(espfsp_client_push_instance_t * instance)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (!espfsp_capture_pipeline_is_enabled(&instance->capture_pipeline))
     {
-        if (state_->instances[i].used == false)
-        {
-            state_->instances[i].used = true;
-            instance = &state_->instances[i];
-            break;
-        }
+        return ESP_OK;
     }
 
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
+        capture_task,
+        "capture_task",
+        &instance->config->capture_task_info,
+        (void *) instance);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not start capture task");
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
+static espfsp_client_push_instance_t *create_new_client_push(const espfsp_client_push_config_t *config)
+{
+    if (config->cb.acquire_frame != NULL && config->cb.release_frame == NULL)
+    {
+        ESP_LOGE(TAG, "Lent frames have to be released");
+        return NULL;
+    }
+
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) espfsp_instance_pool_alloc(
+        &state_.instances);
+
     if (instance == NULL)
     {
         ESP_LOGE(TAG, "No free instance to create client push");
         return NULL;
     }
 
-    instance->config = (espfsp_client_push_config_t *) malloc(sizeof(espfsp_client_push_config_t));
+    instance->config = (espfsp_client_push_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_push_config_t));
     if (instance->config == NULL)
     {
         ESP_LOGE(TAG, "Config is not initialized");
@@ -125,7 +164,24 @@ static espfsp_client_push_instance_t *create_new_client_push(const espfsp_client
 
     instance->session_data.session_id = -123;
     instance->session_data.active = false;
+    memset(&instance->session_data.resume, 0, sizeof(espfsp_client_session_resume_t));
     instance->session_data.camera_started = false;
+    instance->session_data.capabilities = 0;
+
+    espfsp_clock_sync_init(&instance->clock_sync);
+    instance->clock_sync_mutex = NULL;
+    instance->clock_sync_mutex = xSemaphoreCreateBinary();
+    if (instance->clock_sync_mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        return NULL;
+    }
+
+    if (xSemaphoreGive(instance->clock_sync_mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give after init semaphore");
+        return NULL;
+    }
 
     esp_err_t err = ESP_OK;
 
@@ -135,12 +191,38 @@ static espfsp_client_push_instance_t *create_new_client_push(const espfsp_client
         return NULL;
     }
 
+    // Frames lent by camera driver are already buffered by driver, so pipeline is not used for them
+    uint8_t send_buffers = config->cb.acquire_frame != NULL ? 0 : config->send_buffers;
+
+    // Data protocol takes lent frames when pipeline is enabled
+    err = espfsp_capture_pipeline_init(
+        &instance->capture_pipeline, send_buffers, config->frame_config.frame_max_len, config->cb.send_frame);
+    if (err != ESP_OK)
+    {
+        return NULL;
+    }
+
+    espfsp_scene_detector_init(&instance->scene_detector, &config->static_scene);
+
+    err = espfsp_simulcast_layers_init(
+        &instance->simulcast, config->simulcast_layers, config->simulcast, config->cb.derive_layer);
+    if (err != ESP_OK)
+    {
+        return NULL;
+    }
+
     err = espfsp_client_push_data_protos_init(instance);
     if (err != ESP_OK)
     {
         return NULL;
     }
 
+    err = espfsp_task_group_init(&instance->task_group);
+    if (err != ESP_OK)
+    {
+        return NULL;
+    }
+
     err = start_session_and_control_task(instance);
     if (err != ESP_OK)
     {
@@ -153,6 +235,12 @@ static espfsp_client_push_instance_t *create_new_client_push(const espfsp_client
         return NULL;
     }
 
+    err = start_capture_task(instance);
+    if (err != ESP_OK)
+    {
+        return NULL;
+    }
+
     return instance;
 }
 
@@ -161,31 +249,24 @@ static esp_err_t stop_tasks(espfsp_client_push_instance_t *instance)
     esp_err_t ret = ESP_OK;
 
     espfsp_data_proto_stop(&instance->data_proto);
+    espfsp_data_proto_terminate(&instance->data_proto);
     espfsp_comm_proto_stop(&instance->comm_proto);
 
-    // Wait for task to stop
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-
-    vTaskDelete(instance->data_task_handle);
-    vTaskDelete(instance->session_and_control_task_handle);
+    // Tasks exit on their own, so none of them is killed while holding mutex or memory
+    ret = espfsp_task_group_stop_and_join(&instance->task_group, ESPFSP_TASK_GROUP_JOIN_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
 
-    return ret;
+    return espfsp_task_group_deinit(&instance->task_group);
 }
 
 static esp_err_t remove_client_push(espfsp_client_push_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
 
-    bool is_given_instance_correct = false;
-    for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PUSH_MAX_INSTANCES; i++)
-    {
-        if (&state_->instances[i] == instance)
-        {
-            is_given_instance_correct = true;
-        }
-    }
-
-    if (is_given_instance_correct == false)
+    if (!espfsp_instance_pool_is_allocated(&state_.instances, instance))
     {
         ESP_LOGE(TAG, "Given instance pointer is incorrect");
         return ESP_FAIL;
@@ -203,33 +284,72 @@ static esp_err_t remove_client_push(espfsp_client_push_instance_t *instance)
         return ret;
     }
 
+    ret = espfsp_capture_pipeline_deinit(&instance->capture_pipeline);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    ret = espfsp_simulcast_layers_deinit(&instance->simulcast);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
     ret = espfsp_client_push_comm_protos_deinit(instance);
     if (ret != ESP_OK)
     {
         return ret;
     }
 
-    free(instance->config);
-    instance->used = false;
+    vSemaphoreDelete(instance->clock_sync_mutex);
+    espfsp_mem_free(instance->config);
 
-    return ret;
+    return espfsp_instance_pool_free(&state_.instances, instance);
+}
+
+esp_err_t espfsp_client_push_pool_init(const espfsp_pool_config_t *pool_config)
+{
+    if (espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Client push pool already initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_init(&state_.instances, sizeof(espfsp_client_push_instance_t), pool_config);
+}
+
+esp_err_t espfsp_client_push_pool_deinit()
+{
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Client push pool is not initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_deinit(&state_.instances);
+}
+
+size_t espfsp_client_push_pool_storage_size(uint8_t max_instances)
+{
+    return espfsp_instance_pool_storage_size(sizeof(espfsp_client_push_instance_t), max_instances);
 }
 
 espfsp_client_push_handler_t espfsp_client_push_init(const espfsp_client_push_config_t *config)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
-        state_ = (espfsp_client_push_state_t *) malloc(sizeof(espfsp_client_push_state_t));
-        if (state_ == NULL)
+        espfsp_pool_config_t pool_config = {
+            .max_instances = ESPFSP_CLIENT_PUSH_DEFAULT_MAX_INSTANCES,
+            .storage = NULL,
+            .storage_len = 0,
+        };
+
+        if (espfsp_client_push_pool_init(&pool_config) != ESP_OK)
         {
             ESP_LOGE(TAG, "State initialization failed");
             return NULL;
         }
-
-        for (int i = 0; i < CONFIG_ESPFSP_CLIENT_PUSH_MAX_INSTANCES; i++)
-        {
-            state_->instances[i].used = false;
-        }
     }
 
     espfsp_client_push_handler_t handler = (espfsp_client_push_handler_t) create_new_client_push(config);
@@ -243,7 +363,7 @@ espfsp_client_push_handler_t espfsp_client_push_init(const espfsp_client_push_co
 
 void espfsp_client_push_deinit(espfsp_client_push_handler_t handler)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
         ESP_LOGE(TAG, "Client push state is not initialized");
         return;
@@ -255,3 +375,69 @@ void espfsp_client_push_deinit(espfsp_client_push_handler_t handler)
         ESP_LOGE(TAG, "Client push removal failed");
     }
 }
+
+esp_err_t espfsp_client_push_get_clock_sync(espfsp_client_push_handler_t handler, espfsp_clock_sync_info_t *info)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) handler;
+
+    if (xSemaphoreTake(instance->clock_sync_mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    memcpy(info, &instance->clock_sync.info, sizeof(espfsp_clock_sync_info_t));
+
+    if (xSemaphoreGive(instance->clock_sync_mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_client_push_get_stats(espfsp_client_push_handler_t handler, espfsp_client_stats_t *stats)
+{
+    espfsp_client_push_instance_t *instance = (espfsp_client_push_instance_t *) handler;
+
+    espfsp_data_proto_get_stats(&instance->data_proto, &stats->stream);
+
+    // Session data is owned by session task, single fields are read as snapshot
+    stats->session_id = instance->session_data.session_id;
+    stats->session_active = instance->session_data.active;
+    stats->stream_started = instance->session_data.camera_started;
+    stats->scene_static = espfsp_scene_detector_is_static(&instance->scene_detector);
+    espfsp_mem_get_stats(&stats->memory);
+
+    return espfsp_client_push_get_clock_sync(handler, &stats->clock_sync);
+}
+
+esp_err_t espfsp_client_push_estimate_memory(const espfsp_client_push_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    memset(estimate, 0, sizeof(espfsp_mem_estimate_t));
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_push_config_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_session_and_control_task_data_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_client_data_task_data_t));
+
+    espfsp_client_push_comm_protos_estimate_memory(estimate);
+
+    if (config->cb.acquire_frame != NULL)
+    {
+        espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_SEND, 0, estimate);
+    }
+    else if (config->send_buffers >= 2)
+    {
+        espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_SEND, 0, estimate);
+        espfsp_capture_pipeline_estimate_memory(config->send_buffers, config->frame_config.frame_max_len, estimate);
+    }
+    else
+    {
+        espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_SEND, config->frame_config.frame_max_len, estimate);
+    }
+
+    espfsp_simulcast_layers_estimate_memory(config->simulcast_layers, config->simulcast, estimate);
+
+    return ESP_OK;
+}
@@ -0,0 +1,61 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "espfsp_clock_sync.h"
+
+void espfsp_clock_sync_init(espfsp_clock_sync_t *sync)
+{
+    sync->samples_count = 0;
+    sync->next_sample = 0;
+    sync->info.rtt_us = 0;
+    sync->info.offset_us = 0;
+    sync->info.valid = false;
+}
+
+void espfsp_clock_sync_update(espfsp_clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4)
+{
+    int64_t rtt = (t4 - t1) - (t3 - t2);
+    int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+    if (rtt < 0)
+    {
+        rtt = 0;
+    }
+
+    sync->rtt_samples_us[sync->next_sample] = rtt;
+    sync->offset_samples_us[sync->next_sample] = offset;
+    sync->next_sample = (sync->next_sample + 1) % ESPFSP_CLOCK_SYNC_SAMPLES;
+    if (sync->samples_count < ESPFSP_CLOCK_SYNC_SAMPLES)
+    {
+        sync->samples_count++;
+    }
+
+    // Smoothed as TCP SRTT
+    if (!sync->info.valid)
+    {
+        sync->info.rtt_us = rtt;
+    }
+    else
+    {
+        sync->info.rtt_us += (rtt - sync->info.rtt_us) / 8;
+    }
+
+    // Offset is taken from sample with lowest RTT, as it was least delayed by queues and socket
+    // polling, so its error caused by path asymmetry is smallest
+    int best = 0;
+    for (int i = 1; i < sync->samples_count; i++)
+    {
+        if (sync->rtt_samples_us[i] < sync->rtt_samples_us[best])
+        {
+            best = i;
+        }
+    }
+
+    sync->info.offset_us = sync->offset_samples_us[best];
+    sync->info.valid = true;
+}
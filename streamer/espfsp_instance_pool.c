@@ -0,0 +1,150 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "espfsp_mem_alloc.h"
+#include "espfsp_instance_pool.h"
+
+#define INSTANCE_POOL_ALIGN 8
+
+static const char *TAG = "ESPFSP_INSTANCE_POOL";
+
+static size_t align_up(size_t len)
+{
+    return (len + INSTANCE_POOL_ALIGN - 1) & ~((size_t) INSTANCE_POOL_ALIGN - 1);
+}
+
+size_t espfsp_instance_pool_storage_size(size_t slot_size, uint8_t max_slots)
+{
+    // Used flags first, then slots
+    return align_up(max_slots * sizeof(bool)) + max_slots * align_up(slot_size);
+}
+
+esp_err_t espfsp_instance_pool_init(espfsp_instance_pool_t *pool, size_t slot_size, const espfsp_pool_config_t *config)
+{
+    size_t storage_len = espfsp_instance_pool_storage_size(slot_size, config->max_instances);
+    uint8_t *storage = (uint8_t *) config->storage;
+
+    if (config->max_instances == 0)
+    {
+        ESP_LOGE(TAG, "Pool needs at least one instance");
+        return ESP_FAIL;
+    }
+
+    if (storage != NULL && (config->storage_len < storage_len || ((uintptr_t) storage % INSTANCE_POOL_ALIGN) != 0))
+    {
+        ESP_LOGE(TAG, "Given storage too small or not aligned, %d bytes needed", (int) storage_len);
+        return ESP_FAIL;
+    }
+
+    pool->own_storage = storage == NULL;
+    if (pool->own_storage)
+    {
+        storage = (uint8_t *) espfsp_mem_malloc(ESPFSP_MEM_TAG_INSTANCE, 0, storage_len);
+        if (storage == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot allocate memory for pool");
+            return ESP_FAIL;
+        }
+    }
+
+    memset(storage, 0, storage_len);
+
+    pool->used = (bool *) storage;
+    pool->slots = storage + align_up(config->max_instances * sizeof(bool));
+    pool->slot_size = align_up(slot_size);
+    pool->max_slots = config->max_instances;
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_instance_pool_deinit(espfsp_instance_pool_t *pool)
+{
+    for (int i = 0; i < pool->max_slots; i++)
+    {
+        if (pool->used[i])
+        {
+            ESP_LOGE(TAG, "Pool still has instances");
+            return ESP_FAIL;
+        }
+    }
+
+    if (pool->own_storage)
+    {
+        espfsp_mem_free(pool->used);
+    }
+
+    pool->slots = NULL;
+    pool->used = NULL;
+    pool->max_slots = 0;
+
+    return ESP_OK;
+}
+
+bool espfsp_instance_pool_is_initialized(const espfsp_instance_pool_t *pool)
+{
+    return pool->slots != NULL;
+}
+
+void *espfsp_instance_pool_alloc(espfsp_instance_pool_t *pool)
+{
+    for (int i = 0; i < pool->max_slots; i++)
+    {
+        if (!pool->used[i])
+        {
+            uint8_t *slot = pool->slots + i * pool->slot_size;
+
+            pool->used[i] = true;
+            memset(slot, 0, pool->slot_size);
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+static int find_slot_index(const espfsp_instance_pool_t *pool, const void *slot)
+{
+    const uint8_t *ptr = (const uint8_t *) slot;
+
+    if (pool->slots == NULL || ptr < pool->slots || ptr >= pool->slots + pool->max_slots * pool->slot_size)
+    {
+        return -1;
+    }
+
+    if ((ptr - pool->slots) % pool->slot_size != 0)
+    {
+        return -1;
+    }
+
+    return (ptr - pool->slots) / pool->slot_size;
+}
+
+esp_err_t espfsp_instance_pool_free(espfsp_instance_pool_t *pool, void *slot)
+{
+    int index = find_slot_index(pool, slot);
+
+    if (index < 0 || !pool->used[index])
+    {
+        ESP_LOGE(TAG, "Pointer is not allocated from pool");
+        return ESP_FAIL;
+    }
+
+    pool->used[index] = false;
+    return ESP_OK;
+}
+
+bool espfsp_instance_pool_is_allocated(const espfsp_instance_pool_t *pool, const void *slot)
+{
+    int index = find_slot_index(pool, slot);
+
+    return index >= 0 && pool->used[index];
+}
@@ -0,0 +1,110 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "espfsp_latency_hist.h"
+
+#define LINEAR_BUCKET_SHIFT 7
+#define LINEAR_LIMIT_US (ESPFSP_LATENCY_HIST_LINEAR_BUCKETS << LINEAR_BUCKET_SHIFT)
+
+static int get_bucket(uint32_t value_us)
+{
+    if (value_us < LINEAR_LIMIT_US)
+    {
+        return value_us >> LINEAR_BUCKET_SHIFT;
+    }
+
+    int msb = 31 - __builtin_clz(value_us);
+    int octave = msb - (31 - __builtin_clz(LINEAR_LIMIT_US)) + 1;
+    if (octave > ESPFSP_LATENCY_HIST_OCTAVES)
+    {
+        return ESPFSP_LATENCY_HIST_BUCKETS - 1;
+    }
+
+    // Three bits below most significant one select sub-bucket
+    int sub = (value_us >> (msb - 3)) & 0x7;
+    return octave * ESPFSP_LATENCY_HIST_LINEAR_BUCKETS + sub;
+}
+
+// Middle of bucket
+static uint32_t get_bucket_value(int bucket)
+{
+    int octave = bucket / ESPFSP_LATENCY_HIST_LINEAR_BUCKETS;
+    int sub = bucket % ESPFSP_LATENCY_HIST_LINEAR_BUCKETS;
+
+    if (octave == 0)
+    {
+        return (sub << LINEAR_BUCKET_SHIFT) + (1 << (LINEAR_BUCKET_SHIFT - 1));
+    }
+
+    int msb = octave + (31 - __builtin_clz(LINEAR_LIMIT_US)) - 1;
+    uint32_t width = 1U << (msb - 3);
+    return (1U << msb) + sub * width + width / 2;
+}
+
+static uint32_t get_percentile(const espfsp_latency_hist_t *hist, uint32_t permille)
+{
+    uint32_t rank = (uint32_t) (((uint64_t) hist->count * permille + 999) / 1000);
+    uint32_t seen = 0;
+
+    for (int i = 0; i < ESPFSP_LATENCY_HIST_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+        if (seen >= rank && hist->buckets[i] > 0)
+        {
+            uint32_t value = get_bucket_value(i);
+            // Keep within observed range, bucket middle could be outside of it
+            value = value < hist->min_us ? hist->min_us : value;
+            return value > hist->max_us ? hist->max_us : value;
+        }
+    }
+
+    return hist->max_us;
+}
+
+void espfsp_latency_hist_reset(espfsp_latency_hist_t *hist)
+{
+    memset(hist->buckets, 0, sizeof(hist->buckets));
+    hist->count = 0;
+    hist->min_us = UINT32_MAX;
+    hist->max_us = 0;
+    hist->start_us = esp_timer_get_time();
+}
+
+void espfsp_latency_hist_add(espfsp_latency_hist_t *hist, int64_t latency_us)
+{
+    // Negative value is error of clock offset estimate
+    uint32_t value_us = latency_us < 0 ? 0 : (latency_us > UINT32_MAX ? UINT32_MAX : (uint32_t) latency_us);
+
+    hist->buckets[get_bucket(value_us)]++;
+    hist->count++;
+    hist->min_us = value_us < hist->min_us ? value_us : hist->min_us;
+    hist->max_us = value_us > hist->max_us ? value_us : hist->max_us;
+}
+
+void espfsp_latency_hist_get_stats(const espfsp_latency_hist_t *hist, espfsp_latency_stats_t *stats)
+{
+    stats->count = hist->count;
+    stats->window_us = esp_timer_get_time() - hist->start_us;
+
+    if (hist->count == 0)
+    {
+        stats->min_us = 0;
+        stats->p50_us = 0;
+        stats->p90_us = 0;
+        stats->p99_us = 0;
+        stats->max_us = 0;
+        return;
+    }
+
+    stats->min_us = hist->min_us;
+    stats->p50_us = get_percentile(hist, 500);
+    stats->p90_us = get_percentile(hist, 900);
+    stats->p99_us = get_percentile(hist, 990);
+    stats->max_us = hist->max_us;
+}
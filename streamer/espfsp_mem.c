@@ -0,0 +1,241 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "espfsp_mem_alloc.h"
+
+// Keeps alignment given by heap for user part of block
+typedef struct
+{
+    uint32_t size;          // Accounted bytes, header included
+    uint16_t offset;        // From start of heap block to user part
+    uint8_t tag;
+    uint8_t cap;
+} mem_header_t;
+
+_Static_assert(sizeof(mem_header_t) == 8, "Header has to keep 8 byte alignment");
+
+// Statistics are only reported, so relaxed atomics are enough
+typedef struct
+{
+    _Atomic uint32_t current_bytes;
+    _Atomic uint32_t peak_bytes;
+    _Atomic uint32_t blocks;
+    _Atomic uint32_t failures;
+    _Atomic uint32_t allocations;
+} mem_usage_t;
+
+static const char *TAG = "ESPFSP_MEM";
+
+static mem_usage_t tags_[ESPFSP_MEM_TAG_MAX];
+static mem_usage_t caps_[ESPFSP_MEM_CAP_MAX];
+static mem_usage_t total_;
+
+static espfsp_mem_cap_t get_cap(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? ESPFSP_MEM_CAP_SPIRAM : ESPFSP_MEM_CAP_DEFAULT;
+}
+
+static void usage_add(mem_usage_t *usage, uint32_t size)
+{
+    uint32_t current = atomic_fetch_add_explicit(&usage->current_bytes, size, memory_order_relaxed) + size;
+    uint32_t peak = atomic_load_explicit(&usage->peak_bytes, memory_order_relaxed);
+
+    while (current > peak &&
+           !atomic_compare_exchange_weak_explicit(
+               &usage->peak_bytes, &peak, current, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+
+    atomic_fetch_add_explicit(&usage->blocks, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&usage->allocations, 1, memory_order_relaxed);
+}
+
+static void usage_sub(mem_usage_t *usage, uint32_t size)
+{
+    atomic_fetch_sub_explicit(&usage->current_bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&usage->blocks, 1, memory_order_relaxed);
+}
+
+static void usage_fail(mem_usage_t *usage)
+{
+    atomic_fetch_add_explicit(&usage->failures, 1, memory_order_relaxed);
+}
+
+static void usage_get(mem_usage_t *usage, espfsp_mem_usage_t *out)
+{
+    out->current_bytes = atomic_load_explicit(&usage->current_bytes, memory_order_relaxed);
+    out->peak_bytes = atomic_load_explicit(&usage->peak_bytes, memory_order_relaxed);
+    out->blocks = atomic_load_explicit(&usage->blocks, memory_order_relaxed);
+    out->failures = atomic_load_explicit(&usage->failures, memory_order_relaxed);
+    out->allocations = atomic_load_explicit(&usage->allocations, memory_order_relaxed);
+}
+
+static void usage_reset_peak(mem_usage_t *usage)
+{
+    atomic_store_explicit(
+        &usage->peak_bytes, atomic_load_explicit(&usage->current_bytes, memory_order_relaxed), memory_order_relaxed);
+}
+
+static void *account_block(uint8_t *block, espfsp_mem_tag_t tag, uint32_t caps, size_t offset, size_t size)
+{
+    espfsp_mem_cap_t cap = get_cap(caps);
+
+    if (block == NULL)
+    {
+        usage_fail(&tags_[tag]);
+        usage_fail(&caps_[cap]);
+        usage_fail(&total_);
+        ESP_LOGE(TAG, "Allocation of %d bytes failed, tag %d", (int) size, (int) tag);
+        return NULL;
+    }
+
+    mem_header_t *header = (mem_header_t *) (block + offset) - 1;
+    header->size = offset + size;
+    header->offset = offset;
+    header->tag = tag;
+    header->cap = cap;
+
+    usage_add(&tags_[tag], header->size);
+    usage_add(&caps_[cap], header->size);
+    usage_add(&total_, header->size);
+
+    return block + offset;
+}
+
+void *espfsp_mem_malloc(espfsp_mem_tag_t tag, uint32_t caps, size_t size)
+{
+    size_t block_size = sizeof(mem_header_t) + size;
+    uint8_t *block = (uint8_t *) (caps == 0 ? malloc(block_size) : heap_caps_malloc(block_size, caps));
+
+    return account_block(block, tag, caps, sizeof(mem_header_t), size);
+}
+
+void *espfsp_mem_calloc(espfsp_mem_tag_t tag, uint32_t caps, size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size)
+    {
+        return account_block(NULL, tag, caps, 0, 0);
+    }
+
+    void *ptr = espfsp_mem_malloc(tag, caps, n * size);
+    if (ptr != NULL)
+    {
+        memset(ptr, 0, n * size);
+    }
+
+    return ptr;
+}
+
+void *espfsp_mem_aligned_alloc(espfsp_mem_tag_t tag, uint32_t caps, size_t alignment, size_t size)
+{
+    // Whole alignment is spent on header, so user part is aligned as heap block
+    uint8_t *block = (uint8_t *) heap_caps_aligned_alloc(alignment, alignment + size, caps == 0 ? MALLOC_CAP_DEFAULT : caps);
+
+    return account_block(block, tag, caps, alignment, size);
+}
+
+void espfsp_mem_free(void *ptr)
+{
+    if (ptr == NULL)
+    {
+        return;
+    }
+
+    mem_header_t *header = (mem_header_t *) ptr - 1;
+
+    usage_sub(&tags_[header->tag], header->size);
+    usage_sub(&caps_[header->cap], header->size);
+    usage_sub(&total_, header->size);
+
+    heap_caps_free((uint8_t *) ptr - header->offset);
+}
+
+QueueHandle_t espfsp_mem_queue_create(espfsp_mem_tag_t tag, UBaseType_t len, UBaseType_t item_size)
+{
+    // Control block first, so handle is also address of accounted block
+    uint8_t *block = (uint8_t *) espfsp_mem_malloc(tag, 0, sizeof(StaticQueue_t) + len * item_size);
+    if (block == NULL)
+    {
+        return NULL;
+    }
+
+    QueueHandle_t queue = xQueueCreateStatic(len, item_size, block + sizeof(StaticQueue_t), (StaticQueue_t *) block);
+    if (queue == NULL)
+    {
+        espfsp_mem_free(block);
+    }
+
+    return queue;
+}
+
+void espfsp_mem_queue_delete(QueueHandle_t queue)
+{
+    vQueueDelete(queue);
+    espfsp_mem_free((void *) queue);
+}
+
+static void estimate_add(espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, uint32_t caps, size_t size)
+{
+    estimate->tags[tag] += size;
+    estimate->caps[get_cap(caps)] += size;
+    estimate->total += size;
+}
+
+void espfsp_mem_estimate_add(espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, uint32_t caps, size_t size)
+{
+    estimate_add(estimate, tag, caps, sizeof(mem_header_t) + size);
+}
+
+void espfsp_mem_estimate_add_aligned(
+    espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, uint32_t caps, size_t alignment, size_t size)
+{
+    estimate_add(estimate, tag, caps, alignment + size);
+}
+
+void espfsp_mem_estimate_add_queue(
+    espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, UBaseType_t len, UBaseType_t item_size)
+{
+    espfsp_mem_estimate_add(estimate, tag, 0, sizeof(StaticQueue_t) + len * item_size);
+}
+
+void espfsp_mem_get_stats(espfsp_mem_stats_t *stats)
+{
+    for (int i = 0; i < ESPFSP_MEM_TAG_MAX; i++)
+    {
+        usage_get(&tags_[i], &stats->tags[i]);
+    }
+
+    for (int i = 0; i < ESPFSP_MEM_CAP_MAX; i++)
+    {
+        usage_get(&caps_[i], &stats->caps[i]);
+    }
+
+    usage_get(&total_, &stats->total);
+}
+
+void espfsp_mem_reset_peaks(void)
+{
+    for (int i = 0; i < ESPFSP_MEM_TAG_MAX; i++)
+    {
+        usage_reset_peak(&tags_[i]);
+    }
+
+    for (int i = 0; i < ESPFSP_MEM_CAP_MAX; i++)
+    {
+        usage_reset_peak(&caps_[i]);
+    }
+
+    usage_reset_peak(&total_);
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <stdalign.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <sys/time.h>
 
 #include "esp_err.h"
@@ -16,29 +17,25 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_message_buffer.h"
 #include "espfsp_message_defs.h"
+#include "espfsp_trace_ring.h"
 
-static const char *TAG = "ESPFSP_MESSAGE_BUFFER";
-
-static bool is_assembly_producer_owner(const espfsp_message_assembly_t *assembly)
-{
-    return (assembly->bits & MSG_ASS_OWNED_BIT) == MSG_ASS_PRODUCER_OWNED_VAL;
-}
+// Frame intervals that relayout waits for consumer to return held FB
+#define MESSAGE_BUFFER_CONSUMER_OUT_FRAMES 4
 
-// static bool is_assembly_consumer_owner(const espfsp_message_assembly_t *assembly)
-// {
-//     return (assembly->bits & MSG_ASS_OWNED_BIT) == MSG_ASS_CONSUMER_OWNED_VAL;
-// }
+static const char *TAG = "ESPFSP_MESSAGE_BUFFER";
 
-static bool is_assembly_used(const espfsp_message_assembly_t *assembly)
+static uint8_t get_assembly_state(espfsp_message_assembly_t *assembly)
 {
-    return (assembly->bits & MSG_ASS_USAGE_BIT) == MSG_ASS_USED_VAL;
+    return atomic_load_explicit(&assembly->state, memory_order_acquire);
 }
 
-static bool is_assembly_free(const espfsp_message_assembly_t *assembly)
+// Release makes assembly content visible to the next owner
+static void set_assembly_state(espfsp_message_assembly_t *assembly, uint8_t state)
 {
-    return (assembly->bits & MSG_ASS_USAGE_BIT) == MSG_ASS_FREE_VAL;
+    atomic_store_explicit(&assembly->state, state, memory_order_release);
 }
 
 static bool is_earlier(const struct timeval *lh, const struct timeval *rh)
@@ -57,7 +54,7 @@ static espfsp_message_assembly_t *get_assembly_with_timestamp(const struct timev
     {
         espfsp_message_assembly_t *cur = &receiver_buffer->fbs_messages_buf[i];
 
-        if (is_assembly_producer_owner(cur) && is_assembly_used(cur) && is_equal(&cur->timestamp, timestamp))
+        if (get_assembly_state(cur) == MSG_ASS_FILLING && is_equal(&cur->timestamp, timestamp))
         {
             return cur;
         }
@@ -72,7 +69,7 @@ static espfsp_message_assembly_t *get_free_assembly(espfsp_receiver_buffer_t *re
     {
         espfsp_message_assembly_t *cur = &receiver_buffer->fbs_messages_buf[i];
 
-        if (is_assembly_producer_owner(cur) && is_assembly_free(cur))
+        if (get_assembly_state(cur) == MSG_ASS_FREE)
         {
             return cur;
         }
@@ -90,7 +87,7 @@ static espfsp_message_assembly_t *get_earliest_used_assembly(espfsp_receiver_buf
     {
         espfsp_message_assembly_t *cur = &receiver_buffer->fbs_messages_buf[i];
 
-        if (is_assembly_producer_owner(cur) && is_assembly_used(cur))
+        if (get_assembly_state(cur) == MSG_ASS_FILLING)
         {
             tv.tv_sec = cur->timestamp.tv_sec;
             tv.tv_usec = cur->timestamp.tv_usec;
@@ -103,7 +100,7 @@ static espfsp_message_assembly_t *get_earliest_used_assembly(espfsp_receiver_buf
     {
         espfsp_message_assembly_t *cur = &receiver_buffer->fbs_messages_buf[i];
 
-        if (is_assembly_producer_owner(cur) && is_assembly_used(cur) && is_earlier(&cur->timestamp, &tv))
+        if (get_assembly_state(cur) == MSG_ASS_FILLING && is_earlier(&cur->timestamp, &tv))
         {
             tv.tv_sec = cur->timestamp.tv_sec;
             tv.tv_usec = cur->timestamp.tv_usec;
@@ -114,9 +111,217 @@ static espfsp_message_assembly_t *get_earliest_used_assembly(espfsp_receiver_buf
     return to_ret;
 }
 
+// Producer side of ring
+static void push_assembly(espfsp_receiver_buffer_t *receiver_buffer, espfsp_message_assembly_t *assembly)
+{
+    uint32_t head = atomic_load_explicit(&receiver_buffer->frame_ring_head, memory_order_relaxed);
+
+    set_assembly_state(assembly, MSG_ASS_READY);
+    atomic_store_explicit(
+        &receiver_buffer->frame_ring[head % receiver_buffer->allocated_fbs],
+        assembly - receiver_buffer->fbs_messages_buf,
+        memory_order_relaxed);
+    atomic_store_explicit(&receiver_buffer->frame_ring_head, head + 1, memory_order_release);
+    xSemaphoreGive(receiver_buffer->frame_ready);
+}
+
+// Oldest completed frame is taken by consumer, or by producer that has no other assembly to fill.
+// Whoever advances tail owns the frame. Slot at tail is written again only after tail moved past it,
+// so index read before successful CAS is the one published at that position.
+static espfsp_message_assembly_t *take_oldest_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    uint32_t tail = atomic_load_explicit(&receiver_buffer->frame_ring_tail, memory_order_relaxed);
+
+    while (tail != atomic_load_explicit(&receiver_buffer->frame_ring_head, memory_order_acquire))
+    {
+        uint16_t index = atomic_load_explicit(
+            &receiver_buffer->frame_ring[tail % receiver_buffer->allocated_fbs], memory_order_relaxed);
+
+        if (atomic_compare_exchange_weak_explicit(
+                &receiver_buffer->frame_ring_tail, &tail, tail + 1, memory_order_acq_rel, memory_order_relaxed))
+        {
+            return &receiver_buffer->fbs_messages_buf[index];
+        }
+    }
+
+    return NULL;
+}
+
+// Consumer side of ring
+static espfsp_message_assembly_t *pop_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    espfsp_message_assembly_t *assembly = take_oldest_assembly(receiver_buffer);
+
+    if (assembly != NULL)
+    {
+        set_assembly_state(assembly, MSG_ASS_CONSUMED);
+    }
+
+    return assembly;
+}
+
+// Producer side. Cached frame is only kept for new viewers, so it is given up before any frame in ring.
+// Consumer may take it meanwhile, so it is claimed by CAS.
+static espfsp_message_assembly_t *reclaim_cached_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    for (int i = 0; i < receiver_buffer->config->buffered_fbs; i++)
+    {
+        espfsp_message_assembly_t *cur = &receiver_buffer->fbs_messages_buf[i];
+        uint8_t expected = MSG_ASS_CACHED;
+
+        if (atomic_compare_exchange_strong_explicit(
+                &cur->state, &expected, MSG_ASS_FILLING, memory_order_acq_rel, memory_order_relaxed))
+        {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+// Producer side. Consumer runs late, so the oldest completed frame is dropped instead of the newest one.
+// Assemblies above buffered FBs count after shrink are not filled anymore, they are only freed.
+static espfsp_message_assembly_t *reclaim_oldest_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    espfsp_message_assembly_t *assembly = NULL;
+
+    while ((assembly = take_oldest_assembly(receiver_buffer)) != NULL)
+    {
+        atomic_fetch_add_explicit(&receiver_buffer->stat_frames_late, 1, memory_order_relaxed);
+
+        if (assembly - receiver_buffer->fbs_messages_buf < receiver_buffer->config->buffered_fbs)
+        {
+            return assembly;
+        }
+
+        set_assembly_state(assembly, MSG_ASS_FREE);
+    }
+
+    return NULL;
+}
+
+static uint32_t frames_waiting(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    uint32_t head = atomic_load_explicit(&receiver_buffer->frame_ring_head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&receiver_buffer->frame_ring_tail, memory_order_relaxed);
+
+    return head - tail;
+}
+
+bool espfsp_message_buffer_has_frame(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    return frames_waiting(receiver_buffer) > 0;
+}
+
+static bool lock_buffer(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    if (xSemaphoreTake(receiver_buffer->mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return false;
+    }
+
+    return true;
+}
+
+static void unlock_buffer(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    if (xSemaphoreGive(receiver_buffer->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+    }
+}
+
+static size_t align_to_cache_line(size_t size)
+{
+    return (size + MESSAGE_BUFFER_ARENA_ALIGN - 1) & ~((size_t) MESSAGE_BUFFER_ARENA_ALIGN - 1);
+}
+
+size_t espfsp_message_buffer_arena_size(uint16_t buffered_fbs, uint32_t frame_max_len)
+{
+    return align_to_cache_line(sizeof(espfsp_fb_t)) +
+           align_to_cache_line(buffered_fbs * sizeof(espfsp_message_assembly_t)) +
+           align_to_cache_line(buffered_fbs * sizeof(uint16_t)) +
+           buffered_fbs * align_to_cache_line(frame_max_len);
+}
+
+size_t espfsp_message_buffer_get_footprint(const espfsp_receiver_buffer_t *receiver_buffer)
+{
+    return receiver_buffer->arena_size;
+}
+
+void espfsp_message_buffer_estimate_memory(const espfsp_receiver_buffer_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_MESSAGE_BUFFER, 0, sizeof(espfsp_receiver_buffer_config_t));
+    espfsp_mem_estimate_add_aligned(
+        estimate,
+        ESPFSP_MEM_TAG_MESSAGE_BUFFER,
+        MALLOC_CAP_SPIRAM,
+        MESSAGE_BUFFER_ARENA_ALIGN,
+        espfsp_message_buffer_arena_size(config->buffered_fbs, config->frame_max_len));
+}
+
+static uint8_t *alloc_arena(size_t size)
+{
+    uint8_t *arena = (uint8_t *) espfsp_mem_aligned_alloc(
+        ESPFSP_MEM_TAG_MESSAGE_BUFFER, MALLOC_CAP_SPIRAM, MESSAGE_BUFFER_ARENA_ALIGN, size);
+    if (arena == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate %u bytes for receiver buffer arena", (unsigned) size);
+    }
+
+    return arena;
+}
+
+// Arena layout: FB header | assembly headers | ring storage | payloads. Every part starts on cache line.
+static void layout_arena(espfsp_receiver_buffer_t *receiver_buffer, uint16_t buffered_fbs, uint32_t frame_max_len)
+{
+    uint8_t *cur = receiver_buffer->arena;
+
+    memset(cur, 0, espfsp_message_buffer_arena_size(buffered_fbs, 0));
+
+    receiver_buffer->s_fb = (espfsp_fb_t *) cur;
+    cur += align_to_cache_line(sizeof(espfsp_fb_t));
+
+    receiver_buffer->fbs_messages_buf = (espfsp_message_assembly_t *) cur;
+    cur += align_to_cache_line(buffered_fbs * sizeof(espfsp_message_assembly_t));
+
+    receiver_buffer->frame_ring = (_Atomic uint16_t *) cur;
+    cur += align_to_cache_line(buffered_fbs * sizeof(uint16_t));
+
+    for (int i = 0; i < buffered_fbs; i++)
+    {
+        receiver_buffer->fbs_messages_buf[i].buf = cur;
+        atomic_init(&receiver_buffer->fbs_messages_buf[i].state, MSG_ASS_FREE);
+        cur += align_to_cache_line(frame_max_len);
+    }
+
+    atomic_init(&receiver_buffer->frame_ring_head, 0);
+    atomic_init(&receiver_buffer->frame_ring_tail, 0);
+
+    receiver_buffer->allocated_fbs = buffered_fbs;
+    receiver_buffer->allocated_frame_len = frame_max_len;
+    receiver_buffer->s_ass = NULL;
+    receiver_buffer->cached_ass = NULL;
+}
+
+// Consumer reads pacing and FBs count while reconfigure changes them, so they are kept apart from config.
+// Buffers of lower simulcast layers do not know rate of source, so FPS 0 leaves consumer unpaced.
+static void set_pacing(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    uint16_t fps = receiver_buffer->config->fps;
+
+    atomic_store_explicit(
+        &receiver_buffer->fb_get_interval_us, fps > 0 ? (1000 / fps) << 10 : 0, memory_order_relaxed);
+    atomic_store_explicit(
+        &receiver_buffer->fb_in_buffer_before_get, receiver_buffer->config->fb_in_buffer_before_get, memory_order_relaxed);
+    atomic_store_explicit(&receiver_buffer->buffered_fbs, receiver_buffer->config->buffered_fbs, memory_order_relaxed);
+}
+
 esp_err_t espfsp_message_buffer_init(espfsp_receiver_buffer_t *receiver_buffer, const espfsp_receiver_buffer_config_t *config)
 {
-    receiver_buffer->config = (espfsp_receiver_buffer_config_t *) malloc(sizeof(espfsp_receiver_buffer_config_t));
+    receiver_buffer->config = (espfsp_receiver_buffer_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_MESSAGE_BUFFER, 0, sizeof(espfsp_receiver_buffer_config_t));
     if (receiver_buffer->config == NULL)
     {
         ESP_LOGE(TAG, "Memory allocation for config failed");
@@ -125,148 +330,340 @@ esp_err_t espfsp_message_buffer_init(espfsp_receiver_buffer_t *receiver_buffer,
 
     memcpy(receiver_buffer->config, config, sizeof(espfsp_receiver_buffer_config_t));
 
-    receiver_buffer->fbs_messages_buf = (espfsp_message_assembly_t *) heap_caps_calloc(
-        1,
-        config->buffered_fbs * sizeof(espfsp_message_assembly_t),
-        MALLOC_CAP_SPIRAM);
+    receiver_buffer->arena_size = espfsp_message_buffer_arena_size(config->buffered_fbs, config->frame_max_len);
+    receiver_buffer->arena = alloc_arena(receiver_buffer->arena_size);
+    if (receiver_buffer->arena == NULL)
+    {
+        espfsp_mem_free(receiver_buffer->config);
+        return ESP_FAIL;
+    }
+
+    layout_arena(receiver_buffer, config->buffered_fbs, config->frame_max_len);
+    atomic_init(&receiver_buffer->consumer_busy, false);
+    atomic_init(&receiver_buffer->relayout_pending, false);
+    atomic_init(&receiver_buffer->cache_dropped, false);
 
-    if (!receiver_buffer->fbs_messages_buf)
+    receiver_buffer->mutex = NULL;
+    receiver_buffer->mutex = xSemaphoreCreateBinary();
+    if (receiver_buffer->mutex == NULL || xSemaphoreGive(receiver_buffer->mutex) != pdTRUE)
     {
-        ESP_LOGE(TAG, "Cannot allocate memory for fbs_messages_buf");
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        if (receiver_buffer->mutex != NULL)
+        {
+            vSemaphoreDelete(receiver_buffer->mutex);
+        }
+        espfsp_mem_free(receiver_buffer->arena);
+        espfsp_mem_free(receiver_buffer->config);
         return ESP_FAIL;
     }
 
-    for (int i = 0; i < config->buffered_fbs; i++)
+    receiver_buffer->consumer_left = xSemaphoreCreateBinary();
+    receiver_buffer->frame_ready = xSemaphoreCreateBinary();
+    if (receiver_buffer->consumer_left == NULL || receiver_buffer->frame_ready == NULL)
     {
-        receiver_buffer->fbs_messages_buf[i].buf = (uint8_t *) heap_caps_malloc(
-            config->frame_max_len * sizeof(uint8_t),
-            MALLOC_CAP_SPIRAM);
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        if (receiver_buffer->consumer_left != NULL)
+        {
+            vSemaphoreDelete(receiver_buffer->consumer_left);
+        }
+        if (receiver_buffer->frame_ready != NULL)
+        {
+            vSemaphoreDelete(receiver_buffer->frame_ready);
+        }
+        vSemaphoreDelete(receiver_buffer->mutex);
+        espfsp_mem_free(receiver_buffer->arena);
+        espfsp_mem_free(receiver_buffer->config);
+        return ESP_FAIL;
+    }
+
+    atomic_init(&receiver_buffer->buffer_locked, true);
+    receiver_buffer->last_fb_get_us = 0;
+    receiver_buffer->frame_cb = NULL;
+    receiver_buffer->frame_cb_ctx = NULL;
+    atomic_init(&receiver_buffer->stat_frames_received, 0);
+    atomic_init(&receiver_buffer->stat_frames_lost, 0);
+    atomic_init(&receiver_buffer->stat_frames_late, 0);
+    atomic_init(&receiver_buffer->stat_frames_preempted, 0);
+    receiver_buffer->aborted_timestamp.tv_sec = 0;
+    receiver_buffer->aborted_timestamp.tv_usec = 0;
+    receiver_buffer->dropped_timestamp.tv_sec = 0;
+    receiver_buffer->dropped_timestamp.tv_usec = 0;
+    atomic_init(&receiver_buffer->stat_jitter_us, 0);
+    atomic_init(&receiver_buffer->stat_last_transit_us, 0);
+    receiver_buffer->stat_has_transit = false;
+    receiver_buffer->trace_stage = ESPFSP_TRACE_STAGE_PLAY_REASSEMBLED;
+    set_pacing(receiver_buffer);
+
+    ESP_LOGI(TAG, "Receiver buffer arena: %u bytes", (unsigned) receiver_buffer->arena_size);
 
-        if (!receiver_buffer->fbs_messages_buf[i].buf)
+    return ESP_OK;
+}
+
+esp_err_t espfsp_message_buffer_deinit(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    vSemaphoreDelete(receiver_buffer->mutex);
+    vSemaphoreDelete(receiver_buffer->consumer_left);
+    vSemaphoreDelete(receiver_buffer->frame_ready);
+
+    espfsp_mem_free(receiver_buffer->arena);
+    espfsp_mem_free(receiver_buffer->config);
+
+    return ESP_OK;
+}
+
+// Held FB is returned within one frame send, so consumer is given a few frame intervals of rate it
+// is paced with. Unpaced consumer is given them at new rate.
+static TickType_t get_consumer_out_timeout(espfsp_receiver_buffer_t *receiver_buffer, uint16_t new_fps)
+{
+    uint16_t fps = receiver_buffer->config->fps > 0 ? receiver_buffer->config->fps : new_fps;
+    TickType_t ticks = pdMS_TO_TICKS(MESSAGE_BUFFER_CONSUMER_OUT_FRAMES * 1000 / fps);
+
+    return ticks > 0 ? ticks : 1;
+}
+
+// Consumer is excluded by pair of flags, one of both sides always sees the other. Consumer that sees
+// pending relayout on its way out gives semaphore, so it is awaited without polling.
+static bool wait_consumer_out(espfsp_receiver_buffer_t *receiver_buffer, uint16_t new_fps)
+{
+    TickType_t timeout = get_consumer_out_timeout(receiver_buffer, new_fps);
+    TickType_t start = xTaskGetTickCount();
+
+    // Signal left by consumer after earlier relayout gave up
+    xSemaphoreTake(receiver_buffer->consumer_left, 0);
+    atomic_store(&receiver_buffer->relayout_pending, true);
+
+    while (atomic_load(&receiver_buffer->consumer_busy))
+    {
+        TickType_t waited = xTaskGetTickCount() - start;
+
+        if (waited >= timeout || xSemaphoreTake(receiver_buffer->consumer_left, timeout - waited) != pdTRUE)
         {
-            ESP_LOGE(TAG, "Cannot allocate memory for fbs_messages_buf[i].buf for i=%d", i);
-            return ESP_FAIL;
+            break;
         }
+    }
 
-        receiver_buffer->fbs_messages_buf[i].bits = MSG_ASS_PRODUCER_OWNED_VAL | MSG_ASS_FREE_VAL;
+    if (atomic_load(&receiver_buffer->consumer_busy))
+    {
+        atomic_store(&receiver_buffer->relayout_pending, false);
+        return false;
     }
 
-    receiver_buffer->s_fb = (espfsp_fb_t *) heap_caps_malloc(sizeof(espfsp_fb_t), MALLOC_CAP_DEFAULT);
-    if (receiver_buffer->s_fb == NULL)
+    return true;
+}
+
+esp_err_t espfsp_message_buffer_reconfigure(
+    espfsp_receiver_buffer_t *receiver_buffer, const espfsp_receiver_buffer_config_t *config)
+{
+    if (config->fps == 0)
     {
-        ESP_LOGE(TAG, "Cannot allocate memory for fb");
+        ESP_LOGE(TAG, "FPS cannot be 0");
         return ESP_FAIL;
     }
 
-    receiver_buffer->frameQueue = NULL;
-    receiver_buffer->frameQueue = xQueueCreate(config->buffered_fbs, sizeof(espfsp_message_assembly_t*));
-    if (receiver_buffer->frameQueue == NULL)
+    bool should_relayout = config->buffered_fbs > receiver_buffer->allocated_fbs ||
+                           config->frame_max_len > receiver_buffer->allocated_frame_len;
+
+    size_t new_arena_size = espfsp_message_buffer_arena_size(config->buffered_fbs, config->frame_max_len);
+    uint8_t *new_arena = NULL;
+
+    // Arena is reused when new layout fits in it. Otherwise it is allocated before taking lock,
+    // so producer is not blocked for time of allocation
+    if (should_relayout && new_arena_size > receiver_buffer->arena_size)
+    {
+        new_arena = alloc_arena(new_arena_size);
+        if (new_arena == NULL)
+        {
+            return ESP_FAIL;
+        }
+    }
+
+    if (should_relayout && !wait_consumer_out(receiver_buffer, config->fps))
     {
-        ESP_LOGE(TAG, "Cannot initialize message assembly queue");
+        ESP_LOGE(TAG, "Cannot relayout receiver buffer while FB is held by consumer");
+        espfsp_mem_free(new_arena);
         return ESP_FAIL;
     }
 
-    receiver_buffer->buffer_locked = true;
-    receiver_buffer->last_fb_get_us = 0;
-    receiver_buffer->fb_get_interval_us = (uint64_t) ((1000 / config->fps) << 10);
+    if (!lock_buffer(receiver_buffer))
+    {
+        atomic_store(&receiver_buffer->relayout_pending, false);
+        espfsp_mem_free(new_arena);
+        return ESP_FAIL;
+    }
 
-    return ESP_OK;
-}
+    uint8_t *old_arena = NULL;
 
-esp_err_t espfsp_message_buffer_deinit(espfsp_receiver_buffer_t *receiver_buffer)
-{
-    espfsp_message_assembly_t *ass;
-    while (xQueueReceive(receiver_buffer->frameQueue, &ass, 0) == pdTRUE) {}
-    vQueueDelete(receiver_buffer->frameQueue);
+    if (should_relayout)
+    {
+        if (new_arena != NULL)
+        {
+            old_arena = receiver_buffer->arena;
+            receiver_buffer->arena = new_arena;
+            receiver_buffer->arena_size = new_arena_size;
+        }
 
-    free(receiver_buffer->s_fb);
+        layout_arena(receiver_buffer, config->buffered_fbs, config->frame_max_len);
+        atomic_store(&receiver_buffer->buffer_locked, true);
+    }
 
-    for (int i = 0; i < receiver_buffer->config->buffered_fbs; i++)
+    // When number of buffered FBs shrinks, frames in assemblies above new count are still consumed from ring
+    // and returned as usual. Producer just does not use these assemblies anymore.
+    memcpy(receiver_buffer->config, config, sizeof(espfsp_receiver_buffer_config_t));
+    set_pacing(receiver_buffer);
+
+    if (should_relayout)
     {
-        free(receiver_buffer->fbs_messages_buf[i].buf);
+        atomic_store(&receiver_buffer->relayout_pending, false);
     }
 
-    free(receiver_buffer->fbs_messages_buf);
-    free(receiver_buffer->config);
+    unlock_buffer(receiver_buffer);
+
+    espfsp_mem_free(old_arena);
+
+    if (should_relayout)
+    {
+        ESP_LOGI(TAG, "Receiver buffer arena: %u bytes", (unsigned) receiver_buffer->arena_size);
+    }
 
     return ESP_OK;
 }
 
 esp_err_t espfsp_message_buffer_clear(espfsp_receiver_buffer_t *receiver_buffer)
 {
-    for (int i = 0; i < receiver_buffer->config->buffered_fbs; i++)
+    for (int i = 0; i < receiver_buffer->allocated_fbs; i++)
     {
-        receiver_buffer->fbs_messages_buf[i].bits = MSG_ASS_PRODUCER_OWNED_VAL | MSG_ASS_FREE_VAL;
+        atomic_store(&receiver_buffer->fbs_messages_buf[i].state, MSG_ASS_FREE);
     }
 
-    if (xQueueReset(receiver_buffer->frameQueue) != pdPASS) {
-        ESP_LOGE(TAG, "Queue reset unsuccessfully");
-        return ESP_FAIL;
-    }
+    atomic_store(&receiver_buffer->frame_ring_head, 0);
+    atomic_store(&receiver_buffer->frame_ring_tail, 0);
+    receiver_buffer->cached_ass = NULL;
 
     return ESP_OK;
 }
 
 static bool is_buffer_locked(espfsp_receiver_buffer_t *receiver_buffer, uint32_t *timeout_ms)
 {
-    UBaseType_t frames_in_queue = uxQueueMessagesWaiting(receiver_buffer->frameQueue);
+    uint32_t frames_in_queue = frames_waiting(receiver_buffer);
+    uint16_t fb_in_buffer_before_get =
+        atomic_load_explicit(&receiver_buffer->fb_in_buffer_before_get, memory_order_relaxed);
 
-    if (receiver_buffer->buffer_locked)
+    if (atomic_load(&receiver_buffer->buffer_locked))
     {
-        while (frames_in_queue < receiver_buffer->config->fb_in_buffer_before_get && *timeout_ms > 0)
+        while (frames_in_queue < fb_in_buffer_before_get && *timeout_ms > 0)
         {
             vTaskDelay(10 / portTICK_PERIOD_MS);
             *timeout_ms -= *timeout_ms > 10 ? 10 : *timeout_ms;
-            frames_in_queue = uxQueueMessagesWaiting(receiver_buffer->frameQueue);
+            frames_in_queue = frames_waiting(receiver_buffer);
         }
 
-        if (frames_in_queue >= receiver_buffer->config->fb_in_buffer_before_get)
+        if (frames_in_queue >= fb_in_buffer_before_get)
         {
-            receiver_buffer->buffer_locked = false;
+            atomic_store(&receiver_buffer->buffer_locked, false);
         }
     }
-    else if (frames_in_queue == 0 && receiver_buffer->config->fb_in_buffer_before_get != 0)
+    else if (frames_in_queue == 0 && fb_in_buffer_before_get != 0)
     {
-        receiver_buffer->buffer_locked = true;
+        atomic_store(&receiver_buffer->buffer_locked, true);
     }
 
-    return receiver_buffer->buffer_locked;
+    return atomic_load(&receiver_buffer->buffer_locked);
 }
 
 static bool is_buffer_interval_met(espfsp_receiver_buffer_t *receiver_buffer, uint32_t *timeout_ms)
 {
     uint64_t current_time = esp_timer_get_time();
+    uint64_t fb_get_interval_us = atomic_load_explicit(&receiver_buffer->fb_get_interval_us, memory_order_relaxed);
 
-    while((current_time - receiver_buffer->last_fb_get_us) < receiver_buffer->fb_get_interval_us && *timeout_ms > 0)
+    while((current_time - receiver_buffer->last_fb_get_us) < fb_get_interval_us && *timeout_ms > 0)
     {
         vTaskDelay(5 / portTICK_PERIOD_MS);
         *timeout_ms -= *timeout_ms > 5 ? 5 : *timeout_ms;
         current_time = esp_timer_get_time();
     }
 
-    return (current_time - receiver_buffer->last_fb_get_us) >= receiver_buffer->fb_get_interval_us;
+    return (current_time - receiver_buffer->last_fb_get_us) >= fb_get_interval_us;
 }
 
-espfsp_fb_t *espfsp_message_buffer_get_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms)
+static void leave_consumer(espfsp_receiver_buffer_t *receiver_buffer)
 {
-    if (is_buffer_locked(receiver_buffer, &timeout_ms))
+    atomic_store(&receiver_buffer->consumer_busy, false);
+    if (atomic_load(&receiver_buffer->relayout_pending))
     {
-        return NULL;
+        xSemaphoreGive(receiver_buffer->consumer_left);
     }
+}
 
-    if (!is_buffer_interval_met(receiver_buffer, &timeout_ms))
+static bool enter_consumer(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    atomic_store(&receiver_buffer->consumer_busy, true);
+    if (atomic_load(&receiver_buffer->relayout_pending))
     {
-        return NULL;
+        leave_consumer(receiver_buffer);
+        return false;
     }
 
-    BaseType_t xStatus = xQueueReceive(receiver_buffer->frameQueue, &receiver_buffer->s_ass, timeout_ms / portTICK_PERIOD_MS);
-    if (xStatus != pdTRUE)
+    return true;
+}
+
+// Consumer side. Frames older than the newest completed one are freed and counted as late.
+static espfsp_message_assembly_t *pop_newest_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    espfsp_message_assembly_t *ass = pop_assembly(receiver_buffer);
+    espfsp_message_assembly_t *newer = NULL;
+
+    while (ass != NULL && (newer = pop_assembly(receiver_buffer)) != NULL)
     {
-        return NULL;
+        set_assembly_state(ass, MSG_ASS_FREE);
+        atomic_fetch_add_explicit(&receiver_buffer->stat_frames_late, 1, memory_order_relaxed);
+        ass = newer;
     }
 
-    receiver_buffer->last_fb_get_us = esp_timer_get_time();
+    return ass;
+}
+
+// Consumer is marked busy only while touching ring or holding FB, so relayout is not blocked by waiting.
+// Consumer sleeps until producer pushes frame. Signal left by frame taken already only repeats the check.
+static bool receive_assembly(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms, bool newest)
+{
+    espfsp_message_assembly_t *ass = NULL;
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    TickType_t start = xTaskGetTickCount();
+
+    // Timeout shorter than tick still waits for one
+    if (timeout_ms > 0 && timeout == 0)
+    {
+        timeout = 1;
+    }
+
+    while (1)
+    {
+        if (enter_consumer(receiver_buffer))
+        {
+            ass = newest ? pop_newest_assembly(receiver_buffer) : pop_assembly(receiver_buffer);
+            if (ass != NULL)
+            {
+                break;
+            }
+
+            leave_consumer(receiver_buffer);
+        }
+
+        TickType_t waited = xTaskGetTickCount() - start;
+
+        if (waited >= timeout || xSemaphoreTake(receiver_buffer->frame_ready, timeout - waited) != pdTRUE)
+        {
+            break;
+        }
+    }
 
+    receiver_buffer->s_ass = ass;
+
+    return ass != NULL;
+}
+
+static espfsp_fb_t *fill_fb(espfsp_receiver_buffer_t *receiver_buffer)
+{
     receiver_buffer->s_fb->len = receiver_buffer->s_ass->len;
     receiver_buffer->s_fb->width = receiver_buffer->s_ass->width;
     receiver_buffer->s_fb->height = receiver_buffer->s_ass->height;
@@ -276,15 +673,173 @@ espfsp_fb_t *espfsp_message_buffer_get_fb(espfsp_receiver_buffer_t *receiver_buf
     return receiver_buffer->s_fb;
 }
 
+static espfsp_fb_t *get_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms, bool newest)
+{
+    if (is_buffer_locked(receiver_buffer, &timeout_ms) ||
+        !is_buffer_interval_met(receiver_buffer, &timeout_ms) ||
+        !receive_assembly(receiver_buffer, timeout_ms, newest))
+    {
+        return NULL;
+    }
+
+    receiver_buffer->last_fb_get_us = esp_timer_get_time();
+
+    return fill_fb(receiver_buffer);
+}
+
+espfsp_fb_t *espfsp_message_buffer_get_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms)
+{
+    return get_fb(receiver_buffer, timeout_ms, false);
+}
+
+espfsp_fb_t *espfsp_message_buffer_get_newest_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms)
+{
+    return get_fb(receiver_buffer, timeout_ms, true);
+}
+
+// Consumer side. Fails when producer took cached assembly back already.
+static void free_cached_assembly(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    uint8_t expected = MSG_ASS_CACHED;
+
+    if (receiver_buffer->cached_ass != NULL)
+    {
+        atomic_compare_exchange_strong_explicit(
+            &receiver_buffer->cached_ass->state, &expected, MSG_ASS_FREE, memory_order_release, memory_order_relaxed);
+        receiver_buffer->cached_ass = NULL;
+    }
+}
+
+espfsp_fb_t *espfsp_message_buffer_get_cached_fb(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    uint8_t expected = MSG_ASS_CACHED;
+
+    if (!enter_consumer(receiver_buffer))
+    {
+        return NULL;
+    }
+
+    if (atomic_exchange(&receiver_buffer->cache_dropped, false))
+    {
+        free_cached_assembly(receiver_buffer);
+    }
+
+    if (receiver_buffer->cached_ass == NULL ||
+        !atomic_compare_exchange_strong_explicit(
+            &receiver_buffer->cached_ass->state, &expected, MSG_ASS_CONSUMED, memory_order_acquire, memory_order_relaxed))
+    {
+        receiver_buffer->cached_ass = NULL;
+        leave_consumer(receiver_buffer);
+        return NULL;
+    }
+
+    receiver_buffer->s_ass = receiver_buffer->cached_ass;
+
+    return fill_fb(receiver_buffer);
+}
+
+void espfsp_message_buffer_drop_cached_fb(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    atomic_store(&receiver_buffer->cache_dropped, true);
+}
+
 esp_err_t espfsp_message_buffer_return_fb(espfsp_receiver_buffer_t *receiver_buffer)
 {
-    receiver_buffer->s_ass->bits = MSG_ASS_PRODUCER_OWNED_VAL | MSG_ASS_FREE_VAL;
-    receiver_buffer->s_ass = NULL;
+    if (receiver_buffer->s_ass != NULL)
+    {
+        // Returned frame is kept as the last complete frame, previous one is freed. Assemblies above
+        // buffered FBs count after shrink are not taken back by producer, so they are not cached.
+        bool cache_dropped = atomic_exchange(&receiver_buffer->cache_dropped, false);
+        bool cacheable = !cache_dropped &&
+                         receiver_buffer->s_ass - receiver_buffer->fbs_messages_buf <
+                             atomic_load_explicit(&receiver_buffer->buffered_fbs, memory_order_relaxed);
+
+        if (receiver_buffer->s_ass != receiver_buffer->cached_ass)
+        {
+            free_cached_assembly(receiver_buffer);
+        }
+
+        if (cacheable)
+        {
+            receiver_buffer->cached_ass = receiver_buffer->s_ass;
+            set_assembly_state(receiver_buffer->s_ass, MSG_ASS_CACHED);
+        }
+        else
+        {
+            receiver_buffer->cached_ass = NULL;
+            set_assembly_state(receiver_buffer->s_ass, MSG_ASS_FREE);
+        }
+
+        receiver_buffer->s_ass = NULL;
+        leave_consumer(receiver_buffer);
+    }
 
     return ESP_OK;
 }
 
-void espfsp_message_buffer_process_message(const espfsp_message_t *message, espfsp_receiver_buffer_t *receiver_buffer)
+// Transit time contains offset between clocks, which cancels out in jitter
+static void update_stats_on_frame(espfsp_receiver_buffer_t *receiver_buffer, const espfsp_message_assembly_t *ass)
+{
+    int64_t capture_us = (int64_t) ass->timestamp.tv_sec * 1000000 + ass->timestamp.tv_usec;
+    int64_t transit_us = esp_timer_get_time() - capture_us;
+
+    if (receiver_buffer->stat_has_transit)
+    {
+        int64_t prev_transit_us = atomic_load_explicit(&receiver_buffer->stat_last_transit_us, memory_order_relaxed);
+        int64_t d = transit_us - prev_transit_us;
+        int64_t jitter_us = atomic_load_explicit(&receiver_buffer->stat_jitter_us, memory_order_relaxed);
+
+        if (d < 0)
+        {
+            d = -d;
+        }
+        jitter_us += (d - jitter_us) / 16;
+        atomic_store_explicit(&receiver_buffer->stat_jitter_us, (uint32_t) jitter_us, memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&receiver_buffer->stat_last_transit_us, transit_us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&receiver_buffer->stat_frames_received, 1, memory_order_relaxed);
+    receiver_buffer->stat_has_transit = true;
+}
+
+// Sender abandoned frame for newer one, so its assembly is free at once instead of being evicted as lost
+static void abort_assembly(const espfsp_message_t *message, espfsp_receiver_buffer_t *receiver_buffer)
+{
+    espfsp_message_assembly_t *ass = get_assembly_with_timestamp(&message->timestamp, receiver_buffer);
+
+    receiver_buffer->aborted_timestamp.tv_sec = message->timestamp.tv_sec;
+    receiver_buffer->aborted_timestamp.tv_usec = message->timestamp.tv_usec;
+
+    if (ass != NULL)
+    {
+        set_assembly_state(ass, MSG_ASS_FREE);
+        atomic_fetch_add_explicit(&receiver_buffer->stat_frames_preempted, 1, memory_order_relaxed);
+    }
+}
+
+// Consumer moves assemblies between states while producer looks through them, so assembly returned or
+// taken meanwhile can be missed. Search is repeated once before frame being filled is evicted.
+static espfsp_message_assembly_t *get_assembly_for_new_frame(espfsp_receiver_buffer_t *receiver_buffer)
+{
+    espfsp_message_assembly_t *ass = NULL;
+
+    for (int i = 0; i < 2 && ass == NULL; i++)
+    {
+        ass = get_free_assembly(receiver_buffer);
+        if (ass == NULL)
+        {
+            ass = reclaim_cached_assembly(receiver_buffer);
+        }
+        if (ass == NULL)
+        {
+            ass = reclaim_oldest_assembly(receiver_buffer);
+        }
+    }
+
+    return ass;
+}
+
+static void process_message(const espfsp_message_t *message, espfsp_receiver_buffer_t *receiver_buffer)
 {
     if (message->len > receiver_buffer->config->frame_max_len)
     {
@@ -292,28 +847,50 @@ void espfsp_message_buffer_process_message(const espfsp_message_t *message, espf
         return;
     }
 
+    if (message->msg_number == MESSAGE_NUMBER_ABORT)
+    {
+        abort_assembly(message, receiver_buffer);
+        return;
+    }
+
+    // Fragment of aborted frame reordered behind abort would take assembly that is never completed.
+    // Frame with dropped fragment cannot be completed either.
+    if (is_equal(&message->timestamp, &receiver_buffer->aborted_timestamp) ||
+        is_equal(&message->timestamp, &receiver_buffer->dropped_timestamp))
+    {
+        return;
+    }
+
     espfsp_message_assembly_t * ass = get_assembly_with_timestamp(&message->timestamp, receiver_buffer);
     if (ass == NULL)
     {
-        ass = get_free_assembly(receiver_buffer);
-        if (ass == NULL && xQueueReceive(receiver_buffer->frameQueue, &ass, 0) != pdTRUE)
+        ass = get_assembly_for_new_frame(receiver_buffer);
+        if (ass == NULL)
         {
             ass = get_earliest_used_assembly(receiver_buffer);
-            if (ass == NULL)
+            if (ass != NULL)
             {
-                ESP_LOGE(TAG, "Bad usage. Assemblies not returned to buffer");
-                return;
+                atomic_fetch_add_explicit(&receiver_buffer->stat_frames_lost, 1, memory_order_relaxed);
             }
         }
+        if (ass == NULL)
+        {
+            // Every assembly is held by consumer. Rest of frame is ignored, so it is reported once.
+            ESP_LOGW(TAG, "No assembly returned to buffer, frame dropped");
+            atomic_fetch_add_explicit(&receiver_buffer->stat_frames_lost, 1, memory_order_relaxed);
+            receiver_buffer->dropped_timestamp.tv_sec = message->timestamp.tv_sec;
+            receiver_buffer->dropped_timestamp.tv_usec = message->timestamp.tv_usec;
+            return;
+        }
 
         ass->len = message->len;
         ass->width = message->width;
         ass->height = message->height;
         ass->timestamp.tv_sec = message->timestamp.tv_sec;
         ass->timestamp.tv_usec = message->timestamp.tv_usec;
-        ass->msg_total = message->msg_total;
+        ass->msg_total = message->msg_total & MESSAGE_TOTAL_MASK;
         ass->msg_received = 0;
-        ass->bits = MSG_ASS_PRODUCER_OWNED_VAL | MSG_ASS_USED_VAL;
+        atomic_store_explicit(&ass->state, MSG_ASS_FILLING, memory_order_relaxed);
     }
 
     memcpy(ass->buf + (message->msg_number * MESSAGE_BUFFER_SIZE), message->buf, message->msg_len);
@@ -321,10 +898,70 @@ void espfsp_message_buffer_process_message(const espfsp_message_t *message, espf
 
     if (ass->msg_received == ass->msg_total)
     {
-        ass->bits = MSG_ASS_CONSUMER_OWNED_VAL | MSG_ASS_FREE_VAL;
-        if (xQueueSend(receiver_buffer->frameQueue, &ass, 0) != pdPASS)
+        update_stats_on_frame(receiver_buffer, ass);
+        ESPFSP_TRACE(receiver_buffer->trace_stage, &ass->timestamp);
+
+        if (receiver_buffer->frame_cb != NULL)
         {
-            ESP_LOGE(TAG, "Put FB in queue FAILED");
+            espfsp_fb_t fb = {
+                .len = ass->len,
+                .width = ass->width,
+                .height = ass->height,
+                .timestamp = ass->timestamp,
+                .buf = (char *) ass->buf,
+            };
+
+            receiver_buffer->frame_cb(&fb, receiver_buffer->frame_cb_ctx);
         }
+
+        push_assembly(receiver_buffer, ass);
+    }
+}
+
+esp_err_t espfsp_message_buffer_set_frame_cb(
+    espfsp_receiver_buffer_t *receiver_buffer, espfsp_message_buffer_frame_cb_t cb, void *ctx)
+{
+    if (!lock_buffer(receiver_buffer))
+    {
+        return ESP_FAIL;
+    }
+
+    receiver_buffer->frame_cb = cb;
+    receiver_buffer->frame_cb_ctx = ctx;
+
+    unlock_buffer(receiver_buffer);
+
+    return ESP_OK;
+}
+
+void espfsp_message_buffer_get_stats(espfsp_receiver_buffer_t *receiver_buffer, espfsp_receiver_buffer_stats_t *stats)
+{
+    stats->frames_received = atomic_load_explicit(&receiver_buffer->stat_frames_received, memory_order_relaxed);
+    stats->frames_lost = atomic_load_explicit(&receiver_buffer->stat_frames_lost, memory_order_relaxed);
+    stats->frames_late = atomic_load_explicit(&receiver_buffer->stat_frames_late, memory_order_relaxed);
+    stats->frames_preempted = atomic_load_explicit(&receiver_buffer->stat_frames_preempted, memory_order_relaxed);
+    stats->jitter_us = atomic_load_explicit(&receiver_buffer->stat_jitter_us, memory_order_relaxed);
+    stats->last_transit_us = atomic_load_explicit(&receiver_buffer->stat_last_transit_us, memory_order_relaxed);
+    stats->buffer_depth = (uint16_t) frames_waiting(receiver_buffer);
+}
+
+void espfsp_message_buffer_get_stream_stats(espfsp_receiver_buffer_t *receiver_buffer, espfsp_stream_stats_t *stats)
+{
+    espfsp_receiver_buffer_stats_t buffer_stats;
+    espfsp_message_buffer_get_stats(receiver_buffer, &buffer_stats);
+
+    stats->frames_completed = buffer_stats.frames_received;
+    stats->frames_dropped_incomplete = buffer_stats.frames_lost;
+    stats->frames_dropped_late = buffer_stats.frames_late;
+    stats->frames_preempted = buffer_stats.frames_preempted;
+    stats->queue_depth = buffer_stats.buffer_depth;
+}
+
+void espfsp_message_buffer_process_message(const espfsp_message_t *message, espfsp_receiver_buffer_t *receiver_buffer)
+{
+    if (lock_buffer(receiver_buffer))
+    {
+        process_message(message, receiver_buffer);
+        unlock_buffer(receiver_buffer);
     }
 }
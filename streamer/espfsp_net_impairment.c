@@ -0,0 +1,491 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "espfsp_mem_alloc.h"
+#include "espfsp_net_impairment_shim.h"
+
+typedef struct
+{
+    bool used;
+    bool has_addr;
+    uint16_t len;
+    int64_t due_us;
+    uint32_t seq;                   // Keeps order of packets with the same due time
+    struct sockaddr_in addr;
+    uint8_t *buf;
+} queued_packet_t;
+
+// Delay line of single socket. Packets are sent from esp_timer task when due.
+typedef struct
+{
+    int sock;
+    espfsp_net_impairment_config_t config;
+    uint32_t rng;
+    bool burst_bad;
+    int64_t link_free_us;           // When previous packet leaves rate limited link
+    int held;                       // Packet waiting for next one to be reordered, -1 if none
+    uint32_t next_seq;
+    SemaphoreHandle_t mutex;
+    esp_timer_handle_t timer;
+    uint8_t *arena;
+    queued_packet_t queue[ESPFSP_NET_IMPAIRMENT_QUEUE_LEN];
+} impaired_socket_t;
+
+typedef struct
+{
+    _Atomic uint32_t packets;
+    _Atomic uint32_t dropped_uniform;
+    _Atomic uint32_t dropped_burst;
+    _Atomic uint32_t dropped_overflow;
+    _Atomic uint32_t reordered;
+    _Atomic uint32_t duplicated;
+    _Atomic uint32_t delayed;
+    _Atomic uint32_t rate_limited;
+} impairment_stats_t;
+
+static const char *TAG = "ESPFSP_NET_IMPAIRMENT";
+
+// Guards config_, sockets_ and attach_order_. Created by first espfsp_net_impairment_set()
+static SemaphoreHandle_t mutex_ = NULL;
+static espfsp_net_impairment_config_t config_;
+static uint32_t attach_order_;
+static impaired_socket_t *sockets_[ESPFSP_NET_IMPAIRMENT_MAX_SOCKETS];
+static _Atomic int attached_count_;
+static impairment_stats_t stats_;
+
+#define STAT_INC(name) atomic_fetch_add_explicit(&stats_.name, 1, memory_order_relaxed)
+
+// xorshift32, state never becomes zero
+static uint32_t next_random(impaired_socket_t *s)
+{
+    uint32_t x = s->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    s->rng = x;
+    return x;
+}
+
+static bool roll(impaired_socket_t *s, uint16_t permille)
+{
+    return permille > 0 && next_random(s) % 1000 < permille;
+}
+
+static impaired_socket_t *find_socket(int sock)
+{
+    for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_MAX_SOCKETS; i++)
+    {
+        if (sockets_[i] != NULL && sockets_[i]->sock == sock)
+        {
+            return sockets_[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int send_packet(int sock, const uint8_t *buffer, size_t n, const struct sockaddr_in *dest_addr)
+{
+    ssize_t bytes_sent = dest_addr != NULL ?
+        sendto(sock, buffer, n, 0, (const struct sockaddr *) dest_addr, sizeof(*dest_addr)) :
+        send(sock, buffer, n, 0);
+
+    return bytes_sent < 0 ? -1 : 1;
+}
+
+static int find_earliest_packet(impaired_socket_t *s)
+{
+    int earliest = -1;
+
+    for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_QUEUE_LEN; i++)
+    {
+        queued_packet_t *p = &s->queue[i];
+        if (!p->used)
+        {
+            continue;
+        }
+        if (earliest < 0 ||
+            p->due_us < s->queue[earliest].due_us ||
+            (p->due_us == s->queue[earliest].due_us && (int32_t) (p->seq - s->queue[earliest].seq) < 0))
+        {
+            earliest = i;
+        }
+    }
+
+    return earliest;
+}
+
+// Called with socket mutex taken
+static void arm_timer(impaired_socket_t *s)
+{
+    int earliest = find_earliest_packet(s);
+    if (earliest < 0)
+    {
+        return;
+    }
+
+    int64_t timeout_us = s->queue[earliest].due_us - esp_timer_get_time();
+    esp_timer_stop(s->timer);
+    esp_timer_start_once(s->timer, timeout_us > 0 ? timeout_us : 1);
+}
+
+static void delay_line_cb(void *arg)
+{
+    impaired_socket_t *s = (impaired_socket_t *) arg;
+
+    if (xSemaphoreTake(s->mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    int i = find_earliest_packet(s);
+
+    while (i >= 0 && s->queue[i].due_us <= now_us)
+    {
+        queued_packet_t *p = &s->queue[i];
+        if (send_packet(s->sock, p->buf, p->len, p->has_addr ? &p->addr : NULL) < 0)
+        {
+            // Same as loss on real network
+            ESP_LOGW(TAG, "Delayed packet not sent: errno %d", errno);
+        }
+
+        p->used = false;
+        if (s->held == i)
+        {
+            s->held = -1;
+        }
+        i = find_earliest_packet(s);
+    }
+
+    arm_timer(s);
+
+    if (xSemaphoreGive(s->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+    }
+}
+
+static int enqueue_packet(
+    impaired_socket_t *s, const uint8_t *buffer, size_t n, const struct sockaddr_in *dest_addr, int64_t due_us)
+{
+    for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_QUEUE_LEN; i++)
+    {
+        queued_packet_t *p = &s->queue[i];
+        if (p->used)
+        {
+            continue;
+        }
+
+        p->used = true;
+        p->len = n;
+        p->due_us = due_us;
+        p->seq = s->next_seq++;
+        p->has_addr = dest_addr != NULL;
+        if (dest_addr != NULL)
+        {
+            memcpy(&p->addr, dest_addr, sizeof(p->addr));
+        }
+        memcpy(p->buf, buffer, n);
+        return i;
+    }
+
+    return -1;
+}
+
+esp_err_t espfsp_net_impairment_set(const espfsp_net_impairment_config_t *config)
+{
+    if (mutex_ == NULL)
+    {
+        mutex_ = xSemaphoreCreateBinary();
+        if (mutex_ == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot create mutex");
+            return ESP_FAIL;
+        }
+        xSemaphoreGive(mutex_);
+    }
+
+    if (xSemaphoreTake(mutex_, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    memcpy(&config_, config, sizeof(config_));
+    attach_order_ = 0;
+
+    atomic_store_explicit(&stats_.packets, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.dropped_uniform, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.dropped_burst, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.dropped_overflow, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.reordered, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.duplicated, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.delayed, 0, memory_order_relaxed);
+    atomic_store_explicit(&stats_.rate_limited, 0, memory_order_relaxed);
+
+    if (xSemaphoreGive(mutex_) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+void espfsp_net_impairment_get_stats(espfsp_net_impairment_stats_t *stats)
+{
+    stats->packets = atomic_load_explicit(&stats_.packets, memory_order_relaxed);
+    stats->dropped_uniform = atomic_load_explicit(&stats_.dropped_uniform, memory_order_relaxed);
+    stats->dropped_burst = atomic_load_explicit(&stats_.dropped_burst, memory_order_relaxed);
+    stats->dropped_overflow = atomic_load_explicit(&stats_.dropped_overflow, memory_order_relaxed);
+    stats->reordered = atomic_load_explicit(&stats_.reordered, memory_order_relaxed);
+    stats->duplicated = atomic_load_explicit(&stats_.duplicated, memory_order_relaxed);
+    stats->delayed = atomic_load_explicit(&stats_.delayed, memory_order_relaxed);
+    stats->rate_limited = atomic_load_explicit(&stats_.rate_limited, memory_order_relaxed);
+}
+
+static impaired_socket_t *create_impaired_socket(int sock)
+{
+    impaired_socket_t *s = (impaired_socket_t *) espfsp_mem_calloc(
+        ESPFSP_MEM_TAG_NET_IMPAIRMENT, 0, 1, sizeof(impaired_socket_t));
+    if (s == NULL)
+    {
+        return NULL;
+    }
+
+    s->arena = (uint8_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_NET_IMPAIRMENT, MALLOC_CAP_SPIRAM, ESPFSP_NET_IMPAIRMENT_QUEUE_LEN * ESPFSP_NET_IMPAIRMENT_MAX_PACKET_LEN);
+    s->mutex = xSemaphoreCreateBinary();
+
+    esp_timer_create_args_t timer_args = {
+        .callback = delay_line_cb,
+        .arg = s,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "net_impairment",
+    };
+    if (s->arena == NULL || s->mutex == NULL || esp_timer_create(&timer_args, &s->timer) != ESP_OK)
+    {
+        if (s->mutex != NULL)
+        {
+            vSemaphoreDelete(s->mutex);
+        }
+        espfsp_mem_free(s->arena);
+        espfsp_mem_free(s);
+        return NULL;
+    }
+    xSemaphoreGive(s->mutex);
+
+    for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_QUEUE_LEN; i++)
+    {
+        s->queue[i].buf = s->arena + i * ESPFSP_NET_IMPAIRMENT_MAX_PACKET_LEN;
+    }
+
+    s->sock = sock;
+    s->held = -1;
+    memcpy(&s->config, &config_, sizeof(s->config));
+    s->rng = (config_.seed ^ (0x9E3779B9 * ++attach_order_)) | 1;
+
+    return s;
+}
+
+void espfsp_net_impairment_attach(int sock)
+{
+    if (mutex_ == NULL || xSemaphoreTake(mutex_, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    if (config_.enabled)
+    {
+        int slot = -1;
+        for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_MAX_SOCKETS && slot < 0; i++)
+        {
+            slot = sockets_[i] == NULL ? i : -1;
+        }
+
+        impaired_socket_t *s = slot >= 0 ? create_impaired_socket(sock) : NULL;
+        if (s != NULL)
+        {
+            sockets_[slot] = s;
+            atomic_fetch_add(&attached_count_, 1);
+            ESP_LOGW(TAG, "Socket %d is impaired", sock);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Socket %d cannot be impaired", sock);
+        }
+    }
+
+    xSemaphoreGive(mutex_);
+}
+
+void espfsp_net_impairment_detach(int sock)
+{
+    if (atomic_load(&attached_count_) == 0 || xSemaphoreTake(mutex_, portMAX_DELAY) != pdTRUE)
+    {
+        return;
+    }
+
+    for (int i = 0; i < ESPFSP_NET_IMPAIRMENT_MAX_SOCKETS; i++)
+    {
+        impaired_socket_t *s = sockets_[i];
+        if (s == NULL || s->sock != sock)
+        {
+            continue;
+        }
+
+        // Packets still in delay line are lost, as on closed connection. Mutex is taken, so timer
+        // callback is not in the middle of sending
+        xSemaphoreTake(s->mutex, portMAX_DELAY);
+        esp_timer_stop(s->timer);
+        esp_timer_delete(s->timer);
+        vSemaphoreDelete(s->mutex);
+        espfsp_mem_free(s->arena);
+        espfsp_mem_free(s);
+        sockets_[i] = NULL;
+        atomic_fetch_sub(&attached_count_, 1);
+    }
+
+    xSemaphoreGive(mutex_);
+}
+
+bool espfsp_net_impairment_is_attached(int sock)
+{
+    // Sockets are attached and detached only when nothing sends on them
+    return atomic_load_explicit(&attached_count_, memory_order_relaxed) > 0 && find_socket(sock) != NULL;
+}
+
+int espfsp_net_impairment_send(int sock, const uint8_t *buffer, size_t n, const struct sockaddr_in *dest_addr)
+{
+    impaired_socket_t *s = find_socket(sock);
+    if (s == NULL)
+    {
+        return send_packet(sock, buffer, n, dest_addr);
+    }
+
+    const espfsp_net_impairment_config_t *config = &s->config;
+    int ret = 1;
+
+    STAT_INC(packets);
+
+    if (xSemaphoreTake(s->mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return -1;
+    }
+
+    if (config->burst_enter_permille > 0)
+    {
+        s->burst_bad = s->burst_bad ?
+            !roll(s, config->burst_exit_permille) :
+            roll(s, config->burst_enter_permille);
+    }
+    if (s->burst_bad && roll(s, config->burst_loss_permille))
+    {
+        STAT_INC(dropped_burst);
+        xSemaphoreGive(s->mutex);
+        return 1;
+    }
+    if (roll(s, config->loss_permille))
+    {
+        STAT_INC(dropped_uniform);
+        xSemaphoreGive(s->mutex);
+        return 1;
+    }
+
+    int copies = 1;
+    if (roll(s, config->duplicate_permille))
+    {
+        STAT_INC(duplicated);
+        copies = 2;
+    }
+
+    bool delay_line = config->delay_us > 0 || config->jitter_us > 0 ||
+                      config->rate_limit_kbps > 0 || config->reorder_permille > 0;
+
+    if (!delay_line || n > ESPFSP_NET_IMPAIRMENT_MAX_PACKET_LEN)
+    {
+        xSemaphoreGive(s->mutex);
+        for (int i = 0; i < copies && ret > 0; i++)
+        {
+            ret = send_packet(sock, buffer, n, dest_addr);
+        }
+        return ret;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    int64_t due_us = now_us + config->delay_us;
+
+    if (config->jitter_us > 0)
+    {
+        due_us += next_random(s) % (config->jitter_us + 1);
+    }
+    if (config->rate_limit_kbps > 0)
+    {
+        // Serialization on link of given rate, packets wait for previous ones
+        int64_t start_us = s->link_free_us > now_us ? s->link_free_us : now_us;
+        if (start_us > now_us)
+        {
+            STAT_INC(rate_limited);
+        }
+        s->link_free_us = start_us + (int64_t) n * 8000 / config->rate_limit_kbps;
+        due_us += s->link_free_us - now_us;
+    }
+
+    int last = -1;
+    for (int i = 0; i < copies; i++)
+    {
+        last = enqueue_packet(s, buffer, n, dest_addr, due_us);
+        if (last < 0)
+        {
+            STAT_INC(dropped_overflow);
+        }
+    }
+
+    if (last >= 0)
+    {
+        if (s->held >= 0)
+        {
+            s->queue[s->held].due_us = due_us + 1;
+            s->held = -1;
+        }
+        else if (roll(s, config->reorder_permille))
+        {
+            // Released by next packet, or after hold time if none comes
+            s->queue[last].due_us += ESPFSP_NET_IMPAIRMENT_REORDER_HOLD_US;
+            s->held = last;
+            STAT_INC(reordered);
+        }
+        if (due_us > now_us)
+        {
+            STAT_INC(delayed);
+        }
+    }
+
+    arm_timer(s);
+
+    if (xSemaphoreGive(s->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give semaphore");
+        return -1;
+    }
+
+    return ret;
+}
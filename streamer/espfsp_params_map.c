@@ -133,19 +133,19 @@ esp_err_t espfsp_params_map_set_frame_config(espfsp_frame_config_t *frame_config
         {
         case ESPFSP_PARAM_MAP_FRAME_FRAME_MAX_LEN:
             frame_config->frame_max_len = (uint32_t) value;
-            ESP_LOGI(TAG, "Set frame_max_len: %ld", value);
+            ESP_LOGI(TAG, "Set frame_max_len: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_BUFFERED_FBS:
             frame_config->buffered_fbs = (uint16_t) value;
-            ESP_LOGI(TAG, "Set buffered_fbs: %ld", value);
+            ESP_LOGI(TAG, "Set buffered_fbs: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_FB_IN_BUFFER_BEFORE_GET:
             frame_config->fb_in_buffer_before_get = (uint16_t) value;
-            ESP_LOGI(TAG, "Set fb_in_buffer_before_get: %ld", value);
+            ESP_LOGI(TAG, "Set fb_in_buffer_before_get: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_FPS:
             frame_config->fps = (uint16_t) value;
-            ESP_LOGI(TAG, "Set fps: %ld", value);
+            ESP_LOGI(TAG, "Set fps: %lu", (unsigned long) value);
             break;
         default:
             ESP_LOGE(TAG, "Not handled frame parameter");
@@ -168,23 +168,23 @@ esp_err_t espfsp_params_map_set_cam_config(espfsp_cam_config_t *cam_config, uint
         {
         case ESPFSP_PARAM_MAP_CAM_GRAB_MODE:
             cam_config->cam_grab_mode = (espfsp_grab_mode_t) value;
-            ESP_LOGI(TAG, "Set cam_grab_mode: %ld", value);
+            ESP_LOGI(TAG, "Set cam_grab_mode: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_CAM_JPEG_QUALITY:
             cam_config->cam_jpeg_quality = (int) value;
-            ESP_LOGI(TAG, "Set cam_jpeg_quality: %ld", value);
+            ESP_LOGI(TAG, "Set cam_jpeg_quality: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_CAM_FB_COUNT:
             cam_config->cam_fb_count = (int) value;
-            ESP_LOGI(TAG, "Set cam_fb_count: %ld", value);
+            ESP_LOGI(TAG, "Set cam_fb_count: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_CAM_PIXEL_FORMAT:
             cam_config->cam_pixel_format = (espfsp_pixformat_t) value;
-            ESP_LOGI(TAG, "Set cam_pixel_format: %ld", value);
+            ESP_LOGI(TAG, "Set cam_pixel_format: %lu", (unsigned long) value);
             break;
         case ESPFSP_PARAM_MAP_CAM_FRAME_SIZE:
             cam_config->cam_frame_size = (espfsp_framesize_t) value;
-            ESP_LOGI(TAG, "Set cam_frame_size: %ld", value);
+            ESP_LOGI(TAG, "Set cam_frame_size: %lu", (unsigned long) value);
             break;
         default:
             ESP_LOGE(TAG, "Not handled cam parameter");
@@ -207,19 +207,19 @@ esp_err_t espfsp_params_map_get_frame_config_param_val(espfsp_frame_config_t *fr
         {
         case ESPFSP_PARAM_MAP_FRAME_FRAME_MAX_LEN:
             *value = (uint32_t) frame_config->frame_max_len;
-            ESP_LOGI(TAG, "Read frame_max_len: %ld", *value);
+            ESP_LOGI(TAG, "Read frame_max_len: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_BUFFERED_FBS:
             *value = (uint32_t) frame_config->buffered_fbs;
-            ESP_LOGI(TAG, "Read buffered_fbs: %ld", *value);
+            ESP_LOGI(TAG, "Read buffered_fbs: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_FB_IN_BUFFER_BEFORE_GET:
             *value = (uint32_t) frame_config->fb_in_buffer_before_get;
-            ESP_LOGI(TAG, "Read fb_in_buffer_before_get: %ld", *value);
+            ESP_LOGI(TAG, "Read fb_in_buffer_before_get: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_FRAME_FPS:
             *value = (uint32_t) frame_config->fps;
-            ESP_LOGI(TAG, "Read fps: %ld", *value);
+            ESP_LOGI(TAG, "Read fps: %lu", (unsigned long) *value);
             break;
         default:
             ESP_LOGE(TAG, "Not handled frame parameter");
@@ -242,23 +242,23 @@ esp_err_t espfsp_params_map_get_cam_config_param_val(espfsp_cam_config_t *cam_co
         {
         case ESPFSP_PARAM_MAP_CAM_GRAB_MODE:
             *value = (uint32_t) cam_config->cam_grab_mode;
-            ESP_LOGI(TAG, "Read cam_grab_mode: %ld", *value);
+            ESP_LOGI(TAG, "Read cam_grab_mode: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_CAM_JPEG_QUALITY:
             *value = (uint32_t) cam_config->cam_jpeg_quality;
-            ESP_LOGI(TAG, "Read cam_jpeg_quality: %ld", *value);
+            ESP_LOGI(TAG, "Read cam_jpeg_quality: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_CAM_FB_COUNT:
             *value = (uint32_t) cam_config->cam_fb_count;
-            ESP_LOGI(TAG, "Read cam_fb_count: %ld", *value);
+            ESP_LOGI(TAG, "Read cam_fb_count: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_CAM_PIXEL_FORMAT:
             *value = (uint32_t) cam_config->cam_pixel_format;
-            ESP_LOGI(TAG, "Read cam_pixel_format: %ld", *value);
+            ESP_LOGI(TAG, "Read cam_pixel_format: %lu", (unsigned long) *value);
             break;
         case ESPFSP_PARAM_MAP_CAM_FRAME_SIZE:
             *value = (uint32_t) cam_config->cam_frame_size;
-            ESP_LOGI(TAG, "Read cam_frame_size: %ld", *value);
+            ESP_LOGI(TAG, "Read cam_frame_size: %lu", (unsigned long) *value);
             break;
         default:
             ESP_LOGE(TAG, "Not handled cam parameter");
@@ -12,18 +12,43 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_server.h"
 #include "espfsp_message_buffer.h"
 #include "server/espfsp_state_def.h"
 #include "server/espfsp_comm_proto_conf.h"
+#include "server/espfsp_comm_proto_handlers.h"
 #include "server/espfsp_data_proto_conf.h"
 #include "server/espfsp_session_manager.h"
 #include "server/espfsp_data_task.h"
 #include "server/espfsp_session_and_control_task.h"
+#include "server/espfsp_recorder.h"
+#include "server/espfsp_http_stream.h"
+#include "server/espfsp_rtsp_server.h"
+
+// Session and control task and data task for both push and play
+#define SERVER_STATIC_TASKS 4
 
 static const char *TAG = "ESPFSP_SERVER";
 
-static espfsp_server_state_t *state_ = NULL;
+// Init steps of server, in order
+typedef enum {
+    SERVER_INIT_STEP_NONE,
+    SERVER_INIT_STEP_CONFIG,
+    SERVER_INIT_STEP_RECEIVER_BUFFER,
+    SERVER_INIT_STEP_LAYER_BUFFERS,
+    SERVER_INIT_STEP_COMM_PROTOS,
+    SERVER_INIT_STEP_SESSION_MANAGER,
+    SERVER_INIT_STEP_DATA_PROTOS,
+    SERVER_INIT_STEP_PUSH_SUBSCRIPTION,
+    SERVER_INIT_STEP_RECORDER,
+    SERVER_INIT_STEP_HTTP_STREAM,
+    SERVER_INIT_STEP_RTSP_SERVER,
+    SERVER_INIT_STEP_FRAME_CB,
+    SERVER_INIT_STEP_TASK_GROUP,
+} server_init_step_t;
+
+static espfsp_server_state_t state_;
 
 static uint32_t generate_session_id(espfsp_session_manager_session_type_t type)
 {
@@ -31,12 +56,40 @@ static uint32_t generate_session_id(espfsp_session_manager_session_type_t type)
     return next_id++;
 }
 
+// Stages fed from relay with every completed frame. Each of them only copies frame and never blocks relay
+static void relay_frame_cb(const espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+
+    if (instance->config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF)
+    {
+        espfsp_recorder_feed(fb, &instance->recorder);
+    }
+
+    if (instance->config->http_stream_config.enabled)
+    {
+        espfsp_http_stream_feed(fb, &instance->http_stream);
+    }
+
+    if (instance->config->rtsp_config.enabled)
+    {
+        espfsp_rtsp_server_feed(fb, &instance->rtsp_server);
+    }
+}
+
+static bool is_relay_frame_cb_needed(const espfsp_server_config_t *config)
+{
+    return config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF ||
+           config->http_stream_config.enabled ||
+           config->rtsp_config.enabled;
+}
+
 static esp_err_t start_client_push_session_and_control_task(espfsp_server_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_server_session_and_control_task_data_t *data = (espfsp_server_session_and_control_task_data_t *) malloc(
-        sizeof(espfsp_server_session_and_control_task_data_t));
+    espfsp_server_session_and_control_task_data_t *data = (espfsp_server_session_and_control_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_session_and_control_task_data_t));
 
     if (data == NULL)
     {
@@ -49,19 +102,22 @@ static esp_err_t start_client_push_session_and_control_task(espfsp_server_instan
     data->server_port = instance->config->client_push_local.control_port;
     data->connection_task_info.stack_size = instance->config->client_push_session_and_control_task_info.stack_size;
     data->connection_task_info.task_prio = instance->config->client_push_session_and_control_task_info.task_prio;
+    data->task_group = &instance->task_group;
+    data->session_expired_cb = espfsp_server_connection_stop;
+    data->session_expired_ctx = (void *) instance;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_server_session_and_control_task,
         "push_session_and_control_task",
-        instance->config->client_push_session_and_control_task_info.stack_size,
-        (void *) data,
-        instance->config->client_push_session_and_control_task_info.task_prio,
-        &instance->server_client_push_handle);
+        &instance->config->client_push_session_and_control_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -69,10 +125,10 @@ static esp_err_t start_client_push_session_and_control_task(espfsp_server_instan
 
 static esp_err_t start_client_play_session_and_control_task(espfsp_server_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_server_session_and_control_task_data_t *data = (espfsp_server_session_and_control_task_data_t *) malloc(
-        sizeof(espfsp_server_session_and_control_task_data_t));
+    espfsp_server_session_and_control_task_data_t *data = (espfsp_server_session_and_control_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_session_and_control_task_data_t));
 
     if (data == NULL)
     {
@@ -85,19 +141,22 @@ static esp_err_t start_client_play_session_and_control_task(espfsp_server_instan
     data->server_port = instance->config->client_play_local.control_port;
     data->connection_task_info.stack_size = instance->config->client_play_session_and_control_task_info.stack_size;
     data->connection_task_info.task_prio = instance->config->client_play_session_and_control_task_info.task_prio;
+    data->task_group = &instance->task_group;
+    data->session_expired_cb = espfsp_server_connection_stop;
+    data->session_expired_ctx = (void *) instance;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_server_session_and_control_task,
         "play_session_and_control_task",
-        instance->config->client_play_session_and_control_task_info.stack_size,
-        (void *) data,
-        instance->config->client_play_session_and_control_task_info.task_prio,
-        &instance->server_client_play_handle);
+        &instance->config->client_play_session_and_control_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -105,10 +164,10 @@ static esp_err_t start_client_play_session_and_control_task(espfsp_server_instan
 
 static esp_err_t start_client_push_data_task(espfsp_server_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_server_data_task_data_t *data = (espfsp_server_data_task_data_t *) malloc(
-        sizeof(espfsp_server_data_task_data_t));
+    espfsp_server_data_task_data_t *data = (espfsp_server_data_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_data_task_data_t));
 
     if (data == NULL)
     {
@@ -118,19 +177,20 @@ static esp_err_t start_client_push_data_task(espfsp_server_instance_t * instance
 
     data->data_proto = &instance->client_push_data_proto;
     data->server_port = instance->config->client_push_local.data_port;
+    data->task_group = &instance->task_group;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_server_data_task,
         "push_data_task",
-        instance->config->client_push_data_task_info.stack_size,
-        (void *) data,
-        instance->config->client_push_data_task_info.task_prio,
-        &instance->data_recv_task_handle);
+        &instance->config->client_push_data_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -138,10 +198,10 @@ static esp_err_t start_client_push_data_task(espfsp_server_instance_t * instance
 
 static esp_err_t start_client_play_data_task(espfsp_server_instance_t * instance)
 {
-    BaseType_t xStatus;
+    esp_err_t ret = ESP_OK;
 
-    espfsp_server_data_task_data_t *data = (espfsp_server_data_task_data_t *) malloc(
-        sizeof(espfsp_server_data_task_data_t));
+    espfsp_server_data_task_data_t *data = (espfsp_server_data_task_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_data_task_data_t));
 
     if (data == NULL)
     {
@@ -151,19 +211,20 @@ static esp_err_t start_client_play_data_task(espfsp_server_instance_t * instance
 
     data->data_proto = &instance->client_play_data_proto;
     data->server_port = instance->config->client_play_local.data_port;
+    data->task_group = &instance->task_group;
 
-    xStatus = xTaskCreate(
+    ret = espfsp_task_group_create_task(
+        &instance->task_group,
         espfsp_server_data_task,
         "play_data_task",
-        instance->config->client_play_data_task_info.stack_size,
-        (void *) data,
-        instance->config->client_play_data_task_info.task_prio,
-        &instance->data_send_task_handle);
+        &instance->config->client_play_data_task_info,
+        (void *) data);
 
-    if (xStatus != pdPASS)
+    if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Could not start receiver task!");
-        return ESP_FAIL;
+        espfsp_mem_free(data);
+        return ret;
     }
 
     return ESP_OK;
@@ -194,36 +255,131 @@ static esp_err_t start_tasks(espfsp_server_instance_t * instance)
     return start_client_play_data_task(instance);
 }
 
-static espfsp_server_instance_t *create_new_server(const espfsp_server_config_t *config)
+static esp_err_t stop_tasks(espfsp_server_instance_t *instance)
 {
-    espfsp_server_instance_t *instance = NULL;
+    esp_err_t ret = ESP_OK;
+
+    espfsp_data_proto_stop(&instance->client_push_data_proto);
+    espfsp_data_proto_stop(&instance->client_play_data_proto);
+    espfsp_data_proto_terminate(&instance->client_push_data_proto);
+    espfsp_data_proto_terminate(&instance->client_play_data_proto);
+
+    for (int i = 0; i < instance->client_push_comm_proto_count; i++)
+    {
+        espfsp_comm_proto_stop(&instance->client_push_comm_proto[i]);
+    }
+
+    for (int i = 0; i < instance->client_play_comm_proto_count; i++)
+    {
+        espfsp_comm_proto_stop(&instance->client_play_comm_proto[i]);
+    }
+
+    // Tasks exit on their own, so none of them is killed while holding mutex or memory
+    ret = espfsp_task_group_stop_and_join(&instance->task_group, ESPFSP_TASK_GROUP_JOIN_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_MAX_INSTANCES; i++)
+    return espfsp_task_group_deinit(&instance->task_group);
+}
+
+// Server tasks and connection task for every allowed connection are tracked in one task group
+static bool is_task_count_supported(const espfsp_server_config_t *config)
+{
+    int tasks_count = SERVER_STATIC_TASKS +
+                      espfsp_server_client_push_connections(config) +
+                      espfsp_server_client_play_connections(config);
+
+    if (tasks_count > ESPFSP_TASK_GROUP_MAX_TASKS)
+    {
+        ESP_LOGE(TAG, "Server needs %d tasks, at most %d are supported", tasks_count, ESPFSP_TASK_GROUP_MAX_TASKS);
+        return false;
+    }
+
+    return true;
+}
+
+// Releases what init has done until given step, in reverse order of init. Layer buffers are released
+// by their count, so it covers init that failed among them. Instance is left allocated when its tasks
+// do not stop, as they may still use it.
+static void unwind_server(espfsp_server_instance_t *instance, server_init_step_t done_step)
+{
+    const espfsp_server_config_t *config = instance->config;
+
+    if (done_step >= SERVER_INIT_STEP_TASK_GROUP && stop_tasks(instance) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Server tasks not stopped, instance is leaked");
+        return;
+    }
+    if (done_step >= SERVER_INIT_STEP_FRAME_CB && is_relay_frame_cb_needed(config))
+    {
+        espfsp_message_buffer_set_frame_cb(&instance->receiver_buffer, NULL, NULL);
+    }
+    if (done_step >= SERVER_INIT_STEP_RTSP_SERVER && config->rtsp_config.enabled)
     {
-        if (state_->instances[i].used == false)
+        espfsp_rtsp_server_deinit(&instance->rtsp_server);
+    }
+    if (done_step >= SERVER_INIT_STEP_HTTP_STREAM && config->http_stream_config.enabled &&
+        espfsp_http_stream_deinit(&instance->http_stream) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "HTTP stream tasks not stopped, instance is leaked");
+        return;
+    }
+    if (done_step >= SERVER_INIT_STEP_RECORDER && config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF)
+    {
+        espfsp_recorder_deinit(&instance->recorder);
+    }
+    if (done_step >= SERVER_INIT_STEP_PUSH_SUBSCRIPTION)
+    {
+        espfsp_push_subscription_deinit(&instance->push_subscription);
+    }
+    if (done_step >= SERVER_INIT_STEP_DATA_PROTOS)
+    {
+        espfsp_server_data_protos_deinit(instance);
+    }
+    if (done_step >= SERVER_INIT_STEP_SESSION_MANAGER)
+    {
+        espfsp_session_manager_deinit(&instance->session_manager);
+    }
+    if (done_step >= SERVER_INIT_STEP_COMM_PROTOS)
+    {
+        espfsp_server_comm_protos_deinit(instance);
+    }
+    if (done_step >= SERVER_INIT_STEP_LAYER_BUFFERS)
+    {
+        for (int i = 0; i < instance->layer_receiver_buffers_count; i++)
         {
-            state_->instances[i].used = true;
-            instance = &state_->instances[i];
-            break;
+            espfsp_message_buffer_deinit(&instance->layer_receiver_buffers[i]);
         }
     }
-
-    if (instance == NULL)
+    if (done_step >= SERVER_INIT_STEP_RECEIVER_BUFFER)
     {
-        ESP_LOGE(TAG, "No free instance to create server");
-        return NULL;
+        espfsp_message_buffer_deinit(&instance->receiver_buffer);
     }
+    if (done_step >= SERVER_INIT_STEP_CONFIG)
+    {
+        espfsp_mem_free(instance->config);
+    }
+
+    espfsp_instance_pool_free(&state_.instances, instance);
+}
+
+static esp_err_t init_server(
+    espfsp_server_instance_t *instance, const espfsp_server_config_t *config, server_init_step_t *done_step)
+{
+    esp_err_t err = ESP_OK;
 
-    instance->config = (espfsp_server_config_t *) malloc(sizeof(espfsp_server_config_t));
+    instance->config = (espfsp_server_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_config_t));
     if (instance->config == NULL)
     {
         ESP_LOGE(TAG, "Config is not initialized");
-        return NULL;
+        return ESP_FAIL;
     }
 
     memcpy(instance->config, config, sizeof(espfsp_server_config_t));
-
-    esp_err_t err = ESP_OK;
+    *done_step = SERVER_INIT_STEP_CONFIG;
 
     espfsp_receiver_buffer_config_t receiver_buffer_config = {
         .buffered_fbs = config->frame_config.buffered_fbs,
@@ -235,21 +391,47 @@ static espfsp_server_instance_t *create_new_server(const espfsp_server_config_t
     err = espfsp_message_buffer_init(&instance->receiver_buffer, &receiver_buffer_config);
     if (err != ESP_OK)
     {
-        return NULL;
+        return err;
+    }
+    instance->receiver_buffer.trace_stage = ESPFSP_TRACE_STAGE_SERVER_REASSEMBLED;
+    *done_step = SERVER_INIT_STEP_RECEIVER_BUFFER;
+
+    // Rate of lower layers is chosen by push, relay to play is paced by its decimator
+    espfsp_receiver_buffer_config_t layer_receiver_buffer_config = {
+        .buffered_fbs = ESPFSP_SERVER_SIMULCAST_BUFFERED_FBS,
+        .frame_max_len = config->simulcast_frame_max_len,
+        .fb_in_buffer_before_get = 0,
+        .fps = 0,
+    };
+
+    instance->layer_receiver_buffers_count = 0;
+    *done_step = SERVER_INIT_STEP_LAYER_BUFFERS;
+    for (int i = 0; i < config->simulcast_layers; i++)
+    {
+        err = espfsp_message_buffer_init(&instance->layer_receiver_buffers[i], &layer_receiver_buffer_config);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        instance->layer_receiver_buffers[i].trace_stage = ESPFSP_TRACE_STAGE_SERVER_REASSEMBLED;
+        instance->layer_receiver_buffers_count++;
     }
 
     err = espfsp_server_comm_protos_init(instance);
     if (err != ESP_OK)
     {
-        return NULL;
+        return err;
     }
+    *done_step = SERVER_INIT_STEP_COMM_PROTOS;
 
     espfsp_server_session_manager_config_t session_manager_config = {
         .client_push_comm_protos = instance->client_push_comm_proto,
-        .client_push_comm_protos_count = CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS,
+        .client_push_comm_protos_count = instance->client_push_comm_proto_count,
         .client_play_comm_protos = instance->client_play_comm_proto,
-        .client_play_comm_protos_count = CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS,
+        .client_play_comm_protos_count = instance->client_play_comm_proto_count,
         .session_id_gen = generate_session_id,
+        .resume_grace_ms = config->session_resume_grace_ms > 0 ?
+            config->session_resume_grace_ms : ESPFSP_SERVER_DEFAULT_SESSION_RESUME_GRACE_MS,
     };
 
     // Later Frame Config and Camera Concif should be same default for all parts of ESPFSP -
@@ -260,72 +442,171 @@ static espfsp_server_instance_t *create_new_server(const espfsp_server_config_t
     err = espfsp_session_manager_init(&instance->session_manager, &session_manager_config);
     if (err != ESP_OK)
     {
-        return NULL;
+        return err;
     }
+    *done_step = SERVER_INIT_STEP_SESSION_MANAGER;
 
     err = espfsp_server_data_protos_init(instance);
     if (err != ESP_OK)
     {
-        return NULL;
+        return err;
     }
+    *done_step = SERVER_INIT_STEP_DATA_PROTOS;
 
-    err = start_tasks(instance);
+    // Outputs below take it, so it is ready before them
+    instance->streaming_push_comm_proto = NULL;
+    err = espfsp_push_subscription_init(
+        &instance->push_subscription, espfsp_server_push_stream_start, espfsp_server_push_stream_stop, instance);
     if (err != ESP_OK)
     {
-        return NULL;
+        return err;
     }
+    *done_step = SERVER_INIT_STEP_PUSH_SUBSCRIPTION;
 
-    heap_caps_check_integrity_all(true); // To debug memory
+    if (config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF)
+    {
+        err = espfsp_recorder_init(
+            &instance->recorder, &config->recorder_config, config->frame_config.fps, &instance->push_subscription);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    *done_step = SERVER_INIT_STEP_RECORDER;
 
-    return instance;
+    if (config->http_stream_config.enabled)
+    {
+        err = espfsp_http_stream_init(
+            &instance->http_stream,
+            &config->http_stream_config,
+            config->frame_config.frame_max_len,
+            &instance->push_subscription);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    *done_step = SERVER_INIT_STEP_HTTP_STREAM;
+
+    if (config->rtsp_config.enabled)
+    {
+        err = espfsp_rtsp_server_init(
+            &instance->rtsp_server, &config->rtsp_config, &config->frame_config, &instance->push_subscription);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    *done_step = SERVER_INIT_STEP_RTSP_SERVER;
+
+    if (is_relay_frame_cb_needed(config))
+    {
+        err = espfsp_message_buffer_set_frame_cb(&instance->receiver_buffer, relay_frame_cb, instance);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    *done_step = SERVER_INIT_STEP_FRAME_CB;
+
+    err = espfsp_task_group_init(&instance->task_group);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    *done_step = SERVER_INIT_STEP_TASK_GROUP;
+
+    // Tasks started before failure are stopped and joined with task group
+    return start_tasks(instance);
 }
 
-static esp_err_t stop_tasks(espfsp_server_instance_t *instance)
+static espfsp_server_instance_t *create_new_server(const espfsp_server_config_t *config)
 {
-    espfsp_data_proto_stop(&instance->client_push_data_proto);
-    espfsp_data_proto_stop(&instance->client_play_data_proto);
+    if (config->simulcast_layers > ESPFSP_SIMULCAST_MAX_LOWER_LAYERS)
+    {
+        ESP_LOGE(TAG, "At most %d simulcast layers are supported", ESPFSP_SIMULCAST_MAX_LOWER_LAYERS);
+        return NULL;
+    }
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS; i++)
+    if (!is_task_count_supported(config))
     {
-        espfsp_comm_proto_stop(&instance->client_push_comm_proto[i]);
+        return NULL;
     }
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS; i++)
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) espfsp_instance_pool_alloc(&state_.instances);
+
+    if (instance == NULL)
     {
-        espfsp_comm_proto_stop(&instance->client_play_comm_proto[i]);
+        ESP_LOGE(TAG, "No free instance to create server");
+        return NULL;
     }
 
-    // Wait for task to stop
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    server_init_step_t done_step = SERVER_INIT_STEP_NONE;
+
+    if (init_server(instance, config, &done_step) != ESP_OK)
+    {
+        unwind_server(instance, done_step);
+        return NULL;
+    }
 
-    vTaskDelete(instance->server_client_push_handle);
-    vTaskDelete(instance->server_client_play_handle);
-    vTaskDelete(instance->data_send_task_handle);
-    vTaskDelete(instance->data_recv_task_handle);
+    heap_caps_check_integrity_all(true); // To debug memory
 
-    return ESP_OK;
+    return instance;
 }
 
 static esp_err_t remove_server(espfsp_server_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
 
-    bool is_given_instance_correct = false;
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_MAX_INSTANCES; i++)
+    if (!espfsp_instance_pool_is_allocated(&state_.instances, instance))
     {
-        if (&state_->instances[i] == instance)
+        ESP_LOGE(TAG, "Given instance pointer is incorrect");
+        return ESP_FAIL;
+    }
+
+    ret = stop_tasks(instance);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    if (is_relay_frame_cb_needed(instance->config))
+    {
+        ret = espfsp_message_buffer_set_frame_cb(&instance->receiver_buffer, NULL, NULL);
+        if (ret != ESP_OK)
         {
-            is_given_instance_correct = true;
+            return ret;
         }
     }
 
-    if (is_given_instance_correct == false)
+    if (instance->config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF)
     {
-        ESP_LOGE(TAG, "Given instance pointer is incorrect");
-        return ESP_FAIL;
+        ret = espfsp_recorder_deinit(&instance->recorder);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
     }
 
-    ret = stop_tasks(instance);
+    if (instance->config->http_stream_config.enabled)
+    {
+        ret = espfsp_http_stream_deinit(&instance->http_stream);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    if (instance->config->rtsp_config.enabled)
+    {
+        ret = espfsp_rtsp_server_deinit(&instance->rtsp_server);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
+
+    ret = espfsp_push_subscription_deinit(&instance->push_subscription);
     if (ret != ESP_OK)
     {
         return ret;
@@ -355,27 +636,62 @@ static esp_err_t remove_server(espfsp_server_instance_t *instance)
         return ret;
     }
 
-    free(instance->config);
-    instance->used = false;
+    for (int i = 0; i < instance->layer_receiver_buffers_count; i++)
+    {
+        ret = espfsp_message_buffer_deinit(&instance->layer_receiver_buffers[i]);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+    }
 
-    return ret;
+    espfsp_mem_free(instance->config);
+
+    return espfsp_instance_pool_free(&state_.instances, instance);
+}
+
+esp_err_t espfsp_server_pool_init(const espfsp_pool_config_t *pool_config)
+{
+    if (espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Server pool already initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_init(&state_.instances, sizeof(espfsp_server_instance_t), pool_config);
+}
+
+esp_err_t espfsp_server_pool_deinit()
+{
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
+    {
+        ESP_LOGE(TAG, "Server pool is not initialized");
+        return ESP_FAIL;
+    }
+
+    return espfsp_instance_pool_deinit(&state_.instances);
+}
+
+size_t espfsp_server_pool_storage_size(uint8_t max_instances)
+{
+    return espfsp_instance_pool_storage_size(sizeof(espfsp_server_instance_t), max_instances);
 }
 
 espfsp_server_handler_t espfsp_server_init(const espfsp_server_config_t *config)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
-        state_ = (espfsp_server_state_t *) malloc(sizeof(espfsp_server_state_t));
-        if (state_ == NULL)
+        espfsp_pool_config_t pool_config = {
+            .max_instances = ESPFSP_SERVER_DEFAULT_MAX_INSTANCES,
+            .storage = NULL,
+            .storage_len = 0,
+        };
+
+        if (espfsp_server_pool_init(&pool_config) != ESP_OK)
         {
             ESP_LOGE(TAG, "State initialization failed");
             return NULL;
         }
-
-        for (int i = 0; i < CONFIG_ESPFSP_SERVER_MAX_INSTANCES; i++)
-        {
-            state_->instances[i].used = false;
-        }
     }
 
     espfsp_server_handler_t handler = (espfsp_server_handler_t) create_new_server(config);
@@ -389,7 +705,7 @@ espfsp_server_handler_t espfsp_server_init(const espfsp_server_config_t *config)
 
 void espfsp_server_deinit(espfsp_server_handler_t handler)
 {
-    if (state_ == NULL)
+    if (!espfsp_instance_pool_is_initialized(&state_.instances))
     {
         ESP_LOGE(TAG, "Server state is not initialized");
         return;
@@ -401,3 +717,121 @@ void espfsp_server_deinit(espfsp_server_handler_t handler)
         ESP_LOGE(TAG, "Server removal failed");
     }
 }
+
+esp_err_t espfsp_server_recorder_trigger(espfsp_server_handler_t handler)
+{
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) handler;
+
+    if (instance->config->recorder_config.mode == ESPFSP_RECORDER_MODE_OFF)
+    {
+        ESP_LOGE(TAG, "Recorder is not enabled");
+        return ESP_FAIL;
+    }
+
+    return espfsp_recorder_trigger(&instance->recorder);
+}
+
+esp_err_t espfsp_server_get_stream_status(espfsp_server_handler_t handler, espfsp_stream_status_t *status)
+{
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) handler;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+    espfsp_comm_proto_t *play_primary_session = NULL;
+
+    esp_err_t ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_primary_session(
+            session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY, &play_primary_session);
+        if (ret == ESP_OK && play_primary_session == NULL)
+        {
+            ret = ESP_ERR_NOT_FOUND;
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_stream_status(session_manager, play_primary_session, status);
+        }
+        if (ret == ESP_OK && status->updated_us == 0)
+        {
+            ret = ESP_ERR_NOT_FOUND;
+        }
+
+        espfsp_session_manager_release(session_manager);
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_server_get_stats(espfsp_server_handler_t handler, espfsp_server_stats_t *stats)
+{
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) handler;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+    int sessions_count = 0;
+
+    espfsp_data_proto_get_stats(&instance->client_push_data_proto, &stats->push_stream);
+    espfsp_data_proto_get_stats(&instance->client_play_data_proto, &stats->play_stream);
+    stats->source_static = atomic_load(&instance->source_static);
+    stats->play_layer = atomic_load(&instance->play_layer);
+
+    esp_err_t ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_sessions_stats(
+            session_manager, stats->sessions, ESPFSP_SERVER_STATS_MAX_SESSIONS, &sessions_count);
+        espfsp_session_manager_release(session_manager);
+    }
+
+    stats->sessions_count = sessions_count;
+    espfsp_mem_get_stats(&stats->memory);
+    return ret;
+}
+
+esp_err_t espfsp_server_estimate_memory(const espfsp_server_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    uint32_t frame_max_len = config->frame_config.frame_max_len;
+    espfsp_receiver_buffer_config_t receiver_buffer_config = {
+        .buffered_fbs = config->frame_config.buffered_fbs,
+        .frame_max_len = frame_max_len,
+    };
+
+    memset(estimate, 0, sizeof(espfsp_mem_estimate_t));
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_config_t));
+    for (int i = 0; i < 2; i++)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_session_and_control_task_data_t));
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(espfsp_server_data_task_data_t));
+    }
+
+    espfsp_message_buffer_estimate_memory(&receiver_buffer_config, estimate);
+
+    espfsp_receiver_buffer_config_t layer_receiver_buffer_config = {
+        .buffered_fbs = ESPFSP_SERVER_SIMULCAST_BUFFERED_FBS,
+        .frame_max_len = config->simulcast_frame_max_len,
+    };
+    for (int i = 0; i < config->simulcast_layers && i < ESPFSP_SIMULCAST_MAX_LOWER_LAYERS; i++)
+    {
+        espfsp_message_buffer_estimate_memory(&layer_receiver_buffer_config, estimate);
+    }
+    espfsp_server_comm_protos_estimate_memory(config, estimate);
+    espfsp_session_manager_estimate_memory(
+        espfsp_server_client_push_connections(config), espfsp_server_client_play_connections(config), estimate);
+    espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_RECV, frame_max_len, estimate);
+    espfsp_data_proto_estimate_memory(ESPFSP_DATA_PROTO_TYPE_SEND, frame_max_len, estimate);
+
+    if (config->recorder_config.mode != ESPFSP_RECORDER_MODE_OFF)
+    {
+        espfsp_recorder_estimate_memory(&config->recorder_config, frame_max_len, estimate);
+    }
+
+    if (config->http_stream_config.enabled)
+    {
+        espfsp_http_stream_estimate_memory(&config->http_stream_config, frame_max_len, estimate);
+    }
+
+    if (config->rtsp_config.enabled)
+    {
+        espfsp_rtsp_server_estimate_memory(frame_max_len, estimate);
+    }
+
+    return ESP_OK;
+}
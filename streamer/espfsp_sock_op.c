@@ -3,26 +3,49 @@
  * Author: Maksymilian Komarnicki
  */
 
+#include "sdkconfig.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include <arpa/inet.h>
 #include "esp_netif.h"
 #include <netdb.h>
 #include <sys/socket.h>
 
-#include "lwip/err.h"
+#include <stddef.h>
+
 #include "lwip/sockets.h"
-#include "lwip/sys.h"
 #include <lwip/netdb.h>
 
 #include "espfsp_sock_op.h"
 #include "espfsp_message_defs.h"
+#include "espfsp_net_impairment_shim.h"
 
 #define portTICK_PERIOD_US              ( ( TickType_t ) 1000000 / configTICK_RATE_HZ )
 
 static const char *TAG = "ESPFSP_SOCK_OP";
 
+static void set_keepalive(int sock)
+{
+    int keep_alive_opt = 1;
+
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keep_alive_opt, sizeof(keep_alive_opt));
+
+    int tcp_keepintvl_opt = 4; // the interval between keepalive probes in seconds
+    int tcp_keepcnt_opt = 5; // number of keepalive probes before timing out
+
+#if CONFIG_IDF_TARGET_LINUX
+    int tcp_keepidle_opt = 20; // host takes idle time in seconds
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &tcp_keepidle_opt, sizeof(tcp_keepidle_opt));
+#else
+    int tcp_keepalive_opt = 20000; // TCP keepalive period in milliseconds
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPALIVE, &tcp_keepalive_opt, sizeof(tcp_keepalive_opt));
+#endif
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &tcp_keepintvl_opt, sizeof(tcp_keepintvl_opt));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &tcp_keepcnt_opt, sizeof(tcp_keepcnt_opt));
+}
+
 void espfsp_set_addr(struct sockaddr_in *addr, const struct esp_ip4_addr *esp_addr, int port)
 {
     addr->sin_addr.s_addr = esp_addr->addr;
@@ -39,6 +62,11 @@ void espfsp_set_local_addr(struct sockaddr_in *addr, int port)
 
 static int send_all_to(int sock, u_int8_t *buffer, size_t n, struct sockaddr_in *dest_addr)
 {
+    if (espfsp_net_impairment_is_attached(sock))
+    {
+        return espfsp_net_impairment_send(sock, buffer, n, dest_addr);
+    }
+
     size_t n_left = n;
     while (n_left > 0)
     {
@@ -60,8 +88,14 @@ static int send_all_to(int sock, u_int8_t *buffer, size_t n, struct sockaddr_in
     return 1;
 }
 
-static int send_all(int sock, u_int8_t *buffer, size_t n)
+static int send_all_counted(int sock, u_int8_t *buffer, size_t n, espfsp_stream_counters_t *counters)
 {
+    if (espfsp_net_impairment_is_attached(sock))
+    {
+        return espfsp_net_impairment_send(sock, buffer, n, NULL);
+    }
+
+    bool stalled = false;
     size_t n_left = n;
     while (n_left > 0)
     {
@@ -70,6 +104,11 @@ static int send_all(int sock, u_int8_t *buffer, size_t n)
         {
             if (errno == ENOMEM)
             {
+                if (counters != NULL && !stalled)
+                {
+                    espfsp_stream_counters_add(&counters->send_stalls, 1);
+                }
+                stalled = true;
                 continue;
             }
 
@@ -83,6 +122,11 @@ static int send_all(int sock, u_int8_t *buffer, size_t n)
     return 1;
 }
 
+static int send_all(int sock, u_int8_t *buffer, size_t n)
+{
+    return send_all_counted(sock, buffer, n, NULL);
+}
+
 esp_err_t espfsp_send_whole_fb(int sock, espfsp_fb_t *fb)
 {
     espfsp_message_t message = {
@@ -112,44 +156,181 @@ esp_err_t espfsp_send_whole_fb(int sock, espfsp_fb_t *fb)
     return ESP_OK;
 }
 
-esp_err_t espfsp_send_whole_fb_within(int sock, espfsp_fb_t *fb, uint64_t time_us)
+void espfsp_pacer_init(espfsp_pacer_t *pacer, uint64_t time_us, uint32_t parts)
+{
+    pacer->time_to_wait_us_per_part = parts > 0 ? (uint32_t) (time_us / parts) : 0;
+    pacer->acc_time_to_wait_us = 0UL;
+}
+
+void espfsp_pacer_wait(espfsp_pacer_t *pacer)
+{
+    pacer->acc_time_to_wait_us += pacer->time_to_wait_us_per_part;
+    if (portTICK_PERIOD_US <= pacer->acc_time_to_wait_us)
+    {
+        TickType_t ticks_to_delay = pacer->acc_time_to_wait_us / portTICK_PERIOD_US;
+        pacer->acc_time_to_wait_us = pacer->acc_time_to_wait_us % portTICK_PERIOD_US;
+        vTaskDelay(ticks_to_delay); // Delay to spread messages out in time
+    }
+}
+
+esp_err_t espfsp_send_fragments_within(
+    int sock,
+    size_t total_len,
+    size_t fragment_len,
+    uint8_t *packet,
+    uint64_t time_us,
+    espfsp_build_fragment_cb_t build_fragment,
+    void *ctx,
+    espfsp_stream_counters_t *counters)
+{
+    espfsp_pacer_t pacer;
+    uint32_t fragments = (total_len / fragment_len) + (total_len % fragment_len > 0 ? 1 : 0);
+
+    espfsp_pacer_init(&pacer, time_us, fragments);
+
+    for (size_t i = 0; i < total_len; i += fragment_len)
+    {
+        size_t bytes_to_send = i + fragment_len <= total_len ? fragment_len : total_len - i;
+        size_t packet_len = build_fragment(packet, i, bytes_to_send, i + bytes_to_send == total_len, ctx);
+
+        int err = send_all_counted(sock, packet, packet_len, counters);
+        if (err < 0)
+        {
+            ESP_LOGE(TAG, "Error occurred during sending fragment: errno %d", errno);
+            return ESP_FAIL;
+        }
+        if (counters != NULL)
+        {
+            espfsp_stream_counters_add(&counters->fragments_out, 1);
+            espfsp_stream_counters_add(&counters->bytes_out, packet_len);
+        }
+
+        espfsp_pacer_wait(&pacer);
+    }
+
+    return ESP_OK;
+}
+
+// Header and payload are gathered by stack, so payload is not copied into message. Last fragment is
+// shorter on wire, receiver takes only msg_len bytes of payload.
+static int send_fb_fragment(int sock, espfsp_message_t *message, const char *payload, espfsp_stream_counters_t *counters)
+{
+    size_t header_len = offsetof(espfsp_message_t, buf);
+
+    if (espfsp_net_impairment_is_attached(sock))
+    {
+        if (message->msg_len > 0)
+        {
+            memcpy(message->buf, payload, message->msg_len);
+        }
+        return espfsp_net_impairment_send(sock, (uint8_t *) message, header_len + message->msg_len, NULL);
+    }
+
+    struct iovec iov[2] = {
+        { .iov_base = message, .iov_len = header_len },
+        { .iov_base = (void *) payload, .iov_len = message->msg_len },
+    };
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+    };
+
+    bool stalled = false;
+    while (sendmsg(sock, &msg, 0) < 0)
+    {
+        if (errno != ENOMEM)
+        {
+            ESP_LOGE(TAG, "Send message failed with errno %d", errno);
+            return -1;
+        }
+
+        if (counters != NULL && !stalled)
+        {
+            espfsp_stream_counters_add(&counters->send_stalls, 1);
+        }
+        stalled = true;
+    }
+
+    return 1;
+}
+
+static bool should_abandon(espfsp_send_preempt_t *preempt, int64_t start_us)
+{
+    return preempt != NULL &&
+           (uint64_t) (esp_timer_get_time() - start_us) >= preempt->after_us &&
+           preempt->newer_frame(preempt->ctx);
+}
+
+static esp_err_t abandon_fb(int sock, espfsp_message_t *message, espfsp_send_preempt_t *preempt)
+{
+    preempt->abandoned = true;
+
+    if (!preempt->send_abort)
+    {
+        return ESP_OK;
+    }
+
+    message->msg_number = MESSAGE_NUMBER_ABORT;
+    message->msg_len = 0;
+
+    if (send_fb_fragment(sock, message, NULL, NULL) < 0)
+    {
+        ESP_LOGE(TAG, "Error occurred during sending frame abort: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_send_whole_fb_within(
+    int sock,
+    espfsp_fb_t *fb,
+    uint8_t layer,
+    uint64_t time_us,
+    espfsp_stream_counters_t *counters,
+    espfsp_send_preempt_t *preempt)
 {
+    int msg_total = (fb->len / MESSAGE_BUFFER_SIZE) + (fb->len % MESSAGE_BUFFER_SIZE > 0 ? 1 : 0);
     espfsp_message_t message = {
         .len = fb->len,
         .width = fb->width,
         .height = fb->height,
         .timestamp.tv_sec = fb->timestamp.tv_sec,
         .timestamp.tv_usec = fb->timestamp.tv_usec,
-        .msg_total = (fb->len / MESSAGE_BUFFER_SIZE) + (fb->len % MESSAGE_BUFFER_SIZE > 0 ? 1 : 0)};
+        .msg_total = msg_total | ((int) layer << MESSAGE_LAYER_SHIFT)};
 
-    uint32_t time_to_wait_us_per_msg = (uint32_t) (time_us / message.msg_total);
-    uint32_t acc_time_to_wait_us = 0UL;
+    espfsp_pacer_t pacer;
+    espfsp_pacer_init(&pacer, time_us, msg_total);
+    int64_t start_us = esp_timer_get_time();
 
-    // ESP_LOGI(TAG, "Delay per msg: %ldus", time_to_wait_us_per_msg);
-    // ESP_LOGI(TAG, "Ticks len: %ldus", portTICK_PERIOD_US);
+    if (preempt != NULL)
+    {
+        preempt->abandoned = false;
+    }
 
     for (size_t i = 0; i < fb->len; i += MESSAGE_BUFFER_SIZE)
     {
-        int bytes_to_send = i + MESSAGE_BUFFER_SIZE <= fb->len ? MESSAGE_BUFFER_SIZE : fb->len - i;
+        if (should_abandon(preempt, start_us))
+        {
+            return abandon_fb(sock, &message, preempt);
+        }
 
         message.msg_number = i / MESSAGE_BUFFER_SIZE;
-        message.msg_len = bytes_to_send;
-        memcpy(message.buf, fb->buf + i, bytes_to_send);
+        message.msg_len = i + MESSAGE_BUFFER_SIZE <= fb->len ? MESSAGE_BUFFER_SIZE : fb->len - i;
 
-        int err = send_all(sock, (u_int8_t *)&message, sizeof(espfsp_message_t));
+        int err = send_fb_fragment(sock, &message, fb->buf + i, counters);
         if (err < 0)
         {
-            ESP_LOGE(TAG, "Error occurred during sending FB: errno %d", errno);
+            ESP_LOGE(TAG, "Error occurred during sending fragment: errno %d", errno);
             return ESP_FAIL;
         }
-
-        acc_time_to_wait_us += time_to_wait_us_per_msg;
-        if (portTICK_PERIOD_US <= acc_time_to_wait_us)
+        if (counters != NULL)
         {
-            TickType_t ticks_to_delay = acc_time_to_wait_us / portTICK_PERIOD_US;
-            acc_time_to_wait_us = acc_time_to_wait_us % portTICK_PERIOD_US;
-            vTaskDelay(ticks_to_delay); // Delay to spread messages out in time
+            espfsp_stream_counters_add(&counters->fragments_out, 1);
+            espfsp_stream_counters_add(&counters->bytes_out, offsetof(espfsp_message_t, buf) + message.msg_len);
         }
+
+        espfsp_pacer_wait(&pacer);
     }
 
     return ESP_OK;
@@ -504,19 +685,7 @@ esp_err_t espfsp_tcp_accept(int listen_sock, int *sock, struct sockaddr_in *sour
         return ESP_FAIL;
     }
 
-    int keep_alive_opt = 1;
-
-    setsockopt(*sock, SOL_SOCKET, SO_KEEPALIVE, &keep_alive_opt, sizeof(keep_alive_opt));
-
-    int tcp_keepalive_opt = 20000; // TCP keepalive period in milliseconds
-    // int tcp_keepidle_opt = 1; // same as TCP_KEEPALIVE, but the value is in seconds
-    int tcp_keepintvl_opt = 4; // the interval between keepalive probes in seconds
-    int tcp_keepcnt_opt = 5; // number of keepalive probes before timing out
-
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPALIVE, &tcp_keepalive_opt, sizeof(tcp_keepalive_opt));
-    // setsockopt(*sock, IPPROTO_TCP, TCP_KEEPIDLE, &tcp_keepidle_opt, sizeof(tcp_keepidle_opt));
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPINTVL, &tcp_keepintvl_opt, sizeof(tcp_keepintvl_opt));
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPCNT, &tcp_keepcnt_opt, sizeof(tcp_keepcnt_opt));
+    set_keepalive(*sock);
 
     inet_ntoa_r(source_addr->sin_addr, addr_str, sizeof(addr_str) - 1);
 
@@ -589,19 +758,7 @@ esp_err_t espfsp_create_tcp_client(int *sock, int client_port, struct sockaddr_i
     int opt = 1;
     setsockopt(*sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
-    int keep_alive_opt = 1;
-
-    setsockopt(*sock, SOL_SOCKET, SO_KEEPALIVE, &keep_alive_opt, sizeof(keep_alive_opt));
-
-    int tcp_keepalive_opt = 20000; // TCP keepalive period in milliseconds
-    // int tcp_keepidle_opt = 1; // same as TCP_KEEPALIVE, but the value is in seconds
-    int tcp_keepintvl_opt = 4; // the interval between keepalive probes in seconds
-    int tcp_keepcnt_opt = 5; // number of keepalive probes before timing out
-
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPALIVE, &tcp_keepalive_opt, sizeof(tcp_keepalive_opt));
-    // setsockopt(*sock, IPPROTO_TCP, TCP_KEEPIDLE, &tcp_keepidle_opt, sizeof(tcp_keepidle_opt));
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPINTVL, &tcp_keepintvl_opt, sizeof(tcp_keepintvl_opt));
-    setsockopt(*sock, IPPROTO_TCP, TCP_KEEPCNT, &tcp_keepcnt_opt, sizeof(tcp_keepcnt_opt));
+    set_keepalive(*sock);
 
     err = bind(*sock, (struct sockaddr *)&client_addr, sizeof(client_addr));
     if (err != 0)
@@ -652,6 +809,7 @@ esp_err_t espfsp_create_udp_server(int *sock, int port)
     }
 
     ESP_LOGI(TAG, "UDP server socket bound");
+    espfsp_net_impairment_attach(*sock);
     return ESP_OK;
 }
 
@@ -692,6 +850,7 @@ esp_err_t espfsp_create_udp_client(int *sock, int client_port, struct sockaddr_i
     }
 
     ESP_LOGI(TAG, "UDP client socket connected");
+    espfsp_net_impairment_attach(*sock);
     return ESP_OK;
 }
 
@@ -713,6 +872,8 @@ esp_err_t espfsp_remove_udp_host(int sock)
 {
     int err = 0;
 
+    espfsp_net_impairment_detach(sock);
+
     err = close(sock);
     if (err != 0 && errno != ENOTCONN)
     {
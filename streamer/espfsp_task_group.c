@@ -0,0 +1,220 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+
+#include "lwip/sockets.h"
+
+#include "espfsp_task_group.h"
+
+#define TASK_GROUP_SLOTS_BITS ((1 << ESPFSP_TASK_GROUP_MAX_TASKS) - 1)
+#define TASK_GROUP_STOP_BIT (1 << ESPFSP_TASK_GROUP_MAX_TASKS)
+
+static const char *TAG = "ESPFSP_TASK_GROUP";
+
+esp_err_t espfsp_task_group_init(espfsp_task_group_t *group)
+{
+    for (int i = 0; i < ESPFSP_TASK_GROUP_MAX_TASKS; i++)
+    {
+        group->tasks[i] = NULL;
+        group->socks[i] = -1;
+    }
+
+    group->events = xEventGroupCreate();
+    if (group->events == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot create event group");
+        return ESP_FAIL;
+    }
+
+    group->mutex = xSemaphoreCreateBinary();
+    if (group->mutex == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        vEventGroupDelete(group->events);
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreGive(group->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot give after init semaphore");
+        vSemaphoreDelete(group->mutex);
+        vEventGroupDelete(group->events);
+        return ESP_FAIL;
+    }
+
+    xEventGroupSetBits(group->events, TASK_GROUP_SLOTS_BITS);
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_task_group_deinit(espfsp_task_group_t *group)
+{
+    vSemaphoreDelete(group->mutex);
+    vEventGroupDelete(group->events);
+
+    return ESP_OK;
+}
+
+static int find_current_task_slot(espfsp_task_group_t *group)
+{
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+
+    for (int i = 0; i < ESPFSP_TASK_GROUP_MAX_TASKS; i++)
+    {
+        if (group->tasks[i] == current)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+esp_err_t espfsp_task_group_create_task(
+    espfsp_task_group_t *group, TaskFunction_t task, const char *name, const espfsp_task_info_t *task_info, void *arg)
+{
+    esp_err_t ret = ESP_OK;
+    int slot = -1;
+
+    if (espfsp_task_group_should_stop(group))
+    {
+        ESP_LOGE(TAG, "Task group is stopping");
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(group->mutex, portMAX_DELAY);
+
+    EventBits_t free_slots = xEventGroupGetBits(group->events) & TASK_GROUP_SLOTS_BITS;
+    for (int i = 0; i < ESPFSP_TASK_GROUP_MAX_TASKS; i++)
+    {
+        if (free_slots & (1 << i))
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0)
+    {
+        ESP_LOGE(TAG, "No free slot for task %s", name);
+        ret = ESP_FAIL;
+    }
+
+    if (ret == ESP_OK)
+    {
+        xEventGroupClearBits(group->events, 1 << slot);
+
+        // Mutex is held, so task cannot look for its slot before handle is stored
+        BaseType_t xStatus = xTaskCreate(
+            task, name, task_info->stack_size, arg, task_info->task_prio, &group->tasks[slot]);
+
+        if (xStatus != pdPASS)
+        {
+            ESP_LOGE(TAG, "Could not start task %s", name);
+            group->tasks[slot] = NULL;
+            xEventGroupSetBits(group->events, 1 << slot);
+            ret = ESP_FAIL;
+        }
+    }
+
+    xSemaphoreGive(group->mutex);
+
+    return ret;
+}
+
+void espfsp_task_group_exit(espfsp_task_group_t *group)
+{
+    xSemaphoreTake(group->mutex, portMAX_DELAY);
+
+    int slot = find_current_task_slot(group);
+    if (slot >= 0)
+    {
+        group->tasks[slot] = NULL;
+        group->socks[slot] = -1;
+        xEventGroupSetBits(group->events, 1 << slot);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Task not found in group");
+    }
+
+    xSemaphoreGive(group->mutex);
+
+    // Group is not touched from here, owner may release it as soon as slot is free
+    vTaskDelete(NULL);
+}
+
+bool espfsp_task_group_should_stop(espfsp_task_group_t *group)
+{
+    return (xEventGroupGetBits(group->events) & TASK_GROUP_STOP_BIT) != 0;
+}
+
+bool espfsp_task_group_wait_stop(espfsp_task_group_t *group, uint32_t time_ms)
+{
+    EventBits_t bits = xEventGroupWaitBits(
+        group->events, TASK_GROUP_STOP_BIT, pdFALSE, pdTRUE, time_ms / portTICK_PERIOD_MS);
+
+    return (bits & TASK_GROUP_STOP_BIT) != 0;
+}
+
+void espfsp_task_group_set_sock(espfsp_task_group_t *group, int sock)
+{
+    xSemaphoreTake(group->mutex, portMAX_DELAY);
+
+    int slot = find_current_task_slot(group);
+    if (slot >= 0)
+    {
+        group->socks[slot] = sock;
+    }
+
+    bool stopping = espfsp_task_group_should_stop(group);
+
+    xSemaphoreGive(group->mutex);
+
+    // Socket registered after stop request would never be shut down otherwise
+    if (stopping && sock >= 0)
+    {
+        shutdown(sock, SHUT_RDWR);
+    }
+}
+
+esp_err_t espfsp_task_group_stop_and_join(espfsp_task_group_t *group, uint32_t timeout_ms)
+{
+    xSemaphoreTake(group->mutex, portMAX_DELAY);
+
+    xEventGroupSetBits(group->events, TASK_GROUP_STOP_BIT);
+
+    // Blocking TCP calls return after shutdown. UDP receives use timeouts, so they end on their own.
+    for (int i = 0; i < ESPFSP_TASK_GROUP_MAX_TASKS; i++)
+    {
+        if (group->socks[i] >= 0)
+        {
+            shutdown(group->socks[i], SHUT_RDWR);
+        }
+    }
+
+    xSemaphoreGive(group->mutex);
+
+    EventBits_t bits = xEventGroupWaitBits(
+        group->events, TASK_GROUP_SLOTS_BITS, pdFALSE, pdTRUE, timeout_ms / portTICK_PERIOD_MS);
+
+    if ((bits & TASK_GROUP_SLOTS_BITS) != TASK_GROUP_SLOTS_BITS)
+    {
+        ESP_LOGE(TAG, "Tasks did not exit within %ld ms", (long) timeout_ms);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,157 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdatomic.h>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+#include "espfsp_latency_hist.h"
+#include "espfsp_trace_ring.h"
+
+#if CONFIG_ESPFSP_TRACE
+
+// Largest power of two not greater than configured length, so index is masked
+#define TRACE_RING_LEN (1U << (31 - __builtin_clz(CONFIG_ESPFSP_TRACE_RING_LEN)))
+
+// Records searched back for earlier stage of frame, frames older than that are taken as not traced
+#define TRACE_PAIR_SEARCH_LEN 1024
+
+typedef struct
+{
+    int64_t time_us;
+    uint32_t frame_id;          // Low bits of capture time in microseconds
+    uint32_t stage;
+} trace_record_t;
+
+static trace_record_t ring_[TRACE_RING_LEN];
+static _Atomic uint32_t next_;
+
+static const char *STAGE_NAMES[ESPFSP_TRACE_STAGE_MAX] = {
+    "capture",
+    "send_start",
+    "send_end",
+    "server_reassembled",
+    "server_send_frame",
+    "play_reassembled",
+    "get_fb",
+    "return_fb",
+};
+
+void espfsp_trace_record(espfsp_trace_stage_t stage, const struct timeval *capture_timestamp)
+{
+    uint32_t index = atomic_fetch_add_explicit(&next_, 1, memory_order_relaxed) & (TRACE_RING_LEN - 1);
+    trace_record_t *record = &ring_[index];
+
+    record->time_us = esp_timer_get_time();
+    record->frame_id = (uint32_t) ((int64_t) capture_timestamp->tv_sec * 1000000 + capture_timestamp->tv_usec);
+    record->stage = stage;
+}
+
+esp_err_t espfsp_trace_dump_json(FILE *out, uint32_t pid)
+{
+    uint32_t next = atomic_load_explicit(&next_, memory_order_relaxed);
+    uint32_t count = next < TRACE_RING_LEN ? next : TRACE_RING_LEN;
+    uint32_t first = next - count;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    // Stage is thread, so every stage has its own track
+    for (int stage = 0; stage < ESPFSP_TRACE_STAGE_MAX; stage++)
+    {
+        fprintf(out,
+                "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                (unsigned long) pid, stage, STAGE_NAMES[stage]);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const trace_record_t *record = &ring_[(first + i) & (TRACE_RING_LEN - 1)];
+        if (record->stage >= ESPFSP_TRACE_STAGE_MAX)
+        {
+            continue;
+        }
+
+        fprintf(out,
+                "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":%lu,\"tid\":%lu,\"args\":{\"frame\":%lu}}%s\n",
+                STAGE_NAMES[record->stage],
+                (long long) record->time_us,
+                (unsigned long) pid,
+                (unsigned long) record->stage,
+                (unsigned long) record->frame_id,
+                i + 1 < count ? "," : "");
+    }
+
+    fprintf(out, "]}\n");
+    return ferror(out) ? ESP_FAIL : ESP_OK;
+}
+
+void espfsp_trace_clear(void)
+{
+    atomic_store_explicit(&next_, 0, memory_order_relaxed);
+}
+
+esp_err_t espfsp_trace_get_stage_latency(
+    espfsp_trace_stage_t from, espfsp_trace_stage_t to, espfsp_latency_stats_t *stats)
+{
+    uint32_t next = atomic_load_explicit(&next_, memory_order_relaxed);
+    uint32_t count = next < TRACE_RING_LEN ? next : TRACE_RING_LEN;
+    uint32_t first = next - count;
+    espfsp_latency_hist_t hist;
+
+    if (from >= ESPFSP_TRACE_STAGE_MAX || to >= ESPFSP_TRACE_STAGE_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    espfsp_latency_hist_reset(&hist);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const trace_record_t *record = &ring_[(first + i) & (TRACE_RING_LEN - 1)];
+        if (record->stage != to)
+        {
+            continue;
+        }
+
+        for (uint32_t j = i; j > 0 && i - j < TRACE_PAIR_SEARCH_LEN; j--)
+        {
+            const trace_record_t *earlier = &ring_[(first + j - 1) & (TRACE_RING_LEN - 1)];
+            if (earlier->stage == from && earlier->frame_id == record->frame_id)
+            {
+                espfsp_latency_hist_add(&hist, record->time_us - earlier->time_us);
+                break;
+            }
+        }
+    }
+
+    espfsp_latency_hist_get_stats(&hist, stats);
+    stats->window_us = 0;
+    if (count > 0)
+    {
+        stats->window_us = ring_[(next - 1) & (TRACE_RING_LEN - 1)].time_us - ring_[first & (TRACE_RING_LEN - 1)].time_us;
+    }
+
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t espfsp_trace_dump_json(FILE *out, uint32_t pid)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void espfsp_trace_clear(void)
+{
+}
+
+esp_err_t espfsp_trace_get_stage_latency(
+    espfsp_trace_stage_t from, espfsp_trace_stage_t to, espfsp_latency_stats_t *stats)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
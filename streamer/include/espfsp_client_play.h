@@ -31,10 +31,20 @@ typedef struct
     espfsp_frame_config_t frame_config;
 } espfsp_client_play_config_t;
 
+// Optional, has to be called before first espfsp_client_play_init(). Without it pool for single client is allocated.
+esp_err_t espfsp_client_play_pool_init(const espfsp_pool_config_t *pool_config);
+
+// Frees pool, all clients have to be deinitialized before
+esp_err_t espfsp_client_play_pool_deinit();
+
+// Size of static storage for pool with given number of clients
+size_t espfsp_client_play_pool_storage_size(uint8_t max_instances);
+
 espfsp_client_play_handler_t espfsp_client_play_init(const espfsp_client_play_config_t *config);
 
 void espfsp_client_play_deinit(espfsp_client_play_handler_t handler);
 
+// While scene of source is static, frames come only at its keepalive rate, see scene_static in stats
 espfsp_fb_t *espfsp_client_play_get_fb(espfsp_client_play_handler_t handler, uint32_t timeout_ms);
 
 esp_err_t espfsp_client_play_return_fb(espfsp_client_play_handler_t handler, espfsp_fb_t *fb);
@@ -63,3 +73,22 @@ esp_err_t espfsp_client_play_get_sources_timeout(
 
 esp_err_t espfsp_client_play_set_source(
     espfsp_client_play_handler_t handler, const char source_name[SOURCE_NAME_LEN_MAX]);
+
+esp_err_t espfsp_client_play_get_clock_sync(espfsp_client_play_handler_t handler, espfsp_clock_sync_info_t *info);
+
+// Maps capture timestamp of frame, which is in clock of CLIENT_PUSH, to local esp_timer_get_time() clock.
+// Difference to current time is glass-to-glass latency. ESP_ERR_NOT_FOUND until clocks are synchronized.
+esp_err_t espfsp_client_play_capture_time_to_local(
+    espfsp_client_play_handler_t handler, const espfsp_fb_t *fb, int64_t *local_time_us);
+
+// Glass-to-glass latency of frames returned by espfsp_client_play_get_fb(), measured with synchronized
+// clocks. Resetting starts new measurement window, e.g. when stream configuration changes.
+esp_err_t espfsp_client_play_get_latency_stats(espfsp_client_play_handler_t handler, espfsp_latency_stats_t *stats);
+
+esp_err_t espfsp_client_play_reset_latency_stats(espfsp_client_play_handler_t handler);
+
+// Counters are updated without locks, so it can be called periodically in production
+esp_err_t espfsp_client_play_get_stats(espfsp_client_play_handler_t handler, espfsp_client_stats_t *stats);
+
+// Heap that client with given configuration takes once running, without instance pool. Nothing is allocated.
+esp_err_t espfsp_client_play_estimate_memory(const espfsp_client_play_config_t *config, espfsp_mem_estimate_t *estimate);
@@ -7,6 +7,7 @@
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
 #include "esp_netif.h"
@@ -15,10 +16,22 @@
 
 typedef void * espfsp_client_push_handler_t;
 
+// Frames of unchanged scene are sent only at keepalive rate. Change is detected from JPEG size, or from luma
+// of coarse grid for raw formats, compared to last changed frame. First changed frame is sent at once.
+typedef struct
+{
+    bool enabled;
+    uint16_t jpeg_size_delta_permille;  // JPEG size change taken as scene change
+    uint8_t luma_delta;                 // Change of any grid cell taken as scene change, raw formats
+    uint16_t static_after_frames;       // Unchanged frames sent at full rate before scene is static
+    uint32_t keepalive_interval_ms;     // Frame interval while scene is static
+} espfsp_static_scene_config_t;
+
 typedef struct
 {
     espfsp_task_info_t data_task_info;
     espfsp_task_info_t session_and_control_task_info;
+    espfsp_task_info_t capture_task_info;               // Used only with at least 2 send buffers
 
     espfsp_connection_info_t local;
     espfsp_connection_info_t remote;
@@ -28,8 +41,40 @@ typedef struct
     espfsp_client_push_cb_t cb;
     espfsp_frame_config_t frame_config;
     espfsp_cam_config_t cam_config;
+
+    // With 2 or more, next frame is captured in own task while previous one is sent. Each buffer takes
+    // frame_max_len. 0 or 1 keeps capture in data task.
+    uint8_t send_buffers;
+
+    // Frame sent longer than this percent of frame interval is abandoned, once newer one is captured.
+    // Works with at least 2 send buffers, 0 disables.
+    uint16_t preempt_after_percent;
+
+    espfsp_static_scene_config_t static_scene;
+
+    // Simulcast. Lower layers are derived from camera frames with cb.derive_layer and sent besides them,
+    // server chooses layer of viewer. 0 sends camera stream only.
+    uint8_t simulcast_layers;
+    espfsp_simulcast_layer_config_t simulcast[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
 } espfsp_client_push_config_t;
 
+// Optional, has to be called before first espfsp_client_push_init(). Without it pool for single client is allocated.
+esp_err_t espfsp_client_push_pool_init(const espfsp_pool_config_t *pool_config);
+
+// Frees pool, all clients have to be deinitialized before
+esp_err_t espfsp_client_push_pool_deinit();
+
+// Size of static storage for pool with given number of clients
+size_t espfsp_client_push_pool_storage_size(uint8_t max_instances);
+
 espfsp_client_push_handler_t espfsp_client_push_init(const espfsp_client_push_config_t *config);
 
 void espfsp_client_push_deinit(espfsp_client_push_handler_t handler);
+
+esp_err_t espfsp_client_push_get_clock_sync(espfsp_client_push_handler_t handler, espfsp_clock_sync_info_t *info);
+
+// Counters are updated without locks, so it can be called periodically in production
+esp_err_t espfsp_client_push_get_stats(espfsp_client_push_handler_t handler, espfsp_client_stats_t *stats);
+
+// Heap that client with given configuration takes once running, without instance pool. Nothing is allocated.
+esp_err_t espfsp_client_push_estimate_memory(const espfsp_client_push_config_t *config, espfsp_mem_estimate_t *estimate);
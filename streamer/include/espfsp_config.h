@@ -5,10 +5,15 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "sys/time.h"
 
 #include "espfsp_cam_config.h"
 #include "espfsp_frame_config.h"
+#include "espfsp_mem.h"
 
 typedef int esp_err_t;
 
@@ -34,12 +39,87 @@ typedef struct
     int data_port;
 } espfsp_connection_info_t;
 
+// Memory for all instances of one role (server, client play or client push). When storage is given,
+// pool does not use heap; required size is returned by espfsp_<role>_pool_storage_size().
+typedef struct
+{
+    uint8_t max_instances;
+    void *storage;              // Optional, NULL to allocate pool on heap
+    size_t storage_len;
+} espfsp_pool_config_t;
+
+// Estimate for connection to server. offset_us is server clock minus local clock, both are
+// esp_timer_get_time() clocks, the same as frame capture timestamps.
+typedef struct
+{
+    int64_t rtt_us;             // Smoothed round trip time
+    int64_t offset_us;
+    bool valid;                 // False until first PING/PONG exchange
+} espfsp_clock_sync_info_t;
+
+// Counters of single data stream since its start. They wrap around, so rates are taken from
+// differences of two readings.
+typedef struct
+{
+    uint32_t fragments_in;
+    uint32_t fragments_out;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint32_t frames_completed;          // Received with all fragments
+    uint32_t frames_sent;
+    uint32_t frames_dropped_incomplete;
+    uint32_t frames_dropped_late;       // Replaced by newer frames before consumer took them
+    uint32_t frames_dropped_oversize;   // Larger than allowed frame size
+    uint32_t send_stalls;               // Sends retried as network stack had no memory
+    uint32_t frames_preempted;          // Abandoned for newer frame by sender, on receiving side reclaimed on abort
+    uint16_t queue_depth;               // Completed frames waiting for consumer
+} espfsp_stream_stats_t;
+
+typedef struct
+{
+    uint32_t session_id;
+    bool session_active;
+    bool stream_started;
+    espfsp_clock_sync_info_t clock_sync;    // Control connection RTT
+    espfsp_stream_stats_t stream;
+    espfsp_mem_stats_t memory;              // Whole component, see espfsp_mem_get_stats()
+    bool scene_static;                      // Push sends keepalive frames only, play is told so by server
+} espfsp_client_stats_t;
+
+// Latency distribution since last reset. Frame rate is count per window_us.
+typedef struct
+{
+    uint32_t count;
+    int64_t window_us;
+    uint32_t min_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} espfsp_latency_stats_t;
+
+// Latency in stream status reports when clocks of both ends are not synchronized yet
+#define ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN 0xFFFF
+
 typedef enum
 {
     ESPFSP_TRANSPORT_UDP,
     ESPFSP_TRANSPORT_TCP,
 } espfsp_transport_t;
 
+// Lower layers of simulcast stream, besides the camera stream which is layer 0
+#define ESPFSP_SIMULCAST_MAX_LOWER_LAYERS 2
+
+// Lower layer is derived from camera frame, e.g. scaled down and encoded with lower quality
+typedef struct
+{
+    uint16_t width;
+    uint16_t height;
+    uint8_t quality;            // Passed to derive_layer callback as is
+    uint16_t fps;               // Not over fps of camera stream, 0 for every camera frame
+    uint32_t frame_max_len;
+} espfsp_simulcast_layer_config_t;
+
 typedef enum
 {
     ESPFSP_SEND_FRAME_CB_FRAME_OBTAINED,
@@ -50,6 +130,11 @@ typedef esp_err_t (*__espfsp_start_cam)(const espfsp_cam_config_t *cam_config, c
 typedef esp_err_t (*__espfsp_stop_cam)();
 typedef esp_err_t (*__espfsp_send_frame)(espfsp_fb_t *fb, espfsp_send_frame_cb_state_t *state, uint32_t max_allowed_size);
 typedef esp_err_t (*__espfsp_send_reconf_cam)(const espfsp_cam_config_t *cam_config);
+typedef esp_err_t (*__espfsp_acquire_frame)(
+    espfsp_fb_t *fb, void **frame_ctx, espfsp_send_frame_cb_state_t *state, uint32_t max_allowed_size);
+typedef void (*__espfsp_release_frame)(espfsp_fb_t *fb, void *frame_ctx);
+typedef esp_err_t (*__espfsp_derive_layer)(
+    const espfsp_fb_t *source, espfsp_fb_t *fb, const espfsp_simulcast_layer_config_t *layer, uint32_t max_allowed_size);
 
 typedef struct
 {
@@ -57,4 +142,12 @@ typedef struct
     __espfsp_stop_cam stop_cam;
     __espfsp_send_frame send_frame;
     __espfsp_send_reconf_cam reconf_cam;
+
+    // Optional pair used instead of send_frame, like esp_camera_fb_get/return. fb->buf points to driver
+    // memory, that is sent without copy and given back after last fragment. frame_ctx is passed back as is.
+    __espfsp_acquire_frame acquire_frame;
+    __espfsp_release_frame release_frame;
+
+    // Required with simulcast layers. Fills fb->buf, fb->buf is of max_allowed_size.
+    __espfsp_derive_layer derive_layer;
 } espfsp_client_push_cb_t;
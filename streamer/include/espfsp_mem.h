@@ -0,0 +1,60 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Heap used by component, accounted per subsystem and per memory capability. Shared by all
+// servers and clients in application. Bytes include allocator bookkeeping of component, but not of heap itself.
+
+typedef enum
+{
+    ESPFSP_MEM_TAG_INSTANCE,            // Pools, configs, task data and queues of server and clients
+    ESPFSP_MEM_TAG_MESSAGE_BUFFER,
+    ESPFSP_MEM_TAG_DATA_PROTO,
+    ESPFSP_MEM_TAG_COMM_PROTO,
+    ESPFSP_MEM_TAG_SESSION_MANAGER,
+    ESPFSP_MEM_TAG_RECORDER,
+    ESPFSP_MEM_TAG_HTTP_STREAM,
+    ESPFSP_MEM_TAG_RTSP,
+    ESPFSP_MEM_TAG_NET_IMPAIRMENT,
+    ESPFSP_MEM_TAG_MAX,
+} espfsp_mem_tag_t;
+
+typedef enum
+{
+    ESPFSP_MEM_CAP_DEFAULT,             // malloc(), placed by heap configuration
+    ESPFSP_MEM_CAP_SPIRAM,
+    ESPFSP_MEM_CAP_MAX,
+} espfsp_mem_cap_t;
+
+typedef struct
+{
+    uint32_t current_bytes;
+    uint32_t peak_bytes;                // Since start or espfsp_mem_reset_peaks()
+    uint32_t blocks;                    // Currently allocated
+    uint32_t failures;
+    uint32_t allocations;               // Since start, wraps around
+} espfsp_mem_usage_t;
+
+typedef struct
+{
+    espfsp_mem_usage_t tags[ESPFSP_MEM_TAG_MAX];
+    espfsp_mem_usage_t caps[ESPFSP_MEM_CAP_MAX];
+    espfsp_mem_usage_t total;           // Peak of total, not sum of peaks
+} espfsp_mem_stats_t;
+
+// Bytes that given configuration takes, filled by espfsp_<role>_estimate_memory()
+typedef struct
+{
+    uint32_t tags[ESPFSP_MEM_TAG_MAX];
+    uint32_t caps[ESPFSP_MEM_CAP_MAX];
+    uint32_t total;
+} espfsp_mem_estimate_t;
+
+void espfsp_mem_get_stats(espfsp_mem_stats_t *stats);
+
+void espfsp_mem_reset_peaks(void);
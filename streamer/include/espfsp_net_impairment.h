@@ -0,0 +1,48 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+// Network impairment for testing. Applied to datagrams sent on UDP sockets created after
+// espfsp_net_impairment_set(), so data plane of clients and server sees reproducible bad network.
+// Every socket has its own random generator seeded from seed and order of socket creation.
+
+typedef struct
+{
+    bool enabled;
+    uint32_t seed;
+    uint16_t loss_permille;                 // Uniform loss
+    uint16_t burst_enter_permille;          // Gilbert-Elliott, good to bad state per packet, 0 disables bursts
+    uint16_t burst_exit_permille;           // Bad to good state per packet
+    uint16_t burst_loss_permille;           // Loss in bad state
+    uint16_t reorder_permille;              // Packet is sent after next one
+    uint16_t duplicate_permille;
+    uint32_t delay_us;
+    uint32_t jitter_us;                     // Uniform, added to delay_us
+    uint32_t rate_limit_kbps;               // Per socket, packets over rate are delayed. 0 for no limit
+} espfsp_net_impairment_config_t;
+
+typedef struct
+{
+    uint32_t packets;
+    uint32_t dropped_uniform;
+    uint32_t dropped_burst;
+    uint32_t dropped_overflow;              // Delay line was full
+    uint32_t reordered;
+    uint32_t duplicated;
+    uint32_t delayed;
+    uint32_t rate_limited;
+} espfsp_net_impairment_stats_t;
+
+// Sockets created before keep previous settings. Resets statistics.
+esp_err_t espfsp_net_impairment_set(const espfsp_net_impairment_config_t *config);
+
+// Summed over all impaired sockets since last espfsp_net_impairment_set()
+void espfsp_net_impairment_get_stats(espfsp_net_impairment_stats_t *stats);
@@ -7,6 +7,7 @@
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "esp_err.h"
 
@@ -14,6 +15,91 @@
 
 typedef void * espfsp_server_handler_t;
 
+typedef enum
+{
+    ESPFSP_RECORDER_MODE_OFF,
+    ESPFSP_RECORDER_MODE_TRIGGERED,     // Pre-event frames and frames until post_event_s after last trigger
+    ESPFSP_RECORDER_MODE_CONTINUOUS,
+} espfsp_recorder_mode_t;
+
+typedef struct
+{
+    espfsp_recorder_mode_t mode;
+    const char *path_prefix;            // On VFS mount, e.g. "/sdcard/rec". Files are <prefix>_<first frame sec>.avi
+    uint32_t ring_size;                 // Bytes of in-memory ring with last frames
+    uint16_t pre_event_s;
+    uint16_t post_event_s;
+    uint32_t write_batch_size;          // Bytes collected before single write to storage
+    uint32_t max_frames_per_file;
+    espfsp_task_info_t task_info;
+} espfsp_recorder_config_t;
+
+typedef struct
+{
+    bool enabled;
+    int port;
+    const char *path;                   // Stream is served on GET of this path, e.g. "/stream"
+    uint8_t max_clients;
+    uint8_t client_queue_len;           // Frames waiting per client, the oldest one is dropped when full
+    espfsp_task_info_t task_info;       // Used for listener and for every client task
+} espfsp_http_stream_config_t;
+
+typedef struct
+{
+    bool enabled;
+    int port;                           // RTSP control port, usually 554
+    int rtp_port;                       // Local UDP port RTP is sent from, RTCP port is next one
+    espfsp_task_info_t task_info;       // Used for RTSP session task
+} espfsp_rtsp_config_t;
+
+// Last report of CLIENT_PLAY. Counters are cumulative, loss_permille covers frames since previous report.
+typedef struct
+{
+    uint32_t session_id;
+    uint32_t frames_received;
+    uint32_t frames_lost;
+    uint32_t frames_late;
+    uint32_t jitter_us;
+    uint16_t buffer_depth;
+    uint16_t latency_ms;                // Capture to receive, ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN if not known
+    uint16_t loss_permille;             // Lost and late frames
+    bool source_static;                 // Primary CLIENT_PUSH sends keepalive frames only, lower rate is not loss
+    uint8_t layer;                      // Simulcast layer relayed to session, 0 is camera stream
+    int64_t updated_us;                 // 0 when no report was received yet
+} espfsp_stream_status_t;
+
+// Called from session task on every report, e.g. for adapting frame rate or quality
+typedef void (*espfsp_stream_status_cb_t)(const espfsp_stream_status_t *status, void *ctx);
+
+#define ESPFSP_SERVER_STATS_MAX_SESSIONS 8
+
+typedef enum
+{
+    ESPFSP_SERVER_SESSION_CLIENT_PUSH,
+    ESPFSP_SERVER_SESSION_CLIENT_PLAY,
+} espfsp_server_session_type_t;
+
+typedef struct
+{
+    uint32_t session_id;
+    espfsp_server_session_type_t type;
+    bool primary;
+    bool detached;                      // Connection lost, waiting for resume
+    bool stream_started;
+    espfsp_clock_sync_info_t clock_sync;    // Control connection RTT, as reported by client
+} espfsp_server_session_stats_t;
+
+typedef struct
+{
+    espfsp_stream_stats_t push_stream;      // Received from primary CLIENT_PUSH
+    espfsp_stream_stats_t play_stream;      // Sent to primary CLIENT_PLAY
+    bool source_static;                     // Primary CLIENT_PUSH sends keepalive frames only
+    uint8_t play_layer;                     // Simulcast layer relayed to primary CLIENT_PLAY
+    uint8_t sessions_count;                 // All sessions, only first ESPFSP_SERVER_STATS_MAX_SESSIONS are filled
+    espfsp_server_session_stats_t sessions[ESPFSP_SERVER_STATS_MAX_SESSIONS];
+    espfsp_mem_stats_t memory;              // Whole component, see espfsp_mem_get_stats()
+} espfsp_server_stats_t;
+
 typedef struct
 {
     espfsp_task_info_t client_push_data_task_info;
@@ -25,11 +111,51 @@ typedef struct
     espfsp_connection_info_t client_play_local;
     espfsp_transport_t client_push_data_transport;
     espfsp_transport_t client_play_data_transport;
+    uint8_t client_push_max_connections;    // 0 for default
+    uint8_t client_play_max_connections;    // 0 for default
+    uint32_t session_resume_grace_ms;       // How long session of lost connection waits for client, 0 for default
+    uint16_t client_play_preempt_after_percent; // Relayed frame late by this percent of frame interval is abandoned
+                                                // when newer one is received. 0 disables
+
+    // Simulcast. Lower layers of primary CLIENT_PUSH are buffered besides its camera stream, primary
+    // CLIENT_PLAY gets layer its loss reports allow. Recorder, HTTP and RTSP outputs take camera stream.
+    uint8_t simulcast_layers;                   // Lower layers relayed, 0 relays camera stream only
+    uint32_t simulcast_frame_max_len;           // Of every lower layer
+    uint16_t simulcast_down_loss_permille;      // Loss over it lowers layer of play session
+    uint8_t simulcast_up_after_reports;         // Loss free reports before higher layer is tried
 
     espfsp_frame_config_t frame_config;
     espfsp_cam_config_t cam_config;
+
+    espfsp_recorder_config_t recorder_config;
+    espfsp_http_stream_config_t http_stream_config;
+    espfsp_rtsp_config_t rtsp_config;
+
+    espfsp_stream_status_cb_t stream_status_cb;     // Optional
+    void *stream_status_cb_ctx;
 } espfsp_server_config_t;
 
+// Optional, has to be called before first espfsp_server_init(). Without it pool for single server is allocated.
+esp_err_t espfsp_server_pool_init(const espfsp_pool_config_t *pool_config);
+
+// Frees pool, all servers have to be deinitialized before
+esp_err_t espfsp_server_pool_deinit();
+
+// Size of static storage for pool with given number of servers
+size_t espfsp_server_pool_storage_size(uint8_t max_instances);
+
 espfsp_server_handler_t espfsp_server_init(const espfsp_server_config_t *config);
 
 void espfsp_server_deinit(espfsp_server_handler_t handler);
+
+// Starts or extends recording in ESPFSP_RECORDER_MODE_TRIGGERED
+esp_err_t espfsp_server_recorder_trigger(espfsp_server_handler_t handler);
+
+// Last stream status reported by primary CLIENT_PLAY. ESP_ERR_NOT_FOUND if there is none.
+esp_err_t espfsp_server_get_stream_status(espfsp_server_handler_t handler, espfsp_stream_status_t *status);
+
+esp_err_t espfsp_server_get_stats(espfsp_server_handler_t handler, espfsp_server_stats_t *stats);
+
+// Heap that server with given configuration takes once running, without instance pool. Nothing is allocated,
+// so it can be used to tune buffered_fbs and frame_max_len before espfsp_server_init().
+esp_err_t espfsp_server_estimate_memory(const espfsp_server_config_t *config, espfsp_mem_estimate_t *estimate);
@@ -0,0 +1,43 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "espfsp_config.h"
+
+// Per-frame pipeline trace, compiled in with CONFIG_ESPFSP_TRACE. Frames are identified by capture
+// timestamp, which travels with frame, so records of all devices can be joined.
+
+typedef enum
+{
+    ESPFSP_TRACE_STAGE_CAPTURE,             // Frame obtained from send_frame callback of CLIENT_PUSH
+    ESPFSP_TRACE_STAGE_SEND_START,          // First fragment of frame sent
+    ESPFSP_TRACE_STAGE_SEND_END,            // Last fragment of frame sent
+    ESPFSP_TRACE_STAGE_SERVER_REASSEMBLED,
+    ESPFSP_TRACE_STAGE_SERVER_SEND_FRAME,   // Relayed frame taken for sending to CLIENT_PLAY
+    ESPFSP_TRACE_STAGE_PLAY_REASSEMBLED,
+    ESPFSP_TRACE_STAGE_GET_FB,
+    ESPFSP_TRACE_STAGE_RETURN_FB,
+    ESPFSP_TRACE_STAGE_MAX,
+} espfsp_trace_stage_t;
+
+// Writes records as Chrome trace JSON, readable by chrome://tracing and Perfetto. Records written
+// while dumping could be torn, so dump when stream is stopped. pid tells devices apart.
+// ESP_ERR_NOT_SUPPORTED when tracing is not compiled in.
+esp_err_t espfsp_trace_dump_json(FILE *out, uint32_t pid);
+
+void espfsp_trace_clear(void);
+
+// Latency between two stages of the same frames, over records in ring. Every record of stage to is paired
+// with the latest earlier record of stage from, so both have to be recorded on one device. window_us is
+// span of records. Read when stream is stopped, as for dump. ESP_ERR_NOT_SUPPORTED when tracing is not
+// compiled in.
+esp_err_t espfsp_trace_get_stage_latency(
+    espfsp_trace_stage_t from, espfsp_trace_stage_t to, espfsp_latency_stats_t *stats);
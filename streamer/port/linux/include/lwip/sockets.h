@@ -0,0 +1,23 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+// ESP-IDF linux target uses host sockets. Component includes lwIP headers, so they are mapped
+// here to host ones, together with few lwIP extensions component uses.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static inline char *inet_ntoa_r(struct in_addr addr, char *buf, int buflen)
+{
+    return (char *) inet_ntop(AF_INET, &addr, buf, buflen);
+}
@@ -7,6 +7,7 @@
 
 #include "esp_netif.h"
 
+#include "espfsp_task_group.h"
 #include "data_proto/espfsp_data_proto.h"
 
 typedef struct {
@@ -14,6 +15,7 @@ typedef struct {
     int local_port;
     int remote_port;
     struct esp_ip4_addr remote_addr;
+    espfsp_task_group_t *task_group;
 } espfsp_client_data_task_data_t;
 
 // Pointer passed to this task has to point to structure espfsp_client_data_task_data_t
@@ -7,14 +7,30 @@
 
 #include "esp_netif.h"
 
+#include "espfsp_task_group.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
+// Kept across reconnects, so client can ask server to reattach to session of lost connection.
+// Accessed only from session and control task, as Communication Protocol callbacks run there.
+typedef struct {
+    uint32_t session_id;
+    uint32_t token;             // 0 when there is no session to resume
+    uint32_t grace_ms;
+    int64_t lost_us;            // Time when connection of session was lost
+    bool acked;                 // Session ack received on current connection
+} espfsp_client_session_resume_t;
+
 typedef struct {
     espfsp_comm_proto_t *comm_proto;
     espfsp_comm_proto_req_client_type_t client_type;
+    uint8_t simulcast_layers;                   // Lower layers published by CLIENT_PUSH
     int local_port;
     int remote_port;
     struct esp_ip4_addr remote_addr;
+    espfsp_task_group_t *task_group;
+    espfsp_client_session_resume_t *resume;
+    __espfsp_comm_proto_cb session_expired_cb;  // Stops local stream when session was not resumed in time
+    void *session_expired_ctx;
 } espfsp_client_session_and_control_task_data_t;
 
 // Pointer passed to this task has to point to structure espfsp_client_session_and_control_task_data_t
@@ -5,7 +5,10 @@
 
 #include "esp_err.h"
 
+#include "espfsp_mem.h"
+
 #include "client_play/espfsp_state_def.h"
 
 esp_err_t espfsp_client_play_comm_protos_init(espfsp_client_play_instance_t *instance);
 esp_err_t espfsp_client_play_comm_protos_deinit(espfsp_client_play_instance_t *instance);
+void espfsp_client_play_comm_protos_estimate_memory(espfsp_mem_estimate_t *estimate);
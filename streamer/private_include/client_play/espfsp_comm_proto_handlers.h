@@ -13,8 +13,12 @@ esp_err_t espfsp_client_play_req_session_terminate_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_play_req_stop_stream_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_client_play_req_scene_state_handler(
+    espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_play_resp_session_ack_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_client_play_resp_session_pong_handler(
+    espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_play_resp_sources_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_play_resp_frame_config_handler(
@@ -22,4 +26,10 @@ esp_err_t espfsp_client_play_resp_frame_config_handler(
 esp_err_t espfsp_client_play_resp_cam_config_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 
+// Repetive callback, NTP-like exchange for RTT and clock offset. While stream runs, also reports
+// receive statistics
+esp_err_t espfsp_client_play_session_repetive(espfsp_comm_proto_t *comm_proto, void *ctx);
+
 esp_err_t espfsp_client_play_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx);
+// Keeps stream running if session can be resumed, otherwise stops it as espfsp_client_play_connection_stop
+esp_err_t espfsp_client_play_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx);
@@ -10,17 +10,29 @@
 
 #include "espfsp_client_play.h"
 #include "espfsp_message_defs.h"
+#include "espfsp_task_group.h"
+#include "espfsp_instance_pool.h"
 #include "espfsp_message_buffer.h"
+#include "espfsp_clock_sync.h"
+#include "espfsp_latency_hist.h"
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
+#include "client_common/espfsp_session_and_control_task.h"
 
-#define CONFIG_ESPFSP_CLIENT_PLAY_MAX_INSTANCES 1
+// Used when pool is not given in runtime configuration
+#define ESPFSP_CLIENT_PLAY_DEFAULT_MAX_INSTANCES 1
 
 typedef struct {
     SemaphoreHandle_t mutex;
     uint32_t session_id;
     bool active;
     bool stream_started;
+    uint32_t capabilities;          // Negotiated with server, ESPFSP_COMM_PROTO_CAP_*
+    espfsp_client_session_resume_t resume;
+    espfsp_clock_sync_t clock_sync;
+    espfsp_clock_sync_info_t source_clock_sync;     // Of primary CLIENT_PUSH, reported by server
+    bool scene_static;                              // Frames come at keepalive rate, reported by server
+    espfsp_latency_hist_t latency_hist;             // Capture to espfsp_client_play_get_fb()
 } espfsp_client_play_session_data_t;
 
 typedef struct {
@@ -35,10 +47,8 @@ typedef struct {
 
 typedef struct
 {
-    TaskHandle_t data_task_handle;
-    TaskHandle_t session_and_control_task_handle;
+    espfsp_task_group_t task_group;
     espfsp_client_play_config_t *config;
-    bool used;
 
     espfsp_receiver_buffer_t receiver_buffer;
 
@@ -54,5 +64,5 @@ typedef struct
 
 typedef struct
 {
-    espfsp_client_play_instance_t instances[CONFIG_ESPFSP_CLIENT_PLAY_MAX_INSTANCES];
+    espfsp_instance_pool_t instances;   // Of espfsp_client_play_instance_t
 } espfsp_client_play_state_t;
@@ -0,0 +1,72 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "espfsp_config.h"
+#include "espfsp_mem.h"
+#include "espfsp_task_group.h"
+
+// Capture of next frame runs in own task while data task sends previous one. Frame buffers are handed
+// over by two single producer single consumer rings of slot indices, captured ones to sender and sent
+// ones back to capture, so no lock is taken on the way. Every slot is in at most one ring at a time.
+
+#define ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS 4
+
+typedef struct
+{
+    espfsp_fb_t slots[ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];
+    uint32_t slot_len[ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];         // Allocated, owner of slot grows it
+    uint32_t slot_generation[ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];
+    uint8_t slots_count;                                            // 0 when pipeline is disabled
+    uint8_t captured_ring[ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];
+    _Atomic uint32_t captured_head;
+    _Atomic uint32_t captured_tail;
+    uint8_t free_ring[ESPFSP_CAPTURE_PIPELINE_MAX_BUFFERS];
+    _Atomic uint32_t free_head;
+    _Atomic uint32_t free_tail;
+    // Only wake up waiting side, slots are handed over by rings
+    SemaphoreHandle_t captured_signal;
+    SemaphoreHandle_t free_signal;
+    __espfsp_send_frame capture_cb;
+    _Atomic uint32_t frame_max_len;
+    _Atomic uint32_t generation;        // Frames captured before last start are not sent
+    atomic_bool running;
+    atomic_bool capturing;              // Capture task is inside capture_cb
+    int capture_slot;                   // Capture task only
+    int send_slot;                      // Sender only
+} espfsp_capture_pipeline_t;
+
+// Less than 2 buffers leaves pipeline disabled, then all other calls do nothing
+esp_err_t espfsp_capture_pipeline_init(
+    espfsp_capture_pipeline_t *pipeline, uint8_t buffers, uint32_t frame_max_len, __espfsp_send_frame capture_cb);
+esp_err_t espfsp_capture_pipeline_deinit(espfsp_capture_pipeline_t *pipeline);
+void espfsp_capture_pipeline_estimate_memory(uint8_t buffers, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate);
+
+bool espfsp_capture_pipeline_is_enabled(const espfsp_capture_pipeline_t *pipeline);
+
+void espfsp_capture_pipeline_start(espfsp_capture_pipeline_t *pipeline);
+// Returns when capture_cb is not running anymore, so camera can be stopped after it
+void espfsp_capture_pipeline_stop(espfsp_capture_pipeline_t *pipeline);
+void espfsp_capture_pipeline_set_frame_max_len(espfsp_capture_pipeline_t *pipeline, uint32_t frame_max_len);
+
+// Body of capture task, returns on stop request of group
+void espfsp_capture_pipeline_run(espfsp_capture_pipeline_t *pipeline, espfsp_task_group_t *group);
+
+// Sender interface. Frame is owned by sender until release, NULL if nothing was captured within timeout.
+// Newest captured frame is taken, older ones are given back to capture.
+espfsp_fb_t *espfsp_capture_pipeline_take(espfsp_capture_pipeline_t *pipeline, uint32_t timeout_ms);
+void espfsp_capture_pipeline_release(espfsp_capture_pipeline_t *pipeline);
+// Sender side, true when captured frame waits to be taken
+bool espfsp_capture_pipeline_has_frame(espfsp_capture_pipeline_t *pipeline);
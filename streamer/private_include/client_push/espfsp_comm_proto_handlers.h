@@ -17,9 +17,16 @@ esp_err_t espfsp_client_push_req_stop_stream_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_push_resp_session_ack_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_client_push_resp_session_pong_handler(
+    espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_push_req_cam_set_params_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_client_push_req_frame_set_params_handler(
     espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 
+// Repetive callback, NTP-like exchange for RTT and clock offset
+esp_err_t espfsp_client_push_session_repetive(espfsp_comm_proto_t *comm_proto, void *ctx);
+
 esp_err_t espfsp_client_push_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx);
+// Keeps stream running if session can be resumed, otherwise stops it as espfsp_client_push_connection_stop
+esp_err_t espfsp_client_push_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx);
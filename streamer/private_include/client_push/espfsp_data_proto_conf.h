@@ -9,3 +9,8 @@
 
 esp_err_t espfsp_client_push_data_protos_init(espfsp_client_push_instance_t *instance);
 esp_err_t espfsp_client_push_data_protos_deinit(espfsp_client_push_instance_t *instance);
+
+// Camera frames are lent to data task only between these calls. Stop returns when lent frame is given
+// back, so camera can be stopped after it.
+void espfsp_client_push_data_protos_allow_lending(espfsp_client_push_instance_t *instance);
+void espfsp_client_push_data_protos_stop_lending(espfsp_client_push_instance_t *instance);
@@ -0,0 +1,36 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "espfsp_config.h"
+#include "espfsp_client_push.h"
+
+// Signature of raw frame is mean luma of GRID x GRID cells, each sampled in 2 x 2 points
+#define ESPFSP_SCENE_DETECTOR_GRID 8
+
+typedef struct
+{
+    espfsp_static_scene_config_t config;
+    // Reference is last frame taken as changed. Owned by task sending frames.
+    uint8_t signature[ESPFSP_SCENE_DETECTOR_GRID * ESPFSP_SCENE_DETECTOR_GRID];
+    uint32_t reference_len;
+    bool has_reference;
+    uint16_t unchanged_frames;
+    int64_t last_sent_us;
+    atomic_bool scene_static;   // Read by session task
+} espfsp_scene_detector_t;
+
+void espfsp_scene_detector_init(espfsp_scene_detector_t *detector, const espfsp_static_scene_config_t *config);
+
+// Task sending frames only. False when frame is suppressed, as scene did not change.
+bool espfsp_scene_detector_should_send(espfsp_scene_detector_t *detector, const espfsp_fb_t *fb);
+
+// Safe to use from any task
+bool espfsp_scene_detector_is_static(espfsp_scene_detector_t *detector);
@@ -0,0 +1,48 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+
+#include "espfsp_config.h"
+#include "espfsp_mem.h"
+#include "server/espfsp_frame_decimator.h"
+
+// Lower layers of simulcast stream. Every layer is derived from camera frame just sent, at its own
+// frame rate, so camera keeps its configuration whichever layer viewers get.
+
+typedef struct
+{
+    uint8_t count;
+    espfsp_simulcast_layer_config_t configs[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
+    char *bufs[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
+    __espfsp_derive_layer derive_cb;
+    atomic_bool enabled;        // Server negotiated simulcast
+    // Owned by data task
+    espfsp_fb_t fbs[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
+    espfsp_frame_decimator_t decimators[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
+    uint8_t next;               // Next layer to check for current camera frame
+} espfsp_simulcast_layers_t;
+
+esp_err_t espfsp_simulcast_layers_init(
+    espfsp_simulcast_layers_t *layers,
+    uint8_t count,
+    const espfsp_simulcast_layer_config_t *configs,
+    __espfsp_derive_layer derive_cb);
+esp_err_t espfsp_simulcast_layers_deinit(espfsp_simulcast_layers_t *layers);
+void espfsp_simulcast_layers_estimate_memory(
+    uint8_t count, const espfsp_simulcast_layer_config_t *configs, espfsp_mem_estimate_t *estimate);
+
+// Safe to use from any task
+void espfsp_simulcast_layers_set_enabled(espfsp_simulcast_layers_t *layers, bool enabled);
+
+// Data task only. Called until false for every camera frame sent, gives next due layer frame. Layer is 1 based.
+bool espfsp_simulcast_layers_next(
+    espfsp_simulcast_layers_t *layers, const espfsp_fb_t *source, espfsp_fb_t **fb, uint8_t *layer);
@@ -5,36 +5,61 @@
 
 #pragma once
 
+#include <stdatomic.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "espfsp_client_push.h"
 #include "espfsp_message_defs.h"
+#include "espfsp_task_group.h"
+#include "espfsp_instance_pool.h"
+#include "espfsp_clock_sync.h"
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
+#include "client_push/espfsp_capture_pipeline.h"
+#include "client_push/espfsp_scene_detector.h"
+#include "client_push/espfsp_simulcast_layers.h"
+#include "client_common/espfsp_session_and_control_task.h"
 
-#define CONFIG_ESPFSP_CLIENT_PUSH_MAX_INSTANCES 1
+// Used when pool is not given in runtime configuration
+#define ESPFSP_CLIENT_PUSH_DEFAULT_MAX_INSTANCES 1
 
 typedef struct {
     uint32_t session_id;
     bool active;            // Session initiated
     bool camera_started;    // Frame streaming started
+    uint32_t capabilities;  // Negotiated with server, ESPFSP_COMM_PROTO_CAP_*
+    bool scene_static_reported;
+    espfsp_client_session_resume_t resume;
 } espfsp_client_push_session_data_t;
 
 typedef struct
 {
-    TaskHandle_t data_task_handle;
-    TaskHandle_t session_and_control_task_handle;
+    atomic_bool allowed;    // Cleared before camera is stopped
+    atomic_bool lent;       // Data task holds frame of camera driver
+    void *frame_ctx;
+} espfsp_client_push_lend_t;
+
+typedef struct
+{
+    espfsp_task_group_t task_group;
     espfsp_client_push_config_t *config;
-    bool used;
 
     espfsp_comm_proto_t comm_proto;
     espfsp_data_proto_t data_proto;
+    espfsp_capture_pipeline_t capture_pipeline;     // Disabled for less than 2 send buffers
+    espfsp_client_push_lend_t lend;                 // Used with acquire_frame callback
+    espfsp_scene_detector_t scene_detector;         // Used by data task
+    espfsp_simulcast_layers_t simulcast;            // Enabled when negotiated with server
 
     espfsp_client_push_session_data_t session_data;
+
+    SemaphoreHandle_t clock_sync_mutex;     // Estimate is read from user task
+    espfsp_clock_sync_t clock_sync;
 } espfsp_client_push_instance_t;
 
 typedef struct
 {
-    espfsp_client_push_instance_t instances[CONFIG_ESPFSP_CLIENT_PUSH_MAX_INSTANCES];
+    espfsp_instance_pool_t instances;   // Of espfsp_client_push_instance_t
 } espfsp_client_push_state_t;
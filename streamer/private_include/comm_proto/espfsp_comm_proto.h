@@ -13,11 +13,30 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#include "espfsp_mem.h"
+#include "espfsp_sock_op.h"
 #include "espfsp_comm_proto_req.h"
 #include "espfsp_comm_proto_resp.h"
 
 #define MAX_COMM_PROTO_BUFFER_LEN 256
 
+// Wire format version, exchanged in session init. Messages are only extended by appending fields,
+// which older peer does not send, so they are received as zero. Peer not sending version is 0.
+#define ESPFSP_COMM_PROTO_VERSION 1
+#define ESPFSP_COMM_PROTO_MIN_VERSION 0
+
+// Optional features. Session ack carries subset supported by both sides, only this subset is used.
+#define ESPFSP_COMM_PROTO_CAP_SESSION_RESUME (1 << 0)
+#define ESPFSP_COMM_PROTO_CAP_CLOCK_SYNC (1 << 1)
+#define ESPFSP_COMM_PROTO_CAP_STREAM_STATUS (1 << 2)
+#define ESPFSP_COMM_PROTO_CAP_FRAME_ABORT (1 << 3)       // Data receiver takes MESSAGE_NUMBER_ABORT
+#define ESPFSP_COMM_PROTO_CAP_SCENE_STATE (1 << 4)
+#define ESPFSP_COMM_PROTO_CAP_SIMULCAST (1 << 5)         // Data receiver takes layer in MESSAGE_LAYER()
+
+#define ESPFSP_COMM_PROTO_CAPS_SUPPORTED \
+    (ESPFSP_COMM_PROTO_CAP_SESSION_RESUME | ESPFSP_COMM_PROTO_CAP_CLOCK_SYNC | ESPFSP_COMM_PROTO_CAP_STREAM_STATUS | \
+     ESPFSP_COMM_PROTO_CAP_FRAME_ABORT | ESPFSP_COMM_PROTO_CAP_SCENE_STATE | ESPFSP_COMM_PROTO_CAP_SIMULCAST)
+
 typedef enum {
     ESPFSP_COMM_PROTO_STATE_ACTION,
     ESPFSP_COMM_PROTO_STATE_LISTEN,
@@ -73,10 +92,15 @@ struct espfsp_comm_proto_t {
     espfsp_comm_proto_config_t *config;
     QueueHandle_t reqActionQueue;
     uint8_t en;
+    // Socket and its state while espfsp_comm_proto_run() executes, used by messages sent without queue
+    int sock;
+    espfsp_conn_state_t conn_state;
 };
 
 esp_err_t espfsp_comm_proto_init(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_config_t *config);
 esp_err_t espfsp_comm_proto_deinit(espfsp_comm_proto_t *comm_proto);
+// Counts queue full of largest actions and one being received
+void espfsp_comm_proto_estimate_memory(int buffered_actions, espfsp_mem_estimate_t *estimate);
 
 esp_err_t espfsp_comm_proto_run(espfsp_comm_proto_t *comm_proto, int sock);
 esp_err_t espfsp_comm_proto_stop(espfsp_comm_proto_t *comm_proto);
@@ -84,7 +108,10 @@ esp_err_t espfsp_comm_proto_stop(espfsp_comm_proto_t *comm_proto);
 // Actions for requests --- BEGIN
 esp_err_t espfsp_comm_proto_session_init(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_session_init_message_t *msg);
 esp_err_t espfsp_comm_proto_session_terminate(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_session_terminate_message_t *msg);
+// Periodic messages are sent at once, so they never take place of other actions in queue. Allowed only in
+// callbacks called by espfsp_comm_proto_run(), as they run on task owning socket.
 esp_err_t espfsp_comm_proto_session_ping(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_session_ping_message_t *msg);
+esp_err_t espfsp_comm_proto_stream_status(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_stream_status_message_t *msg);
 esp_err_t espfsp_comm_proto_start_stream(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_start_stream_message_t *msg);
 esp_err_t espfsp_comm_proto_stop_stream(espfsp_comm_proto_t *comm_proto, espfsp_comm_proto_req_stop_stream_message_t *msg);
 esp_err_t espfsp_comm_proto_cam_set_params(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_cam_set_params_message_t *msg);
@@ -93,6 +120,7 @@ esp_err_t espfsp_comm_proto_frame_set_params(espfsp_comm_proto_t *comm_proto, es
 esp_err_t espfsp_comm_proto_frame_get_params(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_frame_get_params_message_t *msg);
 esp_err_t espfsp_comm_proto_source_set(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_source_set_message_t *msg);
 esp_err_t espfsp_comm_proto_source_get(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_source_get_message_t *msg);
+esp_err_t espfsp_comm_proto_scene_state(espfsp_comm_proto_t *comm_proto, espfsp_comm_req_scene_state_message_t *msg);
 // Actions for requests --- END
 
 // Actions for responses --- BEGIN
@@ -20,10 +20,10 @@ typedef enum {
     ESPFSP_COMM_REQ_FRAME_GET_PARAMS = 0x09,
     ESPFSP_COMM_REQ_SOURCE_SET = 0x0A,
     ESPFSP_COMM_REQ_SOURCE_GET = 0x0B,
+    ESPFSP_COMM_REQ_STREAM_STATUS = 0x0C,
+    ESPFSP_COMM_REQ_SCENE_STATE = 0x0D,
 
-    ESPFSP_COMM_REQ_MAX_NUMBER = 0x0C,
-
-    // ESPFSP_COMM_REQ_STREAM_STATUS = 0xXX,
+    ESPFSP_COMM_REQ_MAX_NUMBER = 0x0E,
 } espfsp_comm_proto_req_type_t;
 
 typedef enum {
@@ -32,8 +32,14 @@ typedef enum {
 } espfsp_comm_proto_req_client_type_t;
 
 // For ESPFSP_COMM_REQ_SESSION_INIT
+// Nonzero resume_token asks for reattaching to detached session_id
 typedef struct {
     espfsp_comm_proto_req_client_type_t client_type;
+    uint32_t session_id;
+    uint32_t resume_token;
+    uint16_t version;               // ESPFSP_COMM_PROTO_VERSION of sender
+    uint32_t capabilities;          // ESPFSP_COMM_PROTO_CAP_* supported by sender
+    uint8_t simulcast_layers;       // Lower layers sent by CLIENT_PUSH besides camera stream
 } espfsp_comm_proto_req_session_init_message_t;
 
 // For ESPFSP_COMM_REQ_SESSION_TERMINATE
@@ -42,9 +48,14 @@ typedef struct {
 } espfsp_comm_proto_req_session_terminate_message_t;
 
 // For ESPFSP_COMM_REQ_SESSION_PING
+// t1_us is set by Communication Protocol right before sending. Sender passes its last estimate, so
+// also responder knows RTT and clock offset of session.
 typedef struct {
     uint32_t session_id;
-    uint32_t timestamp;
+    int64_t t1_us;
+    int64_t rtt_us;
+    int64_t offset_us;              // Responder clock minus sender clock
+    uint8_t estimate_valid;
 } espfsp_comm_proto_req_session_ping_message_t;
 
 // For ESPFSP_COMM_REQ_START_STREAM
@@ -94,10 +105,22 @@ typedef struct {
     uint32_t session_id;
 } espfsp_comm_req_source_get_message_t;
 
-// // For ESPFSP_COMM_REQ_STREAM_STATUS
-// typedef struct {
-//     uint32_t session_id;
-//     uint8_t stream_id;
-//     uint8_t frame_loss;
-//     uint16_t latency_ms;
-// } espfsp_comm_req_stream_status_message_t;
+// For ESPFSP_COMM_REQ_STREAM_STATUS
+// Counters are cumulative, so lost report does not distort aggregation
+typedef struct {
+    uint32_t session_id;
+    uint32_t frames_received;
+    uint32_t frames_lost;
+    uint32_t frames_late;
+    uint32_t jitter_us;
+    uint16_t buffer_depth;
+    uint16_t latency_ms;            // ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN until clocks are synchronized
+} espfsp_comm_req_stream_status_message_t;
+
+// For ESPFSP_COMM_REQ_SCENE_STATE
+// CLIENT_PUSH sends keepalive frames only while scene is static. Server relays it to CLIENT_PLAY.
+typedef struct {
+    uint32_t session_id;
+    uint8_t scene_static;
+    uint32_t keepalive_interval_ms;
+} espfsp_comm_req_scene_state_message_t;
@@ -23,14 +23,26 @@ typedef enum {
 } espfsp_comm_proto_resp_type_t;
 
 // For ESPFSP_COMM_RESP_SESSION_ACK
+// resume_token is 0 when server does not keep sessions of lost connections
 typedef struct {
     uint32_t session_id;
+    uint32_t resume_token;
+    uint32_t resume_grace_ms;
+    uint8_t resumed;
+    uint16_t version;               // Negotiated, lower of both sides
+    uint32_t capabilities;          // Negotiated, supported by both sides
 } espfsp_comm_proto_resp_session_ack_message_t;
 
 // For ESPFSP_COMM_RESP_SESSION_PONG
+// t3_us is set by Communication Protocol right before sending. Source offset lets CLIENT_PLAY map
+// capture timestamps of primary CLIENT_PUSH to its own clock.
 typedef struct {
     uint32_t session_id;
-    uint32_t timestamp;
+    int64_t t1_us;                  // Copied from ping
+    int64_t t2_us;
+    int64_t t3_us;
+    int64_t source_offset_us;       // Server clock minus primary CLIENT_PUSH clock
+    uint8_t source_offset_valid;
 } espfsp_comm_proto_resp_session_pong_message_t;
 
 // For ESPFSP_COMM_RESP_ACK
@@ -53,10 +65,12 @@ typedef struct {
 } espfsp_comm_resp_frame_params_resp_message_t;
 
 // // For ESPFSP_COMM_RESP_SOURCES_RESP
+#define ESPFSP_COMM_SOURCES_MAX 3
+
 typedef struct {
     uint32_t session_id;
     uint8_t num_sources;
-    char source_names[3][30];
+    char source_names[ESPFSP_COMM_SOURCES_MAX][30];
 } espfsp_comm_resp_sources_resp_message_t;
 
 // // For ESPFSP_COMM_RESP_ERROR_REPORT
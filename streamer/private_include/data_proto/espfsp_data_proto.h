@@ -12,10 +12,14 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 #include "espfsp_config.h"
 #include "espfsp_frame_config.h"
+#include "espfsp_mem.h"
 #include "espfsp_message_buffer.h"
+#include "espfsp_stream_counters.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
 #define MAX_TIME_US_NO_NAT_TRAVERSAL 5000000 // 5 seconds
@@ -53,12 +57,21 @@ typedef enum {
 } espfsp_data_proto_send_frame_state_t;
 
 typedef esp_err_t (*__espfsp_data_proto_send_frame)(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_frame_state_t *state, uint32_t max_allowed_size);
+typedef void (*__espfsp_data_proto_release_frame)(espfsp_fb_t *fb, void *ctx);
+typedef bool (*__espfsp_data_proto_newer_frame)(void *ctx);
+typedef bool (*__espfsp_data_proto_layer_frame)(const espfsp_fb_t *source, espfsp_fb_t **fb, uint8_t *layer, void *ctx);
 
 typedef struct {
     espfsp_data_proto_type_t type;
     espfsp_data_proto_mode_t mode;
     espfsp_receiver_buffer_t *recv_buffer;                  // Receiver buffer has to be configured; It is not managed by Data Protocol
     __espfsp_data_proto_send_frame send_frame_callback;     // Callback to obtain FB that will be sent by Data Protocol
+    __espfsp_data_proto_release_frame release_frame_callback;   // Optional; When set, obtained FB buffer is lent by callback and given back here after sending
+    __espfsp_data_proto_newer_frame newer_frame_callback;      // Optional; Tells if newer frame waits to be sent
+    uint16_t preempt_after_percent;                         // Of frame interval, late frame is abandoned for newer one. 0 disables
+    __espfsp_data_proto_layer_frame layer_frame_callback;   // Optional; Gives lower layer frames derived from frame just sent, until false
+    espfsp_receiver_buffer_t *layer_recv_buffers;           // Optional; Buffers of lower layers 1..layer_recv_buffers_count
+    uint8_t layer_recv_buffers_count;
     void *send_frame_ctx;
     espfsp_frame_config_t *frame_config;
 } espfsp_data_proto_config_t;
@@ -67,19 +80,33 @@ typedef struct {
     espfsp_data_proto_config_t *config;
     espfsp_data_proto_state_t state;
     espfsp_fb_t send_fb;
+    char *send_buf;                                         // NULL when frames are lent by send_frame_callback
     uint64_t last_traffic;
     QueueHandle_t startStopQueue;
     QueueHandle_t settingsQueue;
     espfsp_frame_config_t frame_config;
     uint64_t frame_interval_us;
+    espfsp_stream_counters_t counters;
+    atomic_bool peer_frame_abort;                           // Receiver reclaims abandoned frames on abort message
     uint8_t en;
 } espfsp_data_proto_t;
 
 esp_err_t espfsp_data_proto_init(espfsp_data_proto_t *data_proto, espfsp_data_proto_config_t *config);
 esp_err_t espfsp_data_proto_deinit(espfsp_data_proto_t *data_proto);
+void espfsp_data_proto_estimate_memory(
+    espfsp_data_proto_type_t type, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate);
 
 esp_err_t espfsp_data_proto_run(espfsp_data_proto_t *data_proto, int sock);
 esp_err_t espfsp_data_proto_start(espfsp_data_proto_t *data_proto);
 esp_err_t espfsp_data_proto_stop(espfsp_data_proto_t *data_proto);
 
+// Makes espfsp_data_proto_run() return, used when owner shuts down
+esp_err_t espfsp_data_proto_terminate(espfsp_data_proto_t *data_proto);
+
+// Safe to use from any task. For receiving protocol also frame counters of receiver buffer are filled.
+void espfsp_data_proto_get_stats(espfsp_data_proto_t *data_proto, espfsp_stream_stats_t *stats);
+
 esp_err_t espfsp_data_proto_set_frame_params(espfsp_data_proto_t *data_proto, espfsp_frame_config_t *frame_config);
+
+// Set from capabilities negotiated with receiving peer, safe to use from any task
+void espfsp_data_proto_set_peer_frame_abort(espfsp_data_proto_t *data_proto, bool supported);
@@ -0,0 +1,30 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "espfsp_config.h"
+
+// NTP-like estimation of round trip time and clock offset from PING/PONG exchange. Clocks are
+// esp_timer_get_time() of both peers, same clock as frame capture timestamps.
+
+#define ESPFSP_CLOCK_SYNC_PING_INTERVAL_US 1000000
+#define ESPFSP_CLOCK_SYNC_SAMPLES 8
+
+typedef struct {
+    int64_t rtt_samples_us[ESPFSP_CLOCK_SYNC_SAMPLES];
+    int64_t offset_samples_us[ESPFSP_CLOCK_SYNC_SAMPLES];
+    int samples_count;
+    int next_sample;
+    espfsp_clock_sync_info_t info;
+} espfsp_clock_sync_t;
+
+void espfsp_clock_sync_init(espfsp_clock_sync_t *sync);
+
+// t1 - ping sent, t4 - pong received (local clock); t2 - ping received, t3 - pong sent (remote clock)
+void espfsp_clock_sync_update(espfsp_clock_sync_t *sync, int64_t t1, int64_t t2, int64_t t3, int64_t t4);
@@ -0,0 +1,39 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "espfsp_config.h"
+
+// Fixed number of equally sized slots for instances of one role. Slots live in one block, either
+// given by user (static storage) or allocated once on pool init.
+
+typedef struct {
+    uint8_t *slots;
+    bool *used;
+    size_t slot_size;
+    uint8_t max_slots;
+    bool own_storage;
+} espfsp_instance_pool_t;
+
+size_t espfsp_instance_pool_storage_size(size_t slot_size, uint8_t max_slots);
+
+esp_err_t espfsp_instance_pool_init(espfsp_instance_pool_t *pool, size_t slot_size, const espfsp_pool_config_t *config);
+esp_err_t espfsp_instance_pool_deinit(espfsp_instance_pool_t *pool);
+
+bool espfsp_instance_pool_is_initialized(const espfsp_instance_pool_t *pool);
+
+// Returns zeroed slot or NULL if all slots are used
+void *espfsp_instance_pool_alloc(espfsp_instance_pool_t *pool);
+esp_err_t espfsp_instance_pool_free(espfsp_instance_pool_t *pool, void *slot);
+
+// Checks if pointer is slot allocated from pool, used to validate handlers
+bool espfsp_instance_pool_is_allocated(const espfsp_instance_pool_t *pool, const void *slot);
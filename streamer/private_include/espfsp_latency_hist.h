@@ -0,0 +1,29 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "espfsp_config.h"
+
+// Log-linear histogram of latencies: 128 us buckets below 1 ms, then 8 buckets per power of two, so
+// reported percentiles are within 12.5% of real value. Latencies above ~16 s go to last bucket.
+
+#define ESPFSP_LATENCY_HIST_LINEAR_BUCKETS 8
+#define ESPFSP_LATENCY_HIST_OCTAVES 14
+#define ESPFSP_LATENCY_HIST_BUCKETS (ESPFSP_LATENCY_HIST_LINEAR_BUCKETS * (ESPFSP_LATENCY_HIST_OCTAVES + 1))
+
+typedef struct {
+    uint32_t buckets[ESPFSP_LATENCY_HIST_BUCKETS];
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    int64_t start_us;
+} espfsp_latency_hist_t;
+
+void espfsp_latency_hist_reset(espfsp_latency_hist_t *hist);
+void espfsp_latency_hist_add(espfsp_latency_hist_t *hist, int64_t latency_us);
+void espfsp_latency_hist_get_stats(const espfsp_latency_hist_t *hist, espfsp_latency_stats_t *stats);
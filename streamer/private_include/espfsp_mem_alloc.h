@@ -0,0 +1,36 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "espfsp_mem.h"
+
+// Every heap allocation of component goes through these, so it is accounted in espfsp_mem_get_stats().
+// Blocks have small header in front, so they have to be freed with espfsp_mem_free(), never with free().
+// caps are MALLOC_CAP_* as for heap_caps_malloc(), 0 for plain malloc().
+
+void *espfsp_mem_malloc(espfsp_mem_tag_t tag, uint32_t caps, size_t size);
+void *espfsp_mem_calloc(espfsp_mem_tag_t tag, uint32_t caps, size_t n, size_t size);
+// alignment is power of two, at least 8
+void *espfsp_mem_aligned_alloc(espfsp_mem_tag_t tag, uint32_t caps, size_t alignment, size_t size);
+// NULL is ignored
+void espfsp_mem_free(void *ptr);
+
+// Queue storage is taken from accounted heap, has to be deleted with espfsp_mem_queue_delete()
+QueueHandle_t espfsp_mem_queue_create(espfsp_mem_tag_t tag, UBaseType_t len, UBaseType_t item_size);
+void espfsp_mem_queue_delete(QueueHandle_t queue);
+
+// Estimator counterparts, add what the allocation above would take
+void espfsp_mem_estimate_add(espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, uint32_t caps, size_t size);
+void espfsp_mem_estimate_add_aligned(
+    espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, uint32_t caps, size_t alignment, size_t size);
+void espfsp_mem_estimate_add_queue(
+    espfsp_mem_estimate_t *estimate, espfsp_mem_tag_t tag, UBaseType_t len, UBaseType_t item_size);
@@ -5,39 +5,127 @@
 
 #pragma once
 
+#include <stdatomic.h>
+#include <stdbool.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "espfsp_message_defs.h"
 #include "espfsp_config.h"
+#include "espfsp_trace.h"
+#include "espfsp_mem.h"
+
+// Cache line size of external RAM, so every part of arena starts on its own line
+#define MESSAGE_BUFFER_ARENA_ALIGN 64
 
 typedef struct {
     uint32_t frame_max_len;
     uint16_t buffered_fbs;
     uint16_t fb_in_buffer_before_get;
-    uint16_t fps;
+    uint16_t fps;                   // 0 at init leaves consumer unpaced
 } espfsp_receiver_buffer_config_t;
 
+typedef struct {
+    uint32_t frames_received;
+    uint32_t frames_lost;           // Evicted before all parts were received
+    uint32_t frames_late;           // Completed, but dropped for newer frame before consumer took it
+    uint32_t frames_preempted;      // Reclaimed on abort from sender
+    uint32_t jitter_us;             // Interarrival jitter as in RFC 3550
+    uint16_t buffer_depth;          // Frames waiting for consumer
+    int64_t last_transit_us;        // Arrival minus capture time of last frame, in clocks of both peers
+} espfsp_receiver_buffer_stats_t;
+
+// Called by producer for every completed frame, before it is handed over to consumer. Must not block.
+typedef void (*espfsp_message_buffer_frame_cb_t)(const espfsp_fb_t *fb, void *ctx);
+
 typedef struct {
     espfsp_receiver_buffer_config_t *config;
-    QueueHandle_t frameQueue;
+    SemaphoreHandle_t mutex;
+    uint16_t allocated_fbs;
+    uint32_t allocated_frame_len;
+    uint8_t *arena;
+    size_t arena_size;
+    // Single producer single consumer ring of completed assembly indices. Head is written only by producer.
+    // Tail is advanced by CAS, by consumer or by producer dropping the oldest frame when no assembly is free.
+    // Every assembly is in ring at most once, so ring of allocated_fbs never overflows.
+    _Atomic uint16_t *frame_ring;
+    _Atomic uint32_t frame_ring_head;
+    _Atomic uint32_t frame_ring_tail;
+    SemaphoreHandle_t frame_ready;          // Given by producer for every pushed frame, wakes waiting consumer
+    // Consumer marks itself busy from get until return, reconfiguration marks pending relayout
+    atomic_bool consumer_busy;
+    atomic_bool relayout_pending;
+    SemaphoreHandle_t consumer_left;        // Given by consumer leaving while relayout is pending
     espfsp_message_assembly_t *fbs_messages_buf;
     espfsp_fb_t *s_fb;
     espfsp_message_assembly_t *s_ass;
-    bool buffer_locked;
-    uint64_t fb_get_interval_us;
+    espfsp_message_assembly_t *cached_ass; // Last complete frame returned by consumer, used by consumer only
+    atomic_bool cache_dropped;              // Set by owner when cached frame is stale, cleared by consumer
+    // Consumer side pacing. Set by reconfigure while consumer runs, so kept apart from config.
+    atomic_bool buffer_locked;
+    _Atomic uint32_t fb_get_interval_us;
+    _Atomic uint16_t fb_in_buffer_before_get;
+    _Atomic uint16_t buffered_fbs;          // Returned assemblies above it are not cached
     uint64_t last_fb_get_us;
+    espfsp_message_buffer_frame_cb_t frame_cb;
+    void *frame_cb_ctx;
+    // Statistics are only reported, so relaxed atomics are enough
+    _Atomic uint32_t stat_frames_received;
+    _Atomic uint32_t stat_frames_lost;
+    _Atomic uint32_t stat_frames_late;
+    _Atomic uint32_t stat_frames_preempted;
+    _Atomic uint32_t stat_jitter_us;
+    _Atomic int64_t stat_last_transit_us;
+    bool stat_has_transit;          // Producer only
+    struct timeval aborted_timestamp; // Producer only, fragments of last aborted frame are ignored
+    struct timeval dropped_timestamp; // Producer only, fragments of last frame without assembly are ignored
+    espfsp_trace_stage_t trace_stage; // Recorded for completed frames, set by owner after init
 } espfsp_receiver_buffer_t;
 
 esp_err_t espfsp_message_buffer_init(espfsp_receiver_buffer_t *receiver_buffer, const espfsp_receiver_buffer_config_t *config);
 esp_err_t espfsp_message_buffer_deinit(espfsp_receiver_buffer_t *receiver_buffer);
 
+// Safe to use while producer and consumer are running. Arena is relaid out only when capacity has to grow
+// and reallocated only when new layout does not fit in it,
+// otherwise pacing and prefill are changed in place. Growing fails if consumer does not return FB
+// within a few frame intervals.
+esp_err_t espfsp_message_buffer_reconfigure(
+    espfsp_receiver_buffer_t *receiver_buffer, const espfsp_receiver_buffer_config_t *config);
+
+// All assemblies, their payloads, FB header and ring storage are kept in single arena.
+// Returns number of bytes the arena takes for given configuration, so memory cost is known before init.
+size_t espfsp_message_buffer_arena_size(uint16_t buffered_fbs, uint32_t frame_max_len);
+size_t espfsp_message_buffer_get_footprint(const espfsp_receiver_buffer_t *receiver_buffer);
+void espfsp_message_buffer_estimate_memory(const espfsp_receiver_buffer_config_t *config, espfsp_mem_estimate_t *estimate);
+
 // Allowed to use only if no other task use receive_buffer
 // esp_err_t espfsp_message_buffer_clear(espfsp_receiver_buffer_t *receiver_buffer);
 
-// Consumer interface
+// Consumer interface. Does not take any lock, frames are handed over by ring
 espfsp_fb_t *espfsp_message_buffer_get_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms);
 esp_err_t espfsp_message_buffer_return_fb(espfsp_receiver_buffer_t *receiver_buffer);
+// Consumer that runs late takes only the newest completed frame, older ones are freed and counted as late
+espfsp_fb_t *espfsp_message_buffer_get_newest_fb(espfsp_receiver_buffer_t *receiver_buffer, uint32_t timeout_ms);
+
+// Gives last complete frame again, without copy. It is held and returned like FB from espfsp_message_buffer_get_fb().
+// Returns NULL if no frame was consumed since last relayout, or producer took its assembly back.
+espfsp_fb_t *espfsp_message_buffer_get_cached_fb(espfsp_receiver_buffer_t *receiver_buffer);
+// Cached frame is dropped by consumer on its next get or return, so it can be called from any task
+void espfsp_message_buffer_drop_cached_fb(espfsp_receiver_buffer_t *receiver_buffer);
+
+// Consumer side, true when completed frame waits to be taken
+bool espfsp_message_buffer_has_frame(espfsp_receiver_buffer_t *receiver_buffer);
+
+// Lets another stage observe completed frames without becoming second consumer
+esp_err_t espfsp_message_buffer_set_frame_cb(
+    espfsp_receiver_buffer_t *receiver_buffer, espfsp_message_buffer_frame_cb_t cb, void *ctx);
+
+// Safe to use from any task, counters are cumulative since init
+void espfsp_message_buffer_get_stats(espfsp_receiver_buffer_t *receiver_buffer, espfsp_receiver_buffer_stats_t *stats);
+// Fills frame counters and queue depth of receiving stream
+void espfsp_message_buffer_get_stream_stats(espfsp_receiver_buffer_t *receiver_buffer, espfsp_stream_stats_t *stats);
 
 // Producer interface
 void espfsp_message_buffer_process_message(const espfsp_message_t *message, espfsp_receiver_buffer_t *instance);
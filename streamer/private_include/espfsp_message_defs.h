@@ -7,16 +7,25 @@
 
 #include <sys/time.h>
 #include <stdint.h>
+#include <stdatomic.h>
 
 #define MESSAGE_BUFFER_SIZE 1400
 
-#define MSG_ASS_OWNED_BIT 0x02
-#define MSG_ASS_USAGE_BIT 0x01
+// msg_number of message without payload, sent when rest of frame with its timestamp will not come
+#define MESSAGE_NUMBER_ABORT -1
 
-#define MSG_ASS_PRODUCER_OWNED_VAL (0 << 1)
-#define MSG_ASS_CONSUMER_OWNED_VAL (1 << 1)
-#define MSG_ASS_FREE_VAL (0 << 0)
-#define MSG_ASS_USED_VAL (1 << 0)
+// Simulcast layer is carried in top byte of msg_total, so frames of layer 0 are sent as before
+#define MESSAGE_LAYER_SHIFT 24
+#define MESSAGE_TOTAL_MASK ((1 << MESSAGE_LAYER_SHIFT) - 1)
+#define MESSAGE_LAYER(msg_total) ((uint8_t) ((uint32_t) (msg_total) >> MESSAGE_LAYER_SHIFT))
+
+// Assembly state. FREE and FILLING are owned by producer, READY and CONSUMED by consumer.
+// CACHED is last frame returned by consumer, producer takes it back when no FREE assembly is left.
+#define MSG_ASS_FREE 0
+#define MSG_ASS_FILLING 1
+#define MSG_ASS_READY 2
+#define MSG_ASS_CONSUMED 3
+#define MSG_ASS_CACHED 4
 
 typedef struct
 {
@@ -38,6 +47,6 @@ typedef struct
     struct timeval timestamp;
     int msg_total;
     int msg_received;
-    uint8_t bits;
+    _Atomic uint8_t state;
     uint8_t *buf;
 } espfsp_message_assembly_t;
@@ -0,0 +1,32 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/sockets.h"
+
+#include "espfsp_net_impairment.h"
+
+// Hooks for espfsp_sock_op. Only datagrams up to ESPFSP_NET_IMPAIRMENT_MAX_PACKET_LEN are delayed,
+// larger ones are only subject to loss and duplication.
+
+#define ESPFSP_NET_IMPAIRMENT_MAX_SOCKETS 8
+#define ESPFSP_NET_IMPAIRMENT_QUEUE_LEN 16
+#define ESPFSP_NET_IMPAIRMENT_MAX_PACKET_LEN 1472
+#define ESPFSP_NET_IMPAIRMENT_REORDER_HOLD_US 10000
+
+// No-op when impairment is disabled
+void espfsp_net_impairment_attach(int sock);
+// Has to be called before socket is closed, when no task sends on it anymore
+void espfsp_net_impairment_detach(int sock);
+
+bool espfsp_net_impairment_is_attached(int sock);
+
+// Same result as send_all_to() in espfsp_sock_op, dest_addr is NULL for connected socket
+int espfsp_net_impairment_send(int sock, const uint8_t *buffer, size_t n, const struct sockaddr_in *dest_addr);
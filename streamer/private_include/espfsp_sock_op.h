@@ -5,11 +5,14 @@
 
 #pragma once
 
+#include <stdbool.h>
+
 #include "esp_err.h"
 #include "esp_netif.h"
 #include "lwip/sockets.h"
 
 #include "espfsp_config.h"
+#include "espfsp_stream_counters.h"
 
 // Type represents state of connection for TCP
 // State Good - read, write with success
@@ -24,11 +27,53 @@ typedef enum
     ESPFSP_CONN_STATE_TERMINATED
 } espfsp_conn_state_t;
 
+// Spreads sending of parts evenly over given time
+typedef struct
+{
+    uint32_t time_to_wait_us_per_part;
+    uint32_t acc_time_to_wait_us;
+} espfsp_pacer_t;
+
+typedef bool (*espfsp_newer_frame_cb_t)(void *ctx);
+
+// Frame sent for longer than after_us is abandoned between fragments, once newer frame is waiting
+typedef struct
+{
+    uint64_t after_us;
+    espfsp_newer_frame_cb_t newer_frame;
+    void *ctx;
+    bool send_abort;        // Receiver is told to reclaim frame at once, otherwise it is evicted as lost
+    bool abandoned;         // Set by sender
+} espfsp_send_preempt_t;
+
+// Fills packet with fragment of data starting at offset. Returns length of packet to send
+typedef size_t (*espfsp_build_fragment_cb_t)(uint8_t *packet, size_t offset, size_t len, bool last, void *ctx);
+
+void espfsp_pacer_init(espfsp_pacer_t *pacer, uint64_t time_us, uint32_t parts);
+void espfsp_pacer_wait(espfsp_pacer_t *pacer);
+
 void espfsp_set_addr(struct sockaddr_in *addr, const struct esp_ip4_addr *esp_addr, int port);
 void espfsp_set_local_addr(struct sockaddr_in *addr, int port);
 
 esp_err_t espfsp_send_whole_fb(int sock, espfsp_fb_t *fb);
-esp_err_t espfsp_send_whole_fb_within(int sock, espfsp_fb_t *fb, uint64_t time_us);
+// Counters and preempt are optional, NULL when sent data is not accounted to any stream or frame is always
+// sent whole. Layer other than 0 is only for receiver which negotiated simulcast.
+esp_err_t espfsp_send_whole_fb_within(
+    int sock,
+    espfsp_fb_t *fb,
+    uint8_t layer,
+    uint64_t time_us,
+    espfsp_stream_counters_t *counters,
+    espfsp_send_preempt_t *preempt);
+esp_err_t espfsp_send_fragments_within(
+    int sock,
+    size_t total_len,
+    size_t fragment_len,
+    uint8_t *packet,
+    uint64_t time_us,
+    espfsp_build_fragment_cb_t build_fragment,
+    void *ctx,
+    espfsp_stream_counters_t *counters);
 esp_err_t espfsp_send_whole_fb_to(int sock, espfsp_fb_t *fb, struct sockaddr_in *dest_addr);
 
 esp_err_t espfsp_send(int sock, char *rx_buffer, int rx_buffer_len);
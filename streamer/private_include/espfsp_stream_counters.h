@@ -0,0 +1,55 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "espfsp_config.h"
+
+// Counters of data stream, updated on hot paths. 32-bit relaxed atomics are lock-free on every
+// target, so counters stay enabled in production.
+typedef struct
+{
+    _Atomic uint32_t fragments_in;
+    _Atomic uint32_t fragments_out;
+    _Atomic uint32_t bytes_in;
+    _Atomic uint32_t bytes_out;
+    _Atomic uint32_t frames_sent;
+    _Atomic uint32_t frames_dropped_oversize;
+    _Atomic uint32_t send_stalls;
+    _Atomic uint32_t frames_preempted;
+} espfsp_stream_counters_t;
+
+static inline void espfsp_stream_counters_init(espfsp_stream_counters_t *counters)
+{
+    atomic_init(&counters->fragments_in, 0);
+    atomic_init(&counters->fragments_out, 0);
+    atomic_init(&counters->bytes_in, 0);
+    atomic_init(&counters->bytes_out, 0);
+    atomic_init(&counters->frames_sent, 0);
+    atomic_init(&counters->frames_dropped_oversize, 0);
+    atomic_init(&counters->send_stalls, 0);
+    atomic_init(&counters->frames_preempted, 0);
+}
+
+static inline void espfsp_stream_counters_add(_Atomic uint32_t *counter, uint32_t value)
+{
+    atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+}
+
+// Frame counters of receiving side are in receiver buffer, they are not filled here
+static inline void espfsp_stream_counters_get(espfsp_stream_counters_t *counters, espfsp_stream_stats_t *stats)
+{
+    stats->fragments_in = atomic_load_explicit(&counters->fragments_in, memory_order_relaxed);
+    stats->fragments_out = atomic_load_explicit(&counters->fragments_out, memory_order_relaxed);
+    stats->bytes_in = atomic_load_explicit(&counters->bytes_in, memory_order_relaxed);
+    stats->bytes_out = atomic_load_explicit(&counters->bytes_out, memory_order_relaxed);
+    stats->frames_sent = atomic_load_explicit(&counters->frames_sent, memory_order_relaxed);
+    stats->frames_dropped_oversize = atomic_load_explicit(&counters->frames_dropped_oversize, memory_order_relaxed);
+    stats->send_stalls = atomic_load_explicit(&counters->send_stalls, memory_order_relaxed);
+    stats->frames_preempted = atomic_load_explicit(&counters->frames_preempted, memory_order_relaxed);
+}
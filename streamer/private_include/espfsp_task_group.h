@@ -0,0 +1,52 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+
+#include "espfsp_config.h"
+
+// Task group tracks all tasks of one instance, also tasks created per connection. On stop every task
+// sees stop request, its registered socket is shut down, and owner waits until all tasks have exited.
+// Tasks leave by espfsp_task_group_exit(), so they are never deleted while holding mutex or memory.
+
+#define ESPFSP_TASK_GROUP_MAX_TASKS 23
+#define ESPFSP_TASK_GROUP_JOIN_TIMEOUT_MS 3000
+
+typedef struct {
+    EventGroupHandle_t events;      // Bit set for every free task slot, last bit set on stop request
+    SemaphoreHandle_t mutex;
+    TaskHandle_t tasks[ESPFSP_TASK_GROUP_MAX_TASKS];
+    int socks[ESPFSP_TASK_GROUP_MAX_TASKS];
+} espfsp_task_group_t;
+
+esp_err_t espfsp_task_group_init(espfsp_task_group_t *group);
+esp_err_t espfsp_task_group_deinit(espfsp_task_group_t *group);
+
+esp_err_t espfsp_task_group_create_task(
+    espfsp_task_group_t *group, TaskFunction_t task, const char *name, const espfsp_task_info_t *task_info, void *arg);
+
+// Has to be last call of task in group. Does not return
+void espfsp_task_group_exit(espfsp_task_group_t *group);
+
+bool espfsp_task_group_should_stop(espfsp_task_group_t *group);
+
+// Sleep that ends early on stop request. Returns true if stop was requested
+bool espfsp_task_group_wait_stop(espfsp_task_group_t *group, uint32_t time_ms);
+
+// Socket used by calling task, it is shut down on stop to unblock the task. Set -1 before closing it.
+void espfsp_task_group_set_sock(espfsp_task_group_t *group, int sock);
+
+// Requests stop and waits until all tasks exit. Returns ESP_ERR_TIMEOUT if any task is still running
+esp_err_t espfsp_task_group_stop_and_join(espfsp_task_group_t *group, uint32_t timeout_ms);
@@ -0,0 +1,26 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "sdkconfig.h"
+
+#include "espfsp_trace.h"
+
+#if CONFIG_ESPFSP_TRACE
+
+// Single relaxed atomic increment and three stores per record
+void espfsp_trace_record(espfsp_trace_stage_t stage, const struct timeval *capture_timestamp);
+
+#define ESPFSP_TRACE(stage, capture_timestamp) espfsp_trace_record((stage), (capture_timestamp))
+
+#else
+
+#define ESPFSP_TRACE(stage, capture_timestamp) ((void) 0)
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "espfsp_mem.h"
+
+// MJPEG in AVI container written with plain stdio, so it works on any VFS mount and on host filesystem.
+// Frames are appended sequentially through batch buffer. Index is kept in memory and appended on close,
+// only then header is patched with final sizes.
+
+typedef struct {
+    uint32_t batch_size;        // Bytes collected before single write to file
+    uint32_t max_frames;        // Frames per file, bounds memory used by index
+    uint16_t fps;
+} espfsp_avi_writer_config_t;
+
+typedef struct {
+    espfsp_avi_writer_config_t config;
+    FILE *file;
+    uint8_t *batch;
+    uint32_t batch_len;
+    uint32_t *index;
+    uint32_t frames;
+    uint32_t movi_len;
+    uint32_t max_frame_len;
+} espfsp_avi_writer_t;
+
+esp_err_t espfsp_avi_writer_open(
+    espfsp_avi_writer_t *writer, const char *path, const espfsp_avi_writer_config_t *config, uint32_t width, uint32_t height);
+esp_err_t espfsp_avi_writer_add_frame(espfsp_avi_writer_t *writer, const uint8_t *buf, uint32_t len);
+esp_err_t espfsp_avi_writer_close(espfsp_avi_writer_t *writer);
+
+bool espfsp_avi_writer_is_open(const espfsp_avi_writer_t *writer);
+bool espfsp_avi_writer_is_full(const espfsp_avi_writer_t *writer);
+
+// Taken while file is open
+void espfsp_avi_writer_estimate_memory(const espfsp_avi_writer_config_t *config, espfsp_mem_estimate_t *estimate);
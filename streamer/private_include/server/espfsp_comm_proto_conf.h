@@ -7,7 +7,14 @@
 
 #include "esp_err.h"
 
+#include "espfsp_mem.h"
+
 #include "server/espfsp_state_def.h"
 
 esp_err_t espfsp_server_comm_protos_init(espfsp_server_instance_t *instance);
 esp_err_t espfsp_server_comm_protos_deinit(espfsp_server_instance_t *instance);
+void espfsp_server_comm_protos_estimate_memory(const espfsp_server_config_t *config, espfsp_mem_estimate_t *estimate);
+
+// Configured number of connections or default
+uint8_t espfsp_server_client_push_connections(const espfsp_server_config_t *config);
+uint8_t espfsp_server_client_play_connections(const espfsp_server_config_t *config);
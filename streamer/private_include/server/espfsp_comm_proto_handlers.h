@@ -11,6 +11,7 @@
 
 esp_err_t espfsp_server_req_session_init_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_session_terminate_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_server_req_session_ping_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_start_stream_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_stop_stream_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_cam_set_params_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
@@ -19,5 +20,13 @@ esp_err_t espfsp_server_req_frame_set_params_handler(espfsp_comm_proto_t *comm_p
 esp_err_t espfsp_server_req_frame_get_params_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_source_set_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 esp_err_t espfsp_server_req_source_get_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_server_req_stream_status_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
+esp_err_t espfsp_server_req_scene_state_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx);
 
 esp_err_t espfsp_server_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx);
+// Detaches session if it can be resumed, otherwise stops it as espfsp_server_connection_stop
+esp_err_t espfsp_server_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx);
+
+// Callbacks of push subscription, ctx is server instance
+esp_err_t espfsp_server_push_stream_start(void *ctx);
+esp_err_t espfsp_server_push_stream_stop(void *ctx);
@@ -5,11 +5,13 @@
 
 #pragma once
 
+#include "espfsp_task_group.h"
 #include "data_proto/espfsp_data_proto.h"
 
 typedef struct {
     espfsp_data_proto_t *data_proto;
     int server_port;
+    espfsp_task_group_t *task_group;
 } espfsp_server_data_task_data_t;
 
 // Pointer passed to this task has to point to structure espfsp_server_data_task_data_t
@@ -0,0 +1,26 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <sys/time.h>
+
+// Lowers frame rate for single subscriber. Decision is based only on frame capture timestamps,
+// so it does not depend on when the subscriber asks for frames.
+
+typedef struct {
+    uint16_t fps;                   // 0 passes all frames
+    uint64_t interval_us;
+    uint64_t next_due_us;
+    bool started;
+} espfsp_frame_decimator_t;
+
+void espfsp_frame_decimator_init(espfsp_frame_decimator_t *decimator, uint16_t fps);
+
+// Returns true if frame with given capture time shall be sent to subscriber
+bool espfsp_frame_decimator_pass(espfsp_frame_decimator_t *decimator, const struct timeval *timestamp);
@@ -0,0 +1,63 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_config.h"
+#include "espfsp_server.h"
+#include "espfsp_mem.h"
+#include "espfsp_task_group.h"
+#include "server/espfsp_push_subscription.h"
+
+// MJPEG over HTTP (multipart/x-mixed-replace). Relay copies every frame once into shared slot from pool,
+// every client gets only pointer to it in own bounded queue. When client queue is full, the oldest frame
+// is dropped, so slow client never back-pressures relay. Client task sends directly from shared slot.
+// Every streaming client subscribes to push stream, so frames come also without play session.
+
+typedef struct {
+    atomic_int refs;
+    espfsp_fb_t fb;
+} espfsp_http_stream_frame_t;
+
+typedef struct espfsp_http_stream espfsp_http_stream_t;
+
+typedef struct {
+    espfsp_http_stream_t *http_stream;
+    QueueHandle_t frameQueue;
+    int sock;
+    bool used;
+} espfsp_http_stream_client_t;
+
+struct espfsp_http_stream {
+    espfsp_http_stream_config_t config;
+    uint32_t frame_max_len;
+    SemaphoreHandle_t mutex;                // Guards clients list, taken by relay only without waiting
+    espfsp_http_stream_frame_t *frames;
+    uint16_t frames_count;
+    uint8_t *frames_mem;
+    espfsp_http_stream_client_t *clients;
+    atomic_uint clients_count;
+    espfsp_task_group_t task_group;         // Listener and client tasks, with their sockets
+    espfsp_push_subscription_t *push_subscription;
+};
+
+esp_err_t espfsp_http_stream_init(
+    espfsp_http_stream_t *http_stream,
+    const espfsp_http_stream_config_t *config,
+    uint32_t frame_max_len,
+    espfsp_push_subscription_t *push_subscription);
+esp_err_t espfsp_http_stream_deinit(espfsp_http_stream_t *http_stream);
+void espfsp_http_stream_estimate_memory(
+    const espfsp_http_stream_config_t *config, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate);
+
+// Called from relay for every completed frame. Never blocks
+void espfsp_http_stream_feed(const espfsp_fb_t *fb, void *ctx);
@@ -0,0 +1,29 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Chooses simulcast layer for single subscriber from its loss reports. Layer is lowered on loss.
+// Higher layer is probed after run of clean reports, and run needed is doubled every time probe fails,
+// so subscriber on link which cannot take higher layer is not switched back and forth.
+
+typedef struct {
+    uint8_t layers;                 // With layer 0, 1 disables selection
+    uint8_t layer;                  // 0 is camera stream
+    uint16_t down_loss_permille;
+    uint8_t up_after_reports;
+    uint8_t up_hold_reports;        // Clean reports needed before next probe
+    uint8_t clean_reports;
+    bool probing;                   // Last switch was up and it has not held yet
+} espfsp_layer_selector_t;
+
+void espfsp_layer_selector_init(
+    espfsp_layer_selector_t *selector, uint8_t layers, uint16_t down_loss_permille, uint8_t up_after_reports);
+
+// Returns layer for subscriber after its report
+uint8_t espfsp_layer_selector_update(espfsp_layer_selector_t *selector, uint16_t loss_permille);
@@ -0,0 +1,46 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// Counts subscribers of primary push stream: play session, every HTTP client, RTSP session in PLAY and
+// recorder. Stream is started for first subscriber and stopped after last one leaves. Subscriber is counted
+// even when stream cannot be started yet, it is started then by resume or restart. Callbacks are called
+// with subscription lock held, so they must not take it again.
+
+typedef esp_err_t (*espfsp_push_subscription_cb_t)(void *ctx);
+
+typedef struct {
+    SemaphoreHandle_t mutex;
+    uint16_t subscribers;
+    bool streaming;
+    espfsp_push_subscription_cb_t start_stream;
+    espfsp_push_subscription_cb_t stop_stream;
+    void *ctx;
+} espfsp_push_subscription_t;
+
+esp_err_t espfsp_push_subscription_init(
+    espfsp_push_subscription_t *subscription,
+    espfsp_push_subscription_cb_t start_stream,
+    espfsp_push_subscription_cb_t stop_stream,
+    void *ctx);
+esp_err_t espfsp_push_subscription_deinit(espfsp_push_subscription_t *subscription);
+
+// Returns result of stream start, subscriber stays counted when it fails and has to be dropped anyway
+esp_err_t espfsp_push_subscription_take(espfsp_push_subscription_t *subscription);
+esp_err_t espfsp_push_subscription_drop(espfsp_push_subscription_t *subscription);
+
+// Primary push changed or was lost. Running stream is stopped and started again for subscribers
+esp_err_t espfsp_push_subscription_restart(espfsp_push_subscription_t *subscription);
+// Push connected. Stream is started when subscribers wait for it
+esp_err_t espfsp_push_subscription_resume(espfsp_push_subscription_t *subscription);
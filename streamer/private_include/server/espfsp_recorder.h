@@ -0,0 +1,53 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_config.h"
+#include "espfsp_server.h"
+#include "server/espfsp_avi_writer.h"
+#include "server/espfsp_push_subscription.h"
+
+// Recorder keeps last frames in memory ring. Relay only copies frame into the ring, all storage I/O
+// is done by recorder task, so slow storage cannot stall relay. When ring is full, the oldest frame is dropped.
+// Recorder holds push stream subscription while it runs, in triggered mode it keeps pre-event frames fed.
+
+typedef struct {
+    espfsp_recorder_config_t config;
+    uint16_t fps;
+    SemaphoreHandle_t mutex;
+    uint8_t *ring;
+    uint32_t ring_head;
+    uint32_t ring_tail;
+    uint32_t ring_used;
+    uint8_t *frame_buf;
+    uint32_t frame_buf_len;
+    espfsp_avi_writer_t writer;
+    uint64_t record_until_us;
+    uint32_t dropped_frames;
+    TaskHandle_t task_handle;
+    uint8_t en;
+    espfsp_push_subscription_t *push_subscription;
+} espfsp_recorder_t;
+
+esp_err_t espfsp_recorder_init(
+    espfsp_recorder_t *recorder,
+    const espfsp_recorder_config_t *config,
+    uint16_t fps,
+    espfsp_push_subscription_t *push_subscription);
+esp_err_t espfsp_recorder_deinit(espfsp_recorder_t *recorder);
+// Frame copy buffer grows to largest recorded frame, so frame_max_len is counted
+void espfsp_recorder_estimate_memory(
+    const espfsp_recorder_config_t *config, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate);
+
+// Called from relay for every completed frame. Only copies frame into the ring
+void espfsp_recorder_feed(const espfsp_fb_t *fb, void *ctx);
+
+esp_err_t espfsp_recorder_trigger(espfsp_recorder_t *recorder);
@@ -0,0 +1,48 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#include "espfsp_config.h"
+
+// RTP payload format for JPEG (RFC 2435). Baseline JPEG with 8-bit quantization tables and
+// 4:2:0 or 4:2:2 sampling is supported, which is what camera sensors produce.
+
+#define RTP_JPEG_PAYLOAD_TYPE 26
+#define RTP_JPEG_CLOCK_RATE 90000
+#define RTP_JPEG_FRAGMENT_LEN 1300
+#define RTP_JPEG_MAX_QTABLES 2
+#define RTP_JPEG_MAX_PACKET_LEN (12 + 8 + 4 + 128 + RTP_JPEG_FRAGMENT_LEN)
+
+typedef struct {
+    uint16_t seq;
+    uint32_t ssrc;
+} espfsp_rtp_jpeg_stream_t;
+
+typedef struct {
+    espfsp_rtp_jpeg_stream_t *stream;
+    uint32_t timestamp;
+    uint8_t type;
+    uint8_t width;                  // In 8 pixel blocks
+    uint8_t height;
+    const uint8_t *qtables[RTP_JPEG_MAX_QTABLES];
+    uint8_t qtables_count;
+    const uint8_t *scan;
+    size_t scan_len;
+} espfsp_rtp_jpeg_frame_t;
+
+void espfsp_rtp_jpeg_stream_init(espfsp_rtp_jpeg_stream_t *stream, uint32_t ssrc);
+
+// Finds quantization tables and entropy coded scan in JPEG, nothing is copied
+esp_err_t espfsp_rtp_jpeg_parse(espfsp_rtp_jpeg_stream_t *stream, const espfsp_fb_t *fb, espfsp_rtp_jpeg_frame_t *frame);
+
+// espfsp_build_fragment_cb_t for scan of parsed frame, ctx is espfsp_rtp_jpeg_frame_t
+size_t espfsp_rtp_jpeg_build_packet(uint8_t *packet, size_t offset, size_t len, bool last, void *ctx);
@@ -0,0 +1,50 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_config.h"
+#include "espfsp_server.h"
+#include "espfsp_mem.h"
+#include "server/espfsp_rtp_jpeg.h"
+#include "server/espfsp_push_subscription.h"
+
+// Minimal RTSP server (OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN) with single session. Stream is sent
+// as RTP/JPEG over UDP unicast. Relay copies frame into slot not being sent, so the latest frame
+// is always sent next and relay never waits for network.
+
+#define RTSP_FRAME_SLOTS 2
+
+typedef struct {
+    espfsp_rtsp_config_t config;
+    uint32_t frame_max_len;
+    uint64_t frame_interval_us;
+    SemaphoreHandle_t mutex;
+    espfsp_fb_t frames[RTSP_FRAME_SLOTS];
+    int latest_frame;                       // -1 when no new frame since last send
+    int sending_frame;                      // -1 when no frame is being sent
+    bool playing;                           // Push stream is subscribed meanwhile
+    espfsp_rtp_jpeg_stream_t rtp_stream;
+    uint8_t packet[RTP_JPEG_MAX_PACKET_LEN];
+    uint8_t en;
+    uint8_t task_running;
+    espfsp_push_subscription_t *push_subscription;
+} espfsp_rtsp_server_t;
+
+esp_err_t espfsp_rtsp_server_init(
+    espfsp_rtsp_server_t *rtsp_server,
+    const espfsp_rtsp_config_t *config,
+    const espfsp_frame_config_t *frame_config,
+    espfsp_push_subscription_t *push_subscription);
+esp_err_t espfsp_rtsp_server_deinit(espfsp_rtsp_server_t *rtsp_server);
+void espfsp_rtsp_server_estimate_memory(uint32_t frame_max_len, espfsp_mem_estimate_t *estimate);
+
+// Called from relay for every completed frame. Never blocks
+void espfsp_rtsp_server_feed(const espfsp_fb_t *fb, void *ctx);
@@ -6,6 +6,8 @@
 #pragma once
 
 #include "espfsp_config.h"
+#include "espfsp_task_group.h"
+#include "comm_proto/espfsp_comm_proto.h"
 #include "server/espfsp_session_manager.h"
 
 typedef struct {
@@ -13,6 +15,9 @@ typedef struct {
     espfsp_session_manager_session_type_t session_type;
     int server_port;
     espfsp_task_info_t connection_task_info;
+    espfsp_task_group_t *task_group;        // Task and its connection tasks are run in this group
+    __espfsp_comm_proto_cb session_expired_cb;  // Stops detached session not resumed within grace window
+    void *session_expired_ctx;
 } espfsp_server_session_and_control_task_data_t;
 
 // Pointer passed to this task has to point to structure espfsp_server_session_and_control_task_data_t
@@ -11,6 +11,8 @@
 #include "freertos/task.h"
 
 #include "espfsp_config.h"
+#include "espfsp_server.h"
+#include "espfsp_mem.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
 #define ESPFSP_SERVER_SESSION_NAME_MAX_LEN 30
@@ -25,6 +27,10 @@
 //   client type only one session (so one client) is primary; primary means
 //   that only one CLIENT_PLAY can receive DATA and only one CLIENT_PUSH can
 //   send DATA;
+// - session which lost its connection is detached, not deactivated. It keeps
+//   its ID, stream state and configuration for resume_grace_ms, so client
+//   reconnecting with resume token gets the same session back; detached
+//   session is deactivated only after grace window expires;
 
 typedef enum
 {
@@ -42,6 +48,14 @@ typedef struct
     bool stream_started;
     espfsp_frame_config_t frame_config;
     espfsp_cam_config_t cam_config;
+    espfsp_clock_sync_info_t clock_sync;    // As reported by client in ping
+    espfsp_stream_status_t stream_status;   // As reported by CLIENT_PLAY
+    uint16_t proto_version;                 // Negotiated in session init
+    uint32_t capabilities;
+    uint8_t simulcast_layers;               // Lower layers announced by CLIENT_PUSH, when simulcast was negotiated
+    uint32_t resume_token;
+    bool detached;
+    int64_t detached_deadline_us;
 } espfsp_server_session_manager_data_t;
 
 typedef uint32_t (*__espfsp_session_manager_session_id_generator)(espfsp_session_manager_session_type_t type);
@@ -58,6 +72,7 @@ typedef struct
     __espfsp_session_manager_session_id_generator session_id_gen;
     espfsp_frame_config_t default_frame_config;
     espfsp_cam_config_t default_cam_config;
+    uint32_t resume_grace_ms;               // 0 disables session resumption
 } espfsp_server_session_manager_config_t;
 
 typedef struct
@@ -76,6 +91,8 @@ typedef struct
 // Initialization/Deinitialization of Session Manager
 esp_err_t espfsp_session_manager_init(
     espfsp_session_manager_t *session_manager, espfsp_server_session_manager_config_t *config);
+void espfsp_session_manager_estimate_memory(
+    uint8_t client_push_sessions, uint8_t client_play_sessions, espfsp_mem_estimate_t *estimate);
 esp_err_t espfsp_session_manager_deinit(espfsp_session_manager_t *session_manager);
 
 // Synchronization mechanism for safe access - tasks can use same Session Manager.
@@ -98,6 +115,20 @@ esp_err_t espfsp_session_manager_deactivate_session(
     espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto);
 esp_err_t espfsp_session_manager_get_session_id(
     espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *session_id);
+// Session may have ended meanwhile, so its end is not logged as error
+bool espfsp_session_manager_has_session(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t session_id);
+// Token is 0 when session cannot be resumed
+esp_err_t espfsp_session_manager_get_resume_token(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *resume_token);
+esp_err_t espfsp_session_manager_get_capabilities(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *capabilities);
+esp_err_t espfsp_session_manager_set_capabilities(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint16_t proto_version, uint32_t capabilities);
+esp_err_t espfsp_session_manager_get_simulcast_layers(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint8_t *layers);
+esp_err_t espfsp_session_manager_set_simulcast_layers(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint8_t layers);
 esp_err_t espfsp_session_manager_get_session_name(
     espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, char session_name[30]);
 esp_err_t espfsp_session_manager_get_session_type(
@@ -120,6 +151,22 @@ esp_err_t espfsp_session_manager_set_frame_config(
     espfsp_session_manager_t *session_manager,
     espfsp_comm_proto_t *comm_proto,
     espfsp_frame_config_t *frame_config);
+esp_err_t espfsp_session_manager_get_clock_sync(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    espfsp_clock_sync_info_t *clock_sync);
+esp_err_t espfsp_session_manager_set_clock_sync(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    const espfsp_clock_sync_info_t *clock_sync);
+esp_err_t espfsp_session_manager_get_stream_status(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    espfsp_stream_status_t *stream_status);
+esp_err_t espfsp_session_manager_set_stream_status(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    const espfsp_stream_status_t *stream_status);
 esp_err_t espfsp_session_manager_get_cam_config(
     espfsp_session_manager_t *session_manager,
     espfsp_comm_proto_t *comm_proto,
@@ -129,6 +176,25 @@ esp_err_t espfsp_session_manager_set_cam_config(
     espfsp_comm_proto_t *comm_proto,
     espfsp_cam_config_t *cam_config);
 
+// Session resumption. Detach keeps session of lost connection for grace window. Resume moves
+// detached session with matching ID and token to Communication Protocol of new connection.
+// Expired detached session is returned with its Communication Protocol taken, so it has to be
+// deactivated and returned by caller.
+esp_err_t espfsp_session_manager_detach_session(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto);
+// Returns ESP_ERR_NOT_FOUND when session of Communication Protocol is not detached
+esp_err_t espfsp_session_manager_get_detached_session_id(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *session_id);
+esp_err_t espfsp_session_manager_resume_session(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    uint32_t session_id,
+    uint32_t resume_token);
+esp_err_t espfsp_session_manager_take_expired_session(
+    espfsp_session_manager_t *session_manager,
+    espfsp_session_manager_session_type_t type,
+    espfsp_comm_proto_t **comm_proto);
+
 // General management of Session Manager
 esp_err_t espfsp_session_manager_get_primary_session(
     espfsp_session_manager_t *session_manager,
@@ -144,6 +210,12 @@ esp_err_t espfsp_session_manager_get_active_sessions(
     espfsp_comm_proto_t **comm_proto_buf,
     int comm_proto_buf_len,
     int *active_sessions_count);
+// Fills up to sessions_len entries, sessions_count is number of all sessions including detached
+esp_err_t espfsp_session_manager_get_sessions_stats(
+    espfsp_session_manager_t *session_manager,
+    espfsp_server_session_stats_t *sessions,
+    int sessions_len,
+    int *sessions_count);
 esp_err_t espfsp_session_manager_get_active_session(
     espfsp_session_manager_t *session_manager,
     espfsp_session_manager_session_type_t type,
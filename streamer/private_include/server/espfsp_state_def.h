@@ -5,41 +5,74 @@
 
 #pragma once
 
+#include <stdatomic.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "espfsp_server.h"
 #include "espfsp_message_defs.h"
 #include "espfsp_message_buffer.h"
+#include "espfsp_task_group.h"
+#include "espfsp_instance_pool.h"
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
 #include "server/espfsp_session_manager.h"
+#include "server/espfsp_frame_decimator.h"
+#include "server/espfsp_layer_selector.h"
+#include "server/espfsp_push_subscription.h"
+#include "server/espfsp_recorder.h"
+#include "server/espfsp_http_stream.h"
+#include "server/espfsp_rtsp_server.h"
+
+// Used when pool or connection limits are not given in runtime configuration
+#define ESPFSP_SERVER_DEFAULT_MAX_INSTANCES 1
+#define ESPFSP_SERVER_DEFAULT_CLIENT_PUSH_MAX_CONNECTIONS 3
+#define ESPFSP_SERVER_DEFAULT_CLIENT_PLAY_MAX_CONNECTIONS 1
+#define ESPFSP_SERVER_DEFAULT_SESSION_RESUME_GRACE_MS 3000
 
-#define CONFIG_ESPFSP_SERVER_MAX_INSTANCES 1
-#define CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS 3
-#define CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS 1
+// Lower layers are only relayed, so they are not buffered deeper
+#define ESPFSP_SERVER_SIMULCAST_BUFFERED_FBS 2
 
 typedef struct
 {
-    TaskHandle_t data_send_task_handle;
-    TaskHandle_t data_recv_task_handle;
-    TaskHandle_t server_client_push_handle;
-    TaskHandle_t server_client_play_handle;
+    espfsp_task_group_t task_group;     // Also connection tasks
     espfsp_server_config_t *config;
-    bool used;
 
     espfsp_receiver_buffer_t receiver_buffer;
+    espfsp_receiver_buffer_t layer_receiver_buffers[ESPFSP_SIMULCAST_MAX_LOWER_LAYERS];
+    uint8_t layer_receiver_buffers_count;
+    atomic_bool send_cached_fb; // Set on subscribe, cleared when cached or first live frame is obtained
+    _Atomic uint16_t play_fps;  // Frame rate requested by play session, 0 when it takes all frames
+    espfsp_frame_decimator_t play_decimator;
+    atomic_bool source_static;  // Primary push sends keepalive frames only
+    espfsp_layer_selector_t play_layer_selector;    // Used by session task of play
+    _Atomic uint8_t play_layer; // Simulcast layer chosen for play session
+    uint8_t play_sent_layer;    // Used by data task of play, as two below
+    bool play_switch_pending;   // First frame of new layer was not sent yet
+    struct timeval play_sent_timestamp;
 
-    espfsp_comm_proto_t client_push_comm_proto[CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS];
-    espfsp_comm_proto_t client_play_comm_proto[CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS];
+    espfsp_comm_proto_t *client_push_comm_proto;
+    espfsp_comm_proto_t *client_play_comm_proto;
+    espfsp_comm_proto_t **active_push_comm_protos_buf;  // For every push connection, used under session manager lock
+    uint8_t client_push_comm_proto_count;
+    uint8_t client_play_comm_proto_count;
 
     espfsp_data_proto_t client_push_data_proto;
     espfsp_data_proto_t client_play_data_proto;
 
     espfsp_session_manager_t session_manager;
+
+    espfsp_push_subscription_t push_subscription;
+    espfsp_comm_proto_t *streaming_push_comm_proto;    // Used under push subscription lock, as one below
+    uint32_t streaming_push_session_id;
+
+    espfsp_recorder_t recorder;
+    espfsp_http_stream_t http_stream;
+    espfsp_rtsp_server_t rtsp_server;
 } espfsp_server_instance_t;
 
 typedef struct
 {
-    espfsp_server_instance_t instances[CONFIG_ESPFSP_SERVER_MAX_INSTANCES];
+    espfsp_instance_pool_t instances;   // Of espfsp_server_instance_t
 } espfsp_server_state_t;
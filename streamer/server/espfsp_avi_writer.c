@@ -0,0 +1,369 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "espfsp_mem_alloc.h"
+#include "server/espfsp_avi_writer.h"
+
+#define AVI_HEADER_LEN 224
+
+// Offsets of fields patched on close
+#define AVI_RIFF_SIZE_OFFSET 4
+#define AVI_AVIH_MAX_BYTES_OFFSET 36
+#define AVI_AVIH_TOTAL_FRAMES_OFFSET 48
+#define AVI_AVIH_SUGGESTED_BUF_OFFSET 60
+#define AVI_STRH_LENGTH_OFFSET 140
+#define AVI_STRH_SUGGESTED_BUF_OFFSET 144
+#define AVI_MOVI_SIZE_OFFSET 216
+
+#define AVI_CHUNK_HEADER_LEN 8
+#define AVI_INDEX_ENTRY_WORDS 4
+#define AVI_FLAG_HAS_INDEX 0x10
+#define AVI_INDEX_FLAG_KEYFRAME 0x10
+
+static const char *TAG = "ESPFSP_AVI_WRITER";
+
+static uint8_t *put_u32(uint8_t *p, uint32_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = (val >> 8) & 0xFF;
+    p[2] = (val >> 16) & 0xFF;
+    p[3] = (val >> 24) & 0xFF;
+    return p + 4;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = (val >> 8) & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put_fourcc(uint8_t *p, const char *fourcc)
+{
+    memcpy(p, fourcc, 4);
+    return p + 4;
+}
+
+static void build_header(uint8_t *header, const espfsp_avi_writer_config_t *config, uint32_t width, uint32_t height)
+{
+    uint8_t *p = header;
+
+    memset(header, 0, AVI_HEADER_LEN);
+
+    p = put_fourcc(p, "RIFF");
+    p = put_u32(p, 0);                              // Patched on close
+    p = put_fourcc(p, "AVI ");
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, 192);
+    p = put_fourcc(p, "hdrl");
+
+    p = put_fourcc(p, "avih");
+    p = put_u32(p, 56);
+    p = put_u32(p, 1000000 / config->fps);          // Microseconds per frame
+    p = put_u32(p, 0);                              // Max bytes per second, patched on close
+    p = put_u32(p, 0);
+    p = put_u32(p, AVI_FLAG_HAS_INDEX);
+    p = put_u32(p, 0);                              // Total frames, patched on close
+    p = put_u32(p, 0);
+    p = put_u32(p, 1);                              // Streams
+    p = put_u32(p, 0);                              // Suggested buffer size, patched on close
+    p = put_u32(p, width);
+    p = put_u32(p, height);
+    p += 16;
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, 116);
+    p = put_fourcc(p, "strl");
+
+    p = put_fourcc(p, "strh");
+    p = put_u32(p, 56);
+    p = put_fourcc(p, "vids");
+    p = put_fourcc(p, "MJPG");
+    p = put_u32(p, 0);
+    p = put_u16(p, 0);
+    p = put_u16(p, 0);
+    p = put_u32(p, 0);
+    p = put_u32(p, 1);                              // Scale
+    p = put_u32(p, config->fps);                    // Rate
+    p = put_u32(p, 0);
+    p = put_u32(p, 0);                              // Length in frames, patched on close
+    p = put_u32(p, 0);                              // Suggested buffer size, patched on close
+    p = put_u32(p, 0xFFFFFFFF);                     // Default quality
+    p = put_u32(p, 0);
+    p = put_u16(p, 0);
+    p = put_u16(p, 0);
+    p = put_u16(p, width);
+    p = put_u16(p, height);
+
+    p = put_fourcc(p, "strf");
+    p = put_u32(p, 40);
+    p = put_u32(p, 40);
+    p = put_u32(p, width);
+    p = put_u32(p, height);
+    p = put_u16(p, 1);                              // Planes
+    p = put_u16(p, 24);                             // Bit count
+    p = put_fourcc(p, "MJPG");
+    p = put_u32(p, width * height * 3);
+    p += 16;
+
+    p = put_fourcc(p, "LIST");
+    p = put_u32(p, 0);                              // Patched on close
+    p = put_fourcc(p, "movi");
+}
+
+static esp_err_t write_all(espfsp_avi_writer_t *writer, const void *buf, uint32_t len)
+{
+    if (fwrite(buf, 1, len, writer->file) != len)
+    {
+        ESP_LOGE(TAG, "Write to file failed");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t flush_batch(espfsp_avi_writer_t *writer)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (writer->batch_len > 0)
+    {
+        ret = write_all(writer, writer->batch, writer->batch_len);
+        writer->batch_len = 0;
+    }
+
+    return ret;
+}
+
+static esp_err_t append(espfsp_avi_writer_t *writer, const void *buf, uint32_t len)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (writer->batch_len + len > writer->config.batch_size)
+    {
+        ret = flush_batch(writer);
+    }
+
+    if (ret == ESP_OK && len > writer->config.batch_size)
+    {
+        return write_all(writer, buf, len);
+    }
+
+    if (ret == ESP_OK)
+    {
+        memcpy(writer->batch + writer->batch_len, buf, len);
+        writer->batch_len += len;
+    }
+
+    return ret;
+}
+
+static esp_err_t patch_u32(espfsp_avi_writer_t *writer, long offset, uint32_t val)
+{
+    uint8_t buf[4];
+
+    put_u32(buf, val);
+
+    if (fseek(writer->file, offset, SEEK_SET) != 0)
+    {
+        ESP_LOGE(TAG, "Seek in file failed");
+        return ESP_FAIL;
+    }
+
+    return write_all(writer, buf, sizeof(buf));
+}
+
+esp_err_t espfsp_avi_writer_open(
+    espfsp_avi_writer_t *writer, const char *path, const espfsp_avi_writer_config_t *config, uint32_t width, uint32_t height)
+{
+    uint8_t header[AVI_HEADER_LEN];
+
+    if (config->fps == 0 || config->max_frames == 0)
+    {
+        ESP_LOGE(TAG, "FPS and max frames cannot be 0");
+        return ESP_FAIL;
+    }
+
+    memcpy(&writer->config, config, sizeof(espfsp_avi_writer_config_t));
+    writer->file = NULL;
+    writer->frames = 0;
+    writer->movi_len = 4;                           // 'movi' fourcc is counted in list size
+    writer->max_frame_len = 0;
+    writer->batch_len = 0;
+
+    writer->batch = (uint8_t *) espfsp_mem_malloc(ESPFSP_MEM_TAG_RECORDER, 0, config->batch_size);
+    if (writer->batch == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate memory for write batch");
+        return ESP_FAIL;
+    }
+
+    writer->index = (uint32_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_RECORDER, 0, config->max_frames * AVI_INDEX_ENTRY_WORDS * sizeof(uint32_t));
+    if (writer->index == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate memory for index");
+        espfsp_mem_free(writer->batch);
+        return ESP_FAIL;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (writer->file == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot open file %s", path);
+        espfsp_mem_free(writer->index);
+        espfsp_mem_free(writer->batch);
+        return ESP_FAIL;
+    }
+
+    // Batch buffer is the only buffering, stdio one would copy everything once more
+    setvbuf(writer->file, NULL, _IONBF, 0);
+
+    build_header(header, config, width, height);
+
+    if (append(writer, header, AVI_HEADER_LEN) != ESP_OK)
+    {
+        espfsp_avi_writer_close(writer);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Recording to %s", path);
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_avi_writer_add_frame(espfsp_avi_writer_t *writer, const uint8_t *buf, uint32_t len)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t chunk_header[AVI_CHUNK_HEADER_LEN];
+    uint8_t pad = 0;
+
+    if (espfsp_avi_writer_is_full(writer))
+    {
+        ESP_LOGE(TAG, "Index is full");
+        return ESP_FAIL;
+    }
+
+    put_u32(put_fourcc(chunk_header, "00dc"), len);
+
+    ret = append(writer, chunk_header, sizeof(chunk_header));
+    if (ret == ESP_OK)
+    {
+        ret = append(writer, buf, len);
+    }
+    if (ret == ESP_OK && (len & 1))
+    {
+        // Chunks are word aligned
+        ret = append(writer, &pad, 1);
+    }
+
+    if (ret == ESP_OK)
+    {
+        uint32_t *entry = &writer->index[writer->frames * AVI_INDEX_ENTRY_WORDS];
+
+        put_fourcc((uint8_t *) &entry[0], "00dc");
+        put_u32((uint8_t *) &entry[1], AVI_INDEX_FLAG_KEYFRAME);
+        put_u32((uint8_t *) &entry[2], writer->movi_len);   // Offset from 'movi' fourcc
+        put_u32((uint8_t *) &entry[3], len);
+
+        writer->movi_len += AVI_CHUNK_HEADER_LEN + len + (len & 1);
+        writer->max_frame_len = len > writer->max_frame_len ? len : writer->max_frame_len;
+        writer->frames += 1;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_avi_writer_close(espfsp_avi_writer_t *writer)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t idx_header[AVI_CHUNK_HEADER_LEN];
+    uint32_t idx_len = writer->frames * AVI_INDEX_ENTRY_WORDS * sizeof(uint32_t);
+
+    put_u32(put_fourcc(idx_header, "idx1"), idx_len);
+
+    ret = append(writer, idx_header, sizeof(idx_header));
+    if (ret == ESP_OK)
+    {
+        ret = append(writer, writer->index, idx_len);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = flush_batch(writer);
+    }
+
+    // Header is the only part rewritten, everything else was appended
+    uint32_t file_len = AVI_HEADER_LEN - 4 + writer->movi_len + AVI_CHUNK_HEADER_LEN + idx_len;
+    uint32_t max_bytes_per_sec = writer->max_frame_len * writer->config.fps;
+
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_RIFF_SIZE_OFFSET, file_len - 8);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_AVIH_MAX_BYTES_OFFSET, max_bytes_per_sec);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_AVIH_TOTAL_FRAMES_OFFSET, writer->frames);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_AVIH_SUGGESTED_BUF_OFFSET, writer->max_frame_len + AVI_CHUNK_HEADER_LEN);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_STRH_LENGTH_OFFSET, writer->frames);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_STRH_SUGGESTED_BUF_OFFSET, writer->max_frame_len + AVI_CHUNK_HEADER_LEN);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = patch_u32(writer, AVI_MOVI_SIZE_OFFSET, writer->movi_len);
+    }
+
+    if (fclose(writer->file) != 0)
+    {
+        ESP_LOGE(TAG, "Close of file failed");
+        ret = ESP_FAIL;
+    }
+
+    espfsp_mem_free(writer->index);
+    espfsp_mem_free(writer->batch);
+    writer->file = NULL;
+
+    ESP_LOGI(TAG, "Recording closed, frames: %lu", (unsigned long) writer->frames);
+
+    return ret;
+}
+
+bool espfsp_avi_writer_is_open(const espfsp_avi_writer_t *writer)
+{
+    return writer->file != NULL;
+}
+
+bool espfsp_avi_writer_is_full(const espfsp_avi_writer_t *writer)
+{
+    return writer->frames >= writer->config.max_frames;
+}
+
+void espfsp_avi_writer_estimate_memory(const espfsp_avi_writer_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_RECORDER, 0, config->batch_size);
+    espfsp_mem_estimate_add(
+        estimate, ESPFSP_MEM_TAG_RECORDER, 0, config->max_frames * AVI_INDEX_ENTRY_WORDS * sizeof(uint32_t));
+}
@@ -4,11 +4,13 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
 #include "esp_heap_caps.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_message_defs.h"
 #include "server/espfsp_state_def.h"
 #include "server/espfsp_comm_proto_handlers.h"
@@ -16,45 +18,100 @@
 
 #include "server/espfsp_comm_proto_conf.h"
 
-// static const char *TAG = "ESPFSP_SERVER_COMM_PROTO_CONF";
+#define COMM_PROTO_BUFFERED_ACTIONS 3
+
+static const char *TAG = "ESPFSP_SERVER_COMM_PROTO_CONF";
+
+uint8_t espfsp_server_client_push_connections(const espfsp_server_config_t *config)
+{
+    return config->client_push_max_connections > 0 ?
+        config->client_push_max_connections : ESPFSP_SERVER_DEFAULT_CLIENT_PUSH_MAX_CONNECTIONS;
+}
+
+uint8_t espfsp_server_client_play_connections(const espfsp_server_config_t *config)
+{
+    return config->client_play_max_connections > 0 ?
+        config->client_play_max_connections : ESPFSP_SERVER_DEFAULT_CLIENT_PLAY_MAX_CONNECTIONS;
+}
+
+static void free_comm_protos(espfsp_server_instance_t *instance, int push_inited, int play_inited)
+{
+    for (int i = 0; i < push_inited; i++)
+    {
+        espfsp_comm_proto_deinit(&instance->client_push_comm_proto[i]);
+    }
+
+    for (int i = 0; i < play_inited; i++)
+    {
+        espfsp_comm_proto_deinit(&instance->client_play_comm_proto[i]);
+    }
+
+    espfsp_mem_free(instance->client_push_comm_proto);
+    espfsp_mem_free(instance->client_play_comm_proto);
+    espfsp_mem_free(instance->active_push_comm_protos_buf);
+}
 
 esp_err_t espfsp_server_comm_protos_init(espfsp_server_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
     espfsp_comm_proto_config_t config;
 
+    instance->client_push_comm_proto_count = espfsp_server_client_push_connections(instance->config);
+    instance->client_play_comm_proto_count = espfsp_server_client_play_connections(instance->config);
+
+    // Connection objects are allocated once per server, never per connection
+    instance->client_push_comm_proto = (espfsp_comm_proto_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_COMM_PROTO, 0, instance->client_push_comm_proto_count * sizeof(espfsp_comm_proto_t));
+    instance->client_play_comm_proto = (espfsp_comm_proto_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_COMM_PROTO, 0, instance->client_play_comm_proto_count * sizeof(espfsp_comm_proto_t));
+    instance->active_push_comm_protos_buf = (espfsp_comm_proto_t **) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_COMM_PROTO, 0, instance->client_push_comm_proto_count * sizeof(espfsp_comm_proto_t *));
+
+    if (instance->client_push_comm_proto == NULL ||
+        instance->client_play_comm_proto == NULL ||
+        instance->active_push_comm_protos_buf == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate memory for connections");
+        free_comm_protos(instance, 0, 0);
+        return ESP_FAIL;
+    }
+
     config.callback_ctx = (void *) instance,
-    config.buffered_actions = 3,
+    config.buffered_actions = COMM_PROTO_BUFFERED_ACTIONS,
 
     memset(config.req_callbacks, 0, sizeof(config.req_callbacks));
     memset(config.resp_callbacks, 0, sizeof(config.resp_callbacks));
 
     config.req_callbacks[ESPFSP_COMM_REQ_SESSION_INIT] = espfsp_server_req_session_init_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_SESSION_TERMINATE] = espfsp_server_req_session_terminate_handler;
+    config.req_callbacks[ESPFSP_COMM_REQ_SESSION_PING] = espfsp_server_req_session_ping_handler;
+    config.req_callbacks[ESPFSP_COMM_REQ_SCENE_STATE] = espfsp_server_req_scene_state_handler;
     config.repetive_callback = NULL;
     config.repetive_callback_freq_us = 100000000;
-    config.conn_closed_callback = espfsp_server_connection_stop;
-    config.conn_reset_callback = espfsp_server_connection_stop;
-    config.conn_term_callback = espfsp_server_connection_stop;
+    config.conn_closed_callback = espfsp_server_connection_lost;
+    config.conn_reset_callback = espfsp_server_connection_lost;
+    config.conn_term_callback = espfsp_server_connection_lost;
 
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS; i++)
+    for (int i = 0; i < instance->client_push_comm_proto_count; i++)
     {
         ret = espfsp_comm_proto_init(&instance->client_push_comm_proto[i], &config);
         if (ret != ESP_OK)
         {
+            free_comm_protos(instance, i, 0);
             return ret;
         }
     }
 
     config.callback_ctx = (void *) instance,
-    config.buffered_actions = 3,
+    config.buffered_actions = COMM_PROTO_BUFFERED_ACTIONS,
 
     memset(config.req_callbacks, 0, sizeof(config.req_callbacks));
     memset(config.resp_callbacks, 0, sizeof(config.resp_callbacks));
 
     config.req_callbacks[ESPFSP_COMM_REQ_SESSION_INIT] = espfsp_server_req_session_init_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_SESSION_TERMINATE] = espfsp_server_req_session_terminate_handler;
+    config.req_callbacks[ESPFSP_COMM_REQ_SESSION_PING] = espfsp_server_req_session_ping_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_START_STREAM] = espfsp_server_req_start_stream_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_STOP_STREAM] = espfsp_server_req_stop_stream_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_CAM_SET_PARAMS] = espfsp_server_req_cam_set_params_handler;
@@ -63,17 +120,19 @@ esp_err_t espfsp_server_comm_protos_init(espfsp_server_instance_t *instance)
     config.req_callbacks[ESPFSP_COMM_REQ_SOURCE_GET] = espfsp_server_req_source_get_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_FRAME_GET_PARAMS] = espfsp_server_req_frame_get_params_handler;
     config.req_callbacks[ESPFSP_COMM_REQ_CAM_GET_PARAMS] = espfsp_server_req_cam_get_params_handler;
+    config.req_callbacks[ESPFSP_COMM_REQ_STREAM_STATUS] = espfsp_server_req_stream_status_handler;
     config.repetive_callback = NULL;
     config.repetive_callback_freq_us = 100000000;
-    config.conn_closed_callback = espfsp_server_connection_stop;
-    config.conn_reset_callback = espfsp_server_connection_stop;
-    config.conn_term_callback = espfsp_server_connection_stop;
+    config.conn_closed_callback = espfsp_server_connection_lost;
+    config.conn_reset_callback = espfsp_server_connection_lost;
+    config.conn_term_callback = espfsp_server_connection_lost;
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS; i++)
+    for (int i = 0; i < instance->client_play_comm_proto_count; i++)
     {
         ret = espfsp_comm_proto_init(&instance->client_play_comm_proto[i], &config);
         if (ret != ESP_OK)
         {
+            free_comm_protos(instance, instance->client_push_comm_proto_count, i);
             return ret;
         }
     }
@@ -85,23 +144,42 @@ esp_err_t espfsp_server_comm_protos_deinit(espfsp_server_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PUSH_MAX_CONNECTIONS; i++)
+    for (int i = 0; i < instance->client_push_comm_proto_count; i++)
     {
-        ret = espfsp_comm_proto_deinit(&instance->client_play_comm_proto[i]);
+        ret = espfsp_comm_proto_deinit(&instance->client_push_comm_proto[i]);
         if (ret != ESP_OK)
         {
             return ret;
         }
     }
 
-    for (int i = 0; i < CONFIG_ESPFSP_SERVER_CLIENT_PLAY_MAX_CONNECTIONS; i++)
+    for (int i = 0; i < instance->client_play_comm_proto_count; i++)
     {
-        ret = espfsp_comm_proto_deinit(&instance->client_push_comm_proto[i]);
+        ret = espfsp_comm_proto_deinit(&instance->client_play_comm_proto[i]);
         if (ret != ESP_OK)
         {
             return ret;
         }
     }
 
+    espfsp_mem_free(instance->client_push_comm_proto);
+    espfsp_mem_free(instance->client_play_comm_proto);
+    espfsp_mem_free(instance->active_push_comm_protos_buf);
+
     return ret;
 }
+
+void espfsp_server_comm_protos_estimate_memory(const espfsp_server_config_t *config, espfsp_mem_estimate_t *estimate)
+{
+    uint8_t client_push_count = espfsp_server_client_push_connections(config);
+    uint8_t client_play_count = espfsp_server_client_play_connections(config);
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_COMM_PROTO, 0, client_push_count * sizeof(espfsp_comm_proto_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_COMM_PROTO, 0, client_play_count * sizeof(espfsp_comm_proto_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_COMM_PROTO, 0, client_push_count * sizeof(espfsp_comm_proto_t *));
+
+    for (int i = 0; i < client_push_count + client_play_count; i++)
+    {
+        espfsp_comm_proto_estimate_memory(COMM_PROTO_BUFFERED_ACTIONS, estimate);
+    }
+}
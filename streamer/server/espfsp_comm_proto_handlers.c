@@ -4,6 +4,7 @@
  */
 
 #include "string.h"
+#include <stdatomic.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
@@ -11,6 +12,8 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+
 #include "espfsp_params_map.h"
 #include "comm_proto/espfsp_comm_proto.h"
 #include "data_proto/espfsp_data_proto.h"
@@ -22,32 +25,316 @@ static const char *TAG = "SERVER_COMMUNICATION_PROTOCOL_HANDLERS";
 
 #define LOG_IF_FAIL(ret) if (ret == ESP_FAIL) { ESP_LOGE(TAG, "Session handling failed. Line: %d", __LINE__); }
 
+// Play session gets frames at its own rate, lower than source rate. Frames are dropped on server, as
+// source is shared with other outputs (recorder, HTTP, RTSP). Returns frame config for play data proto.
+static void set_play_frame_rate(
+    espfsp_server_instance_t *instance,
+    const espfsp_frame_config_t *push_frame_config,
+    uint16_t play_fps,
+    espfsp_frame_config_t *play_data_frame_config)
+{
+    memcpy(play_data_frame_config, push_frame_config, sizeof(espfsp_frame_config_t));
+
+    if (play_fps > 0 && play_fps < push_frame_config->fps)
+    {
+        play_data_frame_config->fps = play_fps;
+        atomic_store(&instance->play_fps, play_fps);
+    }
+    else
+    {
+        atomic_store(&instance->play_fps, 0);
+    }
+}
+
+// Stream state of play is set before its data proto is prepared. If that fails, session goes back to
+// stopped, so next start request is handled again instead of being seen as already started.
+static void revert_play_stream_start(espfsp_server_instance_t *instance, espfsp_comm_proto_t *play_comm_proto)
+{
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    // Stop is only read by data task, data proto that was not started stays stopped
+    espfsp_data_proto_stop(&instance->client_play_data_proto);
+    atomic_store(&instance->send_cached_fb, false);
+
+    if (espfsp_session_manager_take(session_manager) == ESP_OK)
+    {
+        espfsp_session_manager_set_stream_state(session_manager, play_comm_proto, false);
+        espfsp_session_manager_release(session_manager);
+    }
+}
+
+// Receiver buffers are shared by all pushes, so frames cached from previous source must not reach viewer
+static void drop_cached_fbs(espfsp_server_instance_t *instance)
+{
+    espfsp_message_buffer_drop_cached_fb(&instance->receiver_buffer);
+    for (uint8_t i = 0; i < instance->layer_receiver_buffers_count; i++)
+    {
+        espfsp_message_buffer_drop_cached_fb(&instance->layer_receiver_buffers[i]);
+    }
+}
+
+// Called under session manager lock. First push with session is taken as source when play has not chosen
+// one, so other outputs stream without play session.
+static esp_err_t get_stream_source(
+    espfsp_server_instance_t *instance, espfsp_comm_proto_t **push_comm_proto, uint32_t *push_session_id)
+{
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+    int active_push_comm_protos_count = 0;
+
+    esp_err_t ret = espfsp_session_manager_get_primary_session(
+        session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, push_comm_proto);
+    if (ret == ESP_OK && *push_comm_proto != NULL)
+    {
+        return espfsp_session_manager_get_session_id(session_manager, *push_comm_proto, push_session_id);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_active_sessions(
+            session_manager,
+            ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH,
+            instance->active_push_comm_protos_buf,
+            instance->client_push_comm_proto_count,
+            &active_push_comm_protos_count);
+    }
+    for (int i = 0; ret == ESP_OK && i < active_push_comm_protos_count && *push_comm_proto == NULL; i++)
+    {
+        // Connection without session yet is skipped
+        if (espfsp_session_manager_get_session_id(
+                session_manager, instance->active_push_comm_protos_buf[i], push_session_id) == ESP_OK)
+        {
+            *push_comm_proto = instance->active_push_comm_protos_buf[i];
+        }
+    }
+    if (ret == ESP_OK && *push_comm_proto != NULL)
+    {
+        ret = espfsp_session_manager_set_primary_session(
+            session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, *push_comm_proto);
+        drop_cached_fbs(instance);
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_server_push_stream_start(void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_comm_proto_req_start_stream_message_t send_msg;
+    espfsp_comm_proto_t *push_comm_proto = NULL;
+    uint32_t push_session_id = -123;
+    espfsp_frame_config_t push_frame_config;
+    bool stream_state_set = false;
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        ret = get_stream_source(instance, &push_comm_proto, &push_session_id);
+        if (ret == ESP_OK && push_comm_proto == NULL)
+        {
+            ESP_LOGI(TAG, "No push session to stream from");
+            ret = ESP_ERR_NOT_FOUND;
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_frame_config(session_manager, push_comm_proto, &push_frame_config);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_set_stream_state(session_manager, push_comm_proto, true);
+            stream_state_set = ret == ESP_OK;
+        }
+
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK)
+    {
+        espfsp_receiver_buffer_config_t receiver_buffer_new_config = {
+            .buffered_fbs = push_frame_config.buffered_fbs,
+            .frame_max_len = push_frame_config.frame_max_len,
+            .fb_in_buffer_before_get = 0,
+            .fps = push_frame_config.fps,
+        };
+
+        ret = espfsp_message_buffer_reconfigure(&instance->receiver_buffer, &receiver_buffer_new_config);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_data_proto_set_frame_params(&instance->client_push_data_proto, &push_frame_config);
+    }
+    if (ret == ESP_OK)
+    {
+        atomic_store(&instance->source_static, false);
+        ret = espfsp_data_proto_start(&instance->client_push_data_proto);
+    }
+    if (ret == ESP_OK)
+    {
+        send_msg.session_id = push_session_id;
+        ret = espfsp_comm_proto_start_stream(push_comm_proto, &send_msg);
+    }
+
+    if (ret == ESP_OK)
+    {
+        instance->streaming_push_comm_proto = push_comm_proto;
+        instance->streaming_push_session_id = push_session_id;
+    }
+    else if (stream_state_set)
+    {
+        ESP_LOGE(TAG, "Push stream start failed, stream state reverted");
+        espfsp_data_proto_stop(&instance->client_push_data_proto);
+        if (espfsp_session_manager_take(session_manager) == ESP_OK)
+        {
+            espfsp_session_manager_set_stream_state(session_manager, push_comm_proto, false);
+            espfsp_session_manager_release(session_manager);
+        }
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_server_push_stream_stop(void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_comm_proto_req_stop_stream_message_t send_msg;
+    espfsp_comm_proto_t *push_comm_proto = instance->streaming_push_comm_proto;
+    bool push_connected = false;
+
+    instance->streaming_push_comm_proto = NULL;
+    if (push_comm_proto == NULL)
+    {
+        return ESP_OK;
+    }
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        // Ended push is not sent stop, as its connection could be taken by new session meanwhile
+        push_connected = espfsp_session_manager_has_session(
+            session_manager, push_comm_proto, instance->streaming_push_session_id);
+        if (push_connected)
+        {
+            ret = espfsp_session_manager_set_stream_state(session_manager, push_comm_proto, false);
+        }
+
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK && push_connected)
+    {
+        send_msg.session_id = instance->streaming_push_session_id;
+        ret = espfsp_comm_proto_stop_stream(push_comm_proto, &send_msg);
+    }
+
+    // Data is not taken from any push, also when stop request could not be sent
+    esp_err_t err = espfsp_data_proto_stop(&instance->client_push_data_proto);
+
+    return ret == ESP_OK ? err : ret;
+}
+
 esp_err_t espfsp_server_req_session_init_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
 {
     esp_err_t ret = ESP_OK;
-    // espfsp_comm_proto_req_session_init_message_t *msg = (espfsp_comm_proto_req_session_init_message_t *) msg_content;
+    espfsp_comm_proto_req_session_init_message_t *msg = (espfsp_comm_proto_req_session_init_message_t *) msg_content;
     espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
     espfsp_session_manager_t *session_manager = &instance->session_manager;
 
     espfsp_comm_proto_resp_session_ack_message_t resp;
     uint32_t session_id = -123;
+    uint32_t resume_token = 0;
+    espfsp_session_manager_session_type_t session_type;
+    bool stale_session = false;
+    bool resumed = false;
 
+    uint16_t version = msg->version < ESPFSP_COMM_PROTO_VERSION ? msg->version : ESPFSP_COMM_PROTO_VERSION;
+    uint32_t capabilities = msg->capabilities & ESPFSP_COMM_PROTO_CAPS_SUPPORTED;
+
+#if ESPFSP_COMM_PROTO_MIN_VERSION > 0
+    if (version < ESPFSP_COMM_PROTO_MIN_VERSION)
+    {
+        ESP_LOGE(TAG, "Protocol version %d of client not supported", msg->version);
+        return ESP_FAIL;
+    }
+#endif
+
+    // Connection could get slot of other detached session, which has to be expired first
     ret = espfsp_session_manager_take(session_manager);
     if (ret == ESP_OK)
     {
-        ret = espfsp_session_manager_activate_session(session_manager, comm_proto);
+        if (espfsp_session_manager_get_detached_session_id(session_manager, comm_proto, &session_id) == ESP_OK)
+        {
+            stale_session = msg->resume_token == 0 || msg->session_id != session_id;
+        }
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK && stale_session)
+    {
+        ESP_LOGI(TAG, "Expire detached session %lu", (unsigned long) session_id);
+        ret = espfsp_server_connection_stop(comm_proto, ctx);
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_take(session_manager);
+    }
+    if (ret == ESP_OK)
+    {
+        if (msg->resume_token != 0 && (capabilities & ESPFSP_COMM_PROTO_CAP_SESSION_RESUME))
+        {
+            resumed = espfsp_session_manager_resume_session(
+                session_manager, comm_proto, msg->session_id, msg->resume_token) == ESP_OK;
+        }
+        if (!resumed)
+        {
+            ret = espfsp_session_manager_activate_session(session_manager, comm_proto);
+        }
         if (ret == ESP_OK)
         {
             ret = espfsp_session_manager_get_session_id(session_manager, comm_proto, &session_id);
         }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_set_capabilities(session_manager, comm_proto, version, capabilities);
+        }
+        if (ret == ESP_OK)
+        {
+            uint8_t layers = (capabilities & ESPFSP_COMM_PROTO_CAP_SIMULCAST) ? msg->simulcast_layers : 0;
+            ret = espfsp_session_manager_set_simulcast_layers(session_manager, comm_proto, layers);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_resume_token(session_manager, comm_proto, &resume_token);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_session_type(session_manager, comm_proto, &session_type);
+        }
 
         espfsp_session_manager_release(session_manager);
     }
     if (ret == ESP_OK)
     {
+        if (resumed)
+        {
+            ESP_LOGI(TAG, "Session %lu resumed", (unsigned long) session_id);
+        }
+
         resp.session_id = session_id;
+        resp.resume_token = resume_token;
+        resp.resume_grace_ms = session_manager->config->resume_grace_ms;
+        resp.resumed = resumed ? 1 : 0;
+        resp.version = version;
+        resp.capabilities = capabilities;
         ret = espfsp_comm_proto_session_ack(comm_proto, &resp);
     }
+    // Outputs could wait for source. Resumed push keeps stream it had
+    if (ret == ESP_OK && !resumed && session_type == ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH &&
+        espfsp_push_subscription_resume(&instance->push_subscription) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Push stream not started for waiting outputs");
+    }
 
     return ret;
 }
@@ -80,6 +367,64 @@ esp_err_t espfsp_server_req_session_terminate_handler(espfsp_comm_proto_t *comm_
     return ret;
 }
 
+esp_err_t espfsp_server_req_session_ping_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    int64_t t2 = esp_timer_get_time();
+    espfsp_comm_proto_req_session_ping_message_t *msg = (espfsp_comm_proto_req_session_ping_message_t *) msg_content;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_comm_proto_resp_session_pong_message_t resp;
+    espfsp_clock_sync_info_t source_clock_sync = { .valid = false };
+    uint32_t session_id = -123;
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        espfsp_comm_proto_t *push_primary_session = NULL;
+
+        ret = espfsp_session_manager_get_session_id(session_manager, comm_proto, &session_id);
+        if (ret == ESP_OK && session_id != msg->session_id)
+        {
+            ESP_LOGE(TAG, "Session ID does not match");
+            ret = ESP_FAIL;
+        }
+        if (ret == ESP_OK && msg->estimate_valid)
+        {
+            espfsp_clock_sync_info_t clock_sync = {
+                .rtt_us = msg->rtt_us,
+                .offset_us = msg->offset_us,
+                .valid = true,
+            };
+            ret = espfsp_session_manager_set_clock_sync(session_manager, comm_proto, &clock_sync);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_primary_session(
+                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &push_primary_session);
+        }
+        if (ret == ESP_OK && push_primary_session != NULL)
+        {
+            ret = espfsp_session_manager_get_clock_sync(session_manager, push_primary_session, &source_clock_sync);
+        }
+
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK)
+    {
+        resp.session_id = session_id;
+        resp.t1_us = msg->t1_us;
+        resp.t2_us = t2;
+        resp.t3_us = 0;
+        resp.source_offset_us = source_clock_sync.offset_us;
+        resp.source_offset_valid = source_clock_sync.valid ? 1 : 0;
+        ret = espfsp_comm_proto_session_pong(comm_proto, &resp);
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_server_req_start_stream_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
 {
     esp_err_t ret = ESP_OK;
@@ -87,13 +432,16 @@ esp_err_t espfsp_server_req_start_stream_handler(espfsp_comm_proto_t *comm_proto
     espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
     espfsp_session_manager_t *session_manager = &instance->session_manager;
 
-    espfsp_comm_proto_req_start_stream_message_t send_msg;
     espfsp_comm_proto_t *primary_push_comm_proto = NULL;
     uint32_t play_session_id = -123;
-    uint32_t primary_push_session_id = -123;
     espfsp_frame_config_t primary_push_frame_config;
-    bool push_stream_started = false;
+    espfsp_frame_config_t play_frame_config;
+    espfsp_frame_config_t play_data_frame_config;
     bool play_stream_started = false;
+    uint32_t play_capabilities = 0;
+    uint8_t push_layers = 0;
+    bool stream_state_set = false;
+    bool subscribed = false;
 
     ret = espfsp_session_manager_take(session_manager);
     if (ret == ESP_OK)
@@ -106,97 +454,101 @@ esp_err_t espfsp_server_req_start_stream_handler(espfsp_comm_proto_t *comm_proto
             return ESP_OK;
         }
         if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_primary_session(
-                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
-        }
-        if (ret == ESP_OK && primary_push_comm_proto == NULL)
-        {
-            ESP_LOGI(TAG, "No push primary session");
-            espfsp_session_manager_release(session_manager);
-            return ESP_OK;
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_session_id(
-                session_manager, primary_push_comm_proto, &primary_push_session_id);
-        }
-        if (ret == ESP_OK && primary_push_session_id == -123)
-        {
-            ESP_LOGE(TAG, "Session ID not found");
-            ret = ESP_FAIL;
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_stream_state(session_manager, primary_push_comm_proto, &push_stream_started);
-        }
-        if (ret == ESP_OK)
         {
             ret = espfsp_session_manager_get_stream_state(session_manager, comm_proto, &play_stream_started);
         }
-        if (ret == ESP_OK && push_stream_started != play_stream_started)
+        if (ret == ESP_OK && !play_stream_started)
         {
-            ESP_LOGE(TAG, "Inconsistent stream state");
-            ret = ESP_FAIL;
-        }
-        if (ret == ESP_OK && !push_stream_started && !play_stream_started)
-        {
-            ret = espfsp_session_manager_set_stream_state(session_manager, primary_push_comm_proto, true);
+            ret = espfsp_session_manager_set_stream_state(session_manager, comm_proto, true);
+            stream_state_set = ret == ESP_OK;
             if (ret == ESP_OK)
             {
-                ret = espfsp_session_manager_set_stream_state(session_manager, comm_proto, true);
+                ret = espfsp_session_manager_get_frame_config(session_manager, comm_proto, &play_frame_config);
             }
             if (ret == ESP_OK)
             {
-                ret = espfsp_session_manager_get_frame_config(
-                    session_manager, primary_push_comm_proto, &primary_push_frame_config);
+                ret = espfsp_session_manager_get_capabilities(session_manager, comm_proto, &play_capabilities);
             }
         }
 
         espfsp_session_manager_release(session_manager);
     }
-    if (ret == ESP_OK && !push_stream_started && !play_stream_started)
+    if (ret == ESP_OK && play_stream_started)
     {
-        if (primary_push_frame_config.buffered_fbs != instance->receiver_buffer.config->buffered_fbs ||
-            primary_push_frame_config.fb_in_buffer_before_get != instance->receiver_buffer.config->fb_in_buffer_before_get ||
-            primary_push_frame_config.frame_max_len != instance->receiver_buffer.config->frame_max_len ||
-            primary_push_frame_config.fps != instance->receiver_buffer.config->fps)
-        {
-            ret = espfsp_message_buffer_deinit(&instance->receiver_buffer);
-            if (ret == ESP_OK)
-            {
-                espfsp_receiver_buffer_config_t receiver_buffer_new_config = {
-                    .buffered_fbs = primary_push_frame_config.buffered_fbs,
-                    .frame_max_len = primary_push_frame_config.frame_max_len,
-                    .fb_in_buffer_before_get = 0,
-                    .fps = primary_push_frame_config.fps,
-                };
-
-                ret = espfsp_message_buffer_init(&instance->receiver_buffer, &receiver_buffer_new_config);
-            }
-        }
+        return ESP_OK;
+    }
 
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_data_proto_set_frame_params(&instance->client_push_data_proto, &primary_push_frame_config);
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_data_proto_set_frame_params(&instance->client_play_data_proto, &primary_push_frame_config);
-        }
-        if (ret == ESP_OK)
+    // Push stream is started with first subscriber, play is one of them
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_push_subscription_take(&instance->push_subscription);
+        subscribed = true;
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_take(session_manager);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_primary_session(
+            session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
+        if (ret == ESP_OK && primary_push_comm_proto == NULL)
         {
-            ret = espfsp_data_proto_start(&instance->client_push_data_proto);
+            ESP_LOGE(TAG, "Push primary session lost");
+            ret = ESP_FAIL;
         }
         if (ret == ESP_OK)
         {
-            ret = espfsp_data_proto_start(&instance->client_play_data_proto);
+            ret = espfsp_session_manager_get_frame_config(
+                session_manager, primary_push_comm_proto, &primary_push_frame_config);
         }
         if (ret == ESP_OK)
         {
-            send_msg.session_id = primary_push_session_id;
-            ret = espfsp_comm_proto_start_stream(primary_push_comm_proto, &send_msg);
+            ret = espfsp_session_manager_get_simulcast_layers(session_manager, primary_push_comm_proto, &push_layers);
         }
+
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK)
+    {
+        set_play_frame_rate(instance, &primary_push_frame_config, play_frame_config.fps, &play_data_frame_config);
+        ret = espfsp_data_proto_set_frame_params(&instance->client_play_data_proto, &play_data_frame_config);
+    }
+    if (ret == ESP_OK)
+    {
+        espfsp_data_proto_set_peer_frame_abort(
+            &instance->client_play_data_proto, play_capabilities & ESPFSP_COMM_PROTO_CAP_FRAME_ABORT);
+        atomic_store(&instance->send_cached_fb, true);
+
+        // Stream starts with camera stream, loss reports move it to lower layers
+        uint8_t layers = push_layers < instance->layer_receiver_buffers_count ?
+            push_layers : instance->layer_receiver_buffers_count;
+        espfsp_layer_selector_init(
+            &instance->play_layer_selector,
+            layers + 1,
+            instance->config->simulcast_down_loss_permille,
+            instance->config->simulcast_up_after_reports);
+        atomic_store(&instance->play_layer, 0);
+        ret = espfsp_data_proto_start(&instance->client_play_data_proto);
+    }
+
+    if (ret != ESP_OK && subscribed)
+    {
+        espfsp_push_subscription_drop(&instance->push_subscription);
+    }
+    if (ret != ESP_OK && stream_state_set)
+    {
+        revert_play_stream_start(instance, comm_proto);
+    }
+    if (ret == ESP_ERR_NOT_FOUND)
+    {
+        // Play may request stream before any push is connected
+        return ESP_OK;
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Stream start failed, stream state reverted");
     }
 
     return ret;
@@ -209,11 +561,7 @@ esp_err_t espfsp_server_req_stop_stream_handler(espfsp_comm_proto_t *comm_proto,
     espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
     espfsp_session_manager_t *session_manager = &instance->session_manager;
 
-    espfsp_comm_proto_req_stop_stream_message_t send_msg;
-    espfsp_comm_proto_t *primary_push_comm_proto = NULL;
-    uint32_t primary_push_session_id = -123;
     uint32_t play_session_id = -123;
-    bool push_stream_started = false;
     bool play_stream_started = false;
 
     ret = espfsp_session_manager_take(session_manager);
@@ -227,63 +575,25 @@ esp_err_t espfsp_server_req_stop_stream_handler(espfsp_comm_proto_t *comm_proto,
             return ESP_OK;
         }
         if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_primary_session(
-                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
-        }
-        if (ret == ESP_OK && primary_push_comm_proto == NULL)
-        {
-            ESP_LOGI(TAG, "No push primary session");
-            espfsp_session_manager_release(session_manager);
-            return ESP_OK;
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_session_id(
-                session_manager, primary_push_comm_proto, &primary_push_session_id);
-        }
-        if (ret == ESP_OK && primary_push_session_id == -123)
-        {
-            ESP_LOGE(TAG, "Session ID not found");
-            ret = ESP_FAIL;
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_session_manager_get_stream_state(session_manager, primary_push_comm_proto, &push_stream_started);
-        }
-        if (ret == ESP_OK)
         {
             ret = espfsp_session_manager_get_stream_state(session_manager, comm_proto, &play_stream_started);
         }
-        if (ret == ESP_OK && push_stream_started != play_stream_started)
-        {
-            ESP_LOGE(TAG, "Inconsistent stream state");
-            ret = ESP_FAIL;
-        }
-        if (ret == ESP_OK &&  push_stream_started && play_stream_started)
+        if (ret == ESP_OK && play_stream_started)
         {
-            ret = espfsp_session_manager_set_stream_state(session_manager, primary_push_comm_proto, false);
-            if (ret == ESP_OK)
-            {
-                ret = espfsp_session_manager_set_stream_state(session_manager, comm_proto, false);
-            }
+            ret = espfsp_session_manager_set_stream_state(session_manager, comm_proto, false);
         }
 
         espfsp_session_manager_release(session_manager);
     }
 
-    if (ret == ESP_OK && push_stream_started && play_stream_started)
+    if (ret == ESP_OK && play_stream_started)
     {
-        send_msg.session_id = primary_push_session_id;
-        ret = espfsp_comm_proto_stop_stream(primary_push_comm_proto, &send_msg);
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_data_proto_stop(&instance->client_push_data_proto);
-        }
-        if (ret == ESP_OK)
-        {
-            ret = espfsp_data_proto_stop(&instance->client_play_data_proto);
-        }
+        atomic_store(&instance->send_cached_fb, false);
+        ret = espfsp_data_proto_stop(&instance->client_play_data_proto);
+
+        // Push stream is stopped with last subscriber
+        esp_err_t err = espfsp_push_subscription_drop(&instance->push_subscription);
+        ret = ret == ESP_OK ? err : ret;
     }
 
     return ret;
@@ -431,6 +741,10 @@ esp_err_t espfsp_server_req_frame_set_params_handler(espfsp_comm_proto_t *comm_p
     uint32_t primary_push_session_id = -123;
     uint32_t play_session_id = -123;
     espfsp_frame_config_t primary_push_frame_config;
+    espfsp_frame_config_t play_frame_config;
+    espfsp_frame_config_t play_data_frame_config;
+    espfsp_params_map_frame_param_t param;
+    bool set_on_push = true;
 
     ret = espfsp_session_manager_take(session_manager);
     if (ret == ESP_OK)
@@ -469,11 +783,29 @@ esp_err_t espfsp_server_req_frame_set_params_handler(espfsp_comm_proto_t *comm_p
                 session_manager, primary_push_comm_proto, &primary_push_frame_config);
         }
         if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_frame_config(session_manager, comm_proto, &play_frame_config);
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_params_map_frame_param_get_param(received_msg->param_id, &param);
+        }
+        if (ret == ESP_OK && param == ESPFSP_PARAM_MAP_FRAME_FPS)
+        {
+            // Requested rate belongs to play session. Source rate is only raised, never lowered for it.
+            ret = espfsp_params_map_set_frame_config(&play_frame_config, received_msg->param_id, received_msg->value);
+            if (ret == ESP_OK)
+            {
+                ret = espfsp_session_manager_set_frame_config(session_manager, comm_proto, &play_frame_config);
+            }
+            set_on_push = received_msg->value > primary_push_frame_config.fps;
+        }
+        if (ret == ESP_OK && set_on_push)
         {
             ret = espfsp_params_map_set_frame_config(
                 &primary_push_frame_config, received_msg->param_id, received_msg->value);
         }
-        if (ret == ESP_OK)
+        if (ret == ESP_OK && set_on_push)
         {
             ret = espfsp_session_manager_set_frame_config(
                 session_manager, primary_push_comm_proto, &primary_push_frame_config);
@@ -481,7 +813,7 @@ esp_err_t espfsp_server_req_frame_set_params_handler(espfsp_comm_proto_t *comm_p
 
         espfsp_session_manager_release(session_manager);
     }
-    if (ret == ESP_OK)
+    if (ret == ESP_OK && set_on_push)
     {
         send_msg.session_id = primary_push_session_id;
         send_msg.param_id = received_msg->param_id;
@@ -491,7 +823,8 @@ esp_err_t espfsp_server_req_frame_set_params_handler(espfsp_comm_proto_t *comm_p
     }
     if (ret == ESP_OK)
     {
-        ret = espfsp_data_proto_set_frame_params(&instance->client_play_data_proto, &primary_push_frame_config);
+        set_play_frame_rate(instance, &primary_push_frame_config, play_frame_config.fps, &play_data_frame_config);
+        ret = espfsp_data_proto_set_frame_params(&instance->client_play_data_proto, &play_data_frame_config);
     }
 
     return ret;
@@ -563,8 +896,8 @@ esp_err_t espfsp_server_req_source_set_handler(espfsp_comm_proto_t *comm_proto,
     espfsp_comm_proto_t *primary_push_comm_proto = NULL;
     espfsp_comm_proto_t *new_primary_push_comm_proto = NULL;
     uint32_t play_session_id = -123;
-    bool push_stream_started = false;
     bool play_stream_started = false;
+    bool source_changed = false;
 
     ret = espfsp_session_manager_take(session_manager);
     if (ret == ESP_OK)
@@ -581,22 +914,12 @@ esp_err_t espfsp_server_req_source_set_handler(espfsp_comm_proto_t *comm_proto,
             ret = espfsp_session_manager_get_primary_session(
                 session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
         }
-        if (ret == ESP_OK && primary_push_comm_proto != NULL)
-        {
-            ret = espfsp_session_manager_get_stream_state(
-                session_manager, primary_push_comm_proto, &push_stream_started);
-        }
-        if (ret == ESP_OK && primary_push_comm_proto != NULL)
-        {
-            ret = espfsp_session_manager_get_stream_state(
-                session_manager, comm_proto, &play_stream_started);
-        }
-        if (ret == ESP_OK && push_stream_started != play_stream_started)
+        if (ret == ESP_OK)
         {
-            ESP_LOGE(TAG, "Inconsistent stream state");
-            ret = ESP_FAIL;
+            ret = espfsp_session_manager_get_stream_state(session_manager, comm_proto, &play_stream_started);
         }
-        if (ret == ESP_OK && !push_stream_started && !play_stream_started)
+        // Other outputs may keep push stream running, then it is switched to new source
+        if (ret == ESP_OK && !play_stream_started)
         {
             ret = espfsp_session_manager_get_active_session(
                 session_manager,
@@ -616,10 +939,19 @@ esp_err_t espfsp_server_req_source_set_handler(espfsp_comm_proto_t *comm_proto,
                     ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH,
                     new_primary_push_comm_proto);
             }
+            if (ret == ESP_OK && new_primary_push_comm_proto != primary_push_comm_proto)
+            {
+                drop_cached_fbs(instance);
+                source_changed = true;
+            }
         }
 
         espfsp_session_manager_release(session_manager);
     }
+    if (ret == ESP_OK && source_changed)
+    {
+        ret = espfsp_push_subscription_restart(&instance->push_subscription);
+    }
 
     return ret;
 }
@@ -633,7 +965,6 @@ esp_err_t espfsp_server_req_source_get_handler(espfsp_comm_proto_t *comm_proto,
 
     espfsp_comm_resp_sources_resp_message_t send_msg;
     uint32_t play_session_id = -123;
-    espfsp_comm_proto_t *active_push_comm_protos_buf[3];
     int active_push_comm_protos_count;
 
     ret = espfsp_session_manager_take(session_manager);
@@ -651,20 +982,27 @@ esp_err_t espfsp_server_req_source_get_handler(espfsp_comm_proto_t *comm_proto,
             ret = espfsp_session_manager_get_active_sessions(
                 session_manager,
                 ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH,
-                active_push_comm_protos_buf,
-                3,
+                instance->active_push_comm_protos_buf,
+                instance->client_push_comm_proto_count,
                 &active_push_comm_protos_count);
         }
         if (ret == ESP_OK)
         {
             ESP_LOGI(TAG, "Sources count: %d", active_push_comm_protos_count);
 
+            // Response carries fixed number of names, rest of sources is not reported
+            if (active_push_comm_protos_count > ESPFSP_COMM_SOURCES_MAX)
+            {
+                ESP_LOGW(TAG, "Only %d sources fit in response", ESPFSP_COMM_SOURCES_MAX);
+                active_push_comm_protos_count = ESPFSP_COMM_SOURCES_MAX;
+            }
+
             for (int i = 0; i < active_push_comm_protos_count; i++)
             {
                 if (ret == ESP_OK)
                 {
                     ret = espfsp_session_manager_get_session_name(
-                        session_manager, active_push_comm_protos_buf[i], send_msg.source_names[i]);
+                        session_manager, instance->active_push_comm_protos_buf[i], send_msg.source_names[i]);
 
                     ESP_LOGI(TAG, "Source name %s: ", send_msg.source_names[i]);
                 }
@@ -684,96 +1022,267 @@ esp_err_t espfsp_server_req_source_get_handler(espfsp_comm_proto_t *comm_proto,
     return ret;
 }
 
-esp_err_t espfsp_server_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx)
+esp_err_t espfsp_server_connection_lost(espfsp_comm_proto_t *comm_proto, void *ctx)
 {
     esp_err_t ret = ESP_OK;
     espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
     espfsp_session_manager_t *session_manager = &instance->session_manager;
+    bool detached = false;
 
-    espfsp_comm_proto_req_stop_stream_message_t other_primary_session_send_msg;
-    espfsp_comm_proto_t *other_primary_session_comm_proto = NULL;
-    uint32_t other_primary_session_session_id = -123;
-    bool was_primary = false;
-    bool should_stop_stream = false;
-
+    // Stream and data plane are kept running, so short connection drop is not visible in video
     ret = espfsp_session_manager_take(session_manager);
     if (ret == ESP_OK)
     {
-        espfsp_session_manager_session_type_t session_type;
-        espfsp_comm_proto_t *given_type_primary_session = NULL;
+        detached = espfsp_session_manager_detach_session(session_manager, comm_proto) == ESP_OK;
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK && detached)
+    {
+        ESP_LOGI(TAG, "Session detached. Waiting %lu ms for resume", (unsigned long) session_manager->config->resume_grace_ms);
+        return ESP_OK;
+    }
 
-        ret = espfsp_session_manager_get_session_type(session_manager, comm_proto, &session_type);
+    return espfsp_server_connection_stop(comm_proto, ctx);
+}
+
+// Counters going backwards mean client restarted stream, then whole report is taken as interval
+static uint16_t get_loss_permille(const espfsp_stream_status_t *prev, const espfsp_comm_req_stream_status_message_t *msg)
+{
+    uint32_t received = msg->frames_received;
+    uint32_t lost = msg->frames_lost;
+    uint32_t late = msg->frames_late;
+
+    if (msg->frames_received >= prev->frames_received &&
+        msg->frames_lost >= prev->frames_lost &&
+        msg->frames_late >= prev->frames_late)
+    {
+        received -= prev->frames_received;
+        lost -= prev->frames_lost;
+        late -= prev->frames_late;
+    }
+
+    // Late frames were received, but never shown
+    uint64_t total = (uint64_t) received + lost;
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t permille = ((uint64_t) lost + late) * 1000 / total;
+    return permille > 1000 ? 1000 : (uint16_t) permille;
+}
+
+esp_err_t espfsp_server_req_stream_status_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_comm_req_stream_status_message_t *msg = (espfsp_comm_req_stream_status_message_t *) msg_content;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_stream_status_t status;
+    espfsp_comm_proto_t *primary_play_comm_proto = NULL;
+    uint32_t session_id = -123;
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_session_id(session_manager, comm_proto, &session_id);
+        if (ret == ESP_OK && session_id != msg->session_id)
+        {
+            ESP_LOGE(TAG, "Session ID does not match");
+            ret = ESP_FAIL;
+        }
+        if (ret == ESP_OK)
+        {
+            ret = espfsp_session_manager_get_stream_status(session_manager, comm_proto, &status);
+        }
         if (ret == ESP_OK)
         {
             ret = espfsp_session_manager_get_primary_session(
-                session_manager, session_type, &given_type_primary_session);
+                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY, &primary_play_comm_proto);
         }
-        if (ret == ESP_OK && given_type_primary_session == comm_proto)
+        if (ret == ESP_OK)
         {
-            was_primary = true;
+            status.loss_permille = get_loss_permille(&status, msg);
+            status.layer = 0;
+            // Only primary play session gets data, selector runs in its session task
+            if (comm_proto == primary_play_comm_proto)
+            {
+                status.layer = espfsp_layer_selector_update(&instance->play_layer_selector, status.loss_permille);
+                atomic_store(&instance->play_layer, status.layer);
+            }
+            status.session_id = session_id;
+            status.frames_received = msg->frames_received;
+            status.frames_lost = msg->frames_lost;
+            status.frames_late = msg->frames_late;
+            status.jitter_us = msg->jitter_us;
+            status.buffer_depth = msg->buffer_depth;
+            status.latency_ms = msg->latency_ms;
+            status.source_static = atomic_load(&instance->source_static);
+            status.updated_us = esp_timer_get_time();
+            ret = espfsp_session_manager_set_stream_status(session_manager, comm_proto, &status);
         }
-        if (ret == ESP_OK && was_primary)
+
+        espfsp_session_manager_release(session_manager);
+    }
+
+    // Outside of session lock, so callback can query server
+    if (ret == ESP_OK && instance->config->stream_status_cb != NULL)
+    {
+        instance->config->stream_status_cb(&status, instance->config->stream_status_cb_ctx);
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_server_req_scene_state_handler(espfsp_comm_proto_t *comm_proto, void *msg_content, void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_comm_req_scene_state_message_t *msg = (espfsp_comm_req_scene_state_message_t *) msg_content;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_comm_req_scene_state_message_t send_msg;
+    espfsp_comm_proto_t *primary_push_comm_proto = NULL;
+    espfsp_comm_proto_t *primary_play_comm_proto = NULL;
+    uint32_t session_id = -123;
+    uint32_t play_session_id = -123;
+    uint32_t play_capabilities = 0;
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_session_manager_get_session_id(session_manager, comm_proto, &session_id);
+        if (ret == ESP_OK && session_id != msg->session_id)
         {
-            ret = espfsp_session_manager_get_stream_state(session_manager, comm_proto, &should_stop_stream);
+            ESP_LOGE(TAG, "Session ID does not match");
+            ret = ESP_FAIL;
         }
-        if (ret == ESP_OK && should_stop_stream)
+        if (ret == ESP_OK)
         {
-            espfsp_comm_proto_t *primary_session = NULL;
             ret = espfsp_session_manager_get_primary_session(
-                session_manager,
-                ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH,
-                &primary_session);
-            if (ret == ESP_OK && primary_session != NULL)
-            {
-                ret = espfsp_session_manager_set_stream_state(session_manager, primary_session, false);
-            }
-            if (ret == ESP_OK && primary_session != comm_proto)
-            {
-                other_primary_session_comm_proto = primary_session;
-            }
-            if (ret == ESP_OK)
-            {
-                primary_session = NULL;
-                ret = espfsp_session_manager_get_primary_session(
-                    session_manager,
-                    ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY,
-                    &primary_session);
-            }
-            if (ret == ESP_OK && primary_session != NULL)
-            {
-                ret = espfsp_session_manager_set_stream_state(session_manager, primary_session, false);
-            }
-            if (ret == ESP_OK && primary_session != comm_proto)
-            {
-                other_primary_session_comm_proto = primary_session;
-            }
+                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
         }
         if (ret == ESP_OK)
         {
-            ret = espfsp_session_manager_deactivate_session(session_manager, comm_proto);
+            ret = espfsp_session_manager_get_primary_session(
+                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY, &primary_play_comm_proto);
+        }
+        if (ret == ESP_OK && primary_play_comm_proto != NULL)
+        {
+            ret = espfsp_session_manager_get_session_id(session_manager, primary_play_comm_proto, &play_session_id);
+        }
+        if (ret == ESP_OK && primary_play_comm_proto != NULL)
+        {
+            ret = espfsp_session_manager_get_capabilities(session_manager, primary_play_comm_proto, &play_capabilities);
         }
 
         espfsp_session_manager_release(session_manager);
     }
-    if (ret == ESP_OK && should_stop_stream)
+
+    // Only primary push feeds stream, others are ignored
+    if (ret != ESP_OK || comm_proto != primary_push_comm_proto)
     {
-        if (ret == ESP_OK)
+        return ret;
+    }
+
+    atomic_store(&instance->source_static, msg->scene_static != 0);
+
+    // Lost relay only delays it to next report
+    if (primary_play_comm_proto != NULL && (play_capabilities & ESPFSP_COMM_PROTO_CAP_SCENE_STATE))
+    {
+        send_msg.session_id = play_session_id;
+        send_msg.scene_static = msg->scene_static;
+        send_msg.keepalive_interval_ms = msg->keepalive_interval_ms;
+        if (espfsp_comm_proto_scene_state(primary_play_comm_proto, &send_msg) != ESP_OK)
         {
-            ret = espfsp_session_manager_get_session_id(
-                session_manager, other_primary_session_comm_proto, &other_primary_session_session_id);
+            ESP_LOGW(TAG, "Scene state not relayed");
         }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_server_connection_stop(espfsp_comm_proto_t *comm_proto, void *ctx)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+    espfsp_session_manager_t *session_manager = &instance->session_manager;
+
+    espfsp_comm_proto_req_stop_stream_message_t play_send_msg;
+    espfsp_comm_proto_t *play_comm_proto = NULL;
+    uint32_t play_session_id = -123;
+    espfsp_session_manager_session_type_t session_type;
+    bool was_primary_push = false;
+    bool play_stream_started = false;
+
+    ret = espfsp_session_manager_take(session_manager);
+    if (ret == ESP_OK)
+    {
+        espfsp_comm_proto_t *primary_push_comm_proto = NULL;
+
+        ret = espfsp_session_manager_get_session_type(session_manager, comm_proto, &session_type);
         if (ret == ESP_OK)
         {
-            other_primary_session_send_msg.session_id = other_primary_session_session_id;
-            ret = espfsp_comm_proto_stop_stream(other_primary_session_comm_proto, &other_primary_session_send_msg);
+            ret = espfsp_session_manager_get_primary_session(
+                session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH, &primary_push_comm_proto);
         }
         if (ret == ESP_OK)
         {
-            ret = espfsp_data_proto_stop(&instance->client_push_data_proto);
+            was_primary_push = primary_push_comm_proto == comm_proto;
+
+            // Play loses stream with its source, other outputs are moved to next push
+            if (session_type == ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY)
+            {
+                play_comm_proto = comm_proto;
+            }
+            else if (was_primary_push)
+            {
+                ret = espfsp_session_manager_get_primary_session(
+                    session_manager, ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY, &play_comm_proto);
+            }
+        }
+        if (ret == ESP_OK && play_comm_proto != NULL)
+        {
+            ret = espfsp_session_manager_get_stream_state(session_manager, play_comm_proto, &play_stream_started);
+        }
+        if (ret == ESP_OK && play_stream_started)
+        {
+            ret = espfsp_session_manager_set_stream_state(session_manager, play_comm_proto, false);
+        }
+        if (ret == ESP_OK && play_stream_started && play_comm_proto != comm_proto)
+        {
+            ret = espfsp_session_manager_get_session_id(session_manager, play_comm_proto, &play_session_id);
         }
         if (ret == ESP_OK)
         {
-            ret = espfsp_data_proto_stop(&instance->client_play_data_proto);
+            ret = espfsp_session_manager_deactivate_session(session_manager, comm_proto);
+        }
+
+        espfsp_session_manager_release(session_manager);
+    }
+    if (ret == ESP_OK && play_stream_started)
+    {
+        if (play_comm_proto != comm_proto)
+        {
+            play_send_msg.session_id = play_session_id;
+            ret = espfsp_comm_proto_stop_stream(play_comm_proto, &play_send_msg);
+        }
+
+        atomic_store(&instance->send_cached_fb, false);
+        esp_err_t err = espfsp_data_proto_stop(&instance->client_play_data_proto);
+        ret = ret == ESP_OK ? err : ret;
+
+        err = espfsp_push_subscription_drop(&instance->push_subscription);
+        ret = ret == ESP_OK ? err : ret;
+    }
+    if (ret == ESP_OK && was_primary_push)
+    {
+        // Push stream of lost source is stopped without request to it
+        ret = espfsp_push_subscription_restart(&instance->push_subscription);
+        if (ret == ESP_ERR_NOT_FOUND)
+        {
+            ret = ESP_OK;
         }
     }
 
@@ -4,6 +4,7 @@
  */
 
 #include <string.h>
+#include <stdatomic.h>
 
 #include "esp_err.h"
 #include "esp_log.h"
@@ -12,31 +13,111 @@
 #include "freertos/task.h"
 
 #include "espfsp_message_buffer.h"
+#include "espfsp_trace_ring.h"
 #include "server/espfsp_state_def.h"
+#include "server/espfsp_frame_decimator.h"
 #include "data_proto/espfsp_data_proto.h"
 
 #include "server/espfsp_data_proto_conf.h"
 
 static const char *TAG = "ESPFSP_SERVER_DATA_PROTO_CONF";
 
+static espfsp_receiver_buffer_t *get_layer_buffer(espfsp_server_instance_t *instance, uint8_t layer)
+{
+    return layer == 0 ? &instance->receiver_buffer : &instance->layer_receiver_buffers[layer - 1];
+}
+
+// Newest frame of layers not relayed is taken and given back at once, so frames are not evicted as lost
+// and the last one is cached when play session is switched to them
+static void drain_other_layers(espfsp_server_instance_t *instance, uint8_t layer)
+{
+    for (uint8_t i = 0; i <= instance->layer_receiver_buffers_count; i++)
+    {
+        espfsp_receiver_buffer_t *buffer = get_layer_buffer(instance, i);
+
+        if (i != layer && espfsp_message_buffer_has_frame(buffer) && espfsp_message_buffer_get_newest_fb(buffer, 0) != NULL)
+        {
+            espfsp_message_buffer_return_fb(buffer);
+        }
+    }
+}
+
+static bool is_after(const struct timeval *lh, const struct timeval *rh)
+{
+    return lh->tv_sec > rh->tv_sec || (lh->tv_sec == rh->tv_sec && lh->tv_usec > rh->tv_usec);
+}
+
 static esp_err_t send_frame(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_frame_state_t *state, uint32_t max_allowed_size)
 {
     esp_err_t ret = ESP_OK;
     espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
     espfsp_fb_t *recv_buf_fb = NULL;
+    uint8_t layer = atomic_load(&instance->play_layer);
+
+    if (layer > instance->layer_receiver_buffers_count)
+    {
+        layer = 0;
+    }
+    if (layer != instance->play_sent_layer)
+    {
+        // Camera is not restarted, viewer gets last frame of new layer until its next one comes
+        instance->play_sent_layer = layer;
+        instance->play_switch_pending = true;
+        atomic_store(&instance->send_cached_fb, true);
+    }
+
+    espfsp_receiver_buffer_t *receiver_buffer = get_layer_buffer(instance, layer);
+    drain_other_layers(instance, layer);
+
+    // Relay sends only the newest frame, viewer would see older ones late anyway
+    recv_buf_fb = espfsp_message_buffer_get_newest_fb(receiver_buffer, 0);
+    if (recv_buf_fb != NULL)
+    {
+        atomic_store(&instance->send_cached_fb, false);
+
+        uint16_t play_fps = atomic_load(&instance->play_fps);
+        if (play_fps != instance->play_decimator.fps)
+        {
+            espfsp_frame_decimator_init(&instance->play_decimator, play_fps);
+        }
+
+        if (!espfsp_frame_decimator_pass(&instance->play_decimator, &recv_buf_fb->timestamp))
+        {
+            *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
+            return espfsp_message_buffer_return_fb(receiver_buffer);
+        }
+    }
+    else if (atomic_load(&instance->send_cached_fb))
+    {
+        // Live stream is not running yet, so new viewer gets last frame of the source meanwhile. It is sent once,
+        // following frames come from live stream.
+        recv_buf_fb = espfsp_message_buffer_get_cached_fb(receiver_buffer);
+        if (recv_buf_fb != NULL)
+        {
+            atomic_store(&instance->send_cached_fb, false);
+        }
+    }
 
-    recv_buf_fb = espfsp_message_buffer_get_fb(&instance->receiver_buffer, 0);
     if (recv_buf_fb == NULL)
     {
         *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
         return ESP_OK;
     }
 
+    // Layers share capture times. Frame of new layer not newer than last one sent would be assembled
+    // together with it by receiver.
+    if (instance->play_switch_pending && !is_after(&recv_buf_fb->timestamp, &instance->play_sent_timestamp))
+    {
+        *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
+        return espfsp_message_buffer_return_fb(receiver_buffer);
+    }
+
     if (recv_buf_fb->len > max_allowed_size)
     {
         ESP_LOGW(TAG, "Allowed frame size exceeded");
+        espfsp_stream_counters_add(&instance->client_play_data_proto.counters.frames_dropped_oversize, 1);
         *state = ESPFSP_DATA_PROTO_FRAME_NOT_OBTAINED;
-        return espfsp_message_buffer_return_fb(&instance->receiver_buffer);
+        return espfsp_message_buffer_return_fb(receiver_buffer);
     }
 
     fb->len = recv_buf_fb->len;
@@ -47,24 +128,51 @@ static esp_err_t send_frame(espfsp_fb_t *fb, void *ctx, espfsp_data_proto_send_f
     fb->timestamp.tv_usec = recv_buf_fb->timestamp.tv_usec;
     memcpy(fb->buf, recv_buf_fb->buf, recv_buf_fb->len);
 
-    ret = espfsp_message_buffer_return_fb(&instance->receiver_buffer);
+    ret = espfsp_message_buffer_return_fb(receiver_buffer);
     if (ret == ESP_OK)
     {
         *state = ESPFSP_DATA_PROTO_FRAME_OBTAINED;
+        instance->play_switch_pending = false;
+        instance->play_sent_timestamp = fb->timestamp;
+        ESPFSP_TRACE(ESPFSP_TRACE_STAGE_SERVER_SEND_FRAME, &fb->timestamp);
     }
 
     return ret;
 }
 
+// Relayed frame is copied out of receiver buffer before it is sent, so newer one can be taken any time
+static bool newer_frame_received(void *ctx)
+{
+    espfsp_server_instance_t *instance = (espfsp_server_instance_t *) ctx;
+
+    return espfsp_message_buffer_has_frame(get_layer_buffer(instance, instance->play_sent_layer));
+}
+
 esp_err_t espfsp_server_data_protos_init(espfsp_server_instance_t *instance)
 {
     esp_err_t ret = ESP_OK;
     espfsp_data_proto_config_t config;
 
+    atomic_init(&instance->send_cached_fb, false);
+    atomic_init(&instance->play_fps, 0);
+    atomic_init(&instance->source_static, false);
+    atomic_init(&instance->play_layer, 0);
+    instance->play_sent_layer = 0;
+    instance->play_switch_pending = false;
+    memset(&instance->play_sent_timestamp, 0, sizeof(struct timeval));
+    espfsp_layer_selector_init(&instance->play_layer_selector, 1, 0, 0);
+    espfsp_frame_decimator_init(&instance->play_decimator, 0);
+
     config.type = ESPFSP_DATA_PROTO_TYPE_RECV;
     config.mode = ESPFSP_DATA_PROTO_MODE_LOCAL;
     config.recv_buffer = &instance->receiver_buffer;
     config.send_frame_callback = NULL;
+    config.release_frame_callback = NULL;
+    config.newer_frame_callback = NULL;
+    config.preempt_after_percent = 0;
+    config.layer_frame_callback = NULL;
+    config.layer_recv_buffers = instance->layer_receiver_buffers;
+    config.layer_recv_buffers_count = instance->layer_receiver_buffers_count;
     config.send_frame_ctx = NULL;
     config.frame_config = &instance->config->frame_config;
 
@@ -78,10 +186,22 @@ esp_err_t espfsp_server_data_protos_init(espfsp_server_instance_t *instance)
     config.mode = ESPFSP_DATA_PROTO_MODE_NAT;
     config.recv_buffer = NULL;
     config.send_frame_callback = send_frame;
+    config.release_frame_callback = NULL;
+    config.newer_frame_callback = newer_frame_received;
+    config.preempt_after_percent = instance->config->client_play_preempt_after_percent;
+    config.layer_frame_callback = NULL;
+    config.layer_recv_buffers = NULL;
+    config.layer_recv_buffers_count = 0;
     config.send_frame_ctx = instance;
     config.frame_config = &instance->config->frame_config;
 
-    return espfsp_data_proto_init(&instance->client_play_data_proto, &config);
+    ret = espfsp_data_proto_init(&instance->client_play_data_proto, &config);
+    if (ret != ESP_OK)
+    {
+        espfsp_data_proto_deinit(&instance->client_push_data_proto);
+    }
+
+    return ret;
 }
 
 esp_err_t espfsp_server_data_protos_deinit(espfsp_server_instance_t *instance)
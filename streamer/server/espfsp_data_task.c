@@ -11,10 +11,14 @@
 
 #include "lwip/sockets.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_sock_op.h"
+#include "espfsp_task_group.h"
 #include "server/espfsp_data_task.h"
 #include "data_proto/espfsp_data_proto.h"
 
+#define SERVER_DATA_RETRY_TIME_MS 200
+
 static const char *TAG = "ESPFSP_SERVER_DATA_TASK";
 
 static void handle_new_connection(espfsp_server_data_task_data_t *data, int sock)
@@ -27,8 +31,9 @@ static void handle_new_connection(espfsp_server_data_task_data_t *data, int sock
 void espfsp_server_data_task(void *pvParameters)
 {
     espfsp_server_data_task_data_t *data = (espfsp_server_data_task_data_t *) pvParameters;
+    espfsp_task_group_t *task_group = data->task_group;
 
-    while (1) // In later phase, synchronization should be added
+    while (!espfsp_task_group_should_stop(task_group))
     {
         esp_err_t ret = ESP_OK;
         int sock = 0;
@@ -37,12 +42,15 @@ void espfsp_server_data_task(void *pvParameters)
         if (ret != ESP_OK)
         {
             ESP_LOGE(TAG, "Create UDP server failed");
+            espfsp_task_group_wait_stop(task_group, SERVER_DATA_RETRY_TIME_MS);
             continue;
         }
 
         ESP_LOGI(TAG, "Start processing messages");
 
+        espfsp_task_group_set_sock(task_group, sock);
         handle_new_connection(data, sock);
+        espfsp_task_group_set_sock(task_group, -1);
 
         ESP_LOGE(TAG, "Shut down socket and restart...");
 
@@ -54,6 +62,6 @@ void espfsp_server_data_task(void *pvParameters)
         }
     }
 
-    free(data);
-    vTaskDelete(NULL);
+    espfsp_mem_free(data);
+    espfsp_task_group_exit(task_group);
 }
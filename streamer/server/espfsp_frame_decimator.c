@@ -0,0 +1,51 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "server/espfsp_frame_decimator.h"
+
+void espfsp_frame_decimator_init(espfsp_frame_decimator_t *decimator, uint16_t fps)
+{
+    decimator->fps = fps;
+    decimator->interval_us = fps > 0 ? 1000000 / fps : 0;
+    decimator->next_due_us = 0;
+    decimator->started = false;
+}
+
+bool espfsp_frame_decimator_pass(espfsp_frame_decimator_t *decimator, const struct timeval *timestamp)
+{
+    uint64_t timestamp_us = (uint64_t) timestamp->tv_sec * 1000000 + timestamp->tv_usec;
+
+    // Quarter of interval absorbs capture jitter, so source rates close to target are not halved
+    uint64_t tolerance_us = decimator->interval_us >> 2;
+
+    if (decimator->fps == 0)
+    {
+        return true;
+    }
+
+    bool early = timestamp_us + tolerance_us < decimator->next_due_us;
+    bool clock_jump = timestamp_us + 2 * decimator->interval_us < decimator->next_due_us;
+
+    if (decimator->started && early && !clock_jump)
+    {
+        return false;
+    }
+
+    // Keep grid of due times to hold average rate. Start new grid after gap in stream or clock jump.
+    if (decimator->started && !early && timestamp_us < decimator->next_due_us + decimator->interval_us)
+    {
+        decimator->next_due_us += decimator->interval_us;
+    }
+    else
+    {
+        decimator->next_due_us = timestamp_us + decimator->interval_us;
+    }
+
+    decimator->started = true;
+    return true;
+}
@@ -0,0 +1,498 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/sockets.h"
+
+#include "espfsp_mem_alloc.h"
+#include "espfsp_sock_op.h"
+#include "server/espfsp_http_stream.h"
+
+#define HTTP_STREAM_BOUNDARY "espfspframe"
+#define HTTP_STREAM_REQUEST_MAX_LEN 512
+#define HTTP_STREAM_REQUEST_TIMEOUT_S 5
+#define HTTP_STREAM_PART_HEADER_MAX_LEN 96
+#define HTTP_STREAM_QUEUE_WAIT (100 / portTICK_PERIOD_MS)
+#define HTTP_STREAM_LISTENER_SLEEP_MS 200
+
+static const char *TAG = "ESPFSP_SERVER_HTTP_STREAM";
+
+static const char *STREAM_RESPONSE =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: multipart/x-mixed-replace; boundary=" HTTP_STREAM_BOUNDARY "\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char *NOT_FOUND_RESPONSE =
+    "HTTP/1.1 404 Not Found\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static void unref_frame(espfsp_http_stream_frame_t *frame)
+{
+    atomic_fetch_sub(&frame->refs, 1);
+}
+
+// Only relay claims slots, so slot with no references can be taken without compare-and-swap
+static espfsp_http_stream_frame_t *get_free_frame(espfsp_http_stream_t *http_stream)
+{
+    for (int i = 0; i < http_stream->frames_count; i++)
+    {
+        if (atomic_load(&http_stream->frames[i].refs) == 0)
+        {
+            return &http_stream->frames[i];
+        }
+    }
+
+    return NULL;
+}
+
+void espfsp_http_stream_feed(const espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_http_stream_t *http_stream = (espfsp_http_stream_t *) ctx;
+
+    if (atomic_load(&http_stream->clients_count) == 0)
+    {
+        return;
+    }
+
+    if (fb->len > http_stream->frame_max_len)
+    {
+        ESP_LOGW(TAG, "Frame too big for HTTP stream");
+        return;
+    }
+
+    // Client connects or disconnects right now. Dropping one frame is better than waiting in relay
+    if (xSemaphoreTake(http_stream->mutex, 0) != pdTRUE)
+    {
+        return;
+    }
+
+    espfsp_http_stream_frame_t *frame = get_free_frame(http_stream);
+    if (frame == NULL)
+    {
+        xSemaphoreGive(http_stream->mutex);
+        ESP_LOGW(TAG, "No free frame slot");
+        return;
+    }
+
+    // Relay holds one reference until frame is queued to every client
+    atomic_store(&frame->refs, 1);
+    frame->fb.len = fb->len;
+    frame->fb.width = fb->width;
+    frame->fb.height = fb->height;
+    frame->fb.timestamp = fb->timestamp;
+    memcpy(frame->fb.buf, fb->buf, fb->len);
+
+    for (int i = 0; i < http_stream->config.max_clients; i++)
+    {
+        espfsp_http_stream_client_t *client = &http_stream->clients[i];
+        espfsp_http_stream_frame_t *oldest = NULL;
+
+        if (!client->used)
+        {
+            continue;
+        }
+
+        atomic_fetch_add(&frame->refs, 1);
+
+        if (xQueueSend(client->frameQueue, &frame, 0) != pdPASS)
+        {
+            if (xQueueReceive(client->frameQueue, &oldest, 0) == pdPASS)
+            {
+                unref_frame(oldest);
+            }
+            if (xQueueSend(client->frameQueue, &frame, 0) != pdPASS)
+            {
+                unref_frame(frame);
+            }
+        }
+    }
+
+    unref_frame(frame);
+
+    xSemaphoreGive(http_stream->mutex);
+}
+
+static bool read_request(int sock, const char *path)
+{
+    char request[HTTP_STREAM_REQUEST_MAX_LEN];
+    char expected[HTTP_STREAM_PART_HEADER_MAX_LEN];
+    int request_len = 0;
+    struct timeval timeout = {
+        .tv_sec = HTTP_STREAM_REQUEST_TIMEOUT_S,
+        .tv_usec = 0,
+    };
+
+    while (request_len < sizeof(request) - 1)
+    {
+        int received = 0;
+        esp_err_t ret = espfsp_receive_block(
+            sock, request + request_len, sizeof(request) - 1 - request_len, &received, &timeout);
+
+        if (ret != ESP_OK || received <= 0)
+        {
+            return false;
+        }
+
+        request_len += received;
+        request[request_len] = '\0';
+
+        if (strstr(request, "\r\n\r\n") != NULL)
+        {
+            break;
+        }
+    }
+
+    snprintf(expected, sizeof(expected), "GET %s ", path);
+
+    return strncmp(request, expected, strlen(expected)) == 0;
+}
+
+static bool send_frame(int sock, espfsp_http_stream_frame_t *frame)
+{
+    char part_header[HTTP_STREAM_PART_HEADER_MAX_LEN];
+    espfsp_conn_state_t conn_state = ESPFSP_CONN_STATE_GOOD;
+    esp_err_t ret = ESP_OK;
+
+    int part_header_len = snprintf(
+        part_header,
+        sizeof(part_header),
+        "--" HTTP_STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n",
+        frame->fb.len);
+
+    ret = espfsp_send_state(sock, part_header, part_header_len, &conn_state);
+    if (ret == ESP_OK && conn_state == ESPFSP_CONN_STATE_GOOD)
+    {
+        ret = espfsp_send_state(sock, frame->fb.buf, frame->fb.len, &conn_state);
+    }
+    if (ret == ESP_OK && conn_state == ESPFSP_CONN_STATE_GOOD)
+    {
+        ret = espfsp_send_state(sock, "\r\n", 2, &conn_state);
+    }
+
+    return ret == ESP_OK && conn_state == ESPFSP_CONN_STATE_GOOD;
+}
+
+static void release_client(espfsp_http_stream_client_t *client)
+{
+    espfsp_http_stream_t *http_stream = client->http_stream;
+    espfsp_http_stream_frame_t *frame = NULL;
+
+    xSemaphoreTake(http_stream->mutex, portMAX_DELAY);
+
+    while (xQueueReceive(client->frameQueue, &frame, 0) == pdPASS)
+    {
+        unref_frame(frame);
+    }
+
+    client->used = false;
+    atomic_fetch_sub(&http_stream->clients_count, 1);
+
+    xSemaphoreGive(http_stream->mutex);
+}
+
+static void client_task(void *pvParameters)
+{
+    espfsp_http_stream_client_t *client = (espfsp_http_stream_client_t *) pvParameters;
+    espfsp_http_stream_t *http_stream = client->http_stream;
+    int sock = client->sock;
+    bool connected = true;
+    bool subscribed = false;
+
+    // Shut down on stop, so request read or frame send blocked on slow client returns
+    espfsp_task_group_set_sock(&http_stream->task_group, sock);
+
+    if (!read_request(sock, http_stream->config.path))
+    {
+        espfsp_send(sock, (char *) NOT_FOUND_RESPONSE, strlen(NOT_FOUND_RESPONSE));
+        connected = false;
+    }
+    else if (espfsp_send(sock, (char *) STREAM_RESPONSE, strlen(STREAM_RESPONSE)) != ESP_OK)
+    {
+        connected = false;
+    }
+    else
+    {
+        // Client waits for frames also when push stream cannot start yet
+        subscribed = true;
+        if (espfsp_push_subscription_take(http_stream->push_subscription) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Push stream not started, HTTP client waits for source");
+        }
+    }
+
+    while (connected && !espfsp_task_group_should_stop(&http_stream->task_group))
+    {
+        espfsp_http_stream_frame_t *frame = NULL;
+
+        if (xQueueReceive(client->frameQueue, &frame, HTTP_STREAM_QUEUE_WAIT) != pdPASS)
+        {
+            continue;
+        }
+
+        connected = send_frame(sock, frame);
+        unref_frame(frame);
+    }
+
+    ESP_LOGI(TAG, "HTTP client disconnected");
+
+    if (subscribed)
+    {
+        espfsp_push_subscription_drop(http_stream->push_subscription);
+    }
+    release_client(client);
+    espfsp_task_group_set_sock(&http_stream->task_group, -1);
+    espfsp_remove_host(sock);
+
+    espfsp_task_group_exit(&http_stream->task_group);
+}
+
+static espfsp_http_stream_client_t *take_client(espfsp_http_stream_t *http_stream)
+{
+    espfsp_http_stream_client_t *client = NULL;
+
+    xSemaphoreTake(http_stream->mutex, portMAX_DELAY);
+
+    for (int i = 0; i < http_stream->config.max_clients; i++)
+    {
+        if (!http_stream->clients[i].used)
+        {
+            client = &http_stream->clients[i];
+            client->used = true;
+            atomic_fetch_add(&http_stream->clients_count, 1);
+            break;
+        }
+    }
+
+    xSemaphoreGive(http_stream->mutex);
+
+    return client;
+}
+
+static void listener_task(void *pvParameters)
+{
+    espfsp_http_stream_t *http_stream = (espfsp_http_stream_t *) pvParameters;
+    int listen_sock = 0;
+
+    if (espfsp_create_tcp_server(&listen_sock, http_stream->config.port) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Create HTTP server failed");
+        espfsp_task_group_exit(&http_stream->task_group);
+    }
+
+    espfsp_task_group_set_sock(&http_stream->task_group, listen_sock);
+
+    while (!espfsp_task_group_should_stop(&http_stream->task_group))
+    {
+        int sock = 0;
+        struct sockaddr_in source_addr;
+        socklen_t addr_len = sizeof(source_addr);
+
+        // Server sock is set nonblocking, so it could return without established connection
+        if (espfsp_tcp_accept(listen_sock, &sock, &source_addr, &addr_len) != ESP_OK || sock < 0)
+        {
+            espfsp_task_group_wait_stop(&http_stream->task_group, HTTP_STREAM_LISTENER_SLEEP_MS);
+            continue;
+        }
+
+        espfsp_http_stream_client_t *client = take_client(http_stream);
+        if (client == NULL)
+        {
+            ESP_LOGW(TAG, "HTTP clients limit reached");
+            espfsp_remove_host(sock);
+            continue;
+        }
+
+        client->sock = sock;
+
+        if (espfsp_task_group_create_task(
+                &http_stream->task_group, client_task, "http_client_task", &http_stream->config.task_info, client) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Task create for HTTP client failed");
+            release_client(client);
+            espfsp_remove_host(sock);
+        }
+    }
+
+    espfsp_task_group_set_sock(&http_stream->task_group, -1);
+    espfsp_remove_host(listen_sock);
+
+    espfsp_task_group_exit(&http_stream->task_group);
+}
+
+static int get_frames_count(const espfsp_http_stream_config_t *config)
+{
+    // Every client can hold whole queue and one frame being sent, relay needs one more to fill
+    return config->max_clients * (config->client_queue_len + 1) + 1;
+}
+
+esp_err_t espfsp_http_stream_init(
+    espfsp_http_stream_t *http_stream,
+    const espfsp_http_stream_config_t *config,
+    uint32_t frame_max_len,
+    espfsp_push_subscription_t *push_subscription)
+{
+    memcpy(&http_stream->config, config, sizeof(espfsp_http_stream_config_t));
+    http_stream->frame_max_len = frame_max_len;
+    http_stream->push_subscription = push_subscription;
+    atomic_init(&http_stream->clients_count, 0);
+
+    if (config->max_clients == 0 || config->client_queue_len == 0 || config->path == NULL)
+    {
+        ESP_LOGE(TAG, "HTTP stream config is not correct");
+        return ESP_FAIL;
+    }
+
+    // Listener and every client have own task
+    if (config->max_clients + 1 > ESPFSP_TASK_GROUP_MAX_TASKS)
+    {
+        ESP_LOGE(TAG, "HTTP stream supports at most %d clients", ESPFSP_TASK_GROUP_MAX_TASKS - 1);
+        return ESP_FAIL;
+    }
+
+    http_stream->frames_count = get_frames_count(config);
+
+    http_stream->frames = (espfsp_http_stream_frame_t *) espfsp_mem_calloc(
+        ESPFSP_MEM_TAG_HTTP_STREAM, 0, http_stream->frames_count, sizeof(espfsp_http_stream_frame_t));
+    http_stream->frames_mem = (uint8_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_HTTP_STREAM, MALLOC_CAP_SPIRAM, http_stream->frames_count * frame_max_len);
+    http_stream->clients = (espfsp_http_stream_client_t *) espfsp_mem_calloc(
+        ESPFSP_MEM_TAG_HTTP_STREAM, 0, config->max_clients, sizeof(espfsp_http_stream_client_t));
+    if (http_stream->frames == NULL || http_stream->frames_mem == NULL || http_stream->clients == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate memory for HTTP stream");
+        espfsp_mem_free(http_stream->frames);
+        espfsp_mem_free(http_stream->frames_mem);
+        espfsp_mem_free(http_stream->clients);
+        return ESP_FAIL;
+    }
+
+    for (int i = 0; i < http_stream->frames_count; i++)
+    {
+        atomic_init(&http_stream->frames[i].refs, 0);
+        http_stream->frames[i].fb.buf = (char *) http_stream->frames_mem + i * frame_max_len;
+    }
+
+    esp_err_t ret = ESP_OK;
+
+    for (int i = 0; i < config->max_clients && ret == ESP_OK; i++)
+    {
+        http_stream->clients[i].http_stream = http_stream;
+        http_stream->clients[i].used = false;
+        http_stream->clients[i].frameQueue = espfsp_mem_queue_create(
+            ESPFSP_MEM_TAG_HTTP_STREAM, config->client_queue_len, sizeof(espfsp_http_stream_frame_t *));
+        if (http_stream->clients[i].frameQueue == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot initialize client queue");
+            ret = ESP_FAIL;
+        }
+    }
+
+    http_stream->mutex = NULL;
+    if (ret == ESP_OK)
+    {
+        http_stream->mutex = xSemaphoreCreateBinary();
+        if (http_stream->mutex == NULL || xSemaphoreGive(http_stream->mutex) != pdTRUE)
+        {
+            ESP_LOGE(TAG, "Cannot init semaphore");
+            ret = ESP_FAIL;
+        }
+    }
+
+    bool task_group_ready = false;
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_task_group_init(&http_stream->task_group);
+        task_group_ready = ret == ESP_OK;
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_task_group_create_task(
+            &http_stream->task_group, listener_task, "http_listener_task", &config->task_info, http_stream);
+        if (ret != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Could not start HTTP listener task!");
+        }
+    }
+
+    if (ret != ESP_OK)
+    {
+        if (task_group_ready)
+        {
+            espfsp_task_group_deinit(&http_stream->task_group);
+        }
+        for (int i = 0; i < config->max_clients; i++)
+        {
+            if (http_stream->clients[i].frameQueue != NULL)
+            {
+                espfsp_mem_queue_delete(http_stream->clients[i].frameQueue);
+            }
+        }
+        if (http_stream->mutex != NULL)
+        {
+            vSemaphoreDelete(http_stream->mutex);
+        }
+        espfsp_mem_free(http_stream->frames);
+        espfsp_mem_free(http_stream->frames_mem);
+        espfsp_mem_free(http_stream->clients);
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_http_stream_deinit(espfsp_http_stream_t *http_stream)
+{
+    // Client sockets are shut down, so clients blocked on send to slow viewer exit as well
+    esp_err_t ret = espfsp_task_group_stop_and_join(&http_stream->task_group, ESPFSP_TASK_GROUP_JOIN_TIMEOUT_MS);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    espfsp_task_group_deinit(&http_stream->task_group);
+
+    for (int i = 0; i < http_stream->config.max_clients; i++)
+    {
+        espfsp_mem_queue_delete(http_stream->clients[i].frameQueue);
+    }
+
+    vSemaphoreDelete(http_stream->mutex);
+    espfsp_mem_free(http_stream->frames);
+    espfsp_mem_free(http_stream->frames_mem);
+    espfsp_mem_free(http_stream->clients);
+
+    return ESP_OK;
+}
+
+void espfsp_http_stream_estimate_memory(
+    const espfsp_http_stream_config_t *config, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate)
+{
+    int frames_count = get_frames_count(config);
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_HTTP_STREAM, 0, frames_count * sizeof(espfsp_http_stream_frame_t));
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_HTTP_STREAM, MALLOC_CAP_SPIRAM, frames_count * frame_max_len);
+    espfsp_mem_estimate_add(
+        estimate, ESPFSP_MEM_TAG_HTTP_STREAM, 0, config->max_clients * sizeof(espfsp_http_stream_client_t));
+
+    for (int i = 0; i < config->max_clients; i++)
+    {
+        espfsp_mem_estimate_add_queue(
+            estimate, ESPFSP_MEM_TAG_HTTP_STREAM, config->client_queue_len, sizeof(espfsp_http_stream_frame_t *));
+    }
+}
@@ -0,0 +1,67 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "server/espfsp_layer_selector.h"
+
+#define MAX_UP_HOLD_REPORTS 240
+
+void espfsp_layer_selector_init(
+    espfsp_layer_selector_t *selector, uint8_t layers, uint16_t down_loss_permille, uint8_t up_after_reports)
+{
+    selector->layers = layers > 0 ? layers : 1;
+    selector->layer = 0;
+    selector->down_loss_permille = down_loss_permille;
+    selector->up_after_reports = up_after_reports > 0 ? up_after_reports : 1;
+    selector->up_hold_reports = selector->up_after_reports;
+    selector->clean_reports = 0;
+    selector->probing = false;
+}
+
+uint8_t espfsp_layer_selector_update(espfsp_layer_selector_t *selector, uint16_t loss_permille)
+{
+    if (loss_permille > selector->down_loss_permille)
+    {
+        if (selector->layer + 1 < selector->layers)
+        {
+            selector->layer++;
+        }
+        if (selector->probing)
+        {
+            selector->up_hold_reports = selector->up_hold_reports * 2 > MAX_UP_HOLD_REPORTS ?
+                MAX_UP_HOLD_REPORTS : selector->up_hold_reports * 2;
+        }
+
+        selector->probing = false;
+        selector->clean_reports = 0;
+        return selector->layer;
+    }
+
+    // Loss below threshold keeps layer, only loss free reports count towards probe
+    if (loss_permille > 0)
+    {
+        selector->clean_reports = 0;
+        return selector->layer;
+    }
+
+    selector->clean_reports++;
+
+    if (selector->probing && selector->clean_reports >= selector->up_after_reports)
+    {
+        selector->probing = false;
+        selector->up_hold_reports = selector->up_after_reports;
+    }
+
+    if (selector->layer > 0 && selector->clean_reports >= selector->up_hold_reports)
+    {
+        selector->layer--;
+        selector->probing = true;
+        selector->clean_reports = 0;
+    }
+
+    return selector->layer;
+}
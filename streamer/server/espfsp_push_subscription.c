@@ -0,0 +1,154 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "server/espfsp_push_subscription.h"
+
+static const char *TAG = "ESPFSP_SERVER_PUSH_SUBSCRIPTION";
+
+// Called with lock held
+static esp_err_t start_stream(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = subscription->start_stream(subscription->ctx);
+    if (ret == ESP_OK)
+    {
+        subscription->streaming = true;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Push stream not started for %u subscribers", subscription->subscribers);
+    }
+
+    return ret;
+}
+
+// Called with lock held. Stream is taken as stopped even when stop fails, so next start is tried anyway
+static esp_err_t stop_stream(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = subscription->stop_stream(subscription->ctx);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Push stream stop failed");
+    }
+
+    subscription->streaming = false;
+    return ret;
+}
+
+esp_err_t espfsp_push_subscription_init(
+    espfsp_push_subscription_t *subscription,
+    espfsp_push_subscription_cb_t start_stream,
+    espfsp_push_subscription_cb_t stop_stream,
+    void *ctx)
+{
+    subscription->subscribers = 0;
+    subscription->streaming = false;
+    subscription->start_stream = start_stream;
+    subscription->stop_stream = stop_stream;
+    subscription->ctx = ctx;
+
+    subscription->mutex = xSemaphoreCreateBinary();
+    if (subscription->mutex == NULL || xSemaphoreGive(subscription->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        if (subscription->mutex != NULL)
+        {
+            vSemaphoreDelete(subscription->mutex);
+        }
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_push_subscription_deinit(espfsp_push_subscription_t *subscription)
+{
+    // Detached sessions may still hold subscription, stream is ended with server anyway
+    vSemaphoreDelete(subscription->mutex);
+    return ESP_OK;
+}
+
+esp_err_t espfsp_push_subscription_take(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(subscription->mutex, portMAX_DELAY);
+
+    subscription->subscribers++;
+    if (!subscription->streaming)
+    {
+        ret = start_stream(subscription);
+    }
+
+    xSemaphoreGive(subscription->mutex);
+
+    return ret;
+}
+
+esp_err_t espfsp_push_subscription_drop(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(subscription->mutex, portMAX_DELAY);
+
+    if (subscription->subscribers == 0)
+    {
+        ESP_LOGE(TAG, "Drop without subscriber");
+        ret = ESP_FAIL;
+    }
+    else
+    {
+        subscription->subscribers--;
+    }
+    if (ret == ESP_OK && subscription->subscribers == 0 && subscription->streaming)
+    {
+        ret = stop_stream(subscription);
+    }
+
+    xSemaphoreGive(subscription->mutex);
+
+    return ret;
+}
+
+esp_err_t espfsp_push_subscription_restart(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(subscription->mutex, portMAX_DELAY);
+
+    if (subscription->streaming)
+    {
+        stop_stream(subscription);
+    }
+    if (subscription->subscribers > 0)
+    {
+        ret = start_stream(subscription);
+    }
+
+    xSemaphoreGive(subscription->mutex);
+
+    return ret;
+}
+
+esp_err_t espfsp_push_subscription_resume(espfsp_push_subscription_t *subscription)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(subscription->mutex, portMAX_DELAY);
+
+    if (!subscription->streaming && subscription->subscribers > 0)
+    {
+        ret = start_stream(subscription);
+    }
+
+    xSemaphoreGive(subscription->mutex);
+
+    return ret;
+}
@@ -0,0 +1,377 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "espfsp_mem_alloc.h"
+#include "server/espfsp_avi_writer.h"
+#include "server/espfsp_recorder.h"
+
+#define RECORDER_TASK_DELAY (10 / portTICK_PERIOD_MS)
+#define RECORDER_FEED_MAX_WAIT (2 / portTICK_PERIOD_MS)
+#define RECORDER_PATH_MAX_LEN 64
+
+static const char *TAG = "ESPFSP_SERVER_RECORDER";
+
+// Frame record in ring. Record never wraps, space left at the end of ring is skipped.
+// Record with zero record_len marks skipped space.
+typedef struct {
+    uint32_t record_len;
+    uint32_t len;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestamp_us;
+} recorder_frame_hdr_t;
+
+static int64_t timeval_to_us(const struct timeval *tv)
+{
+    return (int64_t) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static uint32_t record_len(uint32_t frame_len)
+{
+    return (sizeof(recorder_frame_hdr_t) + frame_len + 7) & ~7;
+}
+
+// Ring functions have to be called with recorder locked
+static recorder_frame_hdr_t *peek_oldest(espfsp_recorder_t *recorder)
+{
+    if (recorder->ring_used == 0)
+    {
+        return NULL;
+    }
+
+    recorder_frame_hdr_t *hdr = (recorder_frame_hdr_t *) (recorder->ring + recorder->ring_tail);
+    if (recorder->config.ring_size - recorder->ring_tail < sizeof(recorder_frame_hdr_t) || hdr->record_len == 0)
+    {
+        recorder->ring_used -= recorder->config.ring_size - recorder->ring_tail;
+        recorder->ring_tail = 0;
+        hdr = (recorder_frame_hdr_t *) recorder->ring;
+    }
+
+    return hdr;
+}
+
+static void drop_oldest(espfsp_recorder_t *recorder)
+{
+    recorder_frame_hdr_t *hdr = peek_oldest(recorder);
+    uint32_t len = hdr->record_len;
+
+    recorder->ring_tail += len;
+    recorder->ring_used -= len;
+
+    if (recorder->ring_tail == recorder->config.ring_size)
+    {
+        recorder->ring_tail = 0;
+    }
+    if (recorder->ring_used == 0)
+    {
+        recorder->ring_head = 0;
+        recorder->ring_tail = 0;
+    }
+}
+
+static bool is_recording(espfsp_recorder_t *recorder)
+{
+    return recorder->config.mode == ESPFSP_RECORDER_MODE_CONTINUOUS ||
+           (uint64_t) esp_timer_get_time() < recorder->record_until_us;
+}
+
+void espfsp_recorder_feed(const espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_recorder_t *recorder = (espfsp_recorder_t *) ctx;
+    uint32_t len = record_len(fb->len);
+    uint32_t ring_size = recorder->config.ring_size;
+    int64_t timestamp_us = timeval_to_us(&fb->timestamp);
+
+    if (len > ring_size)
+    {
+        ESP_LOGW(TAG, "Frame does not fit in recorder ring");
+        return;
+    }
+
+    if (xSemaphoreTake(recorder->mutex, RECORDER_FEED_MAX_WAIT) != pdTRUE)
+    {
+        // Relay is never blocked by recorder for longer than single frame copy
+        recorder->dropped_frames += 1;
+        return;
+    }
+
+    // Out of recording, only last pre_event_s seconds are kept
+    if (!is_recording(recorder))
+    {
+        recorder_frame_hdr_t *oldest = peek_oldest(recorder);
+        while (oldest != NULL && timestamp_us - oldest->timestamp_us > (int64_t) recorder->config.pre_event_s * 1000000)
+        {
+            drop_oldest(recorder);
+            oldest = peek_oldest(recorder);
+        }
+    }
+
+    while (1)
+    {
+        uint32_t skip = ring_size - recorder->ring_head < len ? ring_size - recorder->ring_head : 0;
+
+        if (ring_size - recorder->ring_used >= skip + len)
+        {
+            if (skip >= sizeof(recorder_frame_hdr_t))
+            {
+                ((recorder_frame_hdr_t *) (recorder->ring + recorder->ring_head))->record_len = 0;
+            }
+            if (skip > 0)
+            {
+                recorder->ring_used += skip;
+                recorder->ring_head = 0;
+            }
+            break;
+        }
+
+        if (recorder->ring_used == 0)
+        {
+            recorder->ring_head = 0;
+            recorder->ring_tail = 0;
+            continue;
+        }
+
+        drop_oldest(recorder);
+        recorder->dropped_frames += is_recording(recorder) ? 1 : 0;
+    }
+
+    recorder_frame_hdr_t *hdr = (recorder_frame_hdr_t *) (recorder->ring + recorder->ring_head);
+    hdr->record_len = len;
+    hdr->len = fb->len;
+    hdr->width = fb->width;
+    hdr->height = fb->height;
+    hdr->timestamp_us = timestamp_us;
+    memcpy(hdr + 1, fb->buf, fb->len);
+
+    recorder->ring_head += len;
+    recorder->ring_used += len;
+    if (recorder->ring_head == ring_size)
+    {
+        recorder->ring_head = 0;
+    }
+
+    xSemaphoreGive(recorder->mutex);
+}
+
+// Copies oldest frame out of the ring, so it can be written without lock
+static bool take_frame(espfsp_recorder_t *recorder, recorder_frame_hdr_t *frame_hdr)
+{
+    bool taken = false;
+
+    if (xSemaphoreTake(recorder->mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return false;
+    }
+
+    recorder_frame_hdr_t *hdr = is_recording(recorder) ? peek_oldest(recorder) : NULL;
+    if (hdr != NULL && hdr->len > recorder->frame_buf_len)
+    {
+        espfsp_mem_free(recorder->frame_buf);
+        recorder->frame_buf = (uint8_t *) espfsp_mem_malloc(ESPFSP_MEM_TAG_RECORDER, MALLOC_CAP_SPIRAM, hdr->len);
+        recorder->frame_buf_len = recorder->frame_buf != NULL ? hdr->len : 0;
+    }
+    if (hdr != NULL && recorder->frame_buf != NULL)
+    {
+        memcpy(frame_hdr, hdr, sizeof(recorder_frame_hdr_t));
+        memcpy(recorder->frame_buf, hdr + 1, hdr->len);
+        drop_oldest(recorder);
+        taken = true;
+    }
+
+    xSemaphoreGive(recorder->mutex);
+
+    return taken;
+}
+
+static void write_frame(espfsp_recorder_t *recorder, const recorder_frame_hdr_t *hdr)
+{
+    esp_err_t ret = ESP_OK;
+
+    if (!espfsp_avi_writer_is_open(&recorder->writer))
+    {
+        char path[RECORDER_PATH_MAX_LEN];
+        espfsp_avi_writer_config_t writer_config = {
+            .batch_size = recorder->config.write_batch_size,
+            .max_frames = recorder->config.max_frames_per_file,
+            .fps = recorder->fps,
+        };
+
+        snprintf(path, sizeof(path), "%s_%lld.avi", recorder->config.path_prefix, (long long) (hdr->timestamp_us / 1000000));
+
+        ret = espfsp_avi_writer_open(&recorder->writer, path, &writer_config, hdr->width, hdr->height);
+    }
+    if (ret == ESP_OK)
+    {
+        ret = espfsp_avi_writer_add_frame(&recorder->writer, recorder->frame_buf, hdr->len);
+    }
+    if (ret != ESP_OK || espfsp_avi_writer_is_full(&recorder->writer))
+    {
+        if (espfsp_avi_writer_is_open(&recorder->writer))
+        {
+            espfsp_avi_writer_close(&recorder->writer);
+        }
+    }
+}
+
+static void recorder_task(void *pvParameters)
+{
+    espfsp_recorder_t *recorder = (espfsp_recorder_t *) pvParameters;
+    recorder_frame_hdr_t hdr;
+
+    while (recorder->en)
+    {
+        if (take_frame(recorder, &hdr))
+        {
+            write_frame(recorder, &hdr);
+            continue;
+        }
+
+        if (!is_recording(recorder) && espfsp_avi_writer_is_open(&recorder->writer))
+        {
+            espfsp_avi_writer_close(&recorder->writer);
+        }
+
+        vTaskDelay(RECORDER_TASK_DELAY);
+    }
+
+    if (espfsp_avi_writer_is_open(&recorder->writer))
+    {
+        espfsp_avi_writer_close(&recorder->writer);
+    }
+
+    recorder->task_handle = NULL;
+    vTaskDelete(NULL);
+}
+
+esp_err_t espfsp_recorder_init(
+    espfsp_recorder_t *recorder,
+    const espfsp_recorder_config_t *config,
+    uint16_t fps,
+    espfsp_push_subscription_t *push_subscription)
+{
+    memcpy(&recorder->config, config, sizeof(espfsp_recorder_config_t));
+    recorder->fps = fps;
+    recorder->push_subscription = push_subscription;
+    recorder->ring_head = 0;
+    recorder->ring_tail = 0;
+    recorder->ring_used = 0;
+    recorder->frame_buf = NULL;
+    recorder->frame_buf_len = 0;
+    recorder->writer.file = NULL;
+    recorder->record_until_us = 0;
+    recorder->dropped_frames = 0;
+
+    if (config->ring_size < sizeof(recorder_frame_hdr_t) || config->path_prefix == NULL)
+    {
+        ESP_LOGE(TAG, "Recorder config is not correct");
+        return ESP_FAIL;
+    }
+
+    recorder->ring = (uint8_t *) espfsp_mem_malloc(ESPFSP_MEM_TAG_RECORDER, MALLOC_CAP_SPIRAM, config->ring_size);
+    if (recorder->ring == NULL)
+    {
+        ESP_LOGE(TAG, "Cannot allocate memory for recorder ring");
+        return ESP_FAIL;
+    }
+
+    recorder->mutex = xSemaphoreCreateBinary();
+    if (recorder->mutex == NULL || xSemaphoreGive(recorder->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        espfsp_mem_free(recorder->ring);
+        return ESP_FAIL;
+    }
+
+    recorder->en = 1;
+
+    BaseType_t xStatus = xTaskCreate(
+        recorder_task,
+        "recorder_task",
+        config->task_info.stack_size,
+        (void *) recorder,
+        config->task_info.task_prio,
+        &recorder->task_handle);
+
+    if (xStatus != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not start recorder task!");
+        vSemaphoreDelete(recorder->mutex);
+        espfsp_mem_free(recorder->ring);
+        return ESP_FAIL;
+    }
+
+    // Stream is started once push connects, when none is connected yet
+    if (espfsp_push_subscription_take(recorder->push_subscription) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "Recorder waits for source");
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_recorder_deinit(espfsp_recorder_t *recorder)
+{
+    espfsp_push_subscription_drop(recorder->push_subscription);
+    recorder->en = 0;
+
+    // Wait for task to close file and stop
+    while (recorder->task_handle != NULL)
+    {
+        vTaskDelay(RECORDER_TASK_DELAY);
+    }
+
+    vSemaphoreDelete(recorder->mutex);
+    espfsp_mem_free(recorder->frame_buf);
+    espfsp_mem_free(recorder->ring);
+
+    return ESP_OK;
+}
+
+void espfsp_recorder_estimate_memory(
+    const espfsp_recorder_config_t *config, uint32_t frame_max_len, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_avi_writer_config_t writer_config = {
+        .batch_size = config->write_batch_size,
+        .max_frames = config->max_frames_per_file,
+    };
+
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_RECORDER, MALLOC_CAP_SPIRAM, config->ring_size);
+    espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_RECORDER, MALLOC_CAP_SPIRAM, frame_max_len);
+    espfsp_avi_writer_estimate_memory(&writer_config, estimate);
+}
+
+esp_err_t espfsp_recorder_trigger(espfsp_recorder_t *recorder)
+{
+    if (recorder->config.mode != ESPFSP_RECORDER_MODE_TRIGGERED)
+    {
+        ESP_LOGE(TAG, "Recorder is not in triggered mode");
+        return ESP_FAIL;
+    }
+
+    if (xSemaphoreTake(recorder->mutex, portMAX_DELAY) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot take semaphore");
+        return ESP_FAIL;
+    }
+
+    recorder->record_until_us = esp_timer_get_time() + (uint64_t) recorder->config.post_event_s * 1000000;
+
+    xSemaphoreGive(recorder->mutex);
+
+    return ESP_OK;
+}
@@ -0,0 +1,215 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+
+#include "server/espfsp_rtp_jpeg.h"
+
+#define JPEG_MARKER_SOF0 0xC0
+#define JPEG_MARKER_DQT 0xDB
+#define JPEG_MARKER_DRI 0xDD
+#define JPEG_MARKER_SOS 0xDA
+#define JPEG_MARKER_EOI 0xD9
+
+#define JPEG_QTABLE_LEN 64
+
+#define RTP_JPEG_TYPE_422 0
+#define RTP_JPEG_TYPE_420 1
+#define RTP_JPEG_Q_DYNAMIC 255
+
+static const char *TAG = "ESPFSP_RTP_JPEG";
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+void espfsp_rtp_jpeg_stream_init(espfsp_rtp_jpeg_stream_t *stream, uint32_t ssrc)
+{
+    stream->seq = 0;
+    stream->ssrc = ssrc;
+}
+
+esp_err_t espfsp_rtp_jpeg_parse(espfsp_rtp_jpeg_stream_t *stream, const espfsp_fb_t *fb, espfsp_rtp_jpeg_frame_t *frame)
+{
+    const uint8_t *buf = (const uint8_t *) fb->buf;
+    size_t pos = 2;
+    bool sof_found = false;
+
+    if (fb->len < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+    {
+        ESP_LOGE(TAG, "Frame is not JPEG");
+        return ESP_FAIL;
+    }
+
+    frame->stream = stream;
+    frame->qtables_count = 0;
+
+    // 90 kHz clock from capture time
+    uint64_t timestamp_us = (uint64_t) fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    frame->timestamp = (uint32_t) (timestamp_us * (RTP_JPEG_CLOCK_RATE / 1000) / 1000);
+
+    while (pos + 4 <= fb->len)
+    {
+        if (buf[pos] != 0xFF)
+        {
+            ESP_LOGE(TAG, "JPEG marker expected");
+            return ESP_FAIL;
+        }
+
+        uint8_t marker = buf[pos + 1];
+        uint16_t segment_len = get_u16(&buf[pos + 2]);
+        const uint8_t *segment = &buf[pos + 4];
+
+        if (pos + 2 + segment_len > fb->len)
+        {
+            ESP_LOGE(TAG, "JPEG segment exceeds frame");
+            return ESP_FAIL;
+        }
+
+        switch (marker)
+        {
+        case JPEG_MARKER_DQT:
+
+            for (size_t i = 0; i + 1 + JPEG_QTABLE_LEN <= segment_len - 2; i += 1 + JPEG_QTABLE_LEN)
+            {
+                if ((segment[i] >> 4) != 0 || frame->qtables_count >= RTP_JPEG_MAX_QTABLES)
+                {
+                    ESP_LOGE(TAG, "Only two 8-bit quantization tables are supported");
+                    return ESP_FAIL;
+                }
+
+                // Tables are in zigzag order, as RTP JPEG expects
+                frame->qtables[frame->qtables_count++] = &segment[i + 1];
+            }
+            break;
+
+        case JPEG_MARKER_SOF0:
+        {
+            uint16_t height = get_u16(&segment[1]);
+            uint16_t width = get_u16(&segment[3]);
+            uint8_t luma_sampling = segment[7];
+
+            if (width > 2040 || height > 2040 || (width & 7) || (height & 7))
+            {
+                ESP_LOGE(TAG, "Frame size not supported by RTP JPEG");
+                return ESP_FAIL;
+            }
+            if (luma_sampling == 0x22)
+            {
+                frame->type = RTP_JPEG_TYPE_420;
+            }
+            else if (luma_sampling == 0x21)
+            {
+                frame->type = RTP_JPEG_TYPE_422;
+            }
+            else
+            {
+                ESP_LOGE(TAG, "Sampling not supported by RTP JPEG");
+                return ESP_FAIL;
+            }
+
+            frame->width = width >> 3;
+            frame->height = height >> 3;
+            sof_found = true;
+            break;
+        }
+
+        case JPEG_MARKER_DRI:
+
+            if (get_u16(segment) != 0)
+            {
+                ESP_LOGE(TAG, "Restart markers are not supported");
+                return ESP_FAIL;
+            }
+            break;
+
+        case JPEG_MARKER_SOS:
+
+            if (!sof_found || frame->qtables_count == 0)
+            {
+                ESP_LOGE(TAG, "JPEG header incomplete");
+                return ESP_FAIL;
+            }
+
+            frame->scan = &buf[pos + 2 + segment_len];
+            frame->scan_len = fb->len - (pos + 2 + segment_len);
+
+            // Receiver adds EOI itself
+            if (frame->scan_len >= 2 && frame->scan[frame->scan_len - 2] == 0xFF &&
+                frame->scan[frame->scan_len - 1] == JPEG_MARKER_EOI)
+            {
+                frame->scan_len -= 2;
+            }
+
+            return ESP_OK;
+
+        default:
+            break;
+        }
+
+        pos += 2 + segment_len;
+    }
+
+    ESP_LOGE(TAG, "JPEG scan not found");
+    return ESP_FAIL;
+}
+
+size_t espfsp_rtp_jpeg_build_packet(uint8_t *packet, size_t offset, size_t len, bool last, void *ctx)
+{
+    espfsp_rtp_jpeg_frame_t *frame = (espfsp_rtp_jpeg_frame_t *) ctx;
+    uint16_t seq = frame->stream->seq++;
+    uint8_t *p = packet;
+
+    // RTP header
+    *p++ = 0x80;
+    *p++ = (last ? 0x80 : 0x00) | RTP_JPEG_PAYLOAD_TYPE;
+    *p++ = seq >> 8;
+    *p++ = seq & 0xFF;
+    *p++ = frame->timestamp >> 24;
+    *p++ = (frame->timestamp >> 16) & 0xFF;
+    *p++ = (frame->timestamp >> 8) & 0xFF;
+    *p++ = frame->timestamp & 0xFF;
+    *p++ = frame->stream->ssrc >> 24;
+    *p++ = (frame->stream->ssrc >> 16) & 0xFF;
+    *p++ = (frame->stream->ssrc >> 8) & 0xFF;
+    *p++ = frame->stream->ssrc & 0xFF;
+
+    // JPEG header
+    *p++ = 0;
+    *p++ = (offset >> 16) & 0xFF;
+    *p++ = (offset >> 8) & 0xFF;
+    *p++ = offset & 0xFF;
+    *p++ = frame->type;
+    *p++ = RTP_JPEG_Q_DYNAMIC;
+    *p++ = frame->width;
+    *p++ = frame->height;
+
+    // Quantization tables are sent only with first fragment
+    if (offset == 0)
+    {
+        uint16_t qtables_len = frame->qtables_count * JPEG_QTABLE_LEN;
+
+        *p++ = 0;
+        *p++ = 0;
+        *p++ = qtables_len >> 8;
+        *p++ = qtables_len & 0xFF;
+
+        for (int i = 0; i < frame->qtables_count; i++)
+        {
+            memcpy(p, frame->qtables[i], JPEG_QTABLE_LEN);
+            p += JPEG_QTABLE_LEN;
+        }
+    }
+
+    memcpy(p, frame->scan + offset, len);
+    p += len;
+
+    return p - packet;
+}
@@ -0,0 +1,503 @@
+/*
+ * Home monitoring system
+ * Author: Maksymilian Komarnicki
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "lwip/sockets.h"
+
+#include "espfsp_mem_alloc.h"
+#include "espfsp_sock_op.h"
+#include "server/espfsp_rtp_jpeg.h"
+#include "server/espfsp_rtsp_server.h"
+
+#define RTSP_REQUEST_MAX_LEN 1024
+#define RTSP_RESPONSE_MAX_LEN 768
+#define RTSP_SDP_MAX_LEN 256
+#define RTSP_SLEEP_TIME (10 / portTICK_PERIOD_MS)
+#define RTSP_LISTENER_SLEEP_TIME (200 / portTICK_PERIOD_MS)
+
+static const char *TAG = "ESPFSP_SERVER_RTSP";
+
+typedef struct {
+    espfsp_rtsp_server_t *rtsp_server;
+    int sock;
+    int rtp_sock;
+    uint32_t session_id;
+    bool connected;
+} rtsp_session_t;
+
+void espfsp_rtsp_server_feed(const espfsp_fb_t *fb, void *ctx)
+{
+    espfsp_rtsp_server_t *rtsp_server = (espfsp_rtsp_server_t *) ctx;
+
+    if (!rtsp_server->playing)
+    {
+        return;
+    }
+
+    if (fb->len > rtsp_server->frame_max_len)
+    {
+        ESP_LOGW(TAG, "Frame too big for RTSP stream");
+        return;
+    }
+
+    if (xSemaphoreTake(rtsp_server->mutex, 0) != pdTRUE)
+    {
+        return;
+    }
+
+    // Slot being sent is never touched, the other one always gets the newest frame
+    int slot = rtsp_server->sending_frame == 0 ? 1 : 0;
+    espfsp_fb_t *frame = &rtsp_server->frames[slot];
+
+    frame->len = fb->len;
+    frame->width = fb->width;
+    frame->height = fb->height;
+    frame->timestamp = fb->timestamp;
+    memcpy(frame->buf, fb->buf, fb->len);
+    rtsp_server->latest_frame = slot;
+
+    xSemaphoreGive(rtsp_server->mutex);
+}
+
+static void send_response(rtsp_session_t *session, int cseq, const char *status, const char *headers, const char *body)
+{
+    char response[RTSP_RESPONSE_MAX_LEN];
+
+    int len = snprintf(
+        response,
+        sizeof(response),
+        "RTSP/1.0 %s\r\nCSeq: %d\r\n%s%s%s",
+        status,
+        cseq,
+        headers,
+        body != NULL ? "" : "\r\n",
+        body != NULL ? body : "");
+
+    if (len >= sizeof(response))
+    {
+        ESP_LOGE(TAG, "RTSP response too long");
+        return;
+    }
+
+    if (espfsp_send(session->sock, response, len) != ESP_OK)
+    {
+        session->connected = false;
+    }
+}
+
+// Session in PLAY subscribes to push stream, so frames come also without play session
+static void set_playing(espfsp_rtsp_server_t *rtsp_server, bool playing)
+{
+    if (playing == rtsp_server->playing)
+    {
+        return;
+    }
+
+    rtsp_server->playing = playing;
+
+    if (!playing)
+    {
+        espfsp_push_subscription_drop(rtsp_server->push_subscription);
+    }
+    else if (espfsp_push_subscription_take(rtsp_server->push_subscription) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Push stream not started, RTSP session waits for source");
+    }
+}
+
+static void handle_describe(rtsp_session_t *session, int cseq, const char *url)
+{
+    char sdp[RTSP_SDP_MAX_LEN];
+    char headers[RTSP_RESPONSE_MAX_LEN / 2];
+
+    int sdp_len = snprintf(
+        sdp,
+        sizeof(sdp),
+        "v=0\r\n"
+        "o=- %lu 1 IN IP4 0.0.0.0\r\n"
+        "s=espfsp\r\n"
+        "t=0 0\r\n"
+        "m=video 0 RTP/AVP %d\r\n"
+        "c=IN IP4 0.0.0.0\r\n"
+        "a=control:track0\r\n",
+        (unsigned long) session->session_id,
+        RTP_JPEG_PAYLOAD_TYPE);
+
+    snprintf(
+        headers,
+        sizeof(headers),
+        "Content-Base: %s/\r\nContent-Type: application/sdp\r\nContent-Length: %d\r\n\r\n",
+        url,
+        sdp_len);
+
+    send_response(session, cseq, "200 OK", headers, sdp);
+}
+
+static void handle_setup(rtsp_session_t *session, int cseq, const char *request)
+{
+    espfsp_rtsp_server_t *rtsp_server = session->rtsp_server;
+    char headers[RTSP_RESPONSE_MAX_LEN / 2];
+    int client_rtp_port = 0;
+    int client_rtcp_port = 0;
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+
+    // Only unicast UDP is supported, interleaving in RTSP connection is not
+    const char *client_port = strstr(request, "client_port=");
+    if (client_port == NULL || strstr(request, "RTP/AVP/TCP") != NULL ||
+        sscanf(client_port, "client_port=%d-%d", &client_rtp_port, &client_rtcp_port) != 2)
+    {
+        send_response(session, cseq, "461 Unsupported Transport", "", NULL);
+        return;
+    }
+
+    if (session->rtp_sock >= 0)
+    {
+        espfsp_remove_udp_host(session->rtp_sock);
+        session->rtp_sock = -1;
+    }
+
+    if (getpeername(session->sock, (struct sockaddr *) &client_addr, &addr_len) != 0)
+    {
+        send_response(session, cseq, "500 Internal Server Error", "", NULL);
+        return;
+    }
+
+    client_addr.sin_port = htons(client_rtp_port);
+
+    if (espfsp_create_udp_client(&session->rtp_sock, rtsp_server->config.rtp_port, &client_addr) != ESP_OK)
+    {
+        session->rtp_sock = -1;
+        send_response(session, cseq, "500 Internal Server Error", "", NULL);
+        return;
+    }
+
+    snprintf(
+        headers,
+        sizeof(headers),
+        "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\nSession: %lu\r\n",
+        client_rtp_port,
+        client_rtcp_port,
+        rtsp_server->config.rtp_port,
+        rtsp_server->config.rtp_port + 1,
+        (unsigned long) session->session_id);
+
+    send_response(session, cseq, "200 OK", headers, NULL);
+}
+
+static void handle_request(rtsp_session_t *session, const char *request)
+{
+    espfsp_rtsp_server_t *rtsp_server = session->rtsp_server;
+    char method[16];
+    char url[128];
+    char headers[64];
+    int cseq = 0;
+
+    if (sscanf(request, "%15s %127s", method, url) != 2)
+    {
+        session->connected = false;
+        return;
+    }
+
+    const char *cseq_header = strstr(request, "CSeq:");
+    if (cseq_header != NULL)
+    {
+        cseq = atoi(cseq_header + strlen("CSeq:"));
+    }
+
+    snprintf(headers, sizeof(headers), "Session: %lu\r\n", (unsigned long) session->session_id);
+
+    if (strcmp(method, "OPTIONS") == 0)
+    {
+        send_response(session, cseq, "200 OK", "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+    }
+    else if (strcmp(method, "DESCRIBE") == 0)
+    {
+        handle_describe(session, cseq, url);
+    }
+    else if (strcmp(method, "SETUP") == 0)
+    {
+        handle_setup(session, cseq, request);
+    }
+    else if (strcmp(method, "PLAY") == 0 && session->rtp_sock >= 0)
+    {
+        set_playing(rtsp_server, true);
+        send_response(session, cseq, "200 OK", headers, NULL);
+        ESP_LOGI(TAG, "RTSP play started");
+    }
+    else if (strcmp(method, "PLAY") == 0)
+    {
+        send_response(session, cseq, "455 Method Not Valid in This State", headers, NULL);
+    }
+    else if (strcmp(method, "TEARDOWN") == 0)
+    {
+        set_playing(rtsp_server, false);
+        send_response(session, cseq, "200 OK", headers, NULL);
+        session->connected = false;
+    }
+    else if (strcmp(method, "GET_PARAMETER") == 0)
+    {
+        // Used by players as keep alive
+        send_response(session, cseq, "200 OK", headers, NULL);
+    }
+    else
+    {
+        send_response(session, cseq, "501 Not Implemented", "", NULL);
+    }
+}
+
+static bool send_latest_frame(rtsp_session_t *session)
+{
+    espfsp_rtsp_server_t *rtsp_server = session->rtsp_server;
+    espfsp_rtp_jpeg_frame_t rtp_frame;
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(rtsp_server->mutex, portMAX_DELAY);
+    rtsp_server->sending_frame = rtsp_server->latest_frame;
+    rtsp_server->latest_frame = -1;
+    xSemaphoreGive(rtsp_server->mutex);
+
+    if (rtsp_server->sending_frame < 0)
+    {
+        return false;
+    }
+
+    ret = espfsp_rtp_jpeg_parse(&rtsp_server->rtp_stream, &rtsp_server->frames[rtsp_server->sending_frame], &rtp_frame);
+    if (ret == ESP_OK)
+    {
+        // Same pacing as for own protocol, packets are spread over frame interval
+        ret = espfsp_send_fragments_within(
+            session->rtp_sock,
+            rtp_frame.scan_len,
+            RTP_JPEG_FRAGMENT_LEN,
+            rtsp_server->packet,
+            rtsp_server->frame_interval_us,
+            espfsp_rtp_jpeg_build_packet,
+            &rtp_frame,
+            NULL);
+    }
+
+    xSemaphoreTake(rtsp_server->mutex, portMAX_DELAY);
+    rtsp_server->sending_frame = -1;
+    xSemaphoreGive(rtsp_server->mutex);
+
+    return true;
+}
+
+static void handle_session(espfsp_rtsp_server_t *rtsp_server, int sock)
+{
+    char request[RTSP_REQUEST_MAX_LEN];
+    int request_len = 0;
+    rtsp_session_t session = {
+        .rtsp_server = rtsp_server,
+        .sock = sock,
+        .rtp_sock = -1,
+        .session_id = (uint32_t) esp_timer_get_time(),
+        .connected = true,
+    };
+
+    espfsp_rtp_jpeg_stream_init(&rtsp_server->rtp_stream, session.session_id ^ 0x45535046);
+
+    while (session.connected && rtsp_server->en)
+    {
+        int received = 0;
+        espfsp_conn_state_t conn_state = ESPFSP_CONN_STATE_GOOD;
+        bool busy = false;
+
+        esp_err_t ret = espfsp_receive_no_block_state(
+            sock, request + request_len, sizeof(request) - 1 - request_len, &received, &conn_state);
+        if (ret != ESP_OK || conn_state != ESPFSP_CONN_STATE_GOOD)
+        {
+            break;
+        }
+
+        request_len += received;
+        request[request_len] = '\0';
+
+        char *request_end = strstr(request, "\r\n\r\n");
+        while (request_end != NULL && session.connected)
+        {
+            int handled_len = request_end + 4 - request;
+
+            handle_request(&session, request);
+
+            memmove(request, request + handled_len, request_len - handled_len + 1);
+            request_len -= handled_len;
+            request_end = strstr(request, "\r\n\r\n");
+        }
+
+        if (request_len == sizeof(request) - 1)
+        {
+            ESP_LOGE(TAG, "RTSP request too long");
+            break;
+        }
+
+        if (rtsp_server->playing && session.rtp_sock >= 0)
+        {
+            busy = send_latest_frame(&session);
+        }
+
+        if (!busy)
+        {
+            vTaskDelay(RTSP_SLEEP_TIME);
+        }
+    }
+
+    set_playing(rtsp_server, false);
+
+    if (session.rtp_sock >= 0)
+    {
+        espfsp_remove_udp_host(session.rtp_sock);
+    }
+
+    ESP_LOGI(TAG, "RTSP session closed");
+}
+
+static void rtsp_task(void *pvParameters)
+{
+    espfsp_rtsp_server_t *rtsp_server = (espfsp_rtsp_server_t *) pvParameters;
+    int listen_sock = 0;
+
+    if (espfsp_create_tcp_server(&listen_sock, rtsp_server->config.port) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Create RTSP server failed");
+        rtsp_server->task_running = 0;
+        vTaskDelete(NULL);
+    }
+
+    while (rtsp_server->en)
+    {
+        int sock = 0;
+        struct sockaddr_in source_addr;
+        socklen_t addr_len = sizeof(source_addr);
+
+        // Server sock is set nonblocking, so it could return without established connection.
+        // Next client is accepted when current session ends.
+        if (espfsp_tcp_accept(listen_sock, &sock, &source_addr, &addr_len) != ESP_OK || sock < 0)
+        {
+            vTaskDelay(RTSP_LISTENER_SLEEP_TIME);
+            continue;
+        }
+
+        handle_session(rtsp_server, sock);
+        espfsp_remove_host(sock);
+    }
+
+    espfsp_remove_host(listen_sock);
+
+    rtsp_server->task_running = 0;
+    vTaskDelete(NULL);
+}
+
+esp_err_t espfsp_rtsp_server_init(
+    espfsp_rtsp_server_t *rtsp_server,
+    const espfsp_rtsp_config_t *config,
+    const espfsp_frame_config_t *frame_config,
+    espfsp_push_subscription_t *push_subscription)
+{
+    memcpy(&rtsp_server->config, config, sizeof(espfsp_rtsp_config_t));
+    rtsp_server->push_subscription = push_subscription;
+    rtsp_server->frame_max_len = frame_config->frame_max_len;
+    rtsp_server->latest_frame = -1;
+    rtsp_server->sending_frame = -1;
+    rtsp_server->playing = false;
+
+    if (frame_config->fps == 0)
+    {
+        ESP_LOGE(TAG, "FPS cannot be 0");
+        return ESP_FAIL;
+    }
+
+    rtsp_server->frame_interval_us = (uint64_t) ((1000 / frame_config->fps) << 10);
+
+    for (int i = 0; i < RTSP_FRAME_SLOTS; i++)
+    {
+        rtsp_server->frames[i].buf = (char *) espfsp_mem_malloc(
+            ESPFSP_MEM_TAG_RTSP, MALLOC_CAP_SPIRAM, frame_config->frame_max_len);
+        if (rtsp_server->frames[i].buf == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot allocate memory for RTSP frames");
+            for (int j = 0; j < i; j++)
+            {
+                espfsp_mem_free(rtsp_server->frames[j].buf);
+            }
+            return ESP_FAIL;
+        }
+    }
+
+    rtsp_server->mutex = xSemaphoreCreateBinary();
+    if (rtsp_server->mutex == NULL || xSemaphoreGive(rtsp_server->mutex) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Cannot init semaphore");
+        for (int i = 0; i < RTSP_FRAME_SLOTS; i++)
+        {
+            espfsp_mem_free(rtsp_server->frames[i].buf);
+        }
+        return ESP_FAIL;
+    }
+
+    rtsp_server->en = 1;
+    rtsp_server->task_running = 1;
+
+    BaseType_t xStatus = xTaskCreate(
+        rtsp_task,
+        "rtsp_task",
+        config->task_info.stack_size,
+        (void *) rtsp_server,
+        config->task_info.task_prio,
+        NULL);
+
+    if (xStatus != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not start RTSP task!");
+        vSemaphoreDelete(rtsp_server->mutex);
+        for (int i = 0; i < RTSP_FRAME_SLOTS; i++)
+        {
+            espfsp_mem_free(rtsp_server->frames[i].buf);
+        }
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t espfsp_rtsp_server_deinit(espfsp_rtsp_server_t *rtsp_server)
+{
+    rtsp_server->en = 0;
+
+    // Wait for session to close
+    while (rtsp_server->task_running)
+    {
+        vTaskDelay(RTSP_LISTENER_SLEEP_TIME);
+    }
+
+    vSemaphoreDelete(rtsp_server->mutex);
+
+    for (int i = 0; i < RTSP_FRAME_SLOTS; i++)
+    {
+        espfsp_mem_free(rtsp_server->frames[i].buf);
+    }
+
+    return ESP_OK;
+}
+
+void espfsp_rtsp_server_estimate_memory(uint32_t frame_max_len, espfsp_mem_estimate_t *estimate)
+{
+    for (int i = 0; i < RTSP_FRAME_SLOTS; i++)
+    {
+        espfsp_mem_estimate_add(estimate, ESPFSP_MEM_TAG_RTSP, MALLOC_CAP_SPIRAM, frame_max_len);
+    }
+}
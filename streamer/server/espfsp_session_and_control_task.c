@@ -11,12 +11,14 @@
 
 #include "lwip/sockets.h"
 
+#include "espfsp_mem_alloc.h"
 #include "espfsp_sock_op.h"
+#include "espfsp_task_group.h"
 #include "server/espfsp_session_and_control_task.h"
 #include "server/espfsp_session_manager.h"
 #include "comm_proto/espfsp_comm_proto.h"
 
-#define SERVER_SLEEP_TIME (200 / portTICK_PERIOD_MS)
+#define SERVER_SLEEP_TIME_MS 200
 
 static const char *TAG = "ESPFSP_SERVER_SESSION_AND_CONTROL_TASK";
 
@@ -24,6 +26,7 @@ typedef struct
 {
     espfsp_session_manager_t *session_manager;
     espfsp_session_manager_session_type_t session_type;
+    espfsp_task_group_t *task_group;
     int sock;
 } new_connection_data_t;
 
@@ -33,9 +36,12 @@ static void handle_new_connection_task(void *pvParameters)
 
     espfsp_session_manager_t *session_manager = conn_data->session_manager;
     espfsp_session_manager_session_type_t session_type = conn_data->session_type;
+    espfsp_task_group_t *task_group = conn_data->task_group;
     int sock = conn_data->sock;
 
-    free(conn_data);
+    espfsp_mem_free(conn_data);
+
+    espfsp_task_group_set_sock(task_group, sock);
 
     esp_err_t err = ESP_OK;
     espfsp_comm_proto_t *comm_proto = NULL;
@@ -63,20 +69,63 @@ static void handle_new_connection_task(void *pvParameters)
 
     ESP_LOGI(TAG, "Shut down socket and restart...");
 
+    espfsp_task_group_set_sock(task_group, -1);
+
     esp_err_t ret = espfsp_remove_host(sock);
     if (ret != ESP_OK)
     {
         ESP_LOGE(TAG, "Remove connected host failed");
     }
 
-    vTaskDelete(NULL);
+    espfsp_task_group_exit(task_group);
+}
+
+static void expire_detached_sessions(espfsp_server_session_and_control_task_data_t *data)
+{
+    espfsp_session_manager_t *session_manager = data->session_manager;
+    espfsp_comm_proto_t *comm_proto = NULL;
+
+    do
+    {
+        comm_proto = NULL;
+
+        if (espfsp_session_manager_take(session_manager) != ESP_OK)
+        {
+            return;
+        }
+        espfsp_session_manager_take_expired_session(session_manager, data->session_type, &comm_proto);
+        espfsp_session_manager_release(session_manager);
+
+        if (comm_proto != NULL)
+        {
+            ESP_LOGI(TAG, "Detached session not resumed in time");
+
+            esp_err_t err = data->session_expired_cb(comm_proto, data->session_expired_ctx);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Stop expired session failed");
+            }
+
+            if (espfsp_session_manager_take(session_manager) == ESP_OK)
+            {
+                // Session is dropped anyway, so it is not taken again in next iteration
+                if (err != ESP_OK)
+                {
+                    espfsp_session_manager_deactivate_session(session_manager, comm_proto);
+                }
+                espfsp_session_manager_return_comm_proto(session_manager, comm_proto);
+                espfsp_session_manager_release(session_manager);
+            }
+        }
+    } while (comm_proto != NULL);
 }
 
 void espfsp_server_session_and_control_task(void *pvParameters)
 {
     espfsp_server_session_and_control_task_data_t *data = (espfsp_server_session_and_control_task_data_t *) pvParameters;
+    espfsp_task_group_t *task_group = data->task_group;
 
-    while (1)  // In later phase, synchronization should be added
+    while (!espfsp_task_group_should_stop(task_group))
     {
         esp_err_t ret = ESP_OK;
         int listen_sock = 0;
@@ -85,18 +134,21 @@ void espfsp_server_session_and_control_task(void *pvParameters)
         if (ret != ESP_OK)
         {
             ESP_LOGE(TAG, "Create TCP server failed");
+            espfsp_task_group_wait_stop(task_group, SERVER_SLEEP_TIME_MS);
             continue;
         }
 
         ESP_LOGI(TAG, "Process incoming connections");
 
-        while (1) // In later phase, synchronization should be added
+        while (!espfsp_task_group_should_stop(task_group))
         {
             int sock = 0;
             struct sockaddr_in source_addr;
             socklen_t addr_len = sizeof(source_addr);
 
             // Server sock is set nonblocking, so it could return without established connection
+            expire_detached_sessions(data);
+
             ret = espfsp_tcp_accept(listen_sock, &sock, &source_addr, &addr_len);
             if (ret != ESP_OK)
             {
@@ -105,11 +157,12 @@ void espfsp_server_session_and_control_task(void *pvParameters)
             }
             if (sock < 0)
             {
-                vTaskDelay(SERVER_SLEEP_TIME);
+                espfsp_task_group_wait_stop(task_group, SERVER_SLEEP_TIME_MS);
                 continue;
             }
 
-            new_connection_data_t *conn_data = (new_connection_data_t *) malloc(sizeof(new_connection_data_t));
+            new_connection_data_t *conn_data = (new_connection_data_t *) espfsp_mem_malloc(
+                ESPFSP_MEM_TAG_INSTANCE, 0, sizeof(new_connection_data_t));
             if (conn_data == NULL)
             {
                 ESP_LOGE(TAG, "Memory allocation for connection data failed");
@@ -119,20 +172,22 @@ void espfsp_server_session_and_control_task(void *pvParameters)
 
             conn_data->session_manager = data->session_manager;
             conn_data->session_type = data->session_type;
+            conn_data->task_group = task_group;
             conn_data->sock = sock;
 
-            // In order to safely deinitialize, task handler should be kept and freed
-            BaseType_t xStatus = xTaskCreate(
+            // Connection tasks are tracked in group, so deinit waits for them too
+            ret = espfsp_task_group_create_task(
+                task_group,
                 handle_new_connection_task,
                 "handle_new_connection_task",
-                data->connection_task_info.stack_size,
-                (void *) conn_data,
-                data->connection_task_info.task_prio,
-                NULL);
+                &data->connection_task_info,
+                (void *) conn_data);
 
-            if (xStatus != pdPASS)
+            if (ret != ESP_OK)
             {
                 ESP_LOGE(TAG, "Task create for new connection failed");
+                espfsp_mem_free(conn_data);
+                espfsp_remove_host(sock);
             }
         }
 
@@ -143,6 +198,6 @@ void espfsp_server_session_and_control_task(void *pvParameters)
         }
     }
 
-    free(data);
-    vTaskDelete(NULL);
+    espfsp_mem_free(data);
+    espfsp_task_group_exit(task_group);
 }
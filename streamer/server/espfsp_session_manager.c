@@ -11,9 +11,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include "esp_timer.h"
+#include "esp_random.h"
+
 #include <stdint.h>
 #include <stddef.h>
 
+#include "espfsp_mem_alloc.h"
 #include "server/espfsp_session_manager.h"
 #include "server/espfsp_comm_proto_conf.h"
 
@@ -26,8 +30,8 @@ esp_err_t espfsp_session_manager_init(
 {
     esp_err_t ret = ESP_OK;
 
-    session_manager->config = (espfsp_server_session_manager_config_t *) malloc(
-        sizeof(espfsp_server_session_manager_config_t));
+    session_manager->config = (espfsp_server_session_manager_config_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_SESSION_MANAGER, 0, sizeof(espfsp_server_session_manager_config_t));
     if (session_manager->config == NULL)
     {
         ESP_LOGE(TAG, "Memory allocation failed for configuration");
@@ -36,16 +40,16 @@ esp_err_t espfsp_session_manager_init(
 
     memcpy(session_manager->config, config, sizeof(espfsp_server_session_manager_config_t));
 
-    session_manager->client_push_session_data = (espfsp_server_session_manager_data_t *) malloc(
-        sizeof(espfsp_server_session_manager_data_t) * config->client_push_comm_protos_count);
+    session_manager->client_push_session_data = (espfsp_server_session_manager_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_SESSION_MANAGER, 0, sizeof(espfsp_server_session_manager_data_t) * config->client_push_comm_protos_count);
     if (session_manager->client_push_session_data == NULL)
     {
         ESP_LOGE(TAG, "Memory allocation failed for client push session data");
         return ESP_FAIL;
     }
 
-    session_manager->client_play_session_data = (espfsp_server_session_manager_data_t *) malloc(
-        sizeof(espfsp_server_session_manager_data_t) * config->client_play_comm_protos_count);
+    session_manager->client_play_session_data = (espfsp_server_session_manager_data_t *) espfsp_mem_malloc(
+        ESPFSP_MEM_TAG_SESSION_MANAGER, 0, sizeof(espfsp_server_session_manager_data_t) * config->client_play_comm_protos_count);
     if (session_manager->client_play_session_data == NULL)
     {
         ESP_LOGE(TAG, "Memory allocation failed for client play session data");
@@ -59,6 +63,7 @@ esp_err_t espfsp_session_manager_init(
         data->comm_proto = &config->client_push_comm_protos[i];
         data->type = ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH;
         data->active = false;
+        data->detached = false;
     }
 
     for (int i = 0; i < config->client_play_comm_protos_count; i++)
@@ -68,6 +73,7 @@ esp_err_t espfsp_session_manager_init(
         data->comm_proto = &config->client_play_comm_protos[i];
         data->type = ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PLAY;
         data->active = false;
+        data->detached = false;
     }
 
     session_manager->client_push_session_data_count = config->client_push_comm_protos_count;
@@ -94,15 +100,32 @@ esp_err_t espfsp_session_manager_init(
 
 esp_err_t espfsp_session_manager_deinit(espfsp_session_manager_t *session_manager)
 {
-    free(session_manager->client_push_session_data);
-    free(session_manager->client_play_session_data);
-    free(session_manager->config);
+    espfsp_mem_free(session_manager->client_push_session_data);
+    espfsp_mem_free(session_manager->client_play_session_data);
+    espfsp_mem_free(session_manager->config);
 
     vSemaphoreDelete(session_manager->mutex);
 
     return ESP_OK;
 }
 
+void espfsp_session_manager_estimate_memory(
+    uint8_t client_push_sessions, uint8_t client_play_sessions, espfsp_mem_estimate_t *estimate)
+{
+    espfsp_mem_estimate_add(
+        estimate, ESPFSP_MEM_TAG_SESSION_MANAGER, 0, sizeof(espfsp_server_session_manager_config_t));
+    espfsp_mem_estimate_add(
+        estimate,
+        ESPFSP_MEM_TAG_SESSION_MANAGER,
+        0,
+        sizeof(espfsp_server_session_manager_data_t) * client_push_sessions);
+    espfsp_mem_estimate_add(
+        estimate,
+        ESPFSP_MEM_TAG_SESSION_MANAGER,
+        0,
+        sizeof(espfsp_server_session_manager_data_t) * client_play_sessions);
+}
+
 static espfsp_server_session_manager_data_t * find_unactive_session_data(
     espfsp_server_session_manager_data_t *data_set, int data_count)
 {
@@ -110,7 +133,44 @@ static espfsp_server_session_manager_data_t * find_unactive_session_data(
     {
         espfsp_server_session_manager_data_t *data = &data_set[i];
 
-        if (!data->active)
+        if (!data->active && !data->detached)
+        {
+            return data;
+        }
+    }
+
+    return NULL;
+}
+
+// Used only when all slots are taken. Connection on such slot either resumes its session, or
+// session is expired before new one is activated.
+static espfsp_server_session_manager_data_t * find_unactive_detached_session_data(
+    espfsp_server_session_manager_data_t *data_set, int data_count)
+{
+    espfsp_server_session_manager_data_t *oldest = NULL;
+
+    for (int i = 0; i < data_count; i++)
+    {
+        espfsp_server_session_manager_data_t *data = &data_set[i];
+
+        if (!data->active && data->detached &&
+            (oldest == NULL || data->detached_deadline_us < oldest->detached_deadline_us))
+        {
+            oldest = data;
+        }
+    }
+
+    return oldest;
+}
+
+static espfsp_server_session_manager_data_t * find_detached_session_data(
+    espfsp_server_session_manager_data_t *data_set, int data_count, uint32_t session_id, uint32_t resume_token)
+{
+    for (int i = 0; i < data_count; i++)
+    {
+        espfsp_server_session_manager_data_t *data = &data_set[i];
+
+        if (data->detached && data->session_id == session_id && data->resume_token == resume_token)
         {
             return data;
         }
@@ -249,6 +309,16 @@ esp_err_t espfsp_session_manager_get_comm_proto(
             data->session_id = UNACTIVE_SESSION_ID;
             *comm_proto = data->comm_proto;
         }
+        else
+        {
+            // Detached session keeps its data, it is resolved on session init
+            data = find_unactive_detached_session_data(data_set, data_count);
+            if (data != NULL)
+            {
+                data->active = true;
+                *comm_proto = data->comm_proto;
+            }
+        }
     }
 
     return ret;
@@ -262,7 +332,10 @@ esp_err_t espfsp_session_manager_return_comm_proto(
     if (data != NULL)
     {
         data->active = false;
-        data->session_id = UNACTIVE_SESSION_ID;
+        if (!data->detached)
+        {
+            data->session_id = UNACTIVE_SESSION_ID;
+        }
     }
     else
     {
@@ -282,7 +355,17 @@ esp_err_t espfsp_session_manager_activate_session(
     {
         data->session_id = session_manager->config->session_id_gen(data->type);
         data->stream_started = false;
-        if (snprintf(data->name, sizeof(data->name), "CLIENT_NAME-%ld", data->session_id) > sizeof(data->name))
+        data->detached = false;
+        data->clock_sync.valid = false;
+        data->proto_version = 0;
+        data->capabilities = 0;
+        data->simulcast_layers = 0;
+        memset(&data->stream_status, 0, sizeof(espfsp_stream_status_t));
+        data->stream_status.session_id = data->session_id;
+        data->stream_status.latency_ms = ESPFSP_STREAM_STATUS_LATENCY_UNKNOWN;
+        // Zero is reserved for "no resume" in session init
+        data->resume_token = esp_random() | 1;
+        if (snprintf(data->name, sizeof(data->name), "CLIENT_NAME-%lu", (unsigned long) data->session_id) > sizeof(data->name))
         {
             ESP_LOGE(TAG, "Name too long");
         }
@@ -327,6 +410,7 @@ esp_err_t espfsp_session_manager_deactivate_session(
         }
 
         data->session_id = UNACTIVE_SESSION_ID;
+        data->detached = false;
     }
     else
     {
@@ -355,6 +439,106 @@ esp_err_t espfsp_session_manager_get_session_id(
     return ret;
 }
 
+bool espfsp_session_manager_has_session(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t session_id)
+{
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    return data != NULL && data->session_id != UNACTIVE_SESSION_ID && data->session_id == session_id;
+}
+
+esp_err_t espfsp_session_manager_get_resume_token(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *resume_token)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        bool resumable = session_manager->config->resume_grace_ms > 0 &&
+                         (data->capabilities & ESPFSP_COMM_PROTO_CAP_SESSION_RESUME);
+        *resume_token = resumable ? data->resume_token : 0;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Get resume token failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_get_capabilities(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *capabilities)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        *capabilities = data->capabilities;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Get capabilities failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_set_capabilities(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint16_t proto_version, uint32_t capabilities)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        data->proto_version = proto_version;
+        data->capabilities = capabilities;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Set capabilities failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_get_simulcast_layers(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint8_t *layers)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        *layers = data->simulcast_layers;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Get simulcast layers failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_set_simulcast_layers(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint8_t layers)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        data->simulcast_layers = layers;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Set simulcast layers failed");
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_session_manager_get_session_name(
     espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, char session_name[30])
 {
@@ -473,6 +657,86 @@ esp_err_t espfsp_session_manager_set_frame_config(
     return ret;
 }
 
+esp_err_t espfsp_session_manager_get_clock_sync(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    espfsp_clock_sync_info_t *clock_sync)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        memcpy(clock_sync, &data->clock_sync, sizeof(espfsp_clock_sync_info_t));
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Get clock sync failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_set_clock_sync(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    const espfsp_clock_sync_info_t *clock_sync)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        memcpy(&data->clock_sync, clock_sync, sizeof(espfsp_clock_sync_info_t));
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Set clock sync failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_get_stream_status(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    espfsp_stream_status_t *stream_status)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        memcpy(stream_status, &data->stream_status, sizeof(espfsp_stream_status_t));
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Get stream status failed");
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_set_stream_status(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    const espfsp_stream_status_t *stream_status)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID)
+    {
+        memcpy(&data->stream_status, stream_status, sizeof(espfsp_stream_status_t));
+    }
+    else
+    {
+        ret = ESP_FAIL;
+        ESP_LOGE(TAG, "Set stream status failed");
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_session_manager_get_cam_config(
     espfsp_session_manager_t *session_manager,
     espfsp_comm_proto_t *comm_proto,
@@ -513,6 +777,141 @@ esp_err_t espfsp_session_manager_set_cam_config(
     return ret;
 }
 
+esp_err_t espfsp_session_manager_detach_session(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->session_id != UNACTIVE_SESSION_ID && session_manager->config->resume_grace_ms > 0 &&
+        (data->capabilities & ESPFSP_COMM_PROTO_CAP_SESSION_RESUME))
+    {
+        data->detached = true;
+        data->detached_deadline_us = esp_timer_get_time() + (int64_t) session_manager->config->resume_grace_ms * 1000;
+    }
+    else
+    {
+        ret = ESP_FAIL;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_get_detached_session_id(
+    espfsp_session_manager_t *session_manager, espfsp_comm_proto_t *comm_proto, uint32_t *session_id)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data != NULL && data->detached)
+    {
+        *session_id = data->session_id;
+    }
+    else
+    {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_resume_session(
+    espfsp_session_manager_t *session_manager,
+    espfsp_comm_proto_t *comm_proto,
+    uint32_t session_id,
+    uint32_t resume_token)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data_set = NULL;
+    espfsp_server_session_manager_data_t *detached = NULL;
+    int data_count = 0;
+
+    espfsp_server_session_manager_data_t *data = find_session_data_by_comm_proto(session_manager, comm_proto);
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "Session resume failed");
+        return ESP_FAIL;
+    }
+
+    ret = get_data_set_info(session_manager, data->type, &data_set, &data_count);
+    if (ret == ESP_OK)
+    {
+        detached = find_detached_session_data(data_set, data_count, session_id, resume_token);
+        if (detached == NULL || esp_timer_get_time() >= detached->detached_deadline_us)
+        {
+            return ESP_ERR_NOT_FOUND;
+        }
+    }
+    if (ret == ESP_OK && detached != data)
+    {
+        // Client reconnected on other slot, so session is moved there
+        if (data->session_id != UNACTIVE_SESSION_ID)
+        {
+            ESP_LOGE(TAG, "Session resume failed. Slot already has session");
+            return ESP_FAIL;
+        }
+
+        data->session_id = detached->session_id;
+        data->stream_started = detached->stream_started;
+        data->resume_token = detached->resume_token;
+        data->proto_version = detached->proto_version;
+        data->capabilities = detached->capabilities;
+        data->simulcast_layers = detached->simulcast_layers;
+        memcpy(data->name, detached->name, sizeof(data->name));
+        memcpy(&data->frame_config, &detached->frame_config, sizeof(espfsp_frame_config_t));
+        memcpy(&data->cam_config, &detached->cam_config, sizeof(espfsp_cam_config_t));
+        memcpy(&data->clock_sync, &detached->clock_sync, sizeof(espfsp_clock_sync_info_t));
+        memcpy(&data->stream_status, &detached->stream_status, sizeof(espfsp_stream_status_t));
+
+        if (session_manager->primary_client_play_session_data == detached)
+        {
+            session_manager->primary_client_play_session_data = data;
+        }
+        if (session_manager->primary_client_push_session_data == detached)
+        {
+            session_manager->primary_client_push_session_data = data;
+        }
+
+        detached->session_id = UNACTIVE_SESSION_ID;
+        detached->detached = false;
+    }
+    if (ret == ESP_OK)
+    {
+        data->detached = false;
+    }
+
+    return ret;
+}
+
+esp_err_t espfsp_session_manager_take_expired_session(
+    espfsp_session_manager_t *session_manager,
+    espfsp_session_manager_session_type_t type,
+    espfsp_comm_proto_t **comm_proto)
+{
+    esp_err_t ret = ESP_OK;
+    espfsp_server_session_manager_data_t *data_set = NULL;
+    int data_count = 0;
+    int64_t now = esp_timer_get_time();
+    *comm_proto = NULL;
+
+    ret = get_data_set_info(session_manager, type, &data_set, &data_count);
+    if (ret == ESP_OK)
+    {
+        for (int i = 0; i < data_count; i++)
+        {
+            espfsp_server_session_manager_data_t *data = &data_set[i];
+
+            // Slot taken by new connection is resolved by its session init
+            if (!data->active && data->detached && now >= data->detached_deadline_us)
+            {
+                data->active = true;
+                *comm_proto = data->comm_proto;
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
+
 esp_err_t espfsp_session_manager_get_primary_session(
     espfsp_session_manager_t *session_manager,
     espfsp_session_manager_session_type_t type,
@@ -644,3 +1043,60 @@ esp_err_t espfsp_session_manager_get_active_session(
 
     return ret;
 }
+
+static void fill_sessions_stats(
+    espfsp_session_manager_t *session_manager,
+    espfsp_server_session_manager_data_t *data,
+    int data_count,
+    espfsp_server_session_stats_t *sessions,
+    int sessions_len,
+    int *sessions_count)
+{
+    for (int i = 0; i < data_count; i++)
+    {
+        if (data[i].session_id == UNACTIVE_SESSION_ID)
+        {
+            continue;
+        }
+
+        if (*sessions_count < sessions_len)
+        {
+            espfsp_server_session_stats_t *session = &sessions[*sessions_count];
+            session->session_id = data[i].session_id;
+            session->type = data[i].type == ESPFSP_SESSION_MANAGER_SESSION_TYPE_CLIENT_PUSH ?
+                ESPFSP_SERVER_SESSION_CLIENT_PUSH : ESPFSP_SERVER_SESSION_CLIENT_PLAY;
+            session->primary = &data[i] == session_manager->primary_client_push_session_data ||
+                               &data[i] == session_manager->primary_client_play_session_data;
+            session->detached = data[i].detached;
+            session->stream_started = data[i].stream_started;
+            memcpy(&session->clock_sync, &data[i].clock_sync, sizeof(espfsp_clock_sync_info_t));
+        }
+        (*sessions_count)++;
+    }
+}
+
+esp_err_t espfsp_session_manager_get_sessions_stats(
+    espfsp_session_manager_t *session_manager,
+    espfsp_server_session_stats_t *sessions,
+    int sessions_len,
+    int *sessions_count)
+{
+    *sessions_count = 0;
+
+    fill_sessions_stats(
+        session_manager,
+        session_manager->client_push_session_data,
+        session_manager->client_push_session_data_count,
+        sessions,
+        sessions_len,
+        sessions_count);
+    fill_sessions_stats(
+        session_manager,
+        session_manager->client_play_session_data,
+        session_manager->client_play_session_data_count,
+        sessions,
+        sessions_len,
+        sessions_count);
+
+    return ESP_OK;
+}